@@ -0,0 +1,119 @@
+#include <algorithm>
+#include <memory>
+
+#include "zstd.h"
+
+#include "AddonCompression.h"
+
+// the compression level of deltas, which favors speed since most of the delta is made of references to the base
+static constexpr int deltaCompressionLevel = 1;
+
+struct ZstdCCtxDeleter {
+    void operator()(ZSTD_CCtx* cctx) const {
+        ZSTD_freeCCtx(cctx);
+    }
+};
+
+struct ZstdDCtxDeleter {
+    void operator()(ZSTD_DCtx* dctx) const {
+        ZSTD_freeDCtx(dctx);
+    }
+};
+
+// the smallest window log that covers `size` bytes, within the bounds zstd supports
+static int getWindowLogForSize(ZSTD_cParameter parameter, std::size_t size) {
+    const ZSTD_bounds bounds = ZSTD_cParam_getBounds(parameter);
+
+    int windowLog = bounds.lowerBound;
+    while (windowLog < bounds.upperBound && (static_cast<std::size_t>(1) << windowLog) < size) {
+        windowLog++;
+    }
+
+    return windowLog;
+}
+
+static bool compressWithContext(ZSTD_CCtx* cctx, const uint8_t* data, std::size_t size, std::vector<uint8_t>& output) {
+    output.resize(ZSTD_compressBound(size));
+
+    const std::size_t compressedSize = ZSTD_compress2(cctx, output.data(), output.size(), data, size);
+    if (ZSTD_isError(compressedSize)) {
+        output.clear();
+        return false;
+    }
+
+    output.resize(compressedSize);
+    return true;
+}
+
+static bool decompressWithContext(ZSTD_DCtx* dctx, const uint8_t* data, std::size_t size, uint8_t* output, std::size_t outputSize) {
+    // the content size is always written to the frame header, so a mismatching output size is detected before decompressing
+    if (ZSTD_getFrameContentSize(data, size) != static_cast<unsigned long long>(outputSize)) {
+        return false;
+    }
+
+    const std::size_t decompressedSize = ZSTD_decompressDCtx(dctx, output, outputSize, data, size);
+    return !ZSTD_isError(decompressedSize) && decompressedSize == outputSize;
+}
+
+bool addonCompress(const uint8_t* data, std::size_t size, int level, std::vector<uint8_t>& output) {
+    std::unique_ptr<ZSTD_CCtx, ZstdCCtxDeleter> cctx(ZSTD_createCCtx());
+    if (cctx == nullptr) {
+        return false;
+    }
+
+    const int compressionLevel = std::clamp(level, addonMinCompressionLevel, addonMaxCompressionLevel);
+    if (ZSTD_isError(ZSTD_CCtx_setParameter(cctx.get(), ZSTD_c_compressionLevel, compressionLevel)) ||
+        ZSTD_isError(ZSTD_CCtx_setParameter(cctx.get(), ZSTD_c_checksumFlag, 1))
+    ) {
+        return false;
+    }
+
+    return compressWithContext(cctx.get(), data, size, output);
+}
+
+bool addonDecompress(const uint8_t* data, std::size_t size, uint8_t* output, std::size_t outputSize) {
+    std::unique_ptr<ZSTD_DCtx, ZstdDCtxDeleter> dctx(ZSTD_createDCtx());
+    if (dctx == nullptr) {
+        return false;
+    }
+
+    return decompressWithContext(dctx.get(), data, size, output, outputSize);
+}
+
+bool addonCreateDelta(const uint8_t* data, std::size_t size, const uint8_t* base, std::size_t baseSize, std::vector<uint8_t>& output) {
+    std::unique_ptr<ZSTD_CCtx, ZstdCCtxDeleter> cctx(ZSTD_createCCtx());
+    if (cctx == nullptr) {
+        return false;
+    }
+
+    // the window has to span both the base and the data for the data to reference any part of the base
+    const int windowLog = getWindowLogForSize(ZSTD_c_windowLog, baseSize + size);
+    if (ZSTD_isError(ZSTD_CCtx_setParameter(cctx.get(), ZSTD_c_compressionLevel, deltaCompressionLevel)) ||
+        ZSTD_isError(ZSTD_CCtx_setParameter(cctx.get(), ZSTD_c_checksumFlag, 1)) ||
+        ZSTD_isError(ZSTD_CCtx_setParameter(cctx.get(), ZSTD_c_enableLongDistanceMatching, 1)) ||
+        ZSTD_isError(ZSTD_CCtx_setParameter(cctx.get(), ZSTD_c_windowLog, windowLog)) ||
+        ZSTD_isError(ZSTD_CCtx_refPrefix(cctx.get(), base, baseSize))
+    ) {
+        return false;
+    }
+
+    return compressWithContext(cctx.get(), data, size, output);
+}
+
+bool addonApplyDelta(
+    const uint8_t* delta, std::size_t deltaSize, const uint8_t* base, std::size_t baseSize, uint8_t* output, std::size_t outputSize
+) {
+    std::unique_ptr<ZSTD_DCtx, ZstdDCtxDeleter> dctx(ZSTD_createDCtx());
+    if (dctx == nullptr) {
+        return false;
+    }
+
+    const int windowLogMax = ZSTD_dParam_getBounds(ZSTD_d_windowLogMax).upperBound;
+    if (ZSTD_isError(ZSTD_DCtx_setParameter(dctx.get(), ZSTD_d_windowLogMax, windowLogMax)) ||
+        ZSTD_isError(ZSTD_DCtx_refPrefix(dctx.get(), base, baseSize))
+    ) {
+        return false;
+    }
+
+    return decompressWithContext(dctx.get(), delta, deltaSize, output, outputSize);
+}
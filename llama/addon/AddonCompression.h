@@ -0,0 +1,28 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// the minimum and maximum supported compression levels, which are zstd compression levels.
+// a higher level searches deeper for matches, which compresses better but slower
+constexpr int addonMinCompressionLevel = 1;
+constexpr int addonMaxCompressionLevel = 19;
+
+// compress a buffer into a zstd frame.
+// returns `false` when the compression failed
+bool addonCompress(const uint8_t* data, std::size_t size, int level, std::vector<uint8_t>& output);
+
+// decompress a buffer compressed by `addonCompress` into `output`, which must be exactly the size of the original data.
+// returns `false` when the compressed data is corrupted
+bool addonDecompress(const uint8_t* data, std::size_t size, uint8_t* output, std::size_t outputSize);
+
+// encode `data` as a delta of `base` by compressing it into a zstd frame that references `base` as a prefix,
+// with long distance matching to find the large parts of `base` that `data` contains, even when they moved to other offsets.
+// returns `false` when the encoding failed
+bool addonCreateDelta(const uint8_t* data, std::size_t size, const uint8_t* base, std::size_t baseSize, std::vector<uint8_t>& output);
+
+// reconstruct the data encoded by `addonCreateDelta` into `output`, which must be exactly the size of the original data.
+// returns `false` when the delta is corrupted or doesn't match `base`
+bool addonApplyDelta(
+    const uint8_t* delta, std::size_t deltaSize, const uint8_t* base, std::size_t baseSize, uint8_t* output, std::size_t outputSize
+);
@@ -1,16 +1,25 @@
 #include <thread>
 #include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
 #include "common/common.h"
 #include "llama-context.h"
+#include "llama-model.h"
 #include "llama-vocab.h"
 #include "llama.h"
 
 #include "addonGlobals.h"
+#include "globals/addonProgress.h"
 #include "AddonModel.h"
 #include "AddonModelLora.h"
 #include "AddonGrammarEvaluationState.h"
 #include "AddonContext.h"
+#include "AddonCompression.h"
+#include "AddonMappedFile.h"
+#include "AddonSequenceStateFile.h"
 
 static uint64_t calculateBatchMemorySize(int32_t n_tokens_alloc, int32_t embd, int32_t n_seq_max) {
     uint64_t totalSize = 0;
@@ -32,6 +41,238 @@ static uint64_t calculateBatchMemorySize(int32_t n_tokens_alloc, int32_t embd, i
     return totalSize;
 }
 
+// identifies the model a sequence state file was created with, so loading a state of another model can be rejected before touching the context
+static uint64_t getModelStateFingerprint(const AddonModel* addonModel) {
+    const llama_model* model = addonModel->model;
+    uint64_t fingerprint = addonFnv1aOffsetBasis;
+
+    char modelDescription[128];
+    const int32_t modelDescriptionLength = llama_model_desc(model, modelDescription, sizeof(modelDescription));
+    if (modelDescriptionLength > 0) {
+        fingerprint = addonFnv1a(
+            fingerprint, modelDescription, std::min<size_t>(modelDescriptionLength, sizeof(modelDescription) - 1)
+        );
+    }
+
+    const uint64_t values[] = {
+        addonModel->contentFingerprint,
+        llama_model_n_params(model),
+        llama_model_size(model),
+        static_cast<uint64_t>(llama_model_n_embd(model)),
+        static_cast<uint64_t>(llama_model_n_layer(model)),
+        static_cast<uint64_t>(llama_model_n_head(model)),
+        static_cast<uint64_t>(llama_vocab_n_tokens(llama_model_get_vocab(model)))
+    };
+
+    return addonFnv1a(fingerprint, values, sizeof(values));
+}
+
+// identifies the LoRA adapters the cells of a sequence are evaluated with, so prefixes are only reused across sequences that use the same adapters
+static uint64_t getLoraAdaptersKey(const Napi::Array& loraArray, const Napi::Array& scaleArray) {
+    if (loraArray.Length() == 0 || scaleArray.Length() == 0) {
+        return 0;
+    }
+
+    uint64_t key = addonFnv1aOffsetBasis;
+    for (size_t i = 0; i < loraArray.Length() && i < scaleArray.Length(); i++) {
+        AddonModelLora* lora = Napi::ObjectWrap<AddonModelLora>::Unwrap(loraArray.Get(i).As<Napi::Object>());
+        const float scale = scaleArray.Get(i).As<Napi::Number>().FloatValue();
+
+        key = addonFnv1a(key, &lora->contentFingerprint, sizeof(lora->contentFingerprint));
+        key = addonFnv1a(key, &scale, sizeof(scale));
+    }
+
+    return key;
+}
+
+// the size of the keys and values a single cell of the KV cache holds across all the layers that use the KV cache
+static void getKvCacheBytesPerCell(const llama_model* model, ggml_type keyType, ggml_type valueType, uint64_t& keyBytes, uint64_t& valueBytes) {
+    keyBytes = 0;
+    valueBytes = 0;
+
+    const llama_hparams& hparams = model->hparams;
+    for (uint32_t layer = 0; layer < hparams.n_layer; layer++) {
+        if (hparams.is_recurrent(layer)) {
+            continue;
+        }
+
+        keyBytes += ggml_row_size(keyType, hparams.n_embd_k_gqa(layer));
+        valueBytes += ggml_row_size(valueType, hparams.n_embd_v_gqa(layer));
+    }
+}
+
+static void getContextMemoryBreakdown(llama_context* ctx, std::size_t& cpuRam, std::size_t& gpuVram) {
+    cpuRam = 0;
+    gpuVram = 0;
+
+    for (const auto& [bufferType, memoryBreakdown] : ctx->memory_breakdown()) {
+        const std::size_t size = memoryBreakdown.context + memoryBreakdown.compute;
+        if (size == 0) {
+            continue;
+        }
+
+        if (ggml_backend_buft_is_host(bufferType)) {
+            cpuRam += size;
+        } else {
+            ggml_backend_dev_t device = ggml_backend_buft_get_device(bufferType);
+            if (device != nullptr) {
+                auto deviceType = ggml_backend_dev_type(device);
+                if (deviceType == GGML_BACKEND_DEVICE_TYPE_GPU || deviceType == GGML_BACKEND_DEVICE_TYPE_IGPU) {
+                    gpuVram += size;
+                } else {
+                    cpuRam += size;
+                }
+            } else {
+                cpuRam += size;
+            }
+        }
+    }
+}
+
+enum class AddonEmbeddingFormat {
+    float32 = 0,
+    normalizedFloat32 = 1,
+    int8 = 2,
+    binary = 3
+};
+
+static AddonEmbeddingFormat getEmbeddingFormatFromNapiValue(const Napi::Value& value) {
+    if (!value.IsNumber()) {
+        return AddonEmbeddingFormat::float32;
+    }
+
+    const int32_t format = value.As<Napi::Number>().Int32Value();
+    if (format < static_cast<int32_t>(AddonEmbeddingFormat::float32) || format > static_cast<int32_t>(AddonEmbeddingFormat::binary)) {
+        return AddonEmbeddingFormat::float32;
+    }
+
+    return static_cast<AddonEmbeddingFormat>(format);
+}
+
+static std::size_t getEmbeddingFormatVectorByteSize(AddonEmbeddingFormat format, std::size_t vectorSize) {
+    switch (format) {
+        case AddonEmbeddingFormat::int8: return vectorSize;
+        case AddonEmbeddingFormat::binary: return (vectorSize + 7) / 8;
+        default: return vectorSize * sizeof(float);
+    }
+}
+
+// the loops below use independent lanes so compilers can vectorize them without relaxed floating point math
+static constexpr std::size_t embeddingLanes = 8;
+
+static float getEmbeddingSquaredNorm(const float* vector, std::size_t size) {
+    float lanes[embeddingLanes] = {0};
+    std::size_t i = 0;
+    for (; i + embeddingLanes <= size; i += embeddingLanes) {
+        for (std::size_t j = 0; j < embeddingLanes; j++) {
+            lanes[j] += vector[i + j] * vector[i + j];
+        }
+    }
+
+    float sum = 0;
+    for (std::size_t j = 0; j < embeddingLanes; j++) {
+        sum += lanes[j];
+    }
+    for (; i < size; i++) {
+        sum += vector[i] * vector[i];
+    }
+
+    return sum;
+}
+
+static float getEmbeddingMaxAbsValue(const float* vector, std::size_t size) {
+    float lanes[embeddingLanes] = {0};
+    std::size_t i = 0;
+    for (; i + embeddingLanes <= size; i += embeddingLanes) {
+        for (std::size_t j = 0; j < embeddingLanes; j++) {
+            lanes[j] = std::max(lanes[j], std::fabs(vector[i + j]));
+        }
+    }
+
+    float maxValue = 0;
+    for (std::size_t j = 0; j < embeddingLanes; j++) {
+        maxValue = std::max(maxValue, lanes[j]);
+    }
+    for (; i < size; i++) {
+        maxValue = std::max(maxValue, std::fabs(vector[i]));
+    }
+
+    return maxValue;
+}
+
+// writes the given vector in the given format to `output`, which has to be `getEmbeddingFormatVectorByteSize` bytes long.
+// returns the scale of int8 vectors, where `value = scale * quantizedValue`
+static float writeEmbeddingInFormat(AddonEmbeddingFormat format, const float* vector, std::size_t size, uint8_t* output) {
+    switch (format) {
+        case AddonEmbeddingFormat::normalizedFloat32: {
+            float* outputVector = reinterpret_cast<float*>(output);
+            const float norm = std::sqrt(getEmbeddingSquaredNorm(vector, size));
+            const float inverseNorm = norm > 0 ? 1.0f / norm : 0.0f;
+
+            for (std::size_t i = 0; i < size; i++) {
+                outputVector[i] = vector[i] * inverseNorm;
+            }
+
+            return 1;
+        }
+        case AddonEmbeddingFormat::int8: {
+            int8_t* outputVector = reinterpret_cast<int8_t*>(output);
+            const float scale = getEmbeddingMaxAbsValue(vector, size) / 127.0f;
+            const float inverseScale = scale > 0 ? 1.0f / scale : 0.0f;
+
+            for (std::size_t i = 0; i < size; i++) {
+                outputVector[i] = static_cast<int8_t>(std::lround(std::clamp(vector[i] * inverseScale, -127.0f, 127.0f)));
+            }
+
+            return scale;
+        }
+        case AddonEmbeddingFormat::binary: {
+            // every bit is set when its value is positive, with the first value in the most significant bit of the first byte
+            const std::size_t fullBytes = size / 8;
+            for (std::size_t byte = 0; byte < fullBytes; byte++) {
+                uint8_t packed = 0;
+                for (std::size_t bit = 0; bit < 8; bit++) {
+                    packed |= static_cast<uint8_t>(vector[byte * 8 + bit] > 0) << (7 - bit);
+                }
+                output[byte] = packed;
+            }
+
+            if (fullBytes * 8 < size) {
+                uint8_t packed = 0;
+                for (std::size_t i = fullBytes * 8; i < size; i++) {
+                    packed |= static_cast<uint8_t>(vector[i] > 0) << (7 - (i - fullBytes * 8));
+                }
+                output[fullBytes] = packed;
+            }
+
+            return 1;
+        }
+        default:
+            std::memcpy(output, vector, size * sizeof(float));
+            return 1;
+    }
+}
+
+static Napi::TypedArray createEmbeddingFormatTypedArray(const Napi::Env& env, AddonEmbeddingFormat format, const std::vector<uint8_t>& data) {
+    switch (format) {
+        case AddonEmbeddingFormat::int8: {
+            Napi::Int8Array result = Napi::Int8Array::New(env, data.size());
+            std::memcpy(result.Data(), data.data(), data.size());
+            return result;
+        }
+        case AddonEmbeddingFormat::binary: {
+            Napi::Uint8Array result = Napi::Uint8Array::New(env, data.size());
+            std::memcpy(result.Data(), data.data(), data.size());
+            return result;
+        }
+        default: {
+            Napi::Float32Array result = Napi::Float32Array::New(env, data.size() / sizeof(float));
+            std::memcpy(result.Data(), data.data(), data.size());
+            return result;
+        }
+    }
+}
+
 class AddonContextDecodeBatchWorker : public Napi::AsyncWorker {
     public:
         AddonContext* ctx;
@@ -55,9 +296,47 @@ class AddonContextDecodeBatchWorker : public Napi::AsyncWorker {
 
         void Execute() {
             try {
+                ctx->applyPendingSequenceEvictions();
+
+                std::vector<llama_seq_id> batchSequenceIds;
+                if (ctx->preemptionEnabled) {
+                    std::lock_guard<std::mutex> lock(ctx->preemptionMutex);
+
+                    for (int32_t i = 0; i < ctx->batch.n_tokens; i++) {
+                        const llama_seq_id sequenceId = ctx->batch.seq_id[i][0];
+                        if (std::find(batchSequenceIds.begin(), batchSequenceIds.end(), sequenceId) == batchSequenceIds.end()) {
+                            batchSequenceIds.push_back(sequenceId);
+                        }
+                    }
+
+                    ctx->decodeCounter++;
+                    for (const llama_seq_id sequenceId : batchSequenceIds) {
+                        ctx->sequenceLastDecodes[sequenceId] = ctx->decodeCounter;
+
+                        if (!ctx->swapInSequence(sequenceId, batchSequenceIds)) {
+                            SetError("could not find a KV slot to swap a preempted sequence back into the context (try reducing the size of the batch or increase the KV cache size)");
+                            return;
+                        }
+                    }
+                }
+
                 // Perform the evaluation using llama_decode.
+                ctx->batch_decoded = false;
                 int r = llama_decode(ctx->ctx, ctx->batch);
 
+                // when there are no free cells for the batch, `llama_decode` fails before modifying the KV cache,
+                // so sequences that are not part of the batch are preempted one at a time until the batch fits
+                while (r == 1 && ctx->preemptionEnabled) {
+                    {
+                        std::lock_guard<std::mutex> lock(ctx->preemptionMutex);
+                        if (!ctx->swapOutSequence(batchSequenceIds)) {
+                            break;
+                        }
+                    }
+
+                    r = llama_decode(ctx->ctx, ctx->batch);
+                }
+
                 if (r != 0) {
                     if (r == 1) {
                         SetError("could not find a KV slot for the batch (try reducing the size of the batch or increase the context)");
@@ -69,6 +348,7 @@ class AddonContextDecodeBatchWorker : public Napi::AsyncWorker {
                 }
 
                 llama_synchronize(ctx->ctx);
+                ctx->batch_decoded = true;
             } catch (const std::exception& e) {
                 SetError(e.what());
             } catch(...) {
@@ -76,8 +356,200 @@ class AddonContextDecodeBatchWorker : public Napi::AsyncWorker {
             }
         }
         void OnOK() {
+            if (ctx->prefixCache != nullptr) {
+                for (const auto& pendingTokens : ctx->pendingPrefixCacheTokens) {
+                    ctx->prefixCache->appendSequenceTokens(
+                        pendingTokens.sequenceId,
+                        pendingTokens.startPos,
+                        pendingTokens.tokens.data(),
+                        pendingTokens.tokens.size(),
+                        pendingTokens.loraAdaptersKey
+                    );
+                }
+            }
+
+            ctx->pendingPrefixCacheTokens.clear();
             deferred.Resolve(Env().Undefined());
         }
+        void OnError(const Napi::Error& err) {
+            if (ctx->prefixCache != nullptr) {
+                // the state of the cells of the batch is unknown after a failed decode
+                for (const auto& pendingTokens : ctx->pendingPrefixCacheTokens) {
+                    ctx->prefixCache->truncateSequence(pendingTokens.sequenceId, pendingTokens.startPos);
+                }
+            }
+
+            ctx->pendingPrefixCacheTokens.clear();
+            deferred.Reject(err.Value());
+        }
+};
+
+static double getElapsedMilliseconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+class AddonContextWarmupWorker : public Napi::AsyncWorker {
+    public:
+        AddonContext* ctx;
+        std::vector<int32_t> batchSizes;
+        int32_t sequences = 1;
+
+        double weightsWarmupTime = 0;
+        std::vector<double> batchDecodeTimes;
+        double memoryClearTime = 0;
+
+        AddonContextWarmupWorker(const Napi::Env& env, AddonContext* ctx)
+            : Napi::AsyncWorker(env, "AddonContextWarmupWorker"),
+              ctx(ctx),
+              deferred(Napi::Promise::Deferred::New(env)) {
+            ctx->Ref();
+        }
+        ~AddonContextWarmupWorker() {
+            ctx->Unref();
+        }
+
+        Napi::Promise GetPromise() {
+            return deferred.Promise();
+        }
+
+    protected:
+        Napi::Promise::Deferred deferred;
+
+        void Execute() {
+            const int32_t maxBatchSize = std::max<int32_t>(1, *std::max_element(batchSizes.begin(), batchSizes.end()));
+            llama_batch batch = llama_batch_init(maxBatchSize, 0, 1);
+            ctx->batch_decoded = false; // the context outputs will no longer belong to the context batch
+            ctx->applyPendingSequenceEvictions();
+
+            try {
+                Warmup(batch);
+            } catch (const std::exception& e) {
+                SetError(e.what());
+            } catch(...) {
+                SetError("Unknown error when warming up the context");
+            }
+
+            llama_batch_free(batch);
+        }
+
+        // fill the batch with `batchSize` tokens that are split between `batchSequences` sequences,
+        // with the logits of the last token of each sequence, like a batch of real sequences
+        static void FillBatch(llama_batch& batch, llama_token token, int32_t batchSize, int32_t batchSequences) {
+            common_batch_clear(batch);
+
+            for (int32_t i = 0; i < batchSize; i++) {
+                common_batch_add(batch, token, i / batchSequences, { i % batchSequences }, i >= batchSize - batchSequences);
+            }
+        }
+
+        void Decode(llama_batch& batch) {
+            const int r = llama_decode(ctx->ctx, batch);
+            llama_synchronize(ctx->ctx);
+
+            if (r != 0) {
+                throw std::runtime_error(
+                    r == 1
+                        ? "could not find a KV slot for the warmup batch (try reducing the batch size or the number of sequences)"
+                        : "Failed to decode the warmup batch"
+                );
+            }
+        }
+
+        void ClearMemory() {
+            const auto start = std::chrono::steady_clock::now();
+            llama_memory_clear(llama_get_memory(ctx->ctx), true);
+            memoryClearTime += getElapsedMilliseconds(start);
+        }
+
+        void Warmup(llama_batch& batch) {
+            const int32_t n_batch = static_cast<int32_t>(llama_n_batch(ctx->ctx));
+            const int32_t n_seq_max = static_cast<int32_t>(llama_n_seq_max(ctx->ctx));
+
+            if (sequences < 1 || sequences > n_seq_max) {
+                throw std::runtime_error("The number of warmup sequences must be between 1 and " + std::to_string(n_seq_max));
+            }
+
+            for (const int32_t batchSize : batchSizes) {
+                if (batchSize < 1 || batchSize > n_batch) {
+                    throw std::runtime_error("The warmup batch size must be between 1 and " + std::to_string(n_batch));
+                }
+            }
+
+            const llama_vocab* vocab = llama_model_get_vocab(ctx->model->model);
+            llama_token token = llama_vocab_bos(vocab);
+            if (token == LLAMA_TOKEN_NULL) {
+                token = llama_vocab_eos(vocab);
+            }
+            if (token == LLAMA_TOKEN_NULL) {
+                token = 0;
+            }
+
+            // the synthetic sequences start from an empty KV cache
+            ClearMemory();
+
+            // the warmup mode of llama.cpp uses all the weights of the model (such as all the experts of MoE models),
+            // so all the weights are paged in by the first decode
+            {
+                const auto start = std::chrono::steady_clock::now();
+                FillBatch(batch, token, 1, 1);
+                llama_set_warmup(ctx->ctx, true);
+
+                try {
+                    Decode(batch);
+                } catch (...) {
+                    llama_set_warmup(ctx->ctx, false);
+                    throw;
+                }
+
+                llama_set_warmup(ctx->ctx, false);
+                weightsWarmupTime = getElapsedMilliseconds(start);
+                ClearMemory();
+            }
+
+            // the compute graph and the backend scheduler are allocated for the shape of each batch on its first decode
+            for (const int32_t batchSize : batchSizes) {
+                const auto start = std::chrono::steady_clock::now();
+                FillBatch(batch, token, batchSize, std::min(sequences, batchSize));
+                Decode(batch);
+                batchDecodeTimes.push_back(getElapsedMilliseconds(start));
+                ClearMemory();
+            }
+
+            // the KV cache was cleared, so nothing that was kept for the sequences of the context is valid anymore
+            if (ctx->preemptionEnabled) {
+                std::lock_guard<std::mutex> lock(ctx->preemptionMutex);
+                ctx->swappedSequences.clear();
+                ctx->swappedSequencesCount = 0;
+                ctx->swappedBytes = 0;
+                ctx->sequenceLastDecodes.clear();
+            }
+
+            if (ctx->prefixCache != nullptr) {
+                for (llama_seq_id sequenceId = 0; sequenceId < n_seq_max; sequenceId++) {
+                    ctx->prefixCache->removeSequence(sequenceId);
+                }
+            }
+
+            llama_perf_context_reset(ctx->ctx);
+        }
+
+        void OnOK() {
+            Napi::Object result = Napi::Object::New(Env());
+            result.Set("weightsWarmupTime", Napi::Number::New(Env(), weightsWarmupTime));
+
+            Napi::Array batches = Napi::Array::New(Env(), batchSizes.size());
+            for (std::size_t i = 0; i < batchSizes.size(); i++) {
+                Napi::Object batchResult = Napi::Object::New(Env());
+                batchResult.Set("batchSize", Napi::Number::New(Env(), batchSizes[i]));
+                batchResult.Set("sequences", Napi::Number::New(Env(), std::min(sequences, batchSizes[i])));
+                batchResult.Set("decodeTime", Napi::Number::New(Env(), batchDecodeTimes[i]));
+                batches.Set(i, batchResult);
+            }
+            result.Set("batches", batches);
+            result.Set("memoryClearTime", Napi::Number::New(Env(), memoryClearTime));
+
+            deferred.Resolve(result);
+        }
         void OnError(const Napi::Error& err) {
             deferred.Reject(err.Value());
         }
@@ -106,9 +578,27 @@ class AddonContextLoadContextWorker : public Napi::AsyncWorker {
 
         void Execute() {
             try {
+                context->loadReport.start();
                 context->ctx = llama_init_from_model(context->model->model, context->context_params);
 
                 context->contextLoaded = context->ctx != nullptr;
+
+                if (context->contextLoaded) {
+                    // creating the KV cache and reserving the compute graphs happen in a single llama.cpp call
+                    context->loadReport.endPhase("initialization");
+
+                    context->loadReport.hasBufferBreakdown = true;
+                    for (const auto& [bufferType, memoryBreakdown] : context->ctx->memory_breakdown()) {
+                        const std::size_t size = memoryBreakdown.context + memoryBreakdown.compute;
+                        if (size != 0) {
+                            context->loadReport.buffers.push_back({
+                                ggml_backend_buft_name(bufferType), size, memoryBreakdown.context, memoryBreakdown.compute
+                            });
+                        }
+                    }
+
+                    context->loadReport.finish();
+                }
             } catch (const std::exception& e) {
                 SetError(e.what());
             } catch(...) {
@@ -391,6 +881,8 @@ AddonContext::AddonContext(const Napi::CallbackInfo& info) : Napi::ObjectWrap<Ad
 
         if (options.Has("ranking") && options.Get("ranking").As<Napi::Boolean>().Value()) {
             context_params.pooling_type = LLAMA_POOLING_TYPE_RANK;
+        } else if (options.Has("tokenEmbeddings") && options.Get("tokenEmbeddings").As<Napi::Boolean>().Value()) {
+            context_params.pooling_type = LLAMA_POOLING_TYPE_NONE;
         }
 
         if (options.Has("flashAttention")) {
@@ -437,6 +929,29 @@ AddonContext::AddonContext(const Napi::CallbackInfo& info) : Napi::ObjectWrap<Ad
         if (options.Has("swaFullCache")) {
             context_params.swa_full = options.Get("swaFullCache").As<Napi::Boolean>().Value();
         }
+
+        if (options.Has("prefixCache") && options.Get("prefixCache").As<Napi::Boolean>().Value()) {
+            // reusing a prefix of another sequence requires removing the cells after it,
+            // which is not possible with recurrent state or with cells that were already evicted by SWA
+            const bool canReusePrefixes = !llama_model_is_recurrent(model->model) && !llama_model_is_hybrid(model->model) &&
+                (llama_model_n_swa(model->model) == 0 || context_params.swa_full);
+
+            if (canReusePrefixes) {
+                prefixCache = std::make_unique<AddonPrefixCache>();
+            }
+        }
+
+        if (options.Has("preemptionKvCacheSize") && options.Get("preemptionKvCacheSize").IsNumber()) {
+            // preempting a sequence requires moving all of its cells out of the shared KV cache and back,
+            // which doesn't free anything with the fixed per-sequence state of recurrent models
+            const bool canPreemptSequences = !llama_model_is_recurrent(model->model) && !llama_model_is_hybrid(model->model);
+
+            if (canPreemptSequences) {
+                preemptionEnabled = true;
+                context_params.kv_unified = true;
+                context_params.n_ctx = options.Get("preemptionKvCacheSize").As<Napi::Number>().Uint32Value();
+            }
+        }
     }
 }
 AddonContext::~AddonContext() {
@@ -453,66 +968,291 @@ void AddonContext::disposeBatchMemory() {
     llama_batch_free(batch);
     has_batch = false;
     batch_n_tokens = 0;
+    batch_decoded = false;
 }
 
-void AddonContext::disposeBatchMT() {
-    uint64_t currentBatchMemorySize = 0;
-
-    disposeBatchMemory();
+void AddonContext::applyPendingSequenceEvictions() {
+    std::lock_guard<std::mutex> lock(pendingSequenceEvictionsMutex);
 
-    {
-        std::lock_guard<std::mutex> lock(disposeMutex);
-        currentBatchMemorySize = batchMemorySize;
-        batchMemorySize = 0;
+    for (const llama_seq_id sequenceId : pendingSequenceEvictions) {
+        llama_memory_seq_rm(llama_get_memory(ctx), sequenceId, -1, -1);
     }
 
-    if (currentBatchMemorySize > 0) {
-        adjustNapiExternalMemorySubtract(Env(), currentBatchMemorySize);
-    }
+    pendingSequenceEvictions.clear();
 }
 
-void AddonContext::disposeMemory() {
-    llama_context* currentCtx = nullptr;
+// the default evaluation priority of the JS side, used for sequences that weren't decoded yet
+static constexpr int32_t defaultSequencePreemptionPriority = 5;
+
+bool AddonContext::swapOutSequence(const std::vector<llama_seq_id>& protectedSequenceIds) {
+    llama_memory_t memory = llama_get_memory(ctx);
+
+    // the victim is the sequence with the lowest priority, and then the least recently decoded one
+    llama_seq_id victimSequenceId = -1;
+    int32_t victimPriority = 0;
+    uint64_t victimLastDecode = 0;
+    for (llama_seq_id sequenceId = 0; sequenceId < static_cast<llama_seq_id>(context_params.n_seq_max); sequenceId++) {
+        if (std::find(protectedSequenceIds.begin(), protectedSequenceIds.end(), sequenceId) != protectedSequenceIds.end() ||
+            swappedSequences.find(sequenceId) != swappedSequences.end() ||
+            llama_memory_seq_pos_max(memory, sequenceId) < 0
+        ) {
+            continue;
+        }
 
-    {
-        std::lock_guard<std::mutex> lock(disposeMutex);
+        const auto priorityEntry = sequencePreemptionPriorities.find(sequenceId);
+        const int32_t priority = priorityEntry == sequencePreemptionPriorities.end()
+            ? defaultSequencePreemptionPriority
+            : priorityEntry->second;
 
-        if (!memoryDisposed) {
-            memoryDisposed = true;
-            currentCtx = ctx;
-            ctx = nullptr;
-            contextLoaded = false;
+        const auto lastDecodeEntry = sequenceLastDecodes.find(sequenceId);
+        const uint64_t lastDecode = lastDecodeEntry == sequenceLastDecodes.end() ? 0 : lastDecodeEntry->second;
+
+        if (victimSequenceId == -1 || priority < victimPriority || (priority == victimPriority && lastDecode < victimLastDecode)) {
+            victimSequenceId = sequenceId;
+            victimPriority = priority;
+            victimLastDecode = lastDecode;
         }
     }
 
-    disposeBatchMemory();
+    if (victimSequenceId == -1) {
+        return false;
+    }
 
-    if (currentCtx != nullptr) {
-        llama_free(currentCtx);
+    // a sequence with a priority of 0 is only kept for the prefix cache, so its cells are dropped instead of being swapped out
+    if (victimPriority <= 0) {
+        if (prefixCache != nullptr) {
+            prefixCache->removeSequence(victimSequenceId);
+        }
+
+        llama_memory_seq_rm(memory, victimSequenceId, -1, -1);
+        droppedSequences++;
+        return true;
     }
-}
 
-void AddonContext::disposeMT() {
-    uint64_t currentLoadedContextMemorySize = 0;
-    uint64_t currentBatchMemorySize = 0;
-    bool shouldUnrefModel = false;
+    AddonContextSwappedSequence swappedSequence;
+    swappedSequence.state.resize(llama_state_seq_get_size_ext(ctx, victimSequenceId, 0));
+    const std::size_t writtenSize = llama_state_seq_get_data_ext(
+        ctx, swappedSequence.state.data(), swappedSequence.state.size(), victimSequenceId, 0
+    );
+    if (writtenSize == 0 || writtenSize > swappedSequence.state.size()) {
+        return false;
+    }
 
-    disposeMemory();
+    swappedSequence.state.resize(writtenSize);
+    swappedSequence.state.shrink_to_fit();
 
-    {
-        std::lock_guard<std::mutex> lock(disposeMutex);
+    if (prefixCache != nullptr) {
+        swappedSequence.prefixCacheTokens = prefixCache->getSequenceTokens(victimSequenceId);
+        swappedSequence.prefixCacheLoraAdaptersKey = prefixCache->getSequenceAdaptersKey(victimSequenceId);
+        prefixCache->removeSequence(victimSequenceId);
+    }
 
-        if (disposed) {
-            return;
-        }
+    swappedSequence.minPos = llama_memory_seq_pos_min(memory, victimSequenceId);
+    swappedSequence.maxPos = llama_memory_seq_pos_max(memory, victimSequenceId);
+    llama_memory_seq_rm(memory, victimSequenceId, -1, -1);
 
-        disposed = true;
-        shouldUnrefModel = true;
+    swappedBytes += writtenSize;
+    swappedSequencesCount++;
+    preemptions++;
+    swappedSequences.emplace(victimSequenceId, std::move(swappedSequence));
 
-        if (!model->model_params.no_alloc) {
-            currentLoadedContextMemorySize = loadedContextMemorySize;
-            loadedContextMemorySize = 0;
-        }
+    return true;
+}
+
+std::size_t AddonContext::setSequenceStateData(
+    llama_seq_id sequenceId, const uint8_t* data, std::size_t size, const std::vector<llama_seq_id>& protectedSequenceIds
+) {
+    while (true) {
+        // a failed restore removes the cells it already restored
+        const std::size_t readSize = llama_state_seq_set_data_ext(ctx, data, size, sequenceId, 0);
+        if (readSize == size || !preemptionEnabled || !swapOutSequence(protectedSequenceIds)) {
+            return readSize;
+        }
+    }
+}
+
+bool AddonContext::swapInSequence(llama_seq_id sequenceId, const std::vector<llama_seq_id>& protectedSequenceIds) {
+    auto swappedSequence = swappedSequences.find(sequenceId);
+    if (swappedSequence == swappedSequences.end()) {
+        return true;
+    }
+
+    const std::vector<uint8_t>& state = swappedSequence->second.state;
+    if (setSequenceStateData(sequenceId, state.data(), state.size(), protectedSequenceIds) != state.size()) {
+        return false;
+    }
+
+    llama_memory_t memory = llama_get_memory(ctx);
+    for (const auto& operation : swappedSequence->second.pendingCellOperations) {
+        if (operation.shift) {
+            llama_memory_seq_add(memory, sequenceId, operation.startPos, operation.endPos, operation.shiftDelta);
+        } else {
+            llama_memory_seq_rm(memory, sequenceId, operation.startPos, operation.endPos);
+        }
+    }
+
+    if (prefixCache != nullptr && !swappedSequence->second.prefixCacheTokens.empty()) {
+        const auto& tokens = swappedSequence->second.prefixCacheTokens;
+        prefixCache->setSequenceTokens(sequenceId, tokens.data(), tokens.size(), swappedSequence->second.prefixCacheLoraAdaptersKey);
+    }
+
+    swappedBytes -= state.size();
+    swappedSequencesCount--;
+    swapIns++;
+    swappedSequences.erase(swappedSequence);
+
+    return true;
+}
+
+// swapping a sequence in may preempt other sequences,
+// so this should only be called from a worker thread while the JS side holds the context lock
+bool AddonContext::ensureSequenceResident(llama_seq_id sequenceId) {
+    if (!preemptionEnabled) {
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(preemptionMutex);
+    return swapInSequence(sequenceId, {sequenceId});
+}
+
+// should be called while holding `preemptionMutex`.
+// preemption is only enabled for models whose memory can remove any range of cells, so a removal cannot fail
+bool AddonContext::deferSwappedSequenceCellOperation(llama_seq_id sequenceId, const AddonContextPendingCellOperation& operation) {
+    auto swappedSequenceEntry = swappedSequences.find(sequenceId);
+    if (swappedSequenceEntry == swappedSequences.end()) {
+        return false;
+    }
+
+    AddonContextSwappedSequence& swappedSequence = swappedSequenceEntry->second;
+    const llama_pos startPos = std::max(0, operation.startPos);
+    const llama_pos endPos = operation.endPos < 0
+        ? std::numeric_limits<llama_pos>::max()
+        : operation.endPos;
+
+    if (swappedSequence.maxPos < 0) {
+        // the sequence has no cells to change
+    } else if (operation.shift) {
+        if (swappedSequence.minPos >= startPos && swappedSequence.minPos < endPos) {
+            swappedSequence.minPos = std::max(0, swappedSequence.minPos + operation.shiftDelta);
+        }
+
+        if (swappedSequence.maxPos >= startPos && swappedSequence.maxPos < endPos) {
+            swappedSequence.maxPos = std::max(0, swappedSequence.maxPos + operation.shiftDelta);
+        }
+    } else if (startPos <= swappedSequence.minPos && endPos > swappedSequence.maxPos) {
+        swappedSequence.minPos = -1;
+        swappedSequence.maxPos = -1;
+    } else if (startPos <= swappedSequence.minPos && endPos > swappedSequence.minPos) {
+        swappedSequence.minPos = endPos;
+    } else if (startPos <= swappedSequence.maxPos && endPos > swappedSequence.maxPos) {
+        swappedSequence.maxPos = startPos - 1;
+    }
+
+    const llama_pos prefixCacheLength = operation.shift
+        ? std::min(startPos, startPos + operation.shiftDelta)
+        : startPos;
+    if (swappedSequence.prefixCacheTokens.size() > static_cast<std::size_t>(std::max(0, prefixCacheLength))) {
+        swappedSequence.prefixCacheTokens.resize(std::max(0, prefixCacheLength));
+    }
+
+    swappedSequence.pendingCellOperations.push_back(operation);
+    return true;
+}
+
+void AddonContext::discardSwappedSequence(llama_seq_id sequenceId) {
+    if (!preemptionEnabled) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(preemptionMutex);
+
+    const auto swappedSequence = swappedSequences.find(sequenceId);
+    if (swappedSequence == swappedSequences.end()) {
+        return;
+    }
+
+    swappedBytes -= swappedSequence->second.state.size();
+    swappedSequencesCount--;
+    swappedSequences.erase(swappedSequence);
+}
+
+// replace the state of a sequence with the given state data, preempting other sequences when there are no free cells for it
+std::size_t AddonContext::loadSequenceStateData(llama_seq_id sequenceId, const uint8_t* data, std::size_t size) {
+    discardSwappedSequence(sequenceId);
+
+    if (!preemptionEnabled) {
+        return llama_state_seq_set_data(ctx, data, size, sequenceId);
+    }
+
+    std::lock_guard<std::mutex> lock(preemptionMutex);
+    return setSequenceStateData(sequenceId, data, size, {sequenceId});
+}
+
+void AddonContext::disposeBatchMT() {
+    uint64_t currentBatchMemorySize = 0;
+
+    disposeBatchMemory();
+
+    {
+        std::lock_guard<std::mutex> lock(disposeMutex);
+        currentBatchMemorySize = batchMemorySize;
+        batchMemorySize = 0;
+    }
+
+    if (currentBatchMemorySize > 0) {
+        adjustNapiExternalMemorySubtract(Env(), currentBatchMemorySize);
+    }
+}
+
+void AddonContext::disposeMemory() {
+    llama_context* currentCtx = nullptr;
+
+    {
+        std::lock_guard<std::mutex> lock(disposeMutex);
+
+        if (!memoryDisposed) {
+            memoryDisposed = true;
+            currentCtx = ctx;
+            ctx = nullptr;
+            contextLoaded = false;
+        }
+    }
+
+    disposeBatchMemory();
+
+    if (currentCtx != nullptr) {
+        llama_free(currentCtx);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(preemptionMutex);
+        swappedSequences.clear();
+        swappedSequencesCount = 0;
+        swappedBytes = 0;
+    }
+}
+
+void AddonContext::disposeMT() {
+    uint64_t currentLoadedContextMemorySize = 0;
+    uint64_t currentBatchMemorySize = 0;
+    bool shouldUnrefModel = false;
+
+    disposeMemory();
+
+    {
+        std::lock_guard<std::mutex> lock(disposeMutex);
+
+        if (disposed) {
+            return;
+        }
+
+        disposed = true;
+        shouldUnrefModel = true;
+
+        if (!model->model_params.no_alloc) {
+            currentLoadedContextMemorySize = loadedContextMemorySize;
+            loadedContextMemorySize = 0;
+        }
 
         currentBatchMemorySize = batchMemorySize;
         batchMemorySize = 0;
@@ -583,6 +1323,8 @@ Napi::Value AddonContext::InitBatch(const Napi::CallbackInfo& info) {
     batch = llama_batch_init(n_tokens, 0, 1);
     has_batch = true;
     batch_n_tokens = n_tokens;
+    batch_decoded = false;
+    pendingPrefixCacheTokens.clear();
 
     uint64_t newBatchMemorySize = calculateBatchMemorySize(n_tokens, llama_model_n_embd(model->model), context_params.n_batch);
     if (newBatchMemorySize > batchMemorySize) {
@@ -632,6 +1374,15 @@ Napi::Value AddonContext::AddToBatch(const Napi::CallbackInfo& info) {
         }
     }
 
+    if (prefixCache != nullptr && tokensLength > 0) {
+        AddonContextPendingPrefixCacheTokens pendingTokens;
+        pendingTokens.sequenceId = sequenceId;
+        pendingTokens.startPos = firstTokenContextIndex;
+        pendingTokens.loraAdaptersKey = loraAdaptersKey;
+        pendingTokens.tokens.assign(tokens.Data(), tokens.Data() + tokensLength);
+        pendingPrefixCacheTokens.push_back(std::move(pendingTokens));
+    }
+
     return resLogitIndexes;
 }
 Napi::Value AddonContext::DisposeSequence(const Napi::CallbackInfo& info) {
@@ -641,9 +1392,20 @@ Napi::Value AddonContext::DisposeSequence(const Napi::CallbackInfo& info) {
     }
 
     int32_t sequenceId = info[0].As<Napi::Number>().Int32Value();
-
+    applyPendingSequenceEvictions();
+    discardSwappedSequence(sequenceId);
     bool result = llama_memory_seq_rm(llama_get_memory(ctx), sequenceId, -1, -1);
 
+    if (preemptionEnabled) {
+        std::lock_guard<std::mutex> lock(preemptionMutex);
+        sequencePreemptionPriorities.erase(sequenceId);
+        sequenceLastDecodes.erase(sequenceId);
+    }
+
+    if (prefixCache != nullptr) {
+        prefixCache->removeSequence(sequenceId);
+    }
+
     if (!result) {
         Napi::Error::New(info.Env(), "Failed to dispose sequence").ThrowAsJavaScriptException();
         return info.Env().Undefined();
@@ -661,8 +1423,26 @@ Napi::Value AddonContext::RemoveTokenCellsFromSequence(const Napi::CallbackInfo&
     int32_t startPos = info[1].As<Napi::Number>().Int32Value();
     int32_t endPos = info[2].As<Napi::Number>().Int32Value();
 
+    applyPendingSequenceEvictions();
+    if (startPos <= 0 && endPos < 0) {
+        discardSwappedSequence(sequenceId);
+    }
+
+    std::unique_lock<std::mutex> preemptionLock(preemptionMutex, std::defer_lock);
+    if (preemptionEnabled) {
+        preemptionLock.lock();
+
+        if (deferSwappedSequenceCellOperation(sequenceId, {false, startPos, endPos, 0})) {
+            return Napi::Boolean::New(info.Env(), true);
+        }
+    }
+
     bool result = llama_memory_seq_rm(llama_get_memory(ctx), sequenceId, startPos, endPos);
 
+    if (prefixCache != nullptr) {
+        prefixCache->truncateSequence(sequenceId, result ? std::max(0, startPos) : 0);
+    }
+
     return Napi::Boolean::New(info.Env(), result);
 }
 Napi::Value AddonContext::ShiftSequenceTokenCells(const Napi::CallbackInfo& info) {
@@ -676,8 +1456,23 @@ Napi::Value AddonContext::ShiftSequenceTokenCells(const Napi::CallbackInfo& info
     int32_t endPos = info[2].As<Napi::Number>().Int32Value();
     int32_t shiftDelta = info[3].As<Napi::Number>().Int32Value();
 
+    applyPendingSequenceEvictions();
+
+    std::unique_lock<std::mutex> preemptionLock(preemptionMutex, std::defer_lock);
+    if (preemptionEnabled) {
+        preemptionLock.lock();
+
+        if (deferSwappedSequenceCellOperation(sequenceId, {true, startPos, endPos, shiftDelta})) {
+            return info.Env().Undefined();
+        }
+    }
+
     llama_memory_seq_add(llama_get_memory(ctx), sequenceId, startPos, endPos, shiftDelta);
 
+    if (prefixCache != nullptr) {
+        prefixCache->truncateSequence(sequenceId, std::max(0, std::min(startPos, startPos + shiftDelta)));
+    }
+
     return info.Env().Undefined();
 }
 Napi::Value AddonContext::GetSequenceKvCacheMinPosition(const Napi::CallbackInfo& info) {
@@ -688,6 +1483,18 @@ Napi::Value AddonContext::GetSequenceKvCacheMinPosition(const Napi::CallbackInfo
 
     int32_t sequenceId = info[0].As<Napi::Number>().Int32Value();
 
+    applyPendingSequenceEvictions();
+
+    // a swapped out sequence reports the position it'll have once it's swapped in, without swapping it in
+    std::unique_lock<std::mutex> preemptionLock(preemptionMutex, std::defer_lock);
+    if (preemptionEnabled) {
+        preemptionLock.lock();
+
+        const auto swappedSequence = swappedSequences.find(sequenceId);
+        if (swappedSequence != swappedSequences.end()) {
+            return Napi::Number::New(info.Env(), swappedSequence->second.minPos);
+        }
+    }
 
     const auto minPosition = llama_memory_seq_pos_min(llama_get_memory(ctx), sequenceId);
 
@@ -701,16 +1508,227 @@ Napi::Value AddonContext::GetSequenceKvCacheMaxPosition(const Napi::CallbackInfo
 
     int32_t sequenceId = info[0].As<Napi::Number>().Int32Value();
 
+    applyPendingSequenceEvictions();
+
+    // a swapped out sequence reports the position it'll have once it's swapped in, without swapping it in
+    std::unique_lock<std::mutex> preemptionLock(preemptionMutex, std::defer_lock);
+    if (preemptionEnabled) {
+        preemptionLock.lock();
+
+        const auto swappedSequence = swappedSequences.find(sequenceId);
+        if (swappedSequence != swappedSequences.end()) {
+            return Napi::Number::New(info.Env(), swappedSequence->second.maxPos);
+        }
+    }
 
     const auto maxPosition = llama_memory_seq_pos_max(llama_get_memory(ctx), sequenceId);
 
     return Napi::Number::New(info.Env(), maxPosition);
 }
+Napi::Value AddonContext::ReuseSequencePrefix(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    const llama_seq_id sequenceId = info[0].As<Napi::Number>().Int32Value();
+    Napi::Uint32Array tokens = info[1].As<Napi::Uint32Array>();
+    const std::size_t currentLength = info[2].As<Napi::Number>().Uint32Value();
+    const uint64_t adaptersKey = info.Length() > 4 && info[3].IsArray() && info[4].IsArray()
+        ? getLoraAdaptersKey(info[3].As<Napi::Array>(), info[4].As<Napi::Array>())
+        : 0;
+
+    if (prefixCache == nullptr) {
+        return Napi::Number::New(info.Env(), currentLength);
+    }
+
+    applyPendingSequenceEvictions();
+
+    std::vector<llama_token> resolvedTokens(tokens.ElementLength());
+    for (std::size_t i = 0; i < resolvedTokens.size(); i++) {
+        resolvedTokens[i] = static_cast<llama_token>(tokens[i]);
+    }
+
+    const AddonPrefixCacheMatch match = prefixCache->findLongestPrefix(
+        resolvedTokens.data(), resolvedTokens.size(), adaptersKey, sequenceId
+    );
+    if (match.sequenceId == -1 || match.length <= currentLength ||
+        prefixCache->getSequenceCommonPrefixLength(sequenceId, resolvedTokens.data(), resolvedTokens.size()) < currentLength
+    ) {
+        prefixCache->misses++;
+        return Napi::Number::New(info.Env(), currentLength);
+    }
+
+    // copying a sequence to a sequence on another KV cache stream copies the entire stream,
+    // so the cells of the destination sequence are replaced and the cells after the matched prefix are then removed
+    llama_memory_t memory = llama_get_memory(ctx);
+    discardSwappedSequence(sequenceId);
+    llama_memory_seq_rm(memory, sequenceId, -1, -1);
+    llama_memory_seq_cp(memory, match.sequenceId, sequenceId, -1, -1);
+
+    if (!llama_memory_seq_rm(memory, sequenceId, match.length, -1)) {
+        llama_memory_seq_rm(memory, sequenceId, -1, -1);
+        prefixCache->removeSequence(sequenceId);
+
+        Napi::Error::New(info.Env(), "Failed to remove the cells after the reused prefix").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    prefixCache->setSequenceTokens(sequenceId, resolvedTokens.data(), match.length, adaptersKey);
+    prefixCache->markSequenceUsed(match.sequenceId);
+    prefixCache->hits++;
+    prefixCache->reusedTokens += match.length - currentLength;
+
+    return Napi::Number::New(info.Env(), match.length);
+}
+Napi::Value AddonContext::TakeLeastRecentlyUsedPrefixCacheSequence(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    Napi::Uint32Array sequenceIds = info[0].As<Napi::Uint32Array>();
+    std::vector<llama_seq_id> candidates(sequenceIds.ElementLength());
+    for (std::size_t i = 0; i < candidates.size(); i++) {
+        candidates[i] = static_cast<llama_seq_id>(sequenceIds[i]);
+    }
+
+    const llama_seq_id sequenceId = prefixCache == nullptr
+        ? (candidates.empty() ? -1 : candidates[0])
+        : prefixCache->getLeastRecentlyUsedSequence(candidates);
+
+    if (sequenceId == -1) {
+        return Napi::Number::New(info.Env(), -1);
+    }
+
+    // evict the cached prefix of the sequence to free its cells for a new sequence.
+    // a batch may be decoding right now, so the cells are removed right before the next decode
+    if (prefixCache != nullptr) {
+        prefixCache->removeSequence(sequenceId);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(pendingSequenceEvictionsMutex);
+        pendingSequenceEvictions.push_back(sequenceId);
+    }
+
+    discardSwappedSequence(sequenceId);
+    if (preemptionEnabled) {
+        std::lock_guard<std::mutex> lock(preemptionMutex);
+        sequencePreemptionPriorities.erase(sequenceId);
+        sequenceLastDecodes.erase(sequenceId);
+    }
+
+    return Napi::Number::New(info.Env(), sequenceId);
+}
+Napi::Value AddonContext::GetPrefixCacheStats(const Napi::CallbackInfo& info) {
+    Napi::Object result = Napi::Object::New(info.Env());
+    result.Set("enabled", Napi::Boolean::New(info.Env(), prefixCache != nullptr));
+    result.Set("hits", Napi::Number::New(info.Env(), prefixCache == nullptr ? 0 : prefixCache->hits));
+    result.Set("misses", Napi::Number::New(info.Env(), prefixCache == nullptr ? 0 : prefixCache->misses));
+    result.Set("reusedTokens", Napi::Number::New(info.Env(), prefixCache == nullptr ? 0 : prefixCache->reusedTokens));
+
+    return result;
+}
+Napi::Value AddonContext::GetStateFingerprint(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    // the context options that affect the layout of a sequence state
+    const uint64_t values[] = {
+        getModelStateFingerprint(model),
+        static_cast<uint64_t>(context_params.type_k),
+        static_cast<uint64_t>(context_params.type_v),
+        static_cast<uint64_t>(context_params.flash_attn_type),
+        static_cast<uint64_t>(context_params.swa_full)
+    };
+
+    uint64_t fingerprint = addonFnv1a(addonFnv1aOffsetBasis, values, sizeof(values));
+
+    // the LoRA adapters a sequence state was evaluated with, which affect its content
+    if (info.Length() > 1 && info[0].IsArray() && info[1].IsArray()) {
+        Napi::Array loraArray = info[0].As<Napi::Array>();
+        Napi::Array scaleArray = info[1].As<Napi::Array>();
+
+        for (size_t i = 0; i < loraArray.Length() && i < scaleArray.Length(); i++) {
+            AddonModelLora* lora = Napi::ObjectWrap<AddonModelLora>::Unwrap(loraArray.Get(i).As<Napi::Object>());
+            const float scale = scaleArray.Get(i).As<Napi::Number>().FloatValue();
+
+            fingerprint = addonFnv1a(fingerprint, &lora->contentFingerprint, sizeof(lora->contentFingerprint));
+            fingerprint = addonFnv1a(fingerprint, &scale, sizeof(scale));
+        }
+    }
+
+    char fingerprintHex[17];
+    snprintf(fingerprintHex, sizeof(fingerprintHex), "%016llx", static_cast<unsigned long long>(fingerprint));
+
+    return Napi::String::New(info.Env(), fingerprintHex);
+}
+Napi::Value AddonContext::SetSequencePreemptionPriority(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    if (!preemptionEnabled) {
+        return info.Env().Undefined();
+    }
+
+    const llama_seq_id sequenceId = info[0].As<Napi::Number>().Int32Value();
+    const int32_t priority = info[1].As<Napi::Number>().Int32Value();
+
+    // a sequence with a priority of 0 is only kept for the prefix cache, which doesn't include swapped out sequences
+    if (priority <= 0) {
+        discardSwappedSequence(sequenceId);
+    }
+
+    std::lock_guard<std::mutex> lock(preemptionMutex);
+    sequencePreemptionPriorities[sequenceId] = priority;
+
+    return info.Env().Undefined();
+}
+Napi::Value AddonContext::GetPreemptionStats(const Napi::CallbackInfo& info) {
+    Napi::Object result = Napi::Object::New(info.Env());
+    result.Set("enabled", Napi::Boolean::New(info.Env(), preemptionEnabled));
+    result.Set("preemptions", Napi::Number::New(info.Env(), preemptions.load()));
+    result.Set("droppedSequences", Napi::Number::New(info.Env(), droppedSequences.load()));
+    result.Set("swapIns", Napi::Number::New(info.Env(), swapIns.load()));
+    result.Set("swappedSequences", Napi::Number::New(info.Env(), swappedSequencesCount.load()));
+    result.Set("swappedSize", Napi::Number::New(info.Env(), swappedBytes.load()));
+
+    return result;
+}
 Napi::Value AddonContext::DecodeBatch(const Napi::CallbackInfo& info) {
     AddonContextDecodeBatchWorker* worker = new AddonContextDecodeBatchWorker(info.Env(), this);
     worker->Queue();
     return worker->GetPromise();
 }
+Napi::Value AddonContext::Warmup(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    AddonContextWarmupWorker* worker = new AddonContextWarmupWorker(info.Env(), this);
+
+    Napi::Array batchSizes = info[0].As<Napi::Array>();
+    for (uint32_t i = 0; i < batchSizes.Length(); i++) {
+        worker->batchSizes.push_back(batchSizes.Get(i).As<Napi::Number>().Int32Value());
+    }
+
+    if (worker->batchSizes.empty()) {
+        worker->batchSizes.push_back(1);
+    }
+
+    if (info.Length() > 1 && info[1].IsNumber()) {
+        worker->sequences = info[1].As<Napi::Number>().Int32Value();
+    }
+
+    worker->Queue();
+    return worker->GetPromise();
+}
 Napi::Value AddonContext::SampleToken(const Napi::CallbackInfo& info) {
     AddonContextSampleTokenWorker* worker = new AddonContextSampleTokenWorker(info, this);
     worker->Queue();
@@ -744,117 +1762,1276 @@ Napi::Value AddonContext::GetEmbedding(const Napi::CallbackInfo& info) {
     }
 
     size_t resultSize = maxVectorSize == 0 ? n_embd : std::min(n_embd, maxVectorSize);
-    Napi::Float64Array result = Napi::Float64Array::New(info.Env(), resultSize);
-    for (size_t i = 0; i < resultSize; i++) {
-        result[i] = embeddings[i];
+
+    if (info.Length() > 2 && info[2].IsNumber()) {
+        // the same conversion `evaluateEmbeddings` does, for inputs that are evaluated on their own
+        const AddonEmbeddingFormat format = getEmbeddingFormatFromNapiValue(info[2]);
+        std::vector<uint8_t> data(getEmbeddingFormatVectorByteSize(format, resultSize));
+        const float scale = writeEmbeddingInFormat(format, embeddings, resultSize, data.data());
+
+        Napi::Object resultObject = Napi::Object::New(info.Env());
+        resultObject.Set("vectors", createEmbeddingFormatTypedArray(info.Env(), format, data));
+        resultObject.Set("scale", Napi::Number::New(info.Env(), scale));
+        return resultObject;
     }
 
+    Napi::Float32Array result = Napi::Float32Array::New(info.Env(), resultSize);
+    std::memcpy(result.Data(), embeddings, resultSize * sizeof(float));
+
     return result;
 }
 
-Napi::Value AddonContext::GetStateSize(const Napi::CallbackInfo& info) {
+Napi::Value AddonContext::GetTokenEmbeddings(const Napi::CallbackInfo& info) {
     if (disposed) {
         Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
         return info.Env().Undefined();
     }
 
-    return Napi::Number::From(info.Env(), llama_state_get_size(ctx));
-}
+    const llama_seq_id sequenceId = info[0].As<Napi::Number>().Int32Value();
+    const llama_pos startPos = info[1].As<Napi::Number>().Int32Value();
+    const llama_pos endPos = info[2].As<Napi::Number>().Int32Value();
+    const int32_t maxVectorSize = (info.Length() > 3 && info[3].IsNumber()) ? info[3].As<Napi::Number>().Int32Value() : 0;
+    const bool normalize = info.Length() > 4 && info[4].IsBoolean() && info[4].As<Napi::Boolean>().Value();
 
-Napi::Value AddonContext::GetMemoryBreakdown(const Napi::CallbackInfo& info) {
-    if (disposed) {
-        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+    if (startPos < 0 || endPos <= startPos) {
+        Napi::Error::New(info.Env(), "Invalid token position range").ThrowAsJavaScriptException();
         return info.Env().Undefined();
-    }
-
-    if (!contextLoaded || ctx == nullptr) {
-        Napi::Error::New(info.Env(), "Context is not loaded").ThrowAsJavaScriptException();
+    } else if (llama_pooling_type(ctx) != LLAMA_POOLING_TYPE_NONE) {
+        Napi::Error::New(info.Env(), "Token embeddings are only available when the context pooling type is none").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    } else if (!has_batch || !batch_decoded) {
+        Napi::Error::New(info.Env(), "No decoded batch to get token embeddings from").ThrowAsJavaScriptException();
         return info.Env().Undefined();
     }
 
-    std::size_t cpuRam = 0;
-    std::size_t gpuVram = 0;
+    const int32_t n_embd = llama_model_n_embd(model->model);
+    const std::size_t vectorSize = maxVectorSize <= 0 ? n_embd : std::min(n_embd, maxVectorSize);
+    const std::size_t tokensCount = endPos - startPos;
+    const AddonEmbeddingFormat format = normalize ? AddonEmbeddingFormat::normalizedFloat32 : AddonEmbeddingFormat::float32;
 
-    for (const auto& [bufferType, memoryBreakdown] : ctx->memory_breakdown()) {
-        const std::size_t size = memoryBreakdown.context + memoryBreakdown.compute;
-        if (size == 0) {
+    // the rows are read directly from the outputs of the last decoded batch, where every token of an embedding context has an output
+    Napi::Float32Array result = Napi::Float32Array::New(info.Env(), tokensCount * vectorSize);
+    std::vector<bool> foundPositions(tokensCount, false);
+    std::size_t foundPositionsCount = 0;
+
+    for (int32_t i = 0; i < batch.n_tokens; i++) {
+        if (batch.seq_id[i][0] != sequenceId || batch.pos[i] < startPos || batch.pos[i] >= endPos) {
             continue;
         }
 
-        if (ggml_backend_buft_is_host(bufferType)) {
-            cpuRam += size;
-        } else {
-            ggml_backend_dev_t device = ggml_backend_buft_get_device(bufferType);
-            if (device != nullptr) {
-                auto deviceType = ggml_backend_dev_type(device);
-                if (deviceType == GGML_BACKEND_DEVICE_TYPE_GPU || deviceType == GGML_BACKEND_DEVICE_TYPE_IGPU) {
-                    gpuVram += size;
-                } else {
-                    cpuRam += size;
+        const float* embeddings = llama_get_embeddings_ith(ctx, i);
+        if (embeddings == nullptr) {
+            Napi::Error::New(info.Env(), std::string("Failed to get embeddings for token at position ") + std::to_string(batch.pos[i]))
+                .ThrowAsJavaScriptException();
+            return info.Env().Undefined();
+        }
+
+        const std::size_t row = batch.pos[i] - startPos;
+        writeEmbeddingInFormat(format, embeddings, vectorSize, reinterpret_cast<uint8_t*>(result.Data() + row * vectorSize));
+
+        if (!foundPositions[row]) {
+            foundPositions[row] = true;
+            foundPositionsCount++;
+        }
+    }
+
+    if (foundPositionsCount != tokensCount) {
+        Napi::Error::New(
+            info.Env(),
+            "Some of the tokens in the given range were not evaluated in the last batch of the sequence"
+        ).ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    return result;
+}
+
+// whether the cells of a prefix that's shared by multiple ranking inputs can be decoded once and copied to the sequences of the inputs.
+// the rank pooling of these architectures only reads the last token of each sequence in the batch, and their attention is causal,
+// so the cells of the prefix don't depend on the tokens that come after it.
+// source: `llm_graph_input_cls::set_input` in `llama-graph.cpp`
+static bool canShareRankingPrefixCells(const llama_model* model) {
+    return model->hparams.causal_attn && (model->arch == LLM_ARCH_QWEN3 || model->arch == LLM_ARCH_QWEN3VL) &&
+        !llama_model_is_recurrent(model) && !llama_model_is_hybrid(model);
+}
+
+class AddonContextEvaluateEmbeddingsWorker : public Napi::AsyncWorker {
+    public:
+        AddonContext* ctx;
+        std::vector<llama_token> prefixTokens; // prepended to every input
+        std::vector<llama_token> tokens;
+        std::vector<uint32_t> inputLengths;
+        std::vector<llama_seq_id> sequenceIds;
+        int32_t maxVectorSize = 0;
+        AddonEmbeddingFormat format = AddonEmbeddingFormat::float32;
+        bool applySigmoid = false;
+        bool resolveScores = false; // resolve with only the first value of every vector
+        std::size_t vectorSize = 0;
+        std::size_t vectorByteSize = 0;
+        std::vector<uint8_t> result;
+        std::vector<float> scales;
+
+        AddonContextEvaluateEmbeddingsWorker(const Napi::Env& env, AddonContext* ctx)
+            : Napi::AsyncWorker(env, "AddonContextEvaluateEmbeddingsWorker"),
+              ctx(ctx),
+              deferred(Napi::Promise::Deferred::New(env)) {
+            ctx->Ref();
+        }
+        ~AddonContextEvaluateEmbeddingsWorker() {
+            ctx->Unref();
+        }
+
+        Napi::Promise GetPromise() {
+            return deferred.Promise();
+        }
+
+    protected:
+        Napi::Promise::Deferred deferred;
+
+        void Execute() {
+            llama_batch batch = llama_batch_init(llama_n_batch(ctx->ctx), 0, 1);
+            ctx->batch_decoded = false; // the context outputs will no longer belong to the context batch
+            ctx->applyPendingSequenceEvictions();
+
+            try {
+                EvaluateEmbeddings(batch);
+            } catch (const std::exception& e) {
+                SetError(e.what());
+            } catch(...) {
+                SetError("Unknown error when calling \"llama_decode\"");
+            }
+
+            llama_batch_free(batch);
+        }
+
+        void EvaluateEmbeddings(llama_batch& batch) {
+            const uint32_t n_batch = llama_n_batch(ctx->ctx);
+            const enum llama_pooling_type pooling_type = llama_pooling_type(ctx->ctx);
+            const int32_t n_out = pooling_type == LLAMA_POOLING_TYPE_RANK
+                ? std::max<int32_t>(1, llama_model_n_cls_out(ctx->model->model))
+                : llama_model_n_embd(ctx->model->model);
+            llama_memory_t memory = llama_get_memory(ctx->ctx);
+
+            vectorSize = maxVectorSize <= 0 ? n_out : std::min(n_out, maxVectorSize);
+            vectorByteSize = getEmbeddingFormatVectorByteSize(format, vectorSize);
+            result.assign(inputLengths.size() * vectorByteSize, 0);
+            scales.assign(format == AddonEmbeddingFormat::int8 ? inputLengths.size() : 0, 0);
+
+            if (sequenceIds.empty()) {
+                SetError("No sequences were provided for evaluating embeddings");
+                return;
+            }
+
+            // the shared prefix is decoded once into the first sequence and copied to the other sequences before every batch
+            const bool sharePrefixCells = !prefixTokens.empty() && canShareRankingPrefixCells(ctx->model->model) &&
+                std::all_of(inputLengths.begin(), inputLengths.end(), [](uint32_t inputLength) { return inputLength > 0; });
+            const uint32_t prefixLength = prefixTokens.size();
+            const uint32_t batchedPrefixLength = sharePrefixCells ? 0 : prefixLength;
+
+            for (const llama_seq_id sequenceId : sequenceIds) {
+                llama_memory_seq_rm(memory, sequenceId, -1, -1);
+
+                if (ctx->prefixCache != nullptr) {
+                    ctx->prefixCache->removeSequence(sequenceId);
                 }
-            } else {
-                cpuRam += size;
             }
+
+            if (sharePrefixCells) {
+                for (uint32_t offset = 0; offset < prefixLength; offset += n_batch) {
+                    common_batch_clear(batch);
+                    for (uint32_t i = offset; i < prefixLength && i < offset + n_batch; i++) {
+                        common_batch_add(batch, prefixTokens[i], i, { sequenceIds[0] }, false);
+                    }
+
+                    if (!decodeBatch(batch)) {
+                        return;
+                    }
+                }
+            }
+
+            std::size_t inputIndex = 0;
+            std::size_t inputTokensOffset = 0;
+            std::vector<std::pair<std::size_t, int32_t>> batchInputs; // [input index, batch index of the last token]
+            batchInputs.reserve(sequenceIds.size());
+
+            while (inputIndex < inputLengths.size()) {
+                common_batch_clear(batch);
+                batchInputs.clear();
+
+                // pack as many inputs as possible into the batch, each on a different sequence
+                while (inputIndex < inputLengths.size() && batchInputs.size() < sequenceIds.size()) {
+                    const uint32_t inputLength = inputLengths[inputIndex];
+                    const uint32_t totalInputLength = prefixLength + inputLength;
+                    const uint32_t batchedInputLength = batchedPrefixLength + inputLength;
+
+                    if (totalInputLength > n_batch) {
+                        SetError(
+                            "Input " + std::to_string(inputIndex) + " is longer than the batch size (" +
+                            std::to_string(totalInputLength) + " > " + std::to_string(n_batch) + ")"
+                        );
+                        return;
+                    } else if (totalInputLength == 0) {
+                        inputIndex++;
+                        continue;
+                    } else if (batch.n_tokens + batchedInputLength > n_batch) {
+                        break;
+                    }
+
+                    const llama_seq_id sequenceId = sequenceIds[batchInputs.size()];
+                    for (uint32_t i = 0; i < batchedPrefixLength; i++) {
+                        common_batch_add(batch, prefixTokens[i], i, { sequenceId }, i == totalInputLength - 1);
+                    }
+                    for (uint32_t i = 0; i < inputLength; i++) {
+                        const uint32_t pos = prefixLength + i;
+                        common_batch_add(batch, tokens[inputTokensOffset + i], pos, { sequenceId }, pos == totalInputLength - 1);
+                    }
+
+                    batchInputs.emplace_back(inputIndex, batch.n_tokens - 1);
+                    inputTokensOffset += inputLength;
+                    inputIndex++;
+                }
+
+                if (batchInputs.empty()) {
+                    continue;
+                }
+
+                if (sharePrefixCells) {
+                    for (std::size_t i = 1; i < batchInputs.size(); i++) {
+                        llama_memory_seq_cp(memory, sequenceIds[0], sequenceIds[i], -1, -1);
+                    }
+                }
+
+                if (!decodeBatch(batch)) {
+                    return;
+                }
+
+                for (std::size_t i = 0; i < batchInputs.size(); i++) {
+                    const auto [resultIndex, lastTokenBatchIndex] = batchInputs[i];
+                    const float* embeddings = pooling_type == LLAMA_POOLING_TYPE_NONE
+                        ? llama_get_embeddings_ith(ctx->ctx, lastTokenBatchIndex)
+                        : llama_get_embeddings_seq(ctx->ctx, sequenceIds[i]);
+
+                    if (embeddings == nullptr) {
+                        SetError("Failed to get embeddings for input " + std::to_string(resultIndex));
+                        return;
+                    }
+
+                    if (applySigmoid) {
+                        float* resultVector = reinterpret_cast<float*>(result.data() + resultIndex * vectorByteSize);
+                        for (std::size_t j = 0; j < vectorSize; j++) {
+                            resultVector[j] = 1.0f / (1.0f + std::exp(-embeddings[j]));
+                        }
+                    } else {
+                        const float scale = writeEmbeddingInFormat(format, embeddings, vectorSize, result.data() + resultIndex * vectorByteSize);
+                        if (format == AddonEmbeddingFormat::int8) {
+                            scales[resultIndex] = scale;
+                        }
+                    }
+
+                    // the cells of the shared prefix are kept in the first sequence to be copied to the sequences of the next batch
+                    llama_memory_seq_rm(memory, sequenceIds[i], sharePrefixCells && i == 0 ? prefixLength : -1, -1);
+                }
+            }
+
+            if (sharePrefixCells) {
+                llama_memory_seq_rm(memory, sequenceIds[0], -1, -1);
+            }
+        }
+        bool decodeBatch(llama_batch& batch) {
+            int r = llama_decode(ctx->ctx, batch);
+            if (r != 0) {
+                if (r == 1) {
+                    SetError("could not find a KV slot for the batch (try reducing the size of the batch or increase the context)");
+                } else {
+                    SetError("Eval has failed");
+                }
+
+                return false;
+            }
+
+            llama_synchronize(ctx->ctx);
+            return true;
+        }
+        void OnOK() {
+            if (resolveScores) {
+                Napi::Float32Array scoresArray = Napi::Float32Array::New(Env(), inputLengths.size());
+                for (std::size_t i = 0; i < inputLengths.size(); i++) {
+                    scoresArray[i] = reinterpret_cast<const float*>(result.data() + i * vectorByteSize)[0];
+                }
+
+                deferred.Resolve(scoresArray);
+                return;
+            }
+
+            Napi::Object resultObject = Napi::Object::New(Env());
+            resultObject.Set("vectorSize", Napi::Number::New(Env(), vectorSize));
+            resultObject.Set("vectors", createEmbeddingFormatTypedArray(Env(), format, result));
+
+            if (format == AddonEmbeddingFormat::int8) {
+                Napi::Float32Array scalesArray = Napi::Float32Array::New(Env(), scales.size());
+                std::copy(scales.begin(), scales.end(), scalesArray.Data());
+                resultObject.Set("scales", scalesArray);
+            }
+
+            deferred.Resolve(resultObject);
+        }
+        void OnError(const Napi::Error& err) {
+            deferred.Reject(err.Value());
         }
+};
+
+static std::vector<llama_token> getTokensFromNapiValue(const Napi::Value& value) {
+    Napi::Uint32Array napiTokens = value.As<Napi::Uint32Array>();
+    std::vector<llama_token> tokens(napiTokens.ElementLength());
+
+    for (size_t i = 0; i < tokens.size(); i++) {
+        tokens[i] = static_cast<llama_token>(napiTokens[i]);
+    }
+
+    return tokens;
+}
+
+static std::vector<uint32_t> getUint32VectorFromNapiValue(const Napi::Value& value) {
+    Napi::Uint32Array napiArray = value.As<Napi::Uint32Array>();
+    return std::vector<uint32_t>(napiArray.Data(), napiArray.Data() + napiArray.ElementLength());
+}
+
+static std::vector<llama_seq_id> getSequenceIdsFromNapiValue(const Napi::Value& value) {
+    Napi::Uint32Array napiSequenceIds = value.As<Napi::Uint32Array>();
+    std::vector<llama_seq_id> sequenceIds(napiSequenceIds.ElementLength());
+
+    for (size_t i = 0; i < sequenceIds.size(); i++) {
+        sequenceIds[i] = static_cast<llama_seq_id>(napiSequenceIds[i]);
+    }
+
+    return sequenceIds;
+}
+
+Napi::Value AddonContext::EvaluateEmbeddings(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    AddonContextEvaluateEmbeddingsWorker* worker = new AddonContextEvaluateEmbeddingsWorker(info.Env(), this);
+    worker->tokens = getTokensFromNapiValue(info[0]);
+    worker->inputLengths = getUint32VectorFromNapiValue(info[1]);
+    worker->sequenceIds = getSequenceIdsFromNapiValue(info[2]);
+
+    if (info.Length() > 3 && info[3].IsNumber()) {
+        worker->maxVectorSize = info[3].As<Napi::Number>().Int32Value();
+    }
+
+    if (info.Length() > 4) {
+        worker->format = getEmbeddingFormatFromNapiValue(info[4]);
+    }
+
+    worker->Queue();
+    return worker->GetPromise();
+}
+
+Napi::Value AddonContext::RankBatch(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    if (llama_pooling_type(ctx) != LLAMA_POOLING_TYPE_RANK) {
+        Napi::Error::New(info.Env(), "Ranking is only available when the context pooling type is rank").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    // every input is evaluated as the shared prefix followed by its own tokens, on its own sequence.
+    // when the model allows it, the prefix is decoded once and its cells are copied to the sequences of every batch
+    AddonContextEvaluateEmbeddingsWorker* worker = new AddonContextEvaluateEmbeddingsWorker(info.Env(), this);
+    worker->prefixTokens = getTokensFromNapiValue(info[0]);
+    worker->tokens = getTokensFromNapiValue(info[1]);
+    worker->inputLengths = getUint32VectorFromNapiValue(info[2]);
+    worker->sequenceIds = getSequenceIdsFromNapiValue(info[3]);
+    worker->maxVectorSize = 1;
+    worker->resolveScores = true;
+    worker->applySigmoid = info.Length() > 4 && info[4].IsBoolean() && info[4].As<Napi::Boolean>().Value();
+
+    worker->Queue();
+    return worker->GetPromise();
+}
+
+Napi::Value AddonContext::GetStateSize(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    return Napi::Number::From(info.Env(), llama_state_get_size(ctx));
+}
+
+Napi::Value AddonContext::GetMemoryBreakdown(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    if (!contextLoaded || ctx == nullptr) {
+        Napi::Error::New(info.Env(), "Context is not loaded").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
     }
 
+    std::size_t cpuRam = 0;
+    std::size_t gpuVram = 0;
+    getContextMemoryBreakdown(ctx, cpuRam, gpuVram);
+
     Napi::Object result = Napi::Object::New(info.Env());
     result.Set("cpuRam", Napi::Number::New(info.Env(), cpuRam));
     result.Set("gpuVram", Napi::Number::New(info.Env(), gpuVram));
     return result;
 }
 
-Napi::Value AddonContext::GetThreads(const Napi::CallbackInfo& info) {
-    if (disposed) {
-        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
-        return info.Env().Undefined();
-    }
+Napi::Value AddonContext::GetLoadReport(const Napi::CallbackInfo& info) {
+    if (!loadReport.isFinished()) {
+        return info.Env().Undefined();
+    }
+
+    return loadReport.toNapiObject(info.Env());
+}
+
+Napi::Value AddonContext::GetKvCacheStats(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    if (!contextLoaded || ctx == nullptr) {
+        Napi::Error::New(info.Env(), "Context is not loaded").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    if (!kvCacheBytesPerCellResolved) {
+        getKvCacheBytesPerCell(model->model, context_params.type_k, context_params.type_v, kvCacheKeyBytesPerCell, kvCacheValueBytesPerCell);
+        kvCacheBytesPerCellResolved = true;
+    }
+
+    // this reads the memory of the context, so it should only be called while no other thread uses the context.
+    // sequences that are pending eviction are reported as empty since their cells are about to be freed
+    std::vector<llama_seq_id> evictedSequenceIds;
+    {
+        std::lock_guard<std::mutex> lock(pendingSequenceEvictionsMutex);
+        evictedSequenceIds = pendingSequenceEvictions;
+    }
+
+    // llama.cpp only exposes the position range of every sequence in the memory, not the cells the sequences occupy
+    const uint32_t sequences = llama_n_seq_max(ctx);
+    llama_memory_t memory = llama_get_memory(ctx);
+
+    Napi::Int32Array sequencePositions = Napi::Int32Array::New(info.Env(), sequences * 2);
+    Napi::Uint8Array swappedSequenceFlags = Napi::Uint8Array::New(info.Env(), sequences);
+
+    for (uint32_t i = 0; i < sequences; i++) {
+        const llama_seq_id sequenceId = static_cast<llama_seq_id>(i);
+        const bool evicted = std::find(evictedSequenceIds.begin(), evictedSequenceIds.end(), sequenceId) != evictedSequenceIds.end();
+
+        sequencePositions[i * 2] = evicted ? -1 : llama_memory_seq_pos_min(memory, sequenceId);
+        sequencePositions[i * 2 + 1] = evicted ? -1 : llama_memory_seq_pos_max(memory, sequenceId);
+        swappedSequenceFlags[i] = 0;
+    }
+
+    if (preemptionEnabled) {
+        std::lock_guard<std::mutex> lock(preemptionMutex);
+        for (const auto& [sequenceId, swappedSequence] : swappedSequences) {
+            if (sequenceId >= 0 && static_cast<uint32_t>(sequenceId) < sequences) {
+                swappedSequenceFlags[sequenceId] = 1;
+                sequencePositions[sequenceId * 2] = swappedSequence.minPos;
+                sequencePositions[sequenceId * 2 + 1] = swappedSequence.maxPos;
+            }
+        }
+    }
+
+    Napi::Object result = Napi::Object::New(info.Env());
+    result.Set("totalCells", Napi::Number::New(info.Env(), llama_n_ctx(ctx)));
+    result.Set("unified", Napi::Boolean::New(info.Env(), context_params.kv_unified));
+    result.Set("keyBytesPerCell", Napi::Number::New(info.Env(), kvCacheKeyBytesPerCell));
+    result.Set("valueBytesPerCell", Napi::Number::New(info.Env(), kvCacheValueBytesPerCell));
+    result.Set("sequencePositions", sequencePositions);
+    result.Set("swappedSequences", swappedSequenceFlags);
+
+    return result;
+}
+
+// the number of values of each configuration in the packed configurations array of `addonEstimateContextResourceGrid`:
+// contextSize, batchSize, sequences, embeddings, flashAttention (0 - disabled, 1 - enabled, 2 - auto), swaFullCache, kvCacheKeyType, kvCacheValueType
+static constexpr std::size_t contextResourceGridConfigSize = 8;
+
+class AddonEstimateContextResourceGridWorker : public Napi::AsyncWorker {
+    public:
+        AddonModel* model;
+        std::vector<llama_context_params> configs;
+        std::size_t maxParallelism = 1;
+        std::vector<double> results; // the cpuRam and gpuVram of each configuration, or `-1` when a context cannot be created with it
+
+        AddonEstimateContextResourceGridWorker(const Napi::CallbackInfo& info, AddonModel* model)
+            : Napi::AsyncWorker(info.Env(), "AddonEstimateContextResourceGridWorker"),
+              model(model),
+              deferred(Napi::Promise::Deferred::New(info.Env())) {
+            model->Ref();
+
+            Napi::Int32Array packedConfigs = info[1].As<Napi::Int32Array>();
+            const std::size_t configCount = packedConfigs.ElementLength() / contextResourceGridConfigSize;
+
+            if (info.Length() > 2 && info[2].IsNumber()) {
+                maxParallelism = std::max<int32_t>(1, info[2].As<Napi::Number>().Int32Value());
+            }
+
+            configs.reserve(configCount);
+            for (std::size_t i = 0; i < configCount; i++) {
+                const int32_t* config = packedConfigs.Data() + i * contextResourceGridConfigSize;
+
+                llama_context_params params = llama_context_default_params();
+                params.n_ctx = config[0];
+                params.n_batch = config[1];
+                params.n_ubatch = config[1];
+                params.n_seq_max = config[2];
+                params.embeddings = config[3] != 0;
+                params.flash_attn_type = config[4] == 2
+                    ? LLAMA_FLASH_ATTN_TYPE_AUTO
+                    : config[4] == 1
+                        ? LLAMA_FLASH_ATTN_TYPE_ENABLED
+                        : LLAMA_FLASH_ATTN_TYPE_DISABLED;
+                params.swa_full = config[5] != 0;
+                params.n_threads = 1;
+                params.n_threads_batch = 1;
+                params.no_perf = true;
+
+                if (config[6] >= 0 && config[6] < GGML_TYPE_COUNT) {
+                    params.type_k = static_cast<ggml_type>(config[6]);
+                }
+
+                if (config[7] >= 0 && config[7] < GGML_TYPE_COUNT) {
+                    params.type_v = static_cast<ggml_type>(config[7]);
+                }
+
+                configs.push_back(params);
+            }
+
+            results.assign(configs.size() * 2, -1);
+        }
+        ~AddonEstimateContextResourceGridWorker() {
+            model->Unref();
+        }
+
+        Napi::Promise GetPromise() {
+            return deferred.Promise();
+        }
+
+    protected:
+        Napi::Promise::Deferred deferred;
+
+        void Execute() {
+            // the contexts of a model loaded with `no_alloc` only reserve their graphs without allocating any memory,
+            // so the configurations are independent of each other and can be estimated in parallel.
+            // the JS side only passes a `maxParallelism` larger than 1 for backends that support creating contexts concurrently
+            std::atomic<std::size_t> nextConfigIndex = 0;
+            const auto estimateConfigs = [this, &nextConfigIndex]() {
+                while (true) {
+                    const std::size_t configIndex = nextConfigIndex++;
+                    if (configIndex >= configs.size()) {
+                        return;
+                    }
+
+                    try {
+                        llama_context* ctx = llama_init_from_model(model->model, configs[configIndex]);
+                        if (ctx == nullptr) {
+                            continue;
+                        }
+
+                        std::size_t cpuRam = 0;
+                        std::size_t gpuVram = 0;
+                        getContextMemoryBreakdown(ctx, cpuRam, gpuVram);
+                        llama_free(ctx);
+
+                        results[configIndex * 2] = static_cast<double>(cpuRam);
+                        results[configIndex * 2 + 1] = static_cast<double>(gpuVram);
+                    } catch (...) {
+                        // the configuration is reported as failed
+                    }
+                }
+            };
+
+            try {
+                const std::size_t threadCount = std::min(maxParallelism, configs.size());
+                std::vector<std::thread> threads;
+                for (std::size_t i = 1; i < threadCount; i++) {
+                    threads.emplace_back(estimateConfigs);
+                }
+
+                estimateConfigs();
+
+                for (auto& thread : threads) {
+                    thread.join();
+                }
+            } catch (const std::exception& e) {
+                SetError(e.what());
+            } catch(...) {
+                SetError("Unknown error when estimating the context resource grid");
+            }
+        }
+        void OnOK() {
+            Napi::Float64Array result = Napi::Float64Array::New(Env(), results.size());
+            if (!results.empty()) {
+                std::memcpy(result.Data(), results.data(), results.size() * sizeof(double));
+            }
+
+            deferred.Resolve(result);
+        }
+        void OnError(const Napi::Error& err) {
+            deferred.Reject(err.Value());
+        }
+};
+
+Napi::Value addonEstimateContextResourceGrid(const Napi::CallbackInfo& info) {
+    AddonModel* model = Napi::ObjectWrap<AddonModel>::Unwrap(info[0].As<Napi::Object>());
+    if (model->disposed || !model->modelLoaded) {
+        Napi::Error::New(info.Env(), "Model is not loaded").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    if (!model->model_params.no_alloc) {
+        Napi::Error::New(info.Env(), "Estimating a context resource grid requires a model that was loaded with \"noAlloc\"").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    AddonEstimateContextResourceGridWorker* worker = new AddonEstimateContextResourceGridWorker(info, model);
+    worker->Queue();
+    return worker->GetPromise();
+}
+
+Napi::Value AddonContext::GetThreads(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    return Napi::Number::From(info.Env(), llama_n_threads(ctx));
+}
+
+Napi::Value AddonContext::SetThreads(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    const auto threads = info[0].As<Napi::Number>().Int32Value();
+    const auto resolvedThreads = threads == 0
+        ? std::max((int32_t)std::thread::hardware_concurrency(), std::max(common_cpu_get_num_math(), 1))
+        : threads;
+
+    if (llama_n_threads(ctx) != resolvedThreads) {
+        llama_set_n_threads(ctx, resolvedThreads, resolvedThreads);
+    }
+
+    return info.Env().Undefined();
+}
+
+static bool createStateFileProgressCallback(
+    const Napi::CallbackInfo& info, const Napi::Value& callback, AddonThreadSafeProgressEventCallbackFunction& progressCallback
+) {
+    if (!callback.IsFunction()) {
+        return false;
+    }
+
+    AddonThreadSafeProgressCallbackFunctionContext* context = new Napi::Reference<Napi::Value>(Napi::Persistent(info.This()));
+    progressCallback = AddonThreadSafeProgressEventCallbackFunction::New(
+        info.Env(),
+        callback.As<Napi::Function>(),
+        "stateFileProgressCallback",
+        0,
+        1,
+        context,
+        [](Napi::Env, AddonThreadSafeProgressCallbackFunctionContext* ctx) {
+            delete ctx;
+        }
+    );
+
+    return true;
+}
+
+static void reportStateFileProgress(AddonThreadSafeProgressEventCallbackFunction& progressCallback, float progress) {
+    addon_progress_event* data = new addon_progress_event {
+        progress
+    };
+
+    auto status = progressCallback.NonBlockingCall(data);
+    if (status != napi_ok) {
+        delete data;
+    }
+}
+
+class AddonContextSaveSequenceStateToFileWorker : public Napi::AsyncWorker {
+    public:
+        AddonContext* context;
+        std::string filepath;
+        llama_seq_id sequenceId;
+        std::vector<llama_token> tokens;
+        bool directIo = false;
+        AddonThreadSafeProgressEventCallbackFunction progressCallback;
+        bool hasProgressCallback = false;
+        size_t savedFileSize = 0;
+
+        // a state that was already exported from the context, so writing it doesn't need the context
+        Napi::Reference<Napi::Uint8Array> stateReference;
+        const uint8_t* stateData = nullptr;
+        size_t stateSize = 0;
+        bool hasState = false;
+
+        AddonContextSaveSequenceStateToFileWorker(const Napi::CallbackInfo& info, AddonContext* context)
+            : Napi::AsyncWorker(info.Env(), "AddonContextSaveSequenceStateToFileWorker"),
+              context(context),
+              deferred(Napi::Promise::Deferred::New(info.Env())) {
+            context->Ref();
+
+            filepath = info[0].As<Napi::String>().Utf8Value();
+            sequenceId = info[1].As<Napi::Number>().Int32Value();
+            Napi::Uint32Array inputTokens = info[2].As<Napi::Uint32Array>();
+
+            tokens.resize(inputTokens.ElementLength());
+            for (size_t i = 0; i < tokens.size(); i++) {
+                tokens[i] = inputTokens[i];
+            }
+
+            if (info.Length() > 3 && info[3].IsObject()) {
+                Napi::Object options = info[3].As<Napi::Object>();
+
+                if (options.Has("directIo")) {
+                    directIo = options.Get("directIo").As<Napi::Boolean>().Value();
+                }
+
+                if (options.Has("onProgress")) {
+                    hasProgressCallback = createStateFileProgressCallback(info, options.Get("onProgress"), progressCallback);
+                }
+
+                if (options.Has("state") && options.Get("state").IsTypedArray()) {
+                    Napi::Uint8Array state = options.Get("state").As<Napi::Uint8Array>();
+                    stateData = state.Data();
+                    stateSize = state.ByteLength();
+                    stateReference = Napi::Persistent(state);
+                    hasState = true;
+                }
+            }
+        }
+        ~AddonContextSaveSequenceStateToFileWorker() {
+            if (hasProgressCallback) {
+                progressCallback.Release();
+            }
+
+            context->Unref();
+        }
+
+        Napi::Promise GetPromise() {
+            return deferred.Promise();
+        }
+
+    protected:
+        Napi::Promise::Deferred deferred;
+
+        void Execute() {
+            try {
+                // llama.cpp can only serialize a sequence state in one piece, so it's serialized in memory first
+                // and then streamed to the file in checksummed chunks
+                std::vector<uint8_t> state;
+                if (!hasState) {
+                    context->applyPendingSequenceEvictions();
+                    if (!context->ensureSequenceResident(sequenceId)) {
+                        SetError("Failed to swap the preempted sequence back into the context");
+                        return;
+                    }
+
+                    state.resize(llama_state_seq_get_size(context->ctx, sequenceId));
+                    const size_t writtenStateSize = llama_state_seq_get_data(context->ctx, state.data(), state.size(), sequenceId);
+                    if (writtenStateSize != state.size()) {
+                        SetError("Failed to save state to file");
+                        return;
+                    }
+
+                    stateData = state.data();
+                    stateSize = state.size();
+                }
+
+                std::string error;
+                savedFileSize = addonWriteSequenceStateFile(
+                    filepath,
+                    getModelStateFingerprint(context->model),
+                    tokens.data(),
+                    tokens.size(),
+                    stateData,
+                    stateSize,
+                    directIo,
+                    [this](float progress) {
+                        if (hasProgressCallback) {
+                            reportStateFileProgress(progressCallback, progress);
+                        }
+                    },
+                    error
+                );
+                if (savedFileSize == 0) {
+                    SetError(error);
+                    return;
+                }
+            } catch (const std::exception& e) {
+                SetError(e.what());
+            } catch(...) {
+                SetError("Unknown error when saving a state file");
+            }
+        }
+        void OnOK() {
+            deferred.Resolve(Napi::Number::New(Env(), savedFileSize));
+        }
+        void OnError(const Napi::Error& err) {
+            deferred.Reject(err.Value());
+        }
+};
+Napi::Value AddonContext::SaveSequenceStateToFile(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    AddonContextSaveSequenceStateToFileWorker* worker = new AddonContextSaveSequenceStateToFileWorker(info, this);
+    worker->Queue();
+    return worker->GetPromise();
+}
+
+class AddonContextLoadSequenceStateFromFileWorker : public Napi::AsyncWorker {
+    public:
+        AddonContext* context;
+        std::string filepath;
+        llama_seq_id sequenceId;
+        size_t maxContextSize;
+        AddonThreadSafeProgressEventCallbackFunction progressCallback;
+        bool hasProgressCallback = false;
+        std::vector<llama_token> tokens;
+
+        AddonContextLoadSequenceStateFromFileWorker(const Napi::CallbackInfo& info, AddonContext* context)
+            : Napi::AsyncWorker(info.Env(), "AddonContextLoadSequenceStateFromFileWorker"),
+              context(context),
+              deferred(Napi::Promise::Deferred::New(info.Env())) {
+            context->Ref();
+
+            filepath = info[0].As<Napi::String>().Utf8Value();
+            sequenceId = info[1].As<Napi::Number>().Int32Value();
+            maxContextSize = info[2].As<Napi::Number>().Uint32Value();
+
+            if (info.Length() > 3) {
+                hasProgressCallback = createStateFileProgressCallback(info, info[3], progressCallback);
+            }
+        }
+        ~AddonContextLoadSequenceStateFromFileWorker() {
+            if (hasProgressCallback) {
+                progressCallback.Release();
+            }
+
+            context->Unref();
+        }
+
+        Napi::Promise GetPromise() {
+            return deferred.Promise();
+        }
+
+    protected:
+        Napi::Promise::Deferred deferred;
+
+        void Execute() {
+            try {
+                AddonMappedFile file;
+                if (!file.open(filepath)) {
+                    SetError("Failed to open the state file");
+                    return;
+                }
+
+                // the entire file is validated before the context is touched,
+                // so a corrupted file or a file of another model leaves the current sequence state as it is
+                AddonSequenceStateFileContent content;
+                std::string error;
+                const bool validFile = addonIsSequenceStateFile(file)
+                    ? addonReadSequenceStateFile(
+                        file,
+                        getModelStateFingerprint(context->model),
+                        [this](float progress) {
+                            if (hasProgressCallback) {
+                                reportStateFileProgress(progressCallback, progress * stateFileValidationProgressRatio);
+                            }
+                        },
+                        content,
+                        error
+                    )
+                    : readLegacyStateFile(file, content, error);
+                if (!validFile) {
+                    SetError(error);
+                    return;
+                }
+
+                if (content.tokens.size() > maxContextSize) {
+                    SetError("Failed to load state from file. Current context sequence size may be smaller that the state of the file");
+                    return;
+                }
+
+                context->applyPendingSequenceEvictions();
+
+                if (context->prefixCache != nullptr) {
+                    context->prefixCache->removeSequence(sequenceId);
+                }
+
+                const size_t readSize = context->loadSequenceStateData(sequenceId, content.stateData, content.stateSize);
+                if (readSize == 0 || readSize != content.stateSize) {
+                    // llama.cpp clears the sequence when it fails to read a state into it,
+                    // and a state that's followed by unexpected data is not kept either
+                    llama_memory_seq_rm(llama_get_memory(context->ctx), sequenceId, -1, -1);
+                    sequenceStateCleared = true;
+
+                    SetError("Failed to load state from file. Current context sequence size may be smaller that the state of the file");
+                    return;
+                }
+
+                tokens.assign(content.tokens.begin(), content.tokens.end());
+
+                // the adapters the state was evaluated with are unknown, so its prefix is tracked but never reused
+                if (context->prefixCache != nullptr) {
+                    context->prefixCache->setSequenceTokens(
+                        sequenceId, tokens.data(), tokens.size(), AddonPrefixCache::unknownAdaptersKey
+                    );
+                }
+
+                if (hasProgressCallback) {
+                    reportStateFileProgress(progressCallback, 1);
+                }
+            } catch (const std::exception& e) {
+                SetError(e.what());
+            } catch(...) {
+                SetError("Unknown error when loading a state file");
+            }
+        }
+        void OnOK() {
+            size_t tokenCount = tokens.size();
+            Napi::Uint32Array result = Napi::Uint32Array::New(Env(), tokenCount);
+
+            for (size_t i = 0; i < tokenCount; i++) {
+                result[i] = tokens[i];
+            }
+
+            deferred.Resolve(result);
+        }
+        void OnError(const Napi::Error& err) {
+            if (sequenceStateCleared) {
+                err.Value().Set("sequenceStateCleared", Napi::Boolean::New(Env(), true));
+            }
+
+            deferred.Reject(err.Value());
+        }
+
+    private:
+        // the part of the load progress that is spent on validating the file before loading it into the context
+        static constexpr float stateFileValidationProgressRatio = 0.9f;
+
+        // whether loading the validated state into the context failed after the sequence was already modified
+        bool sequenceStateCleared = false;
+
+        // state files created by `llama_state_seq_save_file`, which are made of a header, the tokens, and the state data.
+        // only the header can be validated before loading the state data into the context
+        bool readLegacyStateFile(const AddonMappedFile& file, AddonSequenceStateFileContent& content, std::string& error) {
+            const uint8_t* fileData = file.data();
+            const size_t fileSize = file.size();
+
+            uint32_t header[3]; // magic, version, token count
+            if (fileSize < sizeof(header)) {
+                error = "The state file is corrupted";
+                return false;
+            }
+
+            std::memcpy(header, fileData, sizeof(header));
+            if (header[0] != LLAMA_STATE_SEQ_MAGIC || header[1] != LLAMA_STATE_SEQ_VERSION) {
+                error = "The state file is corrupted or was created by an unsupported version";
+                return false;
+            }
+
+            const size_t tokenCount = header[2];
+            if (tokenCount > maxContextSize) {
+                error = "Failed to load state from file. Current context sequence size may be smaller that the state of the file";
+                return false;
+            } else if ((fileSize - sizeof(header)) / sizeof(llama_token) < tokenCount) {
+                error = "The state file is corrupted";
+                return false;
+            }
+
+            content.tokens.resize(tokenCount);
+            if (tokenCount > 0) {
+                std::memcpy(content.tokens.data(), fileData + sizeof(header), tokenCount * sizeof(llama_token));
+            }
+
+            content.stateData = fileData + sizeof(header) + tokenCount * sizeof(llama_token);
+            content.stateSize = fileSize - sizeof(header) - tokenCount * sizeof(llama_token);
+
+            return true;
+        }
+};
+Napi::Value AddonContext::LoadSequenceStateFromFile(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    AddonContextLoadSequenceStateFromFileWorker* worker = new AddonContextLoadSequenceStateFromFileWorker(info, this);
+    worker->Queue();
+    return worker->GetPromise();
+}
+
+class AddonContextReadSequenceStateFileWorker : public Napi::AsyncWorker {
+    public:
+        AddonContext* context;
+        std::string filepath;
+        size_t maxContextSize;
+        AddonMappedFile file;
+        bool fileOpened = false;
+        Napi::Reference<Napi::Uint8Array> stateReference;
+        uint8_t* stateData = nullptr;
+        size_t stateSize = 0;
+        std::vector<llama_token> tokens;
+
+        AddonContextReadSequenceStateFileWorker(const Napi::CallbackInfo& info, AddonContext* context)
+            : Napi::AsyncWorker(info.Env(), "AddonContextReadSequenceStateFileWorker"),
+              context(context),
+              deferred(Napi::Promise::Deferred::New(info.Env())) {
+            context->Ref();
+
+            filepath = info[0].As<Napi::String>().Utf8Value();
+            maxContextSize = info[1].As<Napi::Number>().Uint32Value();
+
+            // the state is copied directly into the memory of the returned array, which can't be larger than the file.
+            // the file stays mapped until the worker is done, so it's validated and copied from the same content
+            fileOpened = file.open(filepath);
+
+            Napi::Uint8Array state = Napi::Uint8Array::New(info.Env(), fileOpened ? file.size() : 0);
+            stateData = state.Data();
+            stateReference = Napi::Persistent(state);
+        }
+        ~AddonContextReadSequenceStateFileWorker() {
+            context->Unref();
+        }
+
+        Napi::Promise GetPromise() {
+            return deferred.Promise();
+        }
+
+    protected:
+        Napi::Promise::Deferred deferred;
+
+        void Execute() {
+            try {
+                if (!fileOpened) {
+                    SetError("Failed to open the state file");
+                    return;
+                } else if (!addonIsSequenceStateFile(file)) {
+                    SetError("The state file is corrupted or was created by an unsupported version");
+                    return;
+                }
+
+                AddonSequenceStateFileContent content;
+                std::string error;
+                if (!addonReadSequenceStateFile(file, getModelStateFingerprint(context->model), [](float) {}, content, error)) {
+                    SetError(error);
+                    return;
+                }
+
+                if (content.tokens.size() > maxContextSize) {
+                    SetError("Failed to load state from file. Current context sequence size may be smaller that the state of the file");
+                    return;
+                }
+
+                std::memcpy(stateData, content.stateData, content.stateSize);
+                stateSize = content.stateSize;
+                tokens.assign(content.tokens.begin(), content.tokens.end());
+            } catch (const std::exception& e) {
+                SetError(e.what());
+            } catch(...) {
+                SetError("Unknown error when reading a state file");
+            }
+        }
+        void OnOK() {
+            Napi::Uint32Array resultTokens = Napi::Uint32Array::New(Env(), tokens.size());
+            for (size_t i = 0; i < tokens.size(); i++) {
+                resultTokens[i] = tokens[i];
+            }
+
+            Napi::Uint8Array state = stateReference.Value();
+
+            Napi::Object result = Napi::Object::New(Env());
+            result.Set("tokens", resultTokens);
+            result.Set("state", Napi::Uint8Array::New(Env(), stateSize, state.ArrayBuffer(), state.ByteOffset()));
+            deferred.Resolve(result);
+        }
+        void OnError(const Napi::Error& err) {
+            deferred.Reject(err.Value());
+        }
+};
+Napi::Value AddonContext::ReadSequenceStateFile(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    AddonContextReadSequenceStateFileWorker* worker = new AddonContextReadSequenceStateFileWorker(info, this);
+    worker->Queue();
+    return worker->GetPromise();
+}
+
+static std::vector<llama_token> getSequenceStateTokensFromNapiValue(const Napi::Value& value) {
+    std::vector<llama_token> tokens;
+    if (!value.IsTypedArray()) {
+        return tokens;
+    }
+
+    Napi::Uint32Array inputTokens = value.As<Napi::Uint32Array>();
+    tokens.resize(inputTokens.ElementLength());
+    for (size_t i = 0; i < tokens.size(); i++) {
+        tokens[i] = static_cast<llama_token>(inputTokens[i]);
+    }
+
+    return tokens;
+}
+
+class AddonContextExportSequenceStateWorker : public Napi::AsyncWorker {
+    public:
+        AddonContext* context;
+        llama_seq_id sequenceId;
+        Napi::Reference<Napi::Uint8Array> stateReference;
+        uint8_t* stateData = nullptr;
+        size_t stateSize = 0;
+
+        // a swapped out sequence is exported in the worker thread, since swapping it in may preempt other sequences
+        bool swapped = false;
+        std::vector<uint8_t> swappedState;
+
+        AddonContextExportSequenceStateWorker(const Napi::CallbackInfo& info, AddonContext* context)
+            : Napi::AsyncWorker(info.Env(), "AddonContextExportSequenceStateWorker"),
+              context(context),
+              deferred(Napi::Promise::Deferred::New(info.Env())) {
+            context->Ref();
+
+            sequenceId = info[0].As<Napi::Number>().Int32Value();
+            context->applyPendingSequenceEvictions();
+
+            if (context->preemptionEnabled) {
+                std::lock_guard<std::mutex> lock(context->preemptionMutex);
+                swapped = context->swappedSequences.find(sequenceId) != context->swappedSequences.end();
+            }
+
+            if (swapped) {
+                return;
+            }
+
+            // the state is written directly into the memory of the returned array to avoid copying it again after it's serialized
+            stateSize = llama_state_seq_get_size(context->ctx, sequenceId);
+
+            Napi::Uint8Array state = Napi::Uint8Array::New(info.Env(), stateSize);
+            stateData = state.Data();
+            stateReference = Napi::Persistent(state);
+        }
+        ~AddonContextExportSequenceStateWorker() {
+            context->Unref();
+        }
+
+        Napi::Promise GetPromise() {
+            return deferred.Promise();
+        }
+
+    protected:
+        Napi::Promise::Deferred deferred;
+
+        void Execute() {
+            try {
+                if (swapped) {
+                    exportSwappedSequence();
+                    return;
+                }
+
+                const size_t writtenSize = llama_state_seq_get_data(context->ctx, stateData, stateSize, sequenceId);
+                if (writtenSize != stateSize) {
+                    SetError("Failed to export the sequence state");
+                    return;
+                }
+            } catch (const std::exception& e) {
+                SetError(e.what());
+            } catch(...) {
+                SetError("Unknown error when calling \"llama_state_seq_get_data\"");
+            }
+        }
+        void exportSwappedSequence() {
+            std::lock_guard<std::mutex> lock(context->preemptionMutex);
+
+            // the swapped out state is in the same format as the exported one, so it's used as is when its cells weren't changed
+            const auto swappedSequence = context->swappedSequences.find(sequenceId);
+            if (swappedSequence != context->swappedSequences.end() && swappedSequence->second.pendingCellOperations.empty()) {
+                swappedState = swappedSequence->second.state;
+                return;
+            }
+
+            if (!context->swapInSequence(sequenceId, {sequenceId})) {
+                SetError("Failed to swap the preempted sequence back into the context");
+                return;
+            }
 
-    return Napi::Number::From(info.Env(), llama_n_threads(ctx));
-}
+            swappedState.resize(llama_state_seq_get_size(context->ctx, sequenceId));
+            const size_t writtenSize = llama_state_seq_get_data(context->ctx, swappedState.data(), swappedState.size(), sequenceId);
+            if (writtenSize != swappedState.size()) {
+                SetError("Failed to export the sequence state");
+            }
+        }
+        void OnOK() {
+            if (swapped) {
+                Napi::Uint8Array state = Napi::Uint8Array::New(Env(), swappedState.size());
+                std::memcpy(state.Data(), swappedState.data(), swappedState.size());
+                deferred.Resolve(state);
+                return;
+            }
 
-Napi::Value AddonContext::SetThreads(const Napi::CallbackInfo& info) {
+            deferred.Resolve(stateReference.Value());
+        }
+        void OnError(const Napi::Error& err) {
+            deferred.Reject(err.Value());
+        }
+};
+Napi::Value AddonContext::ExportSequenceState(const Napi::CallbackInfo& info) {
     if (disposed) {
         Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
         return info.Env().Undefined();
     }
 
-    const auto threads = info[0].As<Napi::Number>().Int32Value();
-    const auto resolvedThreads = threads == 0
-        ? std::max((int32_t)std::thread::hardware_concurrency(), std::max(common_cpu_get_num_math(), 1))
-        : threads;
-
-    if (llama_n_threads(ctx) != resolvedThreads) {
-        llama_set_n_threads(ctx, resolvedThreads, resolvedThreads);
-    }
-
-    return info.Env().Undefined();
+    AddonContextExportSequenceStateWorker* worker = new AddonContextExportSequenceStateWorker(info, this);
+    worker->Queue();
+    return worker->GetPromise();
 }
 
-class AddonContextSaveSequenceStateToFileWorker : public Napi::AsyncWorker {
+class AddonContextImportSequenceStateWorker : public Napi::AsyncWorker {
     public:
         AddonContext* context;
-        std::string filepath;
         llama_seq_id sequenceId;
+        Napi::Reference<Napi::Uint8Array> stateReference;
+        const uint8_t* stateData = nullptr;
+        size_t stateSize = 0;
         std::vector<llama_token> tokens;
-        size_t savedFileSize = 0;
 
-        AddonContextSaveSequenceStateToFileWorker(const Napi::CallbackInfo& info, AddonContext* context)
-            : Napi::AsyncWorker(info.Env(), "AddonContextSaveSequenceStateToFileWorker"),
+        AddonContextImportSequenceStateWorker(const Napi::CallbackInfo& info, AddonContext* context)
+            : Napi::AsyncWorker(info.Env(), "AddonContextImportSequenceStateWorker"),
               context(context),
               deferred(Napi::Promise::Deferred::New(info.Env())) {
             context->Ref();
 
-            filepath = info[0].As<Napi::String>().Utf8Value();
-            sequenceId = info[1].As<Napi::Number>().Int32Value();
-            Napi::Uint32Array inputTokens = info[2].As<Napi::Uint32Array>();
+            sequenceId = info[0].As<Napi::Number>().Int32Value();
 
-            tokens.resize(inputTokens.ElementLength());
-            for (size_t i = 0; i < tokens.size(); i++) {
-                tokens[i] = inputTokens[i];
-            }
+            Napi::Uint8Array state = info[1].As<Napi::Uint8Array>();
+            stateData = state.Data();
+            stateSize = state.ByteLength();
+            stateReference = Napi::Persistent(state);
+
+            tokens = getSequenceStateTokensFromNapiValue(info[2]);
         }
-        ~AddonContextSaveSequenceStateToFileWorker() {
+        ~AddonContextImportSequenceStateWorker() {
             context->Unref();
         }
 
@@ -867,57 +3044,71 @@ class AddonContextSaveSequenceStateToFileWorker : public Napi::AsyncWorker {
 
         void Execute() {
             try {
-                savedFileSize = llama_state_seq_save_file(context->ctx, filepath.c_str(), sequenceId, tokens.data(), tokens.size());
-                if (savedFileSize == 0) {
-                    SetError("Failed to save state to file");
+                context->applyPendingSequenceEvictions();
+
+                if (context->prefixCache != nullptr) {
+                    context->prefixCache->removeSequence(sequenceId);
+                }
+
+                const size_t readSize = context->loadSequenceStateData(sequenceId, stateData, stateSize);
+                if (readSize == 0) {
+                    SetError("Failed to import the sequence state. Current context sequence size may be smaller than the imported state");
                     return;
                 }
+
+                // the adapters the state was evaluated with are unknown, so its prefix is tracked but never reused
+                if (context->prefixCache != nullptr) {
+                    context->prefixCache->setSequenceTokens(
+                        sequenceId, tokens.data(), tokens.size(), AddonPrefixCache::unknownAdaptersKey
+                    );
+                }
             } catch (const std::exception& e) {
                 SetError(e.what());
             } catch(...) {
-                SetError("Unknown error when calling \"llama_state_seq_save_file\"");
+                SetError("Unknown error when calling \"llama_state_seq_set_data\"");
             }
         }
         void OnOK() {
-            deferred.Resolve(Napi::Number::New(Env(), savedFileSize));
+            deferred.Resolve(Env().Undefined());
         }
         void OnError(const Napi::Error& err) {
             deferred.Reject(err.Value());
         }
 };
-Napi::Value AddonContext::SaveSequenceStateToFile(const Napi::CallbackInfo& info) {
+Napi::Value AddonContext::ImportSequenceState(const Napi::CallbackInfo& info) {
     if (disposed) {
         Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
         return info.Env().Undefined();
     }
 
-    AddonContextSaveSequenceStateToFileWorker* worker = new AddonContextSaveSequenceStateToFileWorker(info, this);
+    AddonContextImportSequenceStateWorker* worker = new AddonContextImportSequenceStateWorker(info, this);
     worker->Queue();
     return worker->GetPromise();
 }
 
-class AddonContextLoadSequenceStateFromFileWorker : public Napi::AsyncWorker {
+class AddonContextTransferSequenceStateWorker : public Napi::AsyncWorker {
     public:
         AddonContext* context;
-        std::string filepath;
         llama_seq_id sequenceId;
-        size_t maxContextSize;
+        AddonContext* targetContext;
+        llama_seq_id targetSequenceId;
         std::vector<llama_token> tokens;
 
-        AddonContextLoadSequenceStateFromFileWorker(const Napi::CallbackInfo& info, AddonContext* context)
-            : Napi::AsyncWorker(info.Env(), "AddonContextLoadSequenceStateFromFileWorker"),
+        AddonContextTransferSequenceStateWorker(const Napi::CallbackInfo& info, AddonContext* context)
+            : Napi::AsyncWorker(info.Env(), "AddonContextTransferSequenceStateWorker"),
               context(context),
               deferred(Napi::Promise::Deferred::New(info.Env())) {
-            context->Ref();
+            sequenceId = info[0].As<Napi::Number>().Int32Value();
+            targetContext = Napi::ObjectWrap<AddonContext>::Unwrap(info[1].As<Napi::Object>());
+            targetSequenceId = info[2].As<Napi::Number>().Int32Value();
+            tokens = getSequenceStateTokensFromNapiValue(info[3]);
 
-            filepath = info[0].As<Napi::String>().Utf8Value();
-            sequenceId = info[1].As<Napi::Number>().Int32Value();
-            maxContextSize = info[2].As<Napi::Number>().Uint32Value();
-
-            tokens.resize(maxContextSize);
+            context->Ref();
+            targetContext->Ref();
         }
-        ~AddonContextLoadSequenceStateFromFileWorker() {
+        ~AddonContextTransferSequenceStateWorker() {
             context->Unref();
+            targetContext->Unref();
         }
 
         Napi::Promise GetPromise() {
@@ -929,41 +3120,68 @@ class AddonContextLoadSequenceStateFromFileWorker : public Napi::AsyncWorker {
 
         void Execute() {
             try {
-                size_t tokenCount = 0;
-                const size_t fileSize = llama_state_seq_load_file(context->ctx, filepath.c_str(), sequenceId, tokens.data(), tokens.size(), &tokenCount);
-                if (fileSize == 0) {
-                    SetError("Failed to load state from file. Current context sequence size may be smaller that the state of the file");
+                context->applyPendingSequenceEvictions();
+                if (!context->ensureSequenceResident(sequenceId)) {
+                    SetError("Failed to swap the preempted sequence back into the context");
+                    return;
+                }
+
+                std::vector<uint8_t> state(llama_state_seq_get_size(context->ctx, sequenceId));
+                const size_t writtenSize = llama_state_seq_get_data(context->ctx, state.data(), state.size(), sequenceId);
+                if (writtenSize != state.size()) {
+                    SetError("Failed to read the source sequence state");
+                    return;
+                }
+
+                // the adapters of the transferred cells are only known when the source prefix cache tracks all of them
+                const uint64_t adaptersKey = context->prefixCache != nullptr &&
+                        context->prefixCache->getSequenceLength(sequenceId) >= tokens.size()
+                    ? context->prefixCache->getSequenceAdaptersKey(sequenceId)
+                    : AddonPrefixCache::unknownAdaptersKey;
+
+                if (targetContext != context) {
+                    targetContext->applyPendingSequenceEvictions();
+                }
+
+                if (targetContext->prefixCache != nullptr) {
+                    targetContext->prefixCache->removeSequence(targetSequenceId);
+                }
+
+                const size_t readSize = targetContext->loadSequenceStateData(targetSequenceId, state.data(), state.size());
+                if (readSize == 0) {
+                    SetError("Failed to transfer the sequence state. Target context sequence size may be smaller than the source sequence state");
                     return;
                 }
 
-                tokens.resize(tokenCount);
+                if (targetContext->prefixCache != nullptr) {
+                    targetContext->prefixCache->setSequenceTokens(targetSequenceId, tokens.data(), tokens.size(), adaptersKey);
+                }
             } catch (const std::exception& e) {
                 SetError(e.what());
             } catch(...) {
-                SetError("Unknown error when calling \"llama_state_seq_load_file\"");
+                SetError("Unknown error when transferring a sequence state");
             }
         }
         void OnOK() {
-            size_t tokenCount = tokens.size();
-            Napi::Uint32Array result = Napi::Uint32Array::New(Env(), tokenCount);
-
-            for (size_t i = 0; i < tokenCount; i++) {
-                result[i] = tokens[i];
-            }
-
-            deferred.Resolve(result);
+            deferred.Resolve(Env().Undefined());
         }
         void OnError(const Napi::Error& err) {
             deferred.Reject(err.Value());
         }
 };
-Napi::Value AddonContext::LoadSequenceStateFromFile(const Napi::CallbackInfo& info) {
+Napi::Value AddonContext::TransferSequenceState(const Napi::CallbackInfo& info) {
     if (disposed) {
         Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
         return info.Env().Undefined();
     }
 
-    AddonContextLoadSequenceStateFromFileWorker* worker = new AddonContextLoadSequenceStateFromFileWorker(info, this);
+    AddonContext* targetContext = Napi::ObjectWrap<AddonContext>::Unwrap(info[1].As<Napi::Object>());
+    if (targetContext->disposed) {
+        Napi::Error::New(info.Env(), "Target context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    AddonContextTransferSequenceStateWorker* worker = new AddonContextTransferSequenceStateWorker(info, this);
     worker->Queue();
     return worker->GetPromise();
 }
@@ -1051,10 +3269,15 @@ Napi::Value AddonContext::SetLoras(const Napi::CallbackInfo& info) {
     }
 
     llama_set_adapters_lora(ctx, loras.data(), loras.size(), scales.data());
+    loraAdaptersKey = getLoraAdaptersKey(loraArray, scaleArray);
 
     return info.Env().Undefined();
 }
 
+static constexpr std::size_t checkpointCompressionSampleSize = 1024 * 1024;
+static constexpr double checkpointCompressionMinRatio = 0.95; // keep the raw data when compression saves less than 5%
+static constexpr double checkpointDeltaMaxRatio = 0.5; // store the full state when a delta isn't at least 50% smaller
+
 class RestoreCheckpointWorker : public Napi::AsyncWorker {
     public:
         AddonContext* context;
@@ -1086,9 +3309,36 @@ class RestoreCheckpointWorker : public Napi::AsyncWorker {
         void Execute() {
             try {
                 std::lock_guard<std::mutex> lock(checkpoint->dataMutex);
+                context->applyPendingSequenceEvictions();
+                if (!context->ensureSequenceResident(checkpoint->sequenceId)) {
+                    SetError("Failed to swap the preempted sequence back into the context");
+                    return;
+                }
+
+                if (context->prefixCache != nullptr) {
+                    context->prefixCache->removeSequence(checkpoint->sequenceId);
+                }
+
+                // an uncompressed spilled checkpoint is restored directly from the mapped file pages without copying it to memory first
+                AddonMappedFile spillFile;
+                const uint8_t* data = nullptr;
+                std::size_t dataSize = 0;
+                if (!checkpoint->getStoredData(spillFile, data, dataSize)) {
+                    // a missing, torn or modified spill file fails the restore, so the sequence state is evaluated again instead
+                    return;
+                }
+
+                std::vector<uint8_t> rawData;
+                if (checkpoint->compressed || checkpoint->parent != nullptr) {
+                    if (!checkpoint->resolveRawData(data, dataSize, rawData)) {
+                        return;
+                    }
+
+                    data = rawData.data();
+                    dataSize = rawData.size();
+                }
 
-                std::size_t dataSize = checkpoint->data.size();
-                std::size_t restoreSize = llama_state_seq_set_data_ext(context->ctx, checkpoint->data.data(), dataSize, checkpoint->sequenceId, LLAMA_STATE_SEQ_FLAGS_PARTIAL_ONLY);
+                std::size_t restoreSize = llama_state_seq_set_data_ext(context->ctx, data, dataSize, checkpoint->sequenceId, LLAMA_STATE_SEQ_FLAGS_PARTIAL_ONLY);
                 if (restoreSize == dataSize) {
                     restoreSuccess = (
                         llama_memory_seq_rm(llama_get_memory(context->ctx), checkpoint->sequenceId, maxPosIndex + 1, -1) &&
@@ -1134,17 +3384,33 @@ void AddonContext::init(Napi::Object exports) {
                 InstanceMethod("shiftSequenceTokenCells", &AddonContext::ShiftSequenceTokenCells),
                 InstanceMethod("getSequenceKvCacheMinPosition", &AddonContext::GetSequenceKvCacheMinPosition),
                 InstanceMethod("getSequenceKvCacheMaxPosition", &AddonContext::GetSequenceKvCacheMaxPosition),
+                InstanceMethod("reuseSequencePrefix", &AddonContext::ReuseSequencePrefix),
+                InstanceMethod("takeLeastRecentlyUsedPrefixCacheSequence", &AddonContext::TakeLeastRecentlyUsedPrefixCacheSequence),
+                InstanceMethod("getPrefixCacheStats", &AddonContext::GetPrefixCacheStats),
+                InstanceMethod("getStateFingerprint", &AddonContext::GetStateFingerprint),
+                InstanceMethod("setSequencePreemptionPriority", &AddonContext::SetSequencePreemptionPriority),
+                InstanceMethod("getPreemptionStats", &AddonContext::GetPreemptionStats),
                 InstanceMethod("decodeBatch", &AddonContext::DecodeBatch),
+                InstanceMethod("warmup", &AddonContext::Warmup),
                 InstanceMethod("sampleToken", &AddonContext::SampleToken),
                 InstanceMethod("getEmbedding", &AddonContext::GetEmbedding),
+                InstanceMethod("evaluateEmbeddings", &AddonContext::EvaluateEmbeddings),
+                InstanceMethod("getTokenEmbeddings", &AddonContext::GetTokenEmbeddings),
+                InstanceMethod("rankBatch", &AddonContext::RankBatch),
                 InstanceMethod("getStateSize", &AddonContext::GetStateSize),
                 InstanceMethod("getMemoryBreakdown", &AddonContext::GetMemoryBreakdown),
+                InstanceMethod("getLoadReport", &AddonContext::GetLoadReport),
+                InstanceMethod("getKvCacheStats", &AddonContext::GetKvCacheStats),
                 InstanceMethod("getThreads", &AddonContext::GetThreads),
                 InstanceMethod("setThreads", &AddonContext::SetThreads),
                 InstanceMethod("printTimings", &AddonContext::PrintTimings),
                 InstanceMethod("ensureDraftContextIsCompatibleForSpeculative", &AddonContext::EnsureDraftContextIsCompatibleForSpeculative),
                 InstanceMethod("saveSequenceStateToFile", &AddonContext::SaveSequenceStateToFile),
                 InstanceMethod("loadSequenceStateFromFile", &AddonContext::LoadSequenceStateFromFile),
+                InstanceMethod("readSequenceStateFile", &AddonContext::ReadSequenceStateFile),
+                InstanceMethod("exportSequenceState", &AddonContext::ExportSequenceState),
+                InstanceMethod("importSequenceState", &AddonContext::ImportSequenceState),
+                InstanceMethod("transferSequenceState", &AddonContext::TransferSequenceState),
                 InstanceMethod("setLoras", &AddonContext::SetLoras),
                 InstanceMethod("restoreCheckpoint", &AddonContext::RestoreCheckpoint),
                 InstanceMethod("dispose", &AddonContext::Dispose),
@@ -1184,15 +3450,36 @@ class AddonContextSequenceCheckpointInitWorker : public Napi::AsyncWorker {
 
     protected:
         Napi::Promise::Deferred deferred;
+        bool usedDelta = false;
 
         void Execute() {
             try {
+                if (!context->ensureSequenceResident(checkpoint->sequenceId)) {
+                    SetError("Failed to swap the preempted sequence back into the context");
+                    return;
+                }
+
                 checkpoint->minPos = llama_memory_seq_pos_min(llama_get_memory(context->ctx), checkpoint->sequenceId);
                 checkpoint->maxPos = llama_memory_seq_pos_max(llama_get_memory(context->ctx), checkpoint->sequenceId);
                 const size_t checkpointSize = llama_state_seq_get_size_ext(context->ctx, checkpoint->sequenceId, LLAMA_STATE_SEQ_FLAGS_PARTIAL_ONLY);
 
                 checkpoint->data.resize(checkpointSize, 0);
                 llama_state_seq_get_data_ext(context->ctx, checkpoint->data.data(), checkpointSize, checkpoint->sequenceId, LLAMA_STATE_SEQ_FLAGS_PARTIAL_ONLY);
+                checkpoint->rawSize = checkpointSize;
+                checkpoint->compressed = false;
+
+                if (checkpoint->parent != nullptr) {
+                    usedDelta = createDeltaCheckpointData();
+                }
+
+                checkpoint->uncompressedSize = checkpoint->data.size();
+
+                // a delta is already compressed
+                if (checkpoint->compressionLevel > 0 && !usedDelta) {
+                    compressCheckpointData();
+                }
+
+                checkpoint->dataSize = checkpoint->data.size();
             } catch (const std::exception& e) {
                 SetError(e.what());
             } catch(...) {
@@ -1200,8 +3487,144 @@ class AddonContextSequenceCheckpointInitWorker : public Napi::AsyncWorker {
             }
         }
         void OnOK() {
+            if (usedDelta) {
+                checkpoint->isDelta = true;
+            } else {
+                checkpoint->releaseParent();
+            }
+
             deferred.Resolve(Env().Undefined());
         }
+        void OnError(const Napi::Error& err) {
+            checkpoint->releaseParent();
+            deferred.Reject(err.Value());
+        }
+
+        bool createDeltaCheckpointData() {
+            std::vector<uint8_t> parentRawData;
+            if (!checkpoint->parent->readRawData(parentRawData)) {
+                return false;
+            }
+
+            std::vector<uint8_t> delta;
+            if (!addonCreateDelta(checkpoint->data.data(), checkpoint->data.size(), parentRawData.data(), parentRawData.size(), delta) ||
+                static_cast<double>(delta.size()) > static_cast<double>(checkpoint->data.size()) * checkpointDeltaMaxRatio
+            ) {
+                return false;
+            }
+
+            delta.shrink_to_fit();
+            checkpoint->data = std::move(delta);
+            return true;
+        }
+
+        void compressCheckpointData() {
+            const std::size_t rawSize = checkpoint->data.size();
+
+            // compressing a sample first avoids spending time on compressing data that barely compresses
+            const std::size_t sampleSize = std::min(rawSize, checkpointCompressionSampleSize);
+            if (sampleSize < rawSize) {
+                std::vector<uint8_t> compressedSample;
+                if (!addonCompress(checkpoint->data.data(), sampleSize, checkpoint->compressionLevel, compressedSample) ||
+                    static_cast<double>(compressedSample.size()) > static_cast<double>(sampleSize) * checkpointCompressionMinRatio
+                ) {
+                    return;
+                }
+            }
+
+            std::vector<uint8_t> compressedData;
+            if (!addonCompress(checkpoint->data.data(), rawSize, checkpoint->compressionLevel, compressedData) ||
+                static_cast<double>(compressedData.size()) > static_cast<double>(rawSize) * checkpointCompressionMinRatio
+            ) {
+                return;
+            }
+
+            compressedData.shrink_to_fit();
+            checkpoint->data = std::move(compressedData);
+            checkpoint->compressed = true;
+        }
+};
+
+class AddonContextSequenceCheckpointSpillWorker : public Napi::AsyncWorker {
+    public:
+        AddonContextSequenceCheckpoint* checkpoint;
+        std::string filePath;
+
+        AddonContextSequenceCheckpointSpillWorker(const Napi::CallbackInfo& info, AddonContextSequenceCheckpoint* checkpoint)
+            : Napi::AsyncWorker(info.Env(), "AddonContextSequenceCheckpointSpillWorker"),
+              checkpoint(checkpoint),
+              deferred(Napi::Promise::Deferred::New(info.Env())) {
+            checkpoint->Ref();
+
+            filePath = info[0].As<Napi::String>().Utf8Value();
+        }
+        ~AddonContextSequenceCheckpointSpillWorker() {
+            checkpoint->Unref();
+        }
+
+        Napi::Promise GetPromise() {
+            return deferred.Promise();
+        }
+
+    protected:
+        Napi::Promise::Deferred deferred;
+        bool spilled = false;
+
+        void Execute() {
+            try {
+                const uint8_t* spillData = nullptr;
+                std::size_t spillDataSize = 0;
+                {
+                    std::lock_guard<std::mutex> lock(checkpoint->dataMutex);
+
+                    if (checkpoint->disposed || checkpoint->spilling || !checkpoint->spillFilePath.empty() || checkpoint->data.empty()) {
+                        return;
+                    }
+
+                    // the file is written without holding the lock, so restoring the checkpoint isn't blocked on the disk.
+                    // `data` is left in place for readers while it's written, and only released afterward
+                    checkpoint->spilling = true;
+                    spillData = checkpoint->data.data();
+                    spillDataSize = checkpoint->data.size();
+                }
+
+                const uint32_t checksum = addonCrc32(spillData, spillDataSize);
+                const bool written = addonWriteFile(filePath, spillData, spillDataSize);
+
+                std::lock_guard<std::mutex> lock(checkpoint->dataMutex);
+                checkpoint->spilling = false;
+
+                if (!written || checkpoint->disposed) {
+                    addonRemoveFile(filePath);
+
+                    if (checkpoint->disposed && checkpoint->dataSize == 0) {
+                        // the data was released while it was written
+                        checkpoint->data.clear();
+                        checkpoint->data.shrink_to_fit();
+                    }
+
+                    if (!written) {
+                        SetError("Failed to write the checkpoint spill file");
+                    }
+
+                    return;
+                }
+
+                checkpoint->spillFilePath = filePath;
+                checkpoint->spillFileChecksum = checksum;
+                checkpoint->spilled = true;
+                checkpoint->data.clear();
+                checkpoint->data.shrink_to_fit();
+                spilled = true;
+            } catch (const std::exception& e) {
+                SetError(e.what());
+            } catch(...) {
+                SetError("Unknown error when spilling a checkpoint to a file");
+            }
+        }
+        void OnOK() {
+            deferred.Resolve(Napi::Boolean::New(Env(), spilled));
+        }
         void OnError(const Napi::Error& err) {
             deferred.Reject(err.Value());
         }
@@ -1211,24 +3634,185 @@ Napi::Value AddonContextSequenceCheckpoint::Init(const Napi::CallbackInfo& info)
     AddonContext * context = Napi::ObjectWrap<AddonContext>::Unwrap(info[0].As<Napi::Object>());
     sequenceId = info[1].As<Napi::Number>().Int32Value();
 
+    compressionLevel = 0;
+    if (info.Length() > 2 && info[2].IsNumber()) {
+        compressionLevel = std::clamp(info[2].As<Napi::Number>().Int32Value(), 0, addonMaxCompressionLevel);
+    }
+
+    if (info.Length() > 3 && info[3].IsObject()) {
+        AddonContextSequenceCheckpoint* parentCheckpoint = Napi::ObjectWrap<AddonContextSequenceCheckpoint>::Unwrap(info[3].As<Napi::Object>());
+
+        std::lock_guard<std::mutex> lock(parentCheckpoint->dataMutex);
+        if (!parentCheckpoint->disposed && parentCheckpoint->sequenceId == sequenceId) {
+            parent = parentCheckpoint;
+            parent->dependents++;
+            parent->Ref();
+        }
+    }
+
     AddonContextSequenceCheckpointInitWorker* worker = new AddonContextSequenceCheckpointInitWorker(info, this, context);
     worker->Queue();
     return worker->GetPromise();
 }
 
+Napi::Value AddonContextSequenceCheckpoint::SpillToFile(const Napi::CallbackInfo& info) {
+    AddonContextSequenceCheckpointSpillWorker* worker = new AddonContextSequenceCheckpointSpillWorker(info, this);
+    worker->Queue();
+    return worker->GetPromise();
+}
+
 Napi::Value AddonContextSequenceCheckpoint::Dispose(const Napi::CallbackInfo& info) {
     dispose();
     return info.Env().Undefined();
 }
 
 void AddonContextSequenceCheckpoint::dispose() {
+    bool released = false;
+    {
+        std::lock_guard<std::mutex> lock(dataMutex);
+        disposed = true;
+
+        // the data of a checkpoint (and its parent chain) is kept until the delta checkpoints that depend on it are disposed
+        if (dependents == 0) {
+            releaseData();
+            released = true;
+        }
+    }
+
+    if (released) {
+        releaseParent();
+    }
+}
+
+void AddonContextSequenceCheckpoint::releaseData() {
+    // a spill worker that's writing `data` releases it when it's done
+    if (!spilling) {
+        data.clear();
+        data.shrink_to_fit();
+    }
+
+    dataSize = 0;
+    rawSize = 0;
+    compressed = false;
+
+    if (!spillFilePath.empty()) {
+        addonRemoveFile(spillFilePath);
+        spillFilePath.clear();
+        spilled = false;
+    }
+}
+
+void AddonContextSequenceCheckpoint::releaseParent() {
+    AddonContextSequenceCheckpoint* parentCheckpoint = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(dataMutex);
+        parentCheckpoint = parent;
+        parent = nullptr;
+    }
+
+    if (parentCheckpoint == nullptr) {
+        return;
+    }
+
+    bool parentReleased = false;
+    {
+        std::lock_guard<std::mutex> lock(parentCheckpoint->dataMutex);
+        parentCheckpoint->dependents--;
+
+        if (parentCheckpoint->disposed && parentCheckpoint->dependents == 0) {
+            parentCheckpoint->releaseData();
+            parentReleased = true;
+        }
+    }
+
+    if (parentReleased) {
+        parentCheckpoint->releaseParent();
+    }
+
+    parentCheckpoint->Unref();
+}
+
+bool AddonContextSequenceCheckpoint::getStoredData(AddonMappedFile& spillFile, const uint8_t*& storedData, std::size_t& storedSize) {
+    if (spillFilePath.empty()) {
+        storedData = data.data();
+        storedSize = data.size();
+        return true;
+    }
+
+    // a torn or modified spill file is detected before its content is restored
+    if (!spillFile.open(spillFilePath) || spillFile.size() != dataSize || addonCrc32(spillFile.data(), spillFile.size()) != spillFileChecksum) {
+        return false;
+    }
+
+    storedData = spillFile.data();
+    storedSize = spillFile.size();
+    return true;
+}
+
+bool AddonContextSequenceCheckpoint::resolveRawData(const uint8_t* storedData, std::size_t storedSize, std::vector<uint8_t>& output) {
+    std::vector<uint8_t> decompressedData;
+    if (compressed) {
+        decompressedData.resize(uncompressedSize);
+
+        if (!addonDecompress(storedData, storedSize, decompressedData.data(), uncompressedSize)) {
+            return false;
+        }
+
+        storedData = decompressedData.data();
+        storedSize = decompressedData.size();
+    }
+
+    if (parent == nullptr) {
+        if (compressed) {
+            output = std::move(decompressedData);
+        } else {
+            output.assign(storedData, storedData + storedSize);
+        }
+
+        return true;
+    }
+
+    // the parent chain of a delta checkpoint is resolved recursively
+    std::vector<uint8_t> parentRawData;
+    if (!parent->readRawData(parentRawData)) {
+        return false;
+    }
+
+    output.resize(rawSize);
+    return addonApplyDelta(storedData, storedSize, parentRawData.data(), parentRawData.size(), output.data(), output.size());
+}
+
+bool AddonContextSequenceCheckpoint::readRawData(std::vector<uint8_t>& output) {
     std::lock_guard<std::mutex> lock(dataMutex);
-    data.clear();
-    data.resize(0);
+
+    AddonMappedFile spillFile;
+    const uint8_t* storedData = nullptr;
+    std::size_t storedSize = 0;
+    if (!getStoredData(spillFile, storedData, storedSize)) {
+        return false;
+    }
+
+    return resolveRawData(storedData, storedSize, output);
 }
 
 Napi::Value AddonContextSequenceCheckpoint::GetSize(const Napi::CallbackInfo& info) {
-    return Napi::Number::New(info.Env(), data.size());
+    return Napi::Number::New(info.Env(), dataSize);
+}
+
+Napi::Value AddonContextSequenceCheckpoint::GetRawSize(const Napi::CallbackInfo& info) {
+    return Napi::Number::New(info.Env(), rawSize);
+}
+
+Napi::Value AddonContextSequenceCheckpoint::GetCompressed(const Napi::CallbackInfo& info) {
+    return Napi::Boolean::New(info.Env(), compressed);
+}
+
+Napi::Value AddonContextSequenceCheckpoint::GetSpilled(const Napi::CallbackInfo& info) {
+    return Napi::Boolean::New(info.Env(), spilled.load());
+}
+
+Napi::Value AddonContextSequenceCheckpoint::GetIsDelta(const Napi::CallbackInfo& info) {
+    return Napi::Boolean::New(info.Env(), isDelta);
 }
 
 Napi::Value AddonContextSequenceCheckpoint::GetMinPos(const Napi::CallbackInfo& info) {
@@ -1247,9 +3831,14 @@ void AddonContextSequenceCheckpoint::init(Napi::Object exports) {
             "AddonContextSequenceCheckpoint",
             {
                 InstanceMethod("init", &AddonContextSequenceCheckpoint::Init),
+                InstanceMethod("spillToFile", &AddonContextSequenceCheckpoint::SpillToFile),
                 InstanceMethod("dispose", &AddonContextSequenceCheckpoint::Dispose),
 
                 InstanceAccessor("size", &AddonContextSequenceCheckpoint::GetSize, nullptr),
+                InstanceAccessor("rawSize", &AddonContextSequenceCheckpoint::GetRawSize, nullptr),
+                InstanceAccessor("compressed", &AddonContextSequenceCheckpoint::GetCompressed, nullptr),
+                InstanceAccessor("spilled", &AddonContextSequenceCheckpoint::GetSpilled, nullptr),
+                InstanceAccessor("isDelta", &AddonContextSequenceCheckpoint::GetIsDelta, nullptr),
                 InstanceAccessor("minPos", &AddonContextSequenceCheckpoint::GetMinPos, nullptr),
                 InstanceAccessor("maxPos", &AddonContextSequenceCheckpoint::GetMaxPos, nullptr),
             }
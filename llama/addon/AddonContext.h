@@ -1,11 +1,44 @@
 #pragma once
 
+#include <atomic>
+#include <memory>
 #include <mutex>
+#include <string>
+#include <unordered_map>
 
 #include "llama.h"
 #include "napi.h"
 #include "addonGlobals.h"
 #include "AddonSampler.h"
+#include "AddonPrefixCache.h"
+#include "AddonMappedFile.h"
+#include "AddonLoadReport.h"
+
+struct AddonContextPendingPrefixCacheTokens {
+    llama_seq_id sequenceId;
+    llama_pos startPos;
+    std::vector<llama_token> tokens;
+    uint64_t loraAdaptersKey;
+};
+
+struct AddonContextPendingCellOperation {
+    bool shift; // `false` to remove the cells
+    llama_pos startPos;
+    llama_pos endPos;
+    llama_pos shiftDelta;
+};
+
+struct AddonContextSwappedSequence {
+    std::vector<uint8_t> state;
+    std::vector<llama_token> prefixCacheTokens; // added back to the prefix cache when the sequence is swapped in
+    uint64_t prefixCacheLoraAdaptersKey = 0;
+    llama_pos minPos = -1;
+    llama_pos maxPos = -1;
+
+    // changes to the cells of the sequence that were requested while it was swapped out,
+    // applied after it's swapped in, so they don't have to swap it in on the main thread
+    std::vector<AddonContextPendingCellOperation> pendingCellOperations;
+};
 
 class AddonContext : public Napi::ObjectWrap<AddonContext> {
     public:
@@ -16,10 +49,36 @@ class AddonContext : public Napi::ObjectWrap<AddonContext> {
         uint64_t batchMemorySize = 0;
         bool has_batch = false;
         int32_t batch_n_tokens = 0;
+        bool batch_decoded = false; // whether the context outputs belong to the current `batch`
+
+        // `nullptr` when the prefix cache is disabled
+        std::unique_ptr<AddonPrefixCache> prefixCache;
+        std::vector<AddonContextPendingPrefixCacheTokens> pendingPrefixCacheTokens; // added to the prefix cache after the batch is decoded
+        std::mutex pendingSequenceEvictionsMutex;
+        std::vector<llama_seq_id> pendingSequenceEvictions; // removed from the KV cache before the next decode
+        uint64_t loraAdaptersKey = 0; // identifies the LoRA adapters that are currently set on the context
         int n_cur = 0;
 
+        // when enabled, all the sequences share the cells of the KV cache,
+        // and sequences are swapped out to the host memory when there are no free cells left for a batch
+        bool preemptionEnabled = false;
+        std::mutex preemptionMutex;
+        std::unordered_map<llama_seq_id, AddonContextSwappedSequence> swappedSequences;
+        std::unordered_map<llama_seq_id, int32_t> sequencePreemptionPriorities;
+        std::unordered_map<llama_seq_id, uint64_t> sequenceLastDecodes;
+        uint64_t decodeCounter = 0;
+        std::atomic<uint64_t> preemptions = 0;
+        std::atomic<uint64_t> droppedSequences = 0;
+        std::atomic<uint64_t> swapIns = 0;
+        std::atomic<uint64_t> swappedSequencesCount = 0;
+        std::atomic<uint64_t> swappedBytes = 0;
+
         uint64_t loadedContextMemorySize = 0;
+        uint64_t kvCacheKeyBytesPerCell = 0;
+        uint64_t kvCacheValueBytesPerCell = 0;
+        bool kvCacheBytesPerCellResolved = false;
         bool contextLoaded = false;
+        AddonLoadReport loadReport;
         std::mutex disposeMutex;
 
         bool disposed = false;
@@ -32,6 +91,19 @@ class AddonContext : public Napi::ObjectWrap<AddonContext> {
         void disposeMT();
         void disposeBatchMemory();
         void disposeBatchMT();
+        void applyPendingSequenceEvictions();
+
+        // should be called while holding `preemptionMutex`
+        bool swapOutSequence(const std::vector<llama_seq_id>& protectedSequenceIds);
+        bool swapInSequence(llama_seq_id sequenceId, const std::vector<llama_seq_id>& protectedSequenceIds);
+        std::size_t setSequenceStateData(
+            llama_seq_id sequenceId, const uint8_t* data, std::size_t size, const std::vector<llama_seq_id>& protectedSequenceIds
+        );
+        bool deferSwappedSequenceCellOperation(llama_seq_id sequenceId, const AddonContextPendingCellOperation& operation);
+
+        bool ensureSequenceResident(llama_seq_id sequenceId);
+        void discardSwappedSequence(llama_seq_id sequenceId);
+        std::size_t loadSequenceStateData(llama_seq_id sequenceId, const uint8_t* data, std::size_t size);
 
         Napi::Value Init(const Napi::CallbackInfo& info);
         Napi::Value Dispose(const Napi::CallbackInfo& info);
@@ -45,17 +117,33 @@ class AddonContext : public Napi::ObjectWrap<AddonContext> {
         Napi::Value ShiftSequenceTokenCells(const Napi::CallbackInfo& info);
         Napi::Value GetSequenceKvCacheMinPosition(const Napi::CallbackInfo& info);
         Napi::Value GetSequenceKvCacheMaxPosition(const Napi::CallbackInfo& info);
+        Napi::Value ReuseSequencePrefix(const Napi::CallbackInfo& info);
+        Napi::Value TakeLeastRecentlyUsedPrefixCacheSequence(const Napi::CallbackInfo& info);
+        Napi::Value GetPrefixCacheStats(const Napi::CallbackInfo& info);
+        Napi::Value GetStateFingerprint(const Napi::CallbackInfo& info);
+        Napi::Value SetSequencePreemptionPriority(const Napi::CallbackInfo& info);
+        Napi::Value GetPreemptionStats(const Napi::CallbackInfo& info);
         Napi::Value DecodeBatch(const Napi::CallbackInfo& info);
+        Napi::Value Warmup(const Napi::CallbackInfo& info);
         Napi::Value SampleToken(const Napi::CallbackInfo& info);
 
         Napi::Value GetEmbedding(const Napi::CallbackInfo& info);
+        Napi::Value EvaluateEmbeddings(const Napi::CallbackInfo& info);
+        Napi::Value GetTokenEmbeddings(const Napi::CallbackInfo& info);
+        Napi::Value RankBatch(const Napi::CallbackInfo& info);
         Napi::Value GetStateSize(const Napi::CallbackInfo& info);
         Napi::Value GetMemoryBreakdown(const Napi::CallbackInfo& info);
+        Napi::Value GetLoadReport(const Napi::CallbackInfo& info);
+        Napi::Value GetKvCacheStats(const Napi::CallbackInfo& info);
         Napi::Value GetThreads(const Napi::CallbackInfo& info);
         Napi::Value SetThreads(const Napi::CallbackInfo& info);
 
         Napi::Value SaveSequenceStateToFile(const Napi::CallbackInfo& info);
         Napi::Value LoadSequenceStateFromFile(const Napi::CallbackInfo& info);
+        Napi::Value ReadSequenceStateFile(const Napi::CallbackInfo& info);
+        Napi::Value ExportSequenceState(const Napi::CallbackInfo& info);
+        Napi::Value ImportSequenceState(const Napi::CallbackInfo& info);
+        Napi::Value TransferSequenceState(const Napi::CallbackInfo& info);
 
         Napi::Value PrintTimings(const Napi::CallbackInfo& info);
         Napi::Value EnsureDraftContextIsCompatibleForSpeculative(const Napi::CallbackInfo& info);
@@ -70,6 +158,19 @@ class AddonContextSequenceCheckpoint : public Napi::ObjectWrap<AddonContextSeque
     public:
         std::mutex dataMutex;
         std::vector<uint8_t> data;
+        std::size_t dataSize = 0; // the size of the stored data, either in memory or in the spill file
+        std::size_t rawSize = 0; // the size of the state data before compression
+        std::size_t uncompressedSize = 0; // the size of the stored data before compression, which is a delta for delta checkpoints
+        bool compressed = false;
+        int compressionLevel = 0;
+        std::string spillFilePath; // when set, the data is stored in this file instead of in `data`
+        uint32_t spillFileChecksum = 0;
+        std::atomic<bool> spilled = false;
+        bool spilling = false; // `data` is being written to a spill file without holding `dataMutex`, so it must not be modified
+        bool disposed = false;
+        AddonContextSequenceCheckpoint* parent = nullptr; // when set, the data is a delta of the state of this checkpoint
+        bool isDelta = false;
+        std::size_t dependents = 0; // the number of delta checkpoints that use this checkpoint as their parent
         llama_seq_id sequenceId = 0;
         std::size_t minPos = 0;
         std::size_t maxPos = 0;
@@ -78,13 +179,29 @@ class AddonContextSequenceCheckpoint : public Napi::ObjectWrap<AddonContextSeque
         ~AddonContextSequenceCheckpoint();
 
         Napi::Value Init(const Napi::CallbackInfo& info);
+        Napi::Value SpillToFile(const Napi::CallbackInfo& info);
         Napi::Value Dispose(const Napi::CallbackInfo& info);
 
         void dispose();
+        void releaseData();
+        void releaseParent();
+
+        // should be called while holding `dataMutex`
+        bool getStoredData(AddonMappedFile& spillFile, const uint8_t*& storedData, std::size_t& storedSize);
+        bool resolveRawData(const uint8_t* storedData, std::size_t storedSize, std::vector<uint8_t>& output);
+
+        bool readRawData(std::vector<uint8_t>& output);
 
         Napi::Value GetSize(const Napi::CallbackInfo& info);
+        Napi::Value GetRawSize(const Napi::CallbackInfo& info);
+        Napi::Value GetCompressed(const Napi::CallbackInfo& info);
+        Napi::Value GetSpilled(const Napi::CallbackInfo& info);
+        Napi::Value GetIsDelta(const Napi::CallbackInfo& info);
         Napi::Value GetMinPos(const Napi::CallbackInfo& info);
         Napi::Value GetMaxPos(const Napi::CallbackInfo& info);
 
         static void init(Napi::Object exports);
 };
+
+// estimate the memory of contexts with many configurations of a model in one call, using a model that was loaded with `no_alloc`
+Napi::Value addonEstimateContextResourceGrid(const Napi::CallbackInfo& info);
@@ -0,0 +1,562 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "AddonGgufHeader.h"
+#include "AddonMappedFile.h"
+
+// source: `enum gguf_type` in `gguf.h`
+enum class AddonGgufValueType : uint32_t {
+    uint8 = 0,
+    int8 = 1,
+    uint16 = 2,
+    int16 = 3,
+    uint32 = 4,
+    int32 = 5,
+    float32 = 6,
+    boolean = 7,
+    string = 8,
+    array = 9,
+    uint64 = 10,
+    int64 = 11,
+    float64 = 12
+};
+
+static constexpr char ggufMagic[] = {'G', 'G', 'U', 'F'};
+static constexpr uint32_t ggufDefaultAlignment = 32;
+static constexpr const char* ggufAlignmentKey = "general.alignment";
+
+struct AddonGgufArray {
+    AddonGgufValueType type = AddonGgufValueType::uint8;
+    uint64_t length = 0;
+
+    // the little-endian elements of a numeric array, or the concatenated bytes of the items of a string array
+    std::vector<uint8_t> data;
+
+    // the start of each item of a string array in `data`, followed by the end of the last item
+    std::vector<uint32_t> stringOffsets;
+
+    // the items of an array of arrays
+    std::vector<AddonGgufArray> arrays;
+
+    // a lazy array only records where its items are in the file, so they can be decoded later when they're accessed
+    bool lazy = false;
+    uint64_t offset = 0;
+    uint64_t byteLength = 0;
+};
+
+struct AddonGgufKeyValue {
+    std::string key;
+    AddonGgufValueType type = AddonGgufValueType::uint8;
+
+    // the bits of a numeric or a boolean value
+    uint64_t scalar = 0;
+    std::string stringValue;
+    AddonGgufArray array;
+};
+
+struct AddonGgufFileHeader {
+    std::string error;
+
+    uint32_t version = 0;
+    uint64_t tensorCount = 0;
+    uint64_t metadataSize = 0;
+    std::vector<AddonGgufKeyValue> keyValues;
+
+    bool hasTensorInfo = false;
+    uint64_t tensorInfoSize = 0;
+    uint64_t infoEndOffset = 0;
+    std::vector<std::string> tensorNames;
+    std::vector<uint32_t> tensorDimensionCounts;
+    std::vector<uint64_t> tensorDimensions;
+    std::vector<uint32_t> tensorTypes;
+    std::vector<uint64_t> tensorOffsets;
+};
+
+static std::size_t getGgufValueTypeSize(AddonGgufValueType type) {
+    switch (type) {
+        case AddonGgufValueType::uint8:
+        case AddonGgufValueType::int8:
+        case AddonGgufValueType::boolean:
+            return 1;
+        case AddonGgufValueType::uint16:
+        case AddonGgufValueType::int16:
+            return 2;
+        case AddonGgufValueType::uint32:
+        case AddonGgufValueType::int32:
+        case AddonGgufValueType::float32:
+            return 4;
+        case AddonGgufValueType::uint64:
+        case AddonGgufValueType::int64:
+        case AddonGgufValueType::float64:
+            return 8;
+        default:
+            return 0;
+    }
+}
+
+// GGUF files are little-endian, and the values are copied as-is, so this reader only supports little-endian hosts
+class AddonGgufReader {
+    public:
+        AddonGgufReader(const uint8_t* data, std::size_t size) : data(data), size(size) {
+        }
+
+        std::size_t offset = 0;
+
+        const uint8_t* read(std::size_t length) {
+            if (length > size - offset) {
+                throw std::runtime_error("The GGUF file is truncated");
+            }
+
+            const uint8_t* res = data + offset;
+            offset += length;
+            return res;
+        }
+
+        template <typename T>
+        T readValue() {
+            T value;
+            std::memcpy(&value, read(sizeof(T)), sizeof(T));
+            return value;
+        }
+
+        std::string readString() {
+            const uint64_t length = readValue<uint64_t>();
+            const uint8_t* stringData = read(checkedLength(length, 1));
+            return std::string(reinterpret_cast<const char*>(stringData), static_cast<std::size_t>(length));
+        }
+
+        std::size_t checkedLength(uint64_t count, std::size_t itemSize) const {
+            if (itemSize != 0 && count > (size - offset) / itemSize) {
+                throw std::runtime_error("The GGUF file is truncated");
+            }
+
+            return static_cast<std::size_t>(count * itemSize);
+        }
+
+    private:
+        const uint8_t* data;
+        std::size_t size;
+};
+
+static void readGgufArray(AddonGgufReader& reader, AddonGgufArray& array, bool keep, uint64_t lazyMinLength = 0) {
+    array.type = static_cast<AddonGgufValueType>(reader.readValue<uint32_t>());
+    array.length = reader.readValue<uint64_t>();
+
+    if (keep && lazyMinLength != 0 && array.length >= lazyMinLength && array.type != AddonGgufValueType::array) {
+        array.lazy = true;
+        array.offset = reader.offset;
+        keep = false;
+    }
+
+    if (array.type == AddonGgufValueType::string) {
+        // every item has at least its 8 bytes length
+        reader.checkedLength(array.length, sizeof(uint64_t));
+
+        if (keep) {
+            array.stringOffsets.reserve(static_cast<std::size_t>(array.length) + 1);
+        }
+
+        for (uint64_t i = 0; i < array.length; i++) {
+            const uint64_t itemLength = reader.readValue<uint64_t>();
+            const uint8_t* itemData = reader.read(reader.checkedLength(itemLength, 1));
+
+            if (keep) {
+                if (array.data.size() + itemLength > UINT32_MAX) {
+                    throw std::runtime_error("A GGUF string array is too large");
+                }
+
+                array.stringOffsets.push_back(static_cast<uint32_t>(array.data.size()));
+                array.data.insert(array.data.end(), itemData, itemData + itemLength);
+            }
+        }
+
+        if (keep) {
+            array.stringOffsets.push_back(static_cast<uint32_t>(array.data.size()));
+        }
+    } else if (array.type == AddonGgufValueType::array) {
+        // every item has at least its 12 bytes type and length
+        reader.checkedLength(array.length, sizeof(uint32_t) + sizeof(uint64_t));
+
+        if (keep) {
+            array.arrays.resize(static_cast<std::size_t>(array.length));
+        }
+
+        AddonGgufArray skippedArray;
+        for (uint64_t i = 0; i < array.length; i++) {
+            readGgufArray(reader, keep ? array.arrays[static_cast<std::size_t>(i)] : skippedArray, keep);
+        }
+    } else {
+        const std::size_t itemSize = getGgufValueTypeSize(array.type);
+        if (itemSize == 0) {
+            throw std::runtime_error("Unsupported GGUF array type: " + std::to_string(static_cast<uint32_t>(array.type)));
+        }
+
+        const uint8_t* arrayData = reader.read(reader.checkedLength(array.length, itemSize));
+        if (keep) {
+            array.data.assign(arrayData, arrayData + static_cast<std::size_t>(array.length) * itemSize);
+        }
+    }
+
+    if (array.lazy) {
+        array.byteLength = reader.offset - array.offset;
+    }
+}
+
+static void readGgufFileHeader(
+    const std::string& filePath,
+    bool readTensorInfo,
+    const std::unordered_set<std::string>& ignoreKeys,
+    uint64_t lazyArrayMinLength,
+    AddonGgufFileHeader& header
+) {
+    AddonMappedFile file;
+    if (!file.open(filePath)) {
+        throw std::runtime_error("Failed to open the GGUF file: " + filePath);
+    }
+
+    AddonGgufReader reader(file.data(), file.size());
+    if (std::memcmp(reader.read(sizeof(ggufMagic)), ggufMagic, sizeof(ggufMagic)) != 0) {
+        throw std::runtime_error("Invalid GGUF magic");
+    }
+
+    header.version = reader.readValue<uint32_t>();
+    header.tensorCount = reader.readValue<uint64_t>();
+    const uint64_t keyValueCount = reader.readValue<uint64_t>();
+
+    uint32_t alignment = ggufDefaultAlignment;
+    for (uint64_t i = 0; i < keyValueCount; i++) {
+        std::string key = reader.readString();
+        const auto type = static_cast<AddonGgufValueType>(reader.readValue<uint32_t>());
+        const bool keep = ignoreKeys.find(key) == ignoreKeys.end();
+
+        AddonGgufKeyValue keyValue;
+        keyValue.type = type;
+
+        if (type == AddonGgufValueType::string) {
+            keyValue.stringValue = reader.readString();
+        } else if (type == AddonGgufValueType::array) {
+            readGgufArray(reader, keyValue.array, keep, lazyArrayMinLength);
+        } else {
+            const std::size_t valueSize = getGgufValueTypeSize(type);
+            if (valueSize == 0) {
+                throw std::runtime_error("Unsupported GGUF value type: " + std::to_string(static_cast<uint32_t>(type)));
+            }
+
+            std::memcpy(&keyValue.scalar, reader.read(valueSize), valueSize);
+
+            if (key == ggufAlignmentKey && (type == AddonGgufValueType::uint32 || type == AddonGgufValueType::int32) &&
+                keyValue.scalar != 0
+            ) {
+                alignment = static_cast<uint32_t>(keyValue.scalar);
+            }
+        }
+
+        if (keep) {
+            keyValue.key = std::move(key);
+            header.keyValues.push_back(std::move(keyValue));
+        }
+    }
+
+    header.metadataSize = reader.offset;
+
+    if (!readTensorInfo) {
+        return;
+    }
+
+    // every tensor info has at least 24 bytes of name length, dimension count, type and offset
+    const std::size_t tensorCount = reader.checkedLength(header.tensorCount, 24) / 24;
+    header.tensorNames.reserve(tensorCount);
+    header.tensorDimensionCounts.reserve(tensorCount);
+    header.tensorDimensions.reserve(tensorCount * 4);
+    header.tensorTypes.reserve(tensorCount);
+    header.tensorOffsets.reserve(tensorCount);
+
+    for (std::size_t i = 0; i < tensorCount; i++) {
+        header.tensorNames.push_back(reader.readString());
+
+        const uint32_t dimensionCount = reader.readValue<uint32_t>();
+        reader.checkedLength(dimensionCount, sizeof(uint64_t));
+        header.tensorDimensionCounts.push_back(dimensionCount);
+        for (uint32_t d = 0; d < dimensionCount; d++) {
+            header.tensorDimensions.push_back(reader.readValue<uint64_t>());
+        }
+
+        header.tensorTypes.push_back(reader.readValue<uint32_t>());
+        header.tensorOffsets.push_back(reader.readValue<uint64_t>());
+    }
+
+    header.hasTensorInfo = true;
+    header.tensorInfoSize = reader.offset - header.metadataSize;
+    header.infoEndOffset = reader.offset + (alignment - (reader.offset % alignment)) % alignment;
+}
+
+template <typename T>
+static Napi::TypedArrayOf<T> createTypedArray(const Napi::Env& env, const uint8_t* data, std::size_t length) {
+    Napi::TypedArrayOf<T> res = Napi::TypedArrayOf<T>::New(env, length);
+    if (length > 0) {
+        std::memcpy(res.Data(), data, length * sizeof(T));
+    }
+
+    return res;
+}
+
+static Napi::Value createBigInt(const Napi::Env& env, uint64_t value, bool isSigned) {
+    if (isSigned) {
+        return Napi::BigInt::New(env, static_cast<int64_t>(value));
+    }
+
+    return Napi::BigInt::New(env, value);
+}
+
+static Napi::Value createGgufArrayValue(const Napi::Env& env, const AddonGgufArray& array) {
+    Napi::Object res = Napi::Object::New(env);
+    res.Set("type", Napi::Number::New(env, static_cast<uint32_t>(array.type)));
+
+    if (array.lazy) {
+        res.Set("length", Napi::Number::New(env, static_cast<double>(array.length)));
+        res.Set("offset", Napi::Number::New(env, static_cast<double>(array.offset)));
+        res.Set("byteLength", Napi::Number::New(env, static_cast<double>(array.byteLength)));
+        return res;
+    }
+
+    const std::size_t length = static_cast<std::size_t>(array.length);
+    const uint8_t* data = array.data.data();
+
+    switch (array.type) {
+        case AddonGgufValueType::uint8:
+        case AddonGgufValueType::boolean:
+            res.Set("values", createTypedArray<uint8_t>(env, data, length));
+            break;
+        case AddonGgufValueType::int8: res.Set("values", createTypedArray<int8_t>(env, data, length)); break;
+        case AddonGgufValueType::uint16: res.Set("values", createTypedArray<uint16_t>(env, data, length)); break;
+        case AddonGgufValueType::int16: res.Set("values", createTypedArray<int16_t>(env, data, length)); break;
+        case AddonGgufValueType::uint32: res.Set("values", createTypedArray<uint32_t>(env, data, length)); break;
+        case AddonGgufValueType::int32: res.Set("values", createTypedArray<int32_t>(env, data, length)); break;
+        case AddonGgufValueType::float32: res.Set("values", createTypedArray<float>(env, data, length)); break;
+        case AddonGgufValueType::uint64: res.Set("values", createTypedArray<uint64_t>(env, data, length)); break;
+        case AddonGgufValueType::int64: res.Set("values", createTypedArray<int64_t>(env, data, length)); break;
+        case AddonGgufValueType::float64: res.Set("values", createTypedArray<double>(env, data, length)); break;
+        case AddonGgufValueType::string:
+            res.Set("values", createTypedArray<uint8_t>(env, data, array.data.size()));
+            res.Set(
+                "stringOffsets",
+                createTypedArray<uint32_t>(env, reinterpret_cast<const uint8_t*>(array.stringOffsets.data()), array.stringOffsets.size())
+            );
+            break;
+        case AddonGgufValueType::array: {
+            Napi::Array items = Napi::Array::New(env, array.arrays.size());
+            for (std::size_t i = 0; i < array.arrays.size(); i++) {
+                items.Set(i, createGgufArrayValue(env, array.arrays[i]));
+            }
+            res.Set("values", items);
+            break;
+        }
+    }
+
+    return res;
+}
+
+static Napi::Value createGgufScalarValue(const Napi::Env& env, const AddonGgufKeyValue& keyValue) {
+    const uint64_t bits = keyValue.scalar;
+
+    switch (keyValue.type) {
+        case AddonGgufValueType::uint8: return Napi::Number::New(env, static_cast<uint8_t>(bits));
+        case AddonGgufValueType::int8: return Napi::Number::New(env, static_cast<int8_t>(bits));
+        case AddonGgufValueType::uint16: return Napi::Number::New(env, static_cast<uint16_t>(bits));
+        case AddonGgufValueType::int16: return Napi::Number::New(env, static_cast<int16_t>(bits));
+        case AddonGgufValueType::uint32: return Napi::Number::New(env, static_cast<uint32_t>(bits));
+        case AddonGgufValueType::int32: return Napi::Number::New(env, static_cast<int32_t>(bits));
+        case AddonGgufValueType::boolean: return Napi::Boolean::New(env, static_cast<uint8_t>(bits) == 1);
+        case AddonGgufValueType::uint64: return createBigInt(env, bits, false);
+        case AddonGgufValueType::int64: return createBigInt(env, bits, true);
+        case AddonGgufValueType::float32: {
+            float value;
+            std::memcpy(&value, &bits, sizeof(value));
+            return Napi::Number::New(env, value);
+        }
+        case AddonGgufValueType::float64: {
+            double value;
+            std::memcpy(&value, &bits, sizeof(value));
+            return Napi::Number::New(env, value);
+        }
+        case AddonGgufValueType::string: return Napi::String::New(env, keyValue.stringValue);
+        case AddonGgufValueType::array: return createGgufArrayValue(env, keyValue.array);
+    }
+
+    return env.Undefined();
+}
+
+static Napi::Object createGgufFileHeaderValue(const Napi::Env& env, const AddonGgufFileHeader& header) {
+    Napi::Object res = Napi::Object::New(env);
+
+    if (!header.error.empty()) {
+        res.Set("error", Napi::String::New(env, header.error));
+        return res;
+    }
+
+    res.Set("version", Napi::Number::New(env, header.version));
+    res.Set("tensorCount", Napi::BigInt::New(env, header.tensorCount));
+    res.Set("metadataSize", Napi::Number::New(env, static_cast<double>(header.metadataSize)));
+
+    Napi::Array keys = Napi::Array::New(env, header.keyValues.size());
+    Napi::Array values = Napi::Array::New(env, header.keyValues.size());
+    for (std::size_t i = 0; i < header.keyValues.size(); i++) {
+        keys.Set(i, Napi::String::New(env, header.keyValues[i].key));
+        values.Set(i, createGgufScalarValue(env, header.keyValues[i]));
+    }
+    res.Set("keys", keys);
+    res.Set("values", values);
+
+    if (!header.hasTensorInfo) {
+        return res;
+    }
+
+    res.Set("tensorInfoSize", Napi::Number::New(env, static_cast<double>(header.tensorInfoSize)));
+    res.Set("infoEndOffset", Napi::Number::New(env, static_cast<double>(header.infoEndOffset)));
+
+    Napi::Array tensorNames = Napi::Array::New(env, header.tensorNames.size());
+    for (std::size_t i = 0; i < header.tensorNames.size(); i++) {
+        tensorNames.Set(i, Napi::String::New(env, header.tensorNames[i]));
+    }
+    res.Set("tensorNames", tensorNames);
+    res.Set("tensorDimensionCounts", createTypedArray<uint32_t>(
+        env, reinterpret_cast<const uint8_t*>(header.tensorDimensionCounts.data()), header.tensorDimensionCounts.size()
+    ));
+    res.Set("tensorDimensions", createTypedArray<uint64_t>(
+        env, reinterpret_cast<const uint8_t*>(header.tensorDimensions.data()), header.tensorDimensions.size()
+    ));
+    res.Set("tensorTypes", createTypedArray<uint32_t>(
+        env, reinterpret_cast<const uint8_t*>(header.tensorTypes.data()), header.tensorTypes.size()
+    ));
+    res.Set("tensorOffsets", createTypedArray<uint64_t>(
+        env, reinterpret_cast<const uint8_t*>(header.tensorOffsets.data()), header.tensorOffsets.size()
+    ));
+
+    return res;
+}
+
+class AddonReadGgufFileHeadersWorker : public Napi::AsyncWorker {
+    public:
+        std::vector<std::string> filePaths;
+        bool readTensorInfo = true;
+        std::unordered_set<std::string> ignoreKeys;
+        uint64_t lazyArrayMinLength = 0;
+        std::size_t maxParallelism = 1;
+        std::vector<AddonGgufFileHeader> headers;
+
+        AddonReadGgufFileHeadersWorker(const Napi::CallbackInfo& info)
+            : Napi::AsyncWorker(info.Env(), "AddonReadGgufFileHeadersWorker"),
+              deferred(Napi::Promise::Deferred::New(info.Env())) {
+            Napi::Array filePathValues = info[0].As<Napi::Array>();
+            filePaths.reserve(filePathValues.Length());
+            for (uint32_t i = 0; i < filePathValues.Length(); i++) {
+                filePaths.push_back(filePathValues.Get(i).As<Napi::String>().Utf8Value());
+            }
+
+            if (info.Length() > 1 && info[1].IsObject()) {
+                Napi::Object options = info[1].As<Napi::Object>();
+
+                if (options.Has("readTensorInfo")) {
+                    readTensorInfo = options.Get("readTensorInfo").As<Napi::Boolean>().Value();
+                }
+
+                if (options.Has("ignoreKeys") && options.Get("ignoreKeys").IsArray()) {
+                    Napi::Array ignoreKeyValues = options.Get("ignoreKeys").As<Napi::Array>();
+                    for (uint32_t i = 0; i < ignoreKeyValues.Length(); i++) {
+                        ignoreKeys.insert(ignoreKeyValues.Get(i).As<Napi::String>().Utf8Value());
+                    }
+                }
+
+                if (options.Has("lazyArrayMinLength") && options.Get("lazyArrayMinLength").IsNumber()) {
+                    lazyArrayMinLength = static_cast<uint64_t>(
+                        std::max<int64_t>(0, options.Get("lazyArrayMinLength").As<Napi::Number>().Int64Value())
+                    );
+                }
+
+                if (options.Has("maxParallelism") && options.Get("maxParallelism").IsNumber()) {
+                    maxParallelism = std::max<int32_t>(1, options.Get("maxParallelism").As<Napi::Number>().Int32Value());
+                }
+            }
+
+            headers.resize(filePaths.size());
+        }
+
+        Napi::Promise GetPromise() {
+            return deferred.Promise();
+        }
+
+    protected:
+        Napi::Promise::Deferred deferred;
+
+        void Execute() {
+            // the files are independent of each other, so they're parsed in parallel.
+            // a file that fails to parse only reports its own error
+            std::atomic<std::size_t> nextFileIndex = 0;
+            const auto readFileHeaders = [this, &nextFileIndex]() {
+                while (true) {
+                    const std::size_t fileIndex = nextFileIndex++;
+                    if (fileIndex >= filePaths.size()) {
+                        return;
+                    }
+
+                    AddonGgufFileHeader& header = headers[fileIndex];
+                    try {
+                        readGgufFileHeader(filePaths[fileIndex], readTensorInfo, ignoreKeys, lazyArrayMinLength, header);
+                    } catch (const std::exception& e) {
+                        header = AddonGgufFileHeader();
+                        header.error = e.what();
+                    } catch (...) {
+                        header = AddonGgufFileHeader();
+                        header.error = "Unknown error when reading the GGUF file header";
+                    }
+                }
+            };
+
+            try {
+                const std::size_t threadCount = std::min(maxParallelism, filePaths.size());
+                std::vector<std::thread> threads;
+                for (std::size_t i = 1; i < threadCount; i++) {
+                    threads.emplace_back(readFileHeaders);
+                }
+
+                readFileHeaders();
+
+                for (auto& thread : threads) {
+                    thread.join();
+                }
+            } catch (const std::exception& e) {
+                SetError(e.what());
+            } catch(...) {
+                SetError("Unknown error when reading GGUF file headers");
+            }
+        }
+        void OnOK() {
+            Napi::Array res = Napi::Array::New(Env(), headers.size());
+            for (std::size_t i = 0; i < headers.size(); i++) {
+                res.Set(i, createGgufFileHeaderValue(Env(), headers[i]));
+            }
+
+            deferred.Resolve(res);
+        }
+        void OnError(const Napi::Error& err) {
+            deferred.Reject(err.Value());
+        }
+};
+
+Napi::Value addonReadGgufFileHeaders(const Napi::CallbackInfo& info) {
+    if (info.Length() == 0 || !info[0].IsArray()) {
+        Napi::TypeError::New(info.Env(), "Expected an array of file paths as the first argument").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    AddonReadGgufFileHeadersWorker* worker = new AddonReadGgufFileHeadersWorker(info);
+    worker->Queue();
+    return worker->GetPromise();
+}
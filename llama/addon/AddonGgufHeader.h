@@ -0,0 +1,6 @@
+#pragma once
+#include "napi.h"
+
+// read the header, metadata and tensor info of GGUF files without loading them,
+// parsing the files in parallel from a memory mapping of each file
+Napi::Value addonReadGgufFileHeaders(const Napi::CallbackInfo& info);
@@ -2,6 +2,8 @@
 #include <cstdint>
 #include <optional>
 #include <stdexcept>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "AddonGgufMetadata.h"
@@ -59,6 +61,30 @@ void AddonGgufMetadata::dispose() {
 
     disposed = true;
     ggufMetadata.reset();
+    tensorData.clear();
+    sources.clear();
+    sourceBufferRefs.clear();
+}
+
+const uint8_t* AddonGgufMetadata::getTensorSourceBufferData(const std::string& tensorName, std::size_t size) const {
+    const auto tensorDataIt = tensorData.find(tensorName);
+    if (tensorDataIt == tensorData.end()) {
+        return nullptr;
+    }
+
+    const AddonGgufMetadataTensorData& itemTensorData = tensorDataIt->second;
+    if (itemTensorData.sourceIndex >= sources.size() || size > itemTensorData.size) {
+        return nullptr;
+    }
+
+    const AddonGgufMetadataSource& source = sources[itemTensorData.sourceIndex];
+    if (source.type != AddonGgufMetadataSourceType::buffer || source.buffer.data == nullptr ||
+        itemTensorData.offset > source.buffer.length || size > source.buffer.length - itemTensorData.offset
+    ) {
+        return nullptr;
+    }
+
+    return source.buffer.data + itemTensorData.offset;
 }
 
 Napi::Value AddonGgufMetadata::Dispose(const Napi::CallbackInfo& info) {
@@ -71,6 +97,9 @@ class AddonGgufMetadataInitWorker : public Napi::AsyncWorker {
         AddonGgufMetadata* addonGgufMetadata;
         std::vector<AddonGgufMetadataSource> sources;
         std::vector<Napi::Reference<Napi::Buffer<uint8_t>>> bufferRefs;
+        std::vector<AddonGgufMetadataSource> resolvedSources;
+        std::unordered_map<std::string, AddonGgufMetadataTensorData> tensorData;
+        std::size_t totalTensorDataSize = 0;
 
         AddonGgufMetadataInitWorker(const Napi::Env& env, AddonGgufMetadata* addonGgufMetadata)
             : Napi::AsyncWorker(env, "AddonGgufMetadataInitWorker"),
@@ -93,6 +122,9 @@ class AddonGgufMetadataInitWorker : public Napi::AsyncWorker {
             try {
                 gguf_context_ptr& ggufMetadata = addonGgufMetadata->ggufMetadata;
 
+                // the metadata arrays are always parsed entirely here (unlike with `lazyMetadataArrays` on the JS side),
+                // since this metadata is passed to llama.cpp, which loads the vocabulary from these arrays,
+                // and the `gguf` API of llama.cpp has no way to skip arrays and read them later
                 auto loadMetadataSource = [](const AddonGgufMetadataSource& itemSource, ggml_context_ptr& tensorContextGuard) {
                     struct ggml_context* tensorContext = nullptr;
                     struct gguf_init_params ggufParams = {
@@ -113,7 +145,7 @@ class AddonGgufMetadataInitWorker : public Napi::AsyncWorker {
                     return metadata;
                 };
 
-                std::vector<AddonGgufMetadataSource> resolvedSources = sources;
+                resolvedSources = sources;
                 if (!sources.empty()) {
                     ggml_context_ptr initialTensorContextGuard;
                     gguf_context_ptr initialMetadata = loadMetadataSource(sources.front(), initialTensorContextGuard);
@@ -196,6 +228,18 @@ class AddonGgufMetadataInitWorker : public Napi::AsyncWorker {
                         gguf_add_tensor(ggufMetadata.get(), tensor);
                         mergedTensorCount++;
                     }
+
+                    const std::size_t dataOffset = gguf_get_data_offset(metadata.get());
+                    const int64_t tensorCount = gguf_get_n_tensors(metadata.get());
+                    for (int64_t tensorId = 0; tensorId < tensorCount; tensorId++) {
+                        const std::size_t tensorSize = gguf_get_tensor_size(metadata.get(), tensorId);
+                        tensorData[gguf_get_tensor_name(metadata.get(), tensorId)] = AddonGgufMetadataTensorData {
+                            sourceIndex,
+                            dataOffset + gguf_get_tensor_offset(metadata.get(), tensorId),
+                            tensorSize
+                        };
+                        totalTensorDataSize += tensorSize;
+                    }
                 }
 
                 if (mergedSplitCount.has_value() && mergedSplitCount.value() > 1) {
@@ -214,6 +258,13 @@ class AddonGgufMetadataInitWorker : public Napi::AsyncWorker {
             }
         }
         void OnOK() {
+            if (!addonGgufMetadata->disposed) {
+                addonGgufMetadata->sources.swap(resolvedSources);
+                addonGgufMetadata->sourceBufferRefs.swap(bufferRefs);
+                addonGgufMetadata->tensorData.swap(tensorData);
+                addonGgufMetadata->totalTensorDataSize = totalTensorDataSize;
+            }
+
             deferred.Resolve(Env().Undefined());
         }
         void OnError(const Napi::Error& err) {
@@ -1,6 +1,9 @@
 #pragma once
 
 #include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "ggml-cpp.h"
 #include "napi.h"
@@ -32,15 +35,32 @@ struct AddonGgufMetadataSource {
         }
 };
 
+// the location of the data of a tensor in the source it was read from
+struct AddonGgufMetadataTensorData {
+        std::size_t sourceIndex = 0;
+        std::size_t offset = 0;
+        std::size_t size = 0;
+};
+
 class AddonGgufMetadata : public Napi::ObjectWrap<AddonGgufMetadata> {
     public:
         gguf_context_ptr ggufMetadata;
         bool disposed = false;
 
+        // the resolved sources (with all the split parts), and the buffers of the sources that are buffers,
+        // which are kept alive so the tensor data can be read from them when loading a model
+        std::vector<AddonGgufMetadataSource> sources;
+        std::vector<Napi::Reference<Napi::Buffer<uint8_t>>> sourceBufferRefs;
+        std::unordered_map<std::string, AddonGgufMetadataTensorData> tensorData;
+        std::size_t totalTensorDataSize = 0;
+
         AddonGgufMetadata(const Napi::CallbackInfo& info);
         ~AddonGgufMetadata();
         void dispose();
 
+        // returns `nullptr` if the data of the tensor is not fully contained in a source buffer
+        const uint8_t* getTensorSourceBufferData(const std::string& tensorName, std::size_t size) const;
+
         Napi::Value Init(const Napi::CallbackInfo& info);
         Napi::Value Dispose(const Napi::CallbackInfo& info);
 
@@ -0,0 +1,382 @@
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include "AddonLoadReport.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+#ifdef __APPLE__
+#include <libproc.h>
+#include <mach/mach.h>
+#endif
+
+static double getMilliseconds(std::chrono::steady_clock::duration duration) {
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+#ifdef __linux__
+// source: `/proc/[pid]/io` in `man 5 proc`.
+// `/proc/self/io` has the counters of the process, and `/proc/thread-self/io` has the counters of the calling thread
+static uint64_t getLinuxReadBytes(const char* ioPath) {
+    std::ifstream procIo(ioPath);
+    std::string line;
+    while (std::getline(procIo, line)) {
+        if (line.rfind("read_bytes:", 0) == 0) {
+            std::istringstream iss(line.substr(sizeof("read_bytes:") - 1));
+            uint64_t value = 0;
+            iss >> value;
+            return value;
+        }
+    }
+
+    return 0;
+}
+
+// source: `delayacct_blkio_ticks` (field 42) of `/proc/[pid]/stat` in `man 5 proc`.
+// `/proc/self/stat` has the counters of the process, and `/proc/thread-self/stat` has the counters of the calling thread
+static double getLinuxBlockIoWaitTime(const char* statPath) {
+    std::ifstream procStat(statPath);
+    std::string content((std::istreambuf_iterator<char>(procStat)), std::istreambuf_iterator<char>());
+
+    // the process name (field 2) can contain spaces, so the fields are counted from its closing parenthesis
+    const std::size_t nameEnd = content.rfind(')');
+    if (nameEnd == std::string::npos) {
+        return 0;
+    }
+
+    std::istringstream iss(content.substr(nameEnd + 1));
+    std::string field;
+    for (int fieldNumber = 3; fieldNumber <= 42; fieldNumber++) {
+        if (!(iss >> field)) {
+            return 0;
+        }
+    }
+
+    const long ticksPerSecond = sysconf(_SC_CLK_TCK);
+    if (ticksPerSecond <= 0) {
+        return 0;
+    }
+
+    try {
+        return static_cast<double>(std::stoull(field)) * 1000.0 / static_cast<double>(ticksPerSecond);
+    } catch (...) {
+        return 0;
+    }
+}
+#endif
+
+AddonProcessResourceUsage addonGetProcessResourceUsage() {
+    AddonProcessResourceUsage usage;
+    usage.time = std::chrono::steady_clock::now();
+
+#ifdef _WIN32
+    FILETIME creationTime, exitTime, kernelTime, userTime;
+    if (GetProcessTimes(GetCurrentProcess(), &creationTime, &exitTime, &kernelTime, &userTime)) {
+        const auto fileTimeToMilliseconds = [](const FILETIME& fileTime) {
+            // in 100-nanosecond intervals
+            const uint64_t value = (static_cast<uint64_t>(fileTime.dwHighDateTime) << 32) | fileTime.dwLowDateTime;
+            return static_cast<double>(value) / 10000.0;
+        };
+
+        usage.userCpuTime = fileTimeToMilliseconds(userTime);
+        usage.systemCpuTime = fileTimeToMilliseconds(kernelTime);
+    }
+
+    // Windows doesn't tell apart page faults that read from the storage, so they're all reported as minor page faults
+    PROCESS_MEMORY_COUNTERS memoryCounters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &memoryCounters, sizeof(memoryCounters))) {
+        usage.minorPageFaults = memoryCounters.PageFaultCount;
+    }
+
+    IO_COUNTERS ioCounters;
+    if (GetProcessIoCounters(GetCurrentProcess(), &ioCounters)) {
+        usage.readBytes = ioCounters.ReadTransferCount;
+    }
+#else
+    struct rusage resourceUsage;
+    if (getrusage(RUSAGE_SELF, &resourceUsage) == 0) {
+        usage.userCpuTime = resourceUsage.ru_utime.tv_sec * 1000.0 + resourceUsage.ru_utime.tv_usec / 1000.0;
+        usage.systemCpuTime = resourceUsage.ru_stime.tv_sec * 1000.0 + resourceUsage.ru_stime.tv_usec / 1000.0;
+        usage.majorPageFaults = static_cast<uint64_t>(resourceUsage.ru_majflt);
+        usage.minorPageFaults = static_cast<uint64_t>(resourceUsage.ru_minflt);
+    }
+
+#ifdef __linux__
+    usage.readBytes = getLinuxReadBytes("/proc/self/io");
+    usage.blockIoWaitTime = getLinuxBlockIoWaitTime("/proc/self/stat");
+#elif defined(__APPLE__)
+    rusage_info_v2 resourceUsageInfo;
+    if (proc_pid_rusage(getpid(), RUSAGE_INFO_V2, reinterpret_cast<rusage_info_t*>(&resourceUsageInfo)) == 0) {
+        usage.readBytes = resourceUsageInfo.ri_diskio_bytesread;
+    }
+#endif
+#endif
+
+    return usage;
+}
+
+AddonThreadResourceUsage addonGetThreadResourceUsage() {
+    AddonThreadResourceUsage usage;
+
+#ifdef _WIN32
+    FILETIME creationTime, exitTime, kernelTime, userTime;
+    if (GetThreadTimes(GetCurrentThread(), &creationTime, &exitTime, &kernelTime, &userTime)) {
+        const auto fileTimeToMilliseconds = [](const FILETIME& fileTime) {
+            // in 100-nanosecond intervals
+            const uint64_t value = (static_cast<uint64_t>(fileTime.dwHighDateTime) << 32) | fileTime.dwLowDateTime;
+            return static_cast<double>(value) / 10000.0;
+        };
+
+        usage.available = true;
+        usage.userCpuTime = fileTimeToMilliseconds(userTime);
+        usage.systemCpuTime = fileTimeToMilliseconds(kernelTime);
+    }
+#elif defined(__APPLE__)
+    mach_port_t thread = mach_thread_self();
+    thread_basic_info_data_t threadInfo;
+    mach_msg_type_number_t threadInfoCount = THREAD_BASIC_INFO_COUNT;
+    if (thread_info(thread, THREAD_BASIC_INFO, reinterpret_cast<thread_info_t>(&threadInfo), &threadInfoCount) == KERN_SUCCESS) {
+        usage.available = true;
+        usage.userCpuTime = threadInfo.user_time.seconds * 1000.0 + threadInfo.user_time.microseconds / 1000.0;
+        usage.systemCpuTime = threadInfo.system_time.seconds * 1000.0 + threadInfo.system_time.microseconds / 1000.0;
+    }
+    mach_port_deallocate(mach_task_self(), thread);
+#elif defined(RUSAGE_THREAD)
+    struct rusage resourceUsage;
+    if (getrusage(RUSAGE_THREAD, &resourceUsage) == 0) {
+        usage.available = true;
+        usage.userCpuTime = resourceUsage.ru_utime.tv_sec * 1000.0 + resourceUsage.ru_utime.tv_usec / 1000.0;
+        usage.systemCpuTime = resourceUsage.ru_stime.tv_sec * 1000.0 + resourceUsage.ru_stime.tv_usec / 1000.0;
+
+#ifdef __linux__
+        // `/proc/thread-self` is available since Linux 3.17
+        if (access("/proc/thread-self/io", R_OK) == 0) {
+            usage.ioCountersAvailable = true;
+            usage.majorPageFaults = static_cast<uint64_t>(resourceUsage.ru_majflt);
+            usage.minorPageFaults = static_cast<uint64_t>(resourceUsage.ru_minflt);
+            usage.readBytes = getLinuxReadBytes("/proc/thread-self/io");
+            usage.blockIoWaitTime = getLinuxBlockIoWaitTime("/proc/thread-self/stat");
+        }
+#endif
+    }
+#endif
+
+    return usage;
+}
+
+void addonAddThreadResourceUsage(AddonThreadResourceUsage& total, const AddonThreadResourceUsage& start, const AddonThreadResourceUsage& end) {
+    if (start.available && end.available) {
+        total.available = true;
+        total.userCpuTime += std::max(0.0, end.userCpuTime - start.userCpuTime);
+        total.systemCpuTime += std::max(0.0, end.systemCpuTime - start.systemCpuTime);
+    }
+
+    if (start.ioCountersAvailable && end.ioCountersAvailable) {
+        total.ioCountersAvailable = true;
+        total.majorPageFaults += end.majorPageFaults >= start.majorPageFaults ? end.majorPageFaults - start.majorPageFaults : 0;
+        total.minorPageFaults += end.minorPageFaults >= start.minorPageFaults ? end.minorPageFaults - start.minorPageFaults : 0;
+        total.readBytes += end.readBytes >= start.readBytes ? end.readBytes - start.readBytes : 0;
+        total.blockIoWaitTime += std::max(0.0, end.blockIoWaitTime - start.blockIoWaitTime);
+    }
+}
+
+void AddonLoadReport::start() {
+    phases.clear();
+    buffers.clear();
+    hasBufferBreakdown = false;
+    tensorDataSize = 0;
+    tensorDataLoadStarted = false;
+    tensorDataLoadEnded = false;
+    tensorDataLoadTime = 0;
+    tensorDataLoadStartThreadUsage = {};
+    tensorDataLoadEndThreadUsage = {};
+    helperThreadsUsage = {};
+    finished = false;
+
+    startThreadUsage = addonGetThreadResourceUsage();
+    startUsage = addonGetProcessResourceUsage();
+    phaseStart = startUsage.time;
+    started = true;
+}
+
+void AddonLoadReport::addPhase(const std::string& name, std::chrono::steady_clock::time_point end) {
+    phases.push_back({name, getMilliseconds(end - phaseStart)});
+    phaseStart = end;
+}
+
+void AddonLoadReport::endPhase(const std::string& name) {
+    if (!started) {
+        return;
+    }
+
+    addPhase(name, std::chrono::steady_clock::now());
+}
+
+void AddonLoadReport::recordModelLoadProgress(float progress) {
+    if (!started) {
+        return;
+    }
+
+    if (!tensorDataLoadStarted) {
+        tensorDataLoadStarted = true;
+        tensorDataLoadStart = std::chrono::steady_clock::now();
+        tensorDataLoadStartThreadUsage = addonGetThreadResourceUsage();
+    }
+
+    if (progress >= 1 && !tensorDataLoadEnded) {
+        tensorDataLoadEnded = true;
+        tensorDataLoadEnd = std::chrono::steady_clock::now();
+        tensorDataLoadEndThreadUsage = addonGetThreadResourceUsage();
+    }
+}
+
+void AddonLoadReport::endModelLoadPhases() {
+    if (!started) {
+        return;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    if (!tensorDataLoadStarted) {
+        addPhase("load", now);
+        return;
+    }
+
+    const auto tensorDataEnd = tensorDataLoadEnded
+        ? tensorDataLoadEnd
+        : now;
+    if (!tensorDataLoadEnded) {
+        tensorDataLoadEndThreadUsage = addonGetThreadResourceUsage();
+    }
+
+    // reading the metadata and the vocabulary, creating the tensors and allocating the model buffers
+    addPhase("initialization", tensorDataLoadStart);
+
+    // reading the tensor data into the model buffers, including repacking, uploading to the GPU and locking the memory with mlock
+    addPhase("tensorData", tensorDataEnd);
+    tensorDataLoadTime = phases.back().time;
+
+    addPhase("finalization", now);
+}
+
+void AddonLoadReport::addHelperThreadsResourceUsage(const AddonThreadResourceUsage& usage) {
+    if (!started) {
+        return;
+    }
+
+    // `usage` already holds the differences of the counters, so it's added as a difference from zero counters
+    AddonThreadResourceUsage zeroUsage;
+    zeroUsage.available = usage.available;
+    zeroUsage.ioCountersAvailable = usage.ioCountersAvailable;
+    addonAddThreadResourceUsage(helperThreadsUsage, zeroUsage, usage);
+}
+
+void AddonLoadReport::finish() {
+    if (!started) {
+        return;
+    }
+
+    endThreadUsage = addonGetThreadResourceUsage();
+    endUsage = addonGetProcessResourceUsage();
+    finished = true;
+}
+
+bool AddonLoadReport::isFinished() const {
+    return finished;
+}
+
+Napi::Object AddonLoadReport::toNapiObject(const Napi::Env& env) const {
+    Napi::Object result = Napi::Object::New(env);
+    const double totalTime = getMilliseconds(endUsage.time - startUsage.time);
+
+    // only the resource usage of the threads that did the load, on platforms with per-thread counters.
+    // otherwise, the counters of the whole process are used
+    AddonThreadResourceUsage threadsUsage = helperThreadsUsage;
+    addonAddThreadResourceUsage(threadsUsage, startThreadUsage, endThreadUsage);
+    const bool hasThreadsCpuTime = startThreadUsage.available && endThreadUsage.available;
+    const bool hasThreadsIoCounters = startThreadUsage.ioCountersAvailable && endThreadUsage.ioCountersAvailable;
+
+    const uint64_t readBytes = hasThreadsIoCounters
+        ? threadsUsage.readBytes
+        : (endUsage.readBytes >= startUsage.readBytes ? endUsage.readBytes - startUsage.readBytes : 0);
+
+    result.Set("totalTime", Napi::Number::New(env, totalTime));
+
+    Napi::Array phasesArray = Napi::Array::New(env, phases.size());
+    for (std::size_t i = 0; i < phases.size(); i++) {
+        Napi::Object phase = Napi::Object::New(env);
+        phase.Set("name", Napi::String::New(env, phases[i].name));
+        phase.Set("time", Napi::Number::New(env, phases[i].time));
+        phasesArray.Set(i, phase);
+    }
+    result.Set("phases", phasesArray);
+
+    result.Set("readBytes", Napi::Number::New(env, static_cast<double>(readBytes)));
+    result.Set("readThroughput", Napi::Number::New(env, totalTime > 0 ? readBytes / (totalTime / 1000.0) : 0));
+
+    if (tensorDataSize > 0 && tensorDataLoadTime > 0) {
+        result.Set("tensorDataSize", Napi::Number::New(env, static_cast<double>(tensorDataSize)));
+        result.Set("tensorDataThroughput", Napi::Number::New(env, tensorDataSize / (tensorDataLoadTime / 1000.0)));
+    }
+
+    // llama.cpp reads, transforms and locks the data of each tensor in a single call without hooks between these steps,
+    // so the tensor data phase is split by the CPU time of the loading thread:
+    // the time it didn't use the CPU is the time it waited for the storage or for the GPU
+    if (tensorDataLoadTime > 0 && tensorDataLoadStartThreadUsage.available && tensorDataLoadEndThreadUsage.available) {
+        const double userCpuTime = tensorDataLoadEndThreadUsage.userCpuTime - tensorDataLoadStartThreadUsage.userCpuTime;
+        const double systemCpuTime = tensorDataLoadEndThreadUsage.systemCpuTime - tensorDataLoadStartThreadUsage.systemCpuTime;
+
+        // the counters have a coarser resolution than the clock, so they're clamped to the phase time
+        const double transformTime = std::clamp(userCpuTime, 0.0, tensorDataLoadTime);
+        const double kernelTime = std::clamp(systemCpuTime, 0.0, tensorDataLoadTime - transformTime);
+
+        Napi::Object tensorDataBreakdown = Napi::Object::New(env);
+        tensorDataBreakdown.Set("transformTime", Napi::Number::New(env, transformTime));
+        tensorDataBreakdown.Set("kernelTime", Napi::Number::New(env, kernelTime));
+        tensorDataBreakdown.Set("waitTime", Napi::Number::New(env, tensorDataLoadTime - transformTime - kernelTime));
+        result.Set("tensorDataBreakdown", tensorDataBreakdown);
+    }
+
+    if (hasThreadsCpuTime) {
+        result.Set("userCpuTime", Napi::Number::New(env, threadsUsage.userCpuTime));
+        result.Set("systemCpuTime", Napi::Number::New(env, threadsUsage.systemCpuTime));
+    } else {
+        result.Set("userCpuTime", Napi::Number::New(env, std::max(0.0, endUsage.userCpuTime - startUsage.userCpuTime)));
+        result.Set("systemCpuTime", Napi::Number::New(env, std::max(0.0, endUsage.systemCpuTime - startUsage.systemCpuTime)));
+    }
+
+    if (hasThreadsIoCounters) {
+        result.Set("majorPageFaults", Napi::Number::New(env, static_cast<double>(threadsUsage.majorPageFaults)));
+        result.Set("minorPageFaults", Napi::Number::New(env, static_cast<double>(threadsUsage.minorPageFaults)));
+        result.Set("blockIoWaitTime", Napi::Number::New(env, threadsUsage.blockIoWaitTime));
+    } else {
+        result.Set("majorPageFaults", Napi::Number::New(env, static_cast<double>(endUsage.majorPageFaults - startUsage.majorPageFaults)));
+        result.Set("minorPageFaults", Napi::Number::New(env, static_cast<double>(endUsage.minorPageFaults - startUsage.minorPageFaults)));
+        result.Set("blockIoWaitTime", Napi::Number::New(env, std::max(0.0, endUsage.blockIoWaitTime - startUsage.blockIoWaitTime)));
+    }
+    result.Set("ioCountersScope", Napi::String::New(env, hasThreadsIoCounters ? "threads" : "process"));
+
+    Napi::Array buffersArray = Napi::Array::New(env, buffers.size());
+    for (std::size_t i = 0; i < buffers.size(); i++) {
+        Napi::Object buffer = Napi::Object::New(env);
+        buffer.Set("bufferType", Napi::String::New(env, buffers[i].bufferType));
+        buffer.Set("size", Napi::Number::New(env, static_cast<double>(buffers[i].size)));
+
+        if (hasBufferBreakdown) {
+            buffer.Set("kvCacheSize", Napi::Number::New(env, static_cast<double>(buffers[i].kvCacheSize)));
+            buffer.Set("computeSize", Napi::Number::New(env, static_cast<double>(buffers[i].computeSize)));
+        }
+
+        buffersArray.Set(i, buffer);
+    }
+    result.Set("buffers", buffersArray);
+
+    return result;
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "napi.h"
+
+// resource usage counters of the whole process, used on platforms without per-thread counters
+struct AddonProcessResourceUsage {
+    std::chrono::steady_clock::time_point time;
+    double userCpuTime = 0; // in milliseconds
+    double systemCpuTime = 0; // in milliseconds
+    uint64_t majorPageFaults = 0;
+    uint64_t minorPageFaults = 0;
+    uint64_t readBytes = 0; // bytes read from the storage, not including reads served from the page cache
+
+    // the time the process waited for block I/O (including page faults that read from the storage), in milliseconds.
+    // only available on Linux, and is `0` when the delay accounting of the kernel is disabled
+    double blockIoWaitTime = 0;
+};
+
+AddonProcessResourceUsage addonGetProcessResourceUsage();
+
+// resource usage counters of the calling thread, so the resource usage of a load isn't mixed with the work of other threads of the process.
+// `available` is `false` on platforms without per-thread CPU time counters,
+// and `ioCountersAvailable` is `false` on platforms without per-thread page fault and I/O counters (only Linux has them)
+struct AddonThreadResourceUsage {
+    bool available = false;
+    double userCpuTime = 0; // in milliseconds
+    double systemCpuTime = 0; // in milliseconds
+
+    bool ioCountersAvailable = false;
+    uint64_t majorPageFaults = 0;
+    uint64_t minorPageFaults = 0;
+    uint64_t readBytes = 0; // bytes read from the storage, not including reads served from the page cache
+    double blockIoWaitTime = 0; // in milliseconds. `0` when the delay accounting of the kernel is disabled
+};
+
+AddonThreadResourceUsage addonGetThreadResourceUsage();
+
+// add the resource usage of a thread between `start` and `end` to `total`.
+// counters that aren't available in both `start` and `end` are skipped
+void addonAddThreadResourceUsage(AddonThreadResourceUsage& total, const AddonThreadResourceUsage& start, const AddonThreadResourceUsage& end);
+
+struct AddonLoadReportPhase {
+    std::string name;
+    double time = 0; // in milliseconds
+};
+
+struct AddonLoadReportBuffer {
+    std::string bufferType;
+    uint64_t size = 0;
+
+    // set only for contexts
+    uint64_t kvCacheSize = 0;
+    uint64_t computeSize = 0;
+};
+
+// collects the time of each phase of a model or a context load, and the resource usage of the threads that did the load.
+// the timers only read the clock and the resource usage counters at the phase boundaries, so it doesn't slow down the load
+class AddonLoadReport {
+    public:
+        std::vector<AddonLoadReportPhase> phases;
+        std::vector<AddonLoadReportBuffer> buffers;
+        bool hasBufferBreakdown = false;
+
+        // the size of the loaded tensor data, used to calculate the load throughput of the tensor data phase
+        uint64_t tensorDataSize = 0;
+
+        void start();
+
+        // end the current phase, which started at the end of the previous phase
+        void endPhase(const std::string& name);
+
+        // called from the `progress_callback` of `llama_model_load_from_file`,
+        // which is only called while loading the tensor data
+        void recordModelLoadProgress(float progress);
+
+        // end the phases of `llama_model_load_from_file`, split by the load progress that was recorded
+        void endModelLoadPhases();
+
+        // add the resource usage of helper threads that did a part of the load (such as the model prefetch threads)
+        void addHelperThreadsResourceUsage(const AddonThreadResourceUsage& usage);
+
+        void finish();
+        bool isFinished() const;
+
+        Napi::Object toNapiObject(const Napi::Env& env) const;
+
+    private:
+        bool started = false;
+        bool finished = false;
+        AddonProcessResourceUsage startUsage;
+        AddonProcessResourceUsage endUsage;
+        AddonThreadResourceUsage startThreadUsage;
+        AddonThreadResourceUsage endThreadUsage;
+        AddonThreadResourceUsage helperThreadsUsage;
+        std::chrono::steady_clock::time_point phaseStart;
+
+        bool tensorDataLoadStarted = false;
+        bool tensorDataLoadEnded = false;
+        std::chrono::steady_clock::time_point tensorDataLoadStart;
+        std::chrono::steady_clock::time_point tensorDataLoadEnd;
+        double tensorDataLoadTime = 0;
+
+        // the resource usage of the loading thread while loading the tensor data,
+        // used to tell apart the time spent transforming the weights from the time spent waiting for the storage
+        AddonThreadResourceUsage tensorDataLoadStartThreadUsage;
+        AddonThreadResourceUsage tensorDataLoadEndThreadUsage;
+
+        void addPhase(const std::string& name, std::chrono::steady_clock::time_point end);
+};
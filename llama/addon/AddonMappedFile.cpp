@@ -0,0 +1,277 @@
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include "AddonMappedFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+std::wstring addonToWidePath(const std::string& filePath) {
+    const int length = MultiByteToWideChar(CP_UTF8, 0, filePath.c_str(), -1, nullptr, 0);
+    if (length <= 0) {
+        return std::wstring();
+    }
+
+    std::wstring res(length, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, filePath.c_str(), -1, res.data(), length);
+    res.resize(length - 1);
+
+    return res;
+}
+#endif
+
+AddonMappedFile::~AddonMappedFile() {
+    close();
+}
+
+bool AddonMappedFile::open(const std::string& filePath) {
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileW(
+        addonToWidePath(filePath).c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr
+    );
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr) {
+        CloseHandle(file);
+        return false;
+    }
+
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == nullptr) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    fileHandle = file;
+    mappingHandle = mapping;
+    mappedData = static_cast<const uint8_t*>(view);
+    mappedSize = static_cast<std::size_t>(fileSize.QuadPart);
+#else
+    const int fd = ::open(filePath.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size <= 0) {
+        ::close(fd);
+        return false;
+    }
+
+    void* view = mmap(nullptr, static_cast<std::size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping stays valid after the file descriptor is closed
+
+    if (view == MAP_FAILED) {
+        return false;
+    }
+
+#ifdef POSIX_MADV_SEQUENTIAL
+    posix_madvise(view, static_cast<std::size_t>(fileStat.st_size), POSIX_MADV_SEQUENTIAL);
+#endif
+
+    mappedData = static_cast<const uint8_t*>(view);
+    mappedSize = static_cast<std::size_t>(fileStat.st_size);
+#endif
+
+    return true;
+}
+
+void AddonMappedFile::close() {
+#ifdef _WIN32
+    if (mappedData != nullptr) {
+        UnmapViewOfFile(mappedData);
+    }
+
+    if (mappingHandle != nullptr) {
+        CloseHandle(mappingHandle);
+        mappingHandle = nullptr;
+    }
+
+    if (fileHandle != nullptr) {
+        CloseHandle(fileHandle);
+        fileHandle = nullptr;
+    }
+#else
+    if (mappedData != nullptr) {
+        munmap(const_cast<uint8_t*>(mappedData), mappedSize);
+    }
+#endif
+
+    mappedData = nullptr;
+    mappedSize = 0;
+}
+
+bool addonWriteFile(const std::string& filePath, const uint8_t* data, std::size_t size) {
+#ifdef _WIN32
+    HANDLE file = CreateFileW(
+        addonToWidePath(filePath).c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr
+    );
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    bool written = true;
+    std::size_t offset = 0;
+    while (offset < size) {
+        const DWORD writeSize = static_cast<DWORD>(std::min<std::size_t>(size - offset, 1024 * 1024 * 1024));
+        DWORD writtenSize = 0;
+        if (!WriteFile(file, data + offset, writeSize, &writtenSize, nullptr) || writtenSize == 0) {
+            written = false;
+            break;
+        }
+
+        offset += writtenSize;
+    }
+
+    written = written && FlushFileBuffers(file) != 0;
+    return CloseHandle(file) != 0 && written;
+#else
+    const int fd = ::open(filePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd == -1) {
+        return false;
+    }
+
+    bool written = true;
+    std::size_t offset = 0;
+    while (offset < size) {
+        const ssize_t writtenSize = ::write(fd, data + offset, size - offset);
+        if (writtenSize < 0 && errno == EINTR) {
+            continue;
+        } else if (writtenSize <= 0) {
+            written = false;
+            break;
+        }
+
+        offset += static_cast<std::size_t>(writtenSize);
+    }
+
+#ifdef F_FULLFSYNC
+    written = written && (fcntl(fd, F_FULLFSYNC) == 0 || fsync(fd) == 0);
+#else
+    written = written && fsync(fd) == 0;
+#endif
+
+    return ::close(fd) == 0 && written;
+#endif
+}
+
+static const std::array<std::array<uint32_t, 256>, 8>& getCrc32Tables() {
+    static const std::array<std::array<uint32_t, 256>, 8> tables = []() {
+        std::array<std::array<uint32_t, 256>, 8> res{};
+
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320u : 0);
+            }
+
+            res[0][i] = crc;
+        }
+
+        for (uint32_t i = 0; i < 256; i++) {
+            for (std::size_t table = 1; table < res.size(); table++) {
+                res[table][i] = (res[table - 1][i] >> 8) ^ res[0][res[table - 1][i] & 0xFF];
+            }
+        }
+
+        return res;
+    }();
+
+    return tables;
+}
+
+// CRC-32 (IEEE), processing 8 bytes at a time
+uint32_t addonCrc32(const uint8_t* data, std::size_t size) {
+    const auto& tables = getCrc32Tables();
+    uint32_t crc = 0xFFFFFFFFu;
+
+    while (size >= 8) {
+        uint32_t low;
+        uint32_t high;
+        std::memcpy(&low, data, sizeof(low));
+        std::memcpy(&high, data + 4, sizeof(high));
+        low ^= crc;
+
+        crc = tables[7][low & 0xFF] ^ tables[6][(low >> 8) & 0xFF] ^ tables[5][(low >> 16) & 0xFF] ^ tables[4][low >> 24] ^
+            tables[3][high & 0xFF] ^ tables[2][(high >> 8) & 0xFF] ^ tables[1][(high >> 16) & 0xFF] ^ tables[0][high >> 24];
+
+        data += 8;
+        size -= 8;
+    }
+
+    while (size > 0) {
+        crc = (crc >> 8) ^ tables[0][(crc ^ *data) & 0xFF];
+        data++;
+        size--;
+    }
+
+    return crc ^ 0xFFFFFFFFu;
+}
+
+bool addonRemoveFile(const std::string& filePath) {
+#ifdef _WIN32
+    return DeleteFileW(addonToWidePath(filePath).c_str()) != 0;
+#else
+    return unlink(filePath.c_str()) == 0;
+#endif
+}
+
+uint64_t addonFnv1a(uint64_t hash, const void* data, std::size_t size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (std::size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+    }
+
+    return hash;
+}
+
+static constexpr std::size_t contentHashSampleSize = 4 * 1024;
+static constexpr std::size_t contentHashSamples = 1024;
+
+uint64_t addonSampledContentHash(const uint8_t* data, std::size_t size) {
+    const uint64_t contentSize = size;
+    uint64_t hash = addonFnv1a(addonFnv1aOffsetBasis, &contentSize, sizeof(contentSize));
+
+    if (size <= contentHashSampleSize * contentHashSamples) {
+        return addonFnv1a(hash, data, size);
+    }
+
+    // the samples include the start and the end of the content
+    const std::size_t stride = (size - contentHashSampleSize) / (contentHashSamples - 1);
+    for (std::size_t i = 0; i < contentHashSamples; i++) {
+        hash = addonFnv1a(hash, data + i * stride, contentHashSampleSize);
+    }
+
+    return hash;
+}
+
+uint64_t addonSampledFileContentHash(const std::string& filePath) {
+    AddonMappedFile file;
+    if (!file.open(filePath)) {
+        return 0;
+    }
+
+    return addonSampledContentHash(file.data(), file.size());
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// a read-only memory mapping of an entire file
+class AddonMappedFile {
+    public:
+        AddonMappedFile() = default;
+        ~AddonMappedFile();
+
+        AddonMappedFile(const AddonMappedFile&) = delete;
+        AddonMappedFile& operator=(const AddonMappedFile&) = delete;
+
+        // returns `false` when the file cannot be opened or mapped
+        bool open(const std::string& filePath);
+        void close();
+
+        const uint8_t* data() const {
+            return mappedData;
+        }
+
+        std::size_t size() const {
+            return mappedSize;
+        }
+
+    private:
+        const uint8_t* mappedData = nullptr;
+        std::size_t mappedSize = 0;
+
+#ifdef _WIN32
+        void* fileHandle = nullptr;
+        void* mappingHandle = nullptr;
+#endif
+};
+
+// write a buffer to a file, replacing its existing content, and fsync it.
+// returns `false` when the file cannot be fully written
+bool addonWriteFile(const std::string& filePath, const uint8_t* data, std::size_t size);
+
+// returns `false` when the file cannot be removed
+bool addonRemoveFile(const std::string& filePath);
+
+// CRC-32 (IEEE)
+uint32_t addonCrc32(const uint8_t* data, std::size_t size);
+
+// FNV-1a
+constexpr uint64_t addonFnv1aOffsetBasis = 0xCBF29CE484222325ull;
+uint64_t addonFnv1a(uint64_t hash, const void* data, std::size_t size);
+
+// a hash of the size and of evenly spaced samples of the content of a buffer,
+// for telling large files (such as model weights of the same shape) apart without reading all of their content
+uint64_t addonSampledContentHash(const uint8_t* data, std::size_t size);
+
+// `addonSampledContentHash` of the content of a file. returns `0` when the file cannot be read
+uint64_t addonSampledFileContentHash(const std::string& filePath);
+
+#ifdef _WIN32
+// convert a UTF-8 file path to the UTF-16 path the Windows file APIs expect
+std::wstring addonToWidePath(const std::string& filePath);
+#endif
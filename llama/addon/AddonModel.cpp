@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <sstream>
 #include "addonGlobals.h"
 #include "globals/addonLog.h"
@@ -9,7 +10,11 @@
 #include "AddonModel.h"
 #include "AddonModelData.h"
 #include "AddonModelLora.h"
+#include "AddonModelPrefetch.h"
+#include "AddonModelRegistry.h"
 #include "AddonGgufMetadata.h"
+#include "AddonMappedFile.h"
+#include "AddonTokenizer.h"
 
 static Napi::Value getNapiToken(const Napi::CallbackInfo& info, const llama_vocab* vocab, llama_token token) {
     if (token < 0 || token == LLAMA_TOKEN_NULL) {
@@ -39,8 +44,7 @@ static Napi::Value getNapiControlToken(const Napi::CallbackInfo& info, const lla
     return Napi::Number::From(info.Env(), token);
 }
 
-static bool llamaModelParamsProgressCallback(float progress, void * user_data) {
-    AddonModel* addonModel = (AddonModel *) user_data;
+static void reportModelLoadProgress(AddonModel* addonModel, float progress) {
     unsigned percentage = (unsigned) (100 * progress);
 
     if (percentage > addonModel->modelLoadPercentage) {
@@ -68,10 +72,21 @@ static bool llamaModelParamsProgressCallback(float progress, void * user_data) {
             }
         }
     }
+}
+
+static bool llamaModelParamsProgressCallback(float progress, void * user_data) {
+    AddonModel* addonModel = (AddonModel *) user_data;
+    addonModel->loadReport.recordModelLoadProgress(progress);
+
+    // the prefetch reports the first part of the load progress
+    reportModelLoadProgress(addonModel, addonModel->prefetchProgressShare + progress * (1 - addonModel->prefetchProgressShare));
 
     return !(addonModel->abortModelLoad);
 }
 
+// the share of the load progress that the prefetch of the model file is reported as
+static constexpr float prefetchModelLoadProgressShare = 0.5f;
+
 struct ModelEstimatorTensorAccessState {
     bool accessedTensorData = false;
 };
@@ -83,6 +98,58 @@ static void markUnexpectedTensorDataAccess(struct ggml_tensor * /* tensor */, vo
     }
 }
 
+struct ModelSourceBuffersLoadState {
+    AddonModel* model = nullptr;
+    AddonGgufMetadata* ggufMetadata = nullptr;
+    std::size_t loadedSize = 0;
+    bool aborted = false;
+    std::string error;
+};
+
+// copies the data of each tensor from the source buffers right into the model buffers,
+// so loading a model from memory doesn't have to go through a file
+static void setTensorDataFromSourceBuffers(struct ggml_tensor * tensor, void * userData) {
+    auto * loadState = static_cast<ModelSourceBuffersLoadState *>(userData);
+    if (loadState->aborted || !loadState->error.empty()) {
+        return;
+    }
+
+    const std::size_t size = ggml_nbytes(tensor);
+    const uint8_t* data = loadState->ggufMetadata->getTensorSourceBufferData(ggml_get_name(tensor), size);
+    if (data == nullptr) {
+        loadState->error = std::string("The data of the tensor \"") + ggml_get_name(tensor) + "\" is missing from the source buffers";
+        return;
+    }
+
+    ggml_backend_tensor_set(tensor, data, 0, size);
+    loadState->loadedSize += size;
+
+    const std::size_t totalSize = loadState->ggufMetadata->totalTensorDataSize;
+    const float progress = totalSize == 0
+        ? 1
+        : std::min(1.0f, static_cast<float>(static_cast<double>(loadState->loadedSize) / static_cast<double>(totalSize)));
+    if (!llamaModelParamsProgressCallback(progress, loadState->model)) {
+        loadState->aborted = true;
+    }
+}
+
+// a hash of the content of the sources of a model, so a sequence state of another model with the same shape (such as a finetune) is rejected
+static uint64_t getModelContentFingerprint(const AddonModel* model, const AddonGgufMetadata* ggufMetadata) {
+    if (ggufMetadata == nullptr) {
+        return addonSampledFileContentHash(model->modelPath);
+    }
+
+    uint64_t fingerprint = addonFnv1aOffsetBasis;
+    for (const auto& source : ggufMetadata->sources) {
+        const uint64_t sourceHash = source.type == AddonGgufMetadataSourceType::buffer
+            ? addonSampledContentHash(source.buffer.data, source.buffer.length)
+            : addonSampledFileContentHash(source.path);
+        fingerprint = addonFnv1a(fingerprint, &sourceHash, sizeof(sourceHash));
+    }
+
+    return fingerprint;
+}
+
 class AddonModelLoadModelWorker : public Napi::AsyncWorker {
     public:
         AddonModel* model;
@@ -113,13 +180,107 @@ class AddonModelLoadModelWorker : public Napi::AsyncWorker {
         Napi::Promise::Deferred deferred;
 
         void Execute() {
+            model->loadReport.start();
+
             try {
-                if (model->modelPath != "" && ggufMetadata == nullptr) {
-                    model->model = llama_model_load_from_file(model->modelPath.c_str(), model->model_params);
+                if (model->attachShareHandle != 0) {
+                    model->sharedModel = addonFindSharedModel(model->attachShareHandle);
+                    if (model->sharedModel == nullptr) {
+                        throw std::runtime_error("The shared model is no longer loaded");
+                    }
+
+                    model->model = model->sharedModel->model;
+                    model->sharedModelReused = true;
+                    model->loadReport.endPhase("attach");
+                } else if (model->modelPath != "" && ggufMetadata == nullptr) {
+                    bool prefetchAborted = false;
+                    const auto loadModel = [this, &prefetchAborted]() -> llama_model* {
+                        if (model->prefetch && model->model_params.use_mmap && !model->model_params.use_direct_io &&
+                            !model->model_params.no_alloc && !model->model_params.vocab_only
+                        ) {
+                            model->prefetchProgressShare = prefetchModelLoadProgressShare;
+                            AddonThreadResourceUsage prefetchThreadsResourceUsage;
+                            const bool prefetched = addonPrefetchModelFile(
+                                model->modelPath,
+                                model->prefetchOptions,
+                                [this](float progress) {
+                                    reportModelLoadProgress(model, progress * model->prefetchProgressShare);
+                                },
+                                [this]() {
+                                    return model->abortModelLoad;
+                                },
+                                &prefetchThreadsResourceUsage
+                            );
+                            model->loadReport.addHelperThreadsResourceUsage(prefetchThreadsResourceUsage);
+
+                            if (!prefetched) {
+                                prefetchAborted = true;
+                                return nullptr;
+                            }
+
+                            model->loadReport.endPhase("prefetch");
+                        }
+
+                        llama_model* loadedModel = llama_model_load_from_file(model->modelPath.c_str(), model->model_params);
+                        model->loadReport.endModelLoadPhases();
+
+                        return loadedModel;
+                    };
+
+                    if (model->model_params.no_alloc) {
+                        model->model = loadModel();
+                    } else {
+                        model->sharedModel = addonAcquireSharedModel(
+                            addonGetSharedModelKey(model->modelPath, model->model_params, model->kv_overrides),
+                            model->shared,
+                            loadModel,
+                            model->sharedModelReused
+                        );
+                        model->model = model->sharedModel == nullptr
+                            ? nullptr
+                            : model->sharedModel->model;
+
+                        if (model->sharedModelReused) {
+                            model->loadReport.endPhase("attach");
+                        }
+                    }
+
+                    if (prefetchAborted) {
+                        model->modelLoaded = false;
+                        return;
+                    }
+                } else if (!model->model_params.no_alloc) {
+                    if (ggufMetadata->disposed || ggufMetadata->ggufMetadata.get() == nullptr) {
+                        throw std::runtime_error("GGUF metadata is disposed");
+                    }
+
+                    ModelSourceBuffersLoadState loadState;
+                    loadState.model = model;
+                    loadState.ggufMetadata = ggufMetadata;
+                    model->model = llama_model_init_from_user(
+                        ggufMetadata->ggufMetadata.get(),
+                        setTensorDataFromSourceBuffers,
+                        &loadState,
+                        model->model_params
+                    );
+
+                    if (!loadState.error.empty() || loadState.aborted) {
+                        if (model->model != nullptr) {
+                            llama_model_free(model->model);
+                            model->model = nullptr;
+                        }
+
+                        if (!loadState.error.empty()) {
+                            throw std::runtime_error(loadState.error);
+                        }
+
+                        model->modelLoaded = false;
+                        return;
+                    }
+
+                    model->loadReport.endModelLoadPhases();
                 } else {
-                    if (!model->model_params.no_alloc) {
-                        throw std::runtime_error("Loading a model from source buffers requires no_alloc=true");
-                    } else if (ggufMetadata->disposed || ggufMetadata->ggufMetadata.get() == nullptr) {
+                    if (ggufMetadata->disposed || ggufMetadata->ggufMetadata.get() == nullptr) {
                         throw std::runtime_error("GGUF metadata is disposed");
                     }
 
@@ -141,11 +302,34 @@ class AddonModelLoadModelWorker : public Napi::AsyncWorker {
                             "Unexpected tensor data access when loading a model from source buffers with no_alloc=true"
                         );
                     }
+
+                    model->loadReport.endPhase("load");
                 }
 
                 if (model->model != nullptr) {
                     model->vocab = llama_model_get_vocab(model->model);
                     model->modelLoaded = true;
+
+                    if (!model->model_params.no_alloc) {
+                        if (!model->sharedModelReused) {
+                            model->loadReport.tensorDataSize = llama_model_size(model->model);
+                        }
+
+                        if (!model->model_params.vocab_only) {
+                            model->contentFingerprint = getModelContentFingerprint(model, ggufMetadata);
+                        }
+
+                        for (const auto& [bufferType, size] : model->model->memory_breakdown()) {
+                            if (size != 0) {
+                                model->loadReport.buffers.push_back({ggml_backend_buft_name(bufferType), size});
+                            }
+                        }
+                    }
+
+                    model->loadReport.finish();
+
+                    // a reused model doesn't report the load progress of the model file
+                    reportModelLoadProgress(model, 1);
                 } else {
                     model->modelLoaded = false;
                 }
@@ -242,7 +426,15 @@ class AddonModelLoadLoraWorker : public Napi::AsyncWorker {
 
         void Execute() {
             try {
-                const auto loraAdapter = llama_adapter_lora_init(modelLora->model->model, modelLora->loraFilePath.c_str());
+                modelLora->sharedModel = modelLora->model->sharedModel;
+
+                llama_adapter_lora* loraAdapter = nullptr;
+                if (modelLora->sharedModel != nullptr) {
+                    std::lock_guard<std::mutex> adaptersLock(modelLora->sharedModel->adaptersMutex);
+                    loraAdapter = llama_adapter_lora_init(modelLora->model->model, modelLora->loraFilePath.c_str());
+                } else {
+                    loraAdapter = llama_adapter_lora_init(modelLora->model->model, modelLora->loraFilePath.c_str());
+                }
 
                 if (loraAdapter == nullptr) {
                     SetError(
@@ -254,6 +446,7 @@ class AddonModelLoadLoraWorker : public Napi::AsyncWorker {
                 }
 
                 modelLora->lora_adapter = loraAdapter;
+                modelLora->contentFingerprint = addonSampledFileContentHash(modelLora->loraFilePath);
 
                 bool hasModelData = false;
                 {
@@ -264,8 +457,7 @@ class AddonModelLoadLoraWorker : public Napi::AsyncWorker {
                 }
 
                 if (!hasModelData) {
-                    llama_adapter_lora_free(modelLora->lora_adapter);
-                    modelLora->lora_adapter = nullptr;
+                    modelLora->disposeMemory();
                     SetError("Model data is not initialized");
                 }
             } catch (const std::exception& e) {
@@ -373,6 +565,28 @@ AddonModel::AddonModel(const Napi::CallbackInfo& info) :
             }
         }
 
+        if (options.Has("prefetch")) {
+            prefetch = options.Get("prefetch").As<Napi::Boolean>().Value();
+        }
+
+        if (options.Has("prefetchThreads")) {
+            prefetchOptions.threads = std::max<int32_t>(0, options.Get("prefetchThreads").As<Napi::Number>().Int32Value());
+        }
+
+        if (options.Has("prefetchNumaStrategy")) {
+            // only the "distribute" strategy spreads the model across the NUMA nodes.
+            // with the other strategies the prefetch threads run where the process is allowed to run, so the pages are placed on the same nodes
+            prefetchOptions.distributeAcrossNumaNodes = options.Get("prefetchNumaStrategy").As<Napi::String>().Utf8Value() == "distribute";
+        }
+
+        if (options.Has("shared")) {
+            shared = options.Get("shared").As<Napi::Boolean>().Value();
+        }
+
+        if (options.Has("shareHandle")) {
+            attachShareHandle = static_cast<uint64_t>(options.Get("shareHandle").As<Napi::Number>().Int64Value());
+        }
+
         if (options.Has("hasLoadAbortSignal")) {
             hasLoadAbortSignal = options.Get("hasLoadAbortSignal").As<Napi::Boolean>().Value();
         }
@@ -433,10 +647,9 @@ AddonModel::AddonModel(const Napi::CallbackInfo& info) :
             model_params.kv_overrides = kv_overrides.data();
         }
 
-        if (onLoadProgressEventCallbackSet || hasLoadAbortSignal) {
-            model_params.progress_callback_user_data = &(*this);
-            model_params.progress_callback = llamaModelParamsProgressCallback;
-        }
+        // the progress callback is also used to time the phases of the load report
+        model_params.progress_callback_user_data = &(*this);
+        model_params.progress_callback = llamaModelParamsProgressCallback;
     }
 
     if (model_params.no_alloc) {
@@ -451,6 +664,7 @@ AddonModel::~AddonModel() {
 
 void AddonModel::disposeMemory() {
     llama_model* currentModel = nullptr;
+    std::shared_ptr<AddonSharedModel> currentSharedModel;
     AddonModelData* currentData = nullptr;
 
     {
@@ -464,6 +678,7 @@ void AddonModel::disposeMemory() {
 
         currentData = data;
         currentModel = model;
+        currentSharedModel = std::move(sharedModel);
         model = nullptr;
         vocab = nullptr;
         modelLoaded = false;
@@ -473,7 +688,10 @@ void AddonModel::disposeMemory() {
         currentData->disposeMemory();
     }
 
-    if (currentModel != nullptr) {
+    if (currentSharedModel != nullptr) {
+        // the model is freed when no other environment uses it
+        currentSharedModel.reset();
+    } else if (currentModel != nullptr) {
         llama_model_free(currentModel);
     }
 }
@@ -577,17 +795,7 @@ Napi::Value AddonModel::Tokenize(const Napi::CallbackInfo& info) {
         return info.Env().Undefined();
     }
 
-    std::string text = info[0].As<Napi::String>().Utf8Value();
-    bool specialTokens = info[1].As<Napi::Boolean>().Value();
-
-    std::vector<llama_token> tokens = common_tokenize(vocab, text, false, specialTokens);
-
-    Napi::Uint32Array result = Napi::Uint32Array::New(info.Env(), tokens.size());
-    for (size_t i = 0; i < tokens.size(); ++i) {
-        result[i] = static_cast<uint32_t>(tokens[i]);
-    }
-
-    return result;
+    return addonTokenizeForNapiCallbackInfo(info, vocab);
 }
 Napi::Value AddonModel::Detokenize(const Napi::CallbackInfo& info) {
     if (disposed) {
@@ -600,21 +808,16 @@ Napi::Value AddonModel::Detokenize(const Napi::CallbackInfo& info) {
         ? info[1].As<Napi::Boolean>().Value()
         : false;
 
-    std::string result;
-    result.resize(std::max(result.capacity(), tokens.ElementLength()));
-
-    int n_chars = llama_detokenize(vocab, (llama_token*)tokens.Data(), tokens.ElementLength(), &result[0], result.size(), false, decodeSpecialTokens);
-    if (n_chars < 0) {
-        result.resize(-n_chars);
-        n_chars = llama_detokenize(vocab, (llama_token*)tokens.Data(), tokens.ElementLength(), &result[0], result.size(), false, decodeSpecialTokens);
-        GGML_ASSERT(n_chars <= result.size());  // whitespace trimming is performed after per-token detokenization
+    return addonDetokenizeToNapiValue(info.Env(), vocab, tokens, decodeSpecialTokens);
+}
+Napi::Value AddonModel::CountTokens(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Model is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
     }
 
-    result.resize(n_chars);
-
-    return Napi::String::New(info.Env(), result);
+    return addonCountTokensForNapiCallbackInfo(info, vocab);
 }
-
 Napi::Value AddonModel::GetTrainContextSize(const Napi::CallbackInfo& info) {
     if (disposed) {
         Napi::Error::New(info.Env(), "Model is disposed").ThrowAsJavaScriptException();
@@ -842,6 +1045,31 @@ Napi::Value AddonModel::GetModelSize(const Napi::CallbackInfo& info) {
     return Napi::Number::From(info.Env(), llama_model_size(model));
 }
 
+Napi::Value AddonModel::GetShareHandle(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Model is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    if (sharedModel == nullptr) {
+        return info.Env().Undefined();
+    }
+
+    return Napi::Number::From(info.Env(), static_cast<double>(sharedModel->id));
+}
+
+Napi::Value AddonModel::GetSharedModelReused(const Napi::CallbackInfo& info) {
+    return Napi::Boolean::New(info.Env(), sharedModelReused);
+}
+
+Napi::Value AddonModel::GetLoadReport(const Napi::CallbackInfo& info) {
+    if (!loadReport.isFinished()) {
+        return info.Env().Undefined();
+    }
+
+    return loadReport.toNapiObject(info.Env());
+}
+
 void AddonModel::init(Napi::Object exports) {
     exports.Set(
         "AddonModel",
@@ -854,6 +1082,7 @@ void AddonModel::init(Napi::Object exports) {
                 InstanceMethod("abortActiveModelLoad", &AddonModel::AbortActiveModelLoad),
                 InstanceMethod("tokenize", &AddonModel::Tokenize),
                 InstanceMethod("detokenize", &AddonModel::Detokenize),
+                InstanceMethod("countTokens", &AddonModel::CountTokens),
                 InstanceMethod("getTrainContextSize", &AddonModel::GetTrainContextSize),
                 InstanceMethod("getEmbeddingVectorSize", &AddonModel::GetEmbeddingVectorSize),
                 InstanceMethod("getTotalSize", &AddonModel::GetTotalSize),
@@ -875,6 +1104,9 @@ void AddonModel::init(Napi::Object exports) {
                 InstanceMethod("shouldPrependBosToken", &AddonModel::ShouldPrependBosToken),
                 InstanceMethod("shouldAppendEosToken", &AddonModel::ShouldAppendEosToken),
                 InstanceMethod("getModelSize", &AddonModel::GetModelSize),
+                InstanceMethod("getShareHandle", &AddonModel::GetShareHandle),
+                InstanceMethod("getSharedModelReused", &AddonModel::GetSharedModelReused),
+                InstanceMethod("getLoadReport", &AddonModel::GetLoadReport),
                 InstanceMethod("dispose", &AddonModel::Dispose),
             }
         )
@@ -2,6 +2,7 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <vector>
@@ -10,6 +11,9 @@
 #include "napi.h"
 #include "addonGlobals.h"
 #include "globals/addonProgress.h"
+#include "AddonModelPrefetch.h"
+#include "AddonModelRegistry.h"
+#include "AddonLoadReport.h"
 
 
 class AddonModel : public Napi::ObjectWrap<AddonModel> {
@@ -33,6 +37,26 @@ class AddonModel : public Napi::ObjectWrap<AddonModel> {
         AddonThreadSafeProgressEventCallbackFunction addonThreadSafeOnLoadProgressEventCallback;
         bool onLoadProgressEventCallbackSet = false;
         bool hasLoadAbortSignal = false;
+        bool prefetch = false;
+        AddonModelPrefetchOptions prefetchOptions;
+        float prefetchProgressShare = 0;
+        AddonLoadReport loadReport;
+
+        // the process-wide model this instance uses. models loaded with `no_alloc` aren't registered
+        std::shared_ptr<AddonSharedModel> sharedModel;
+
+        // reuse a model that's already loaded with the same file and parameters in any environment of the process
+        bool shared = false;
+
+        // attach to the loaded model with this id instead of loading the model file
+        uint64_t attachShareHandle = 0;
+
+        // whether the model was already loaded by another instance when this instance loaded it
+        bool sharedModelReused = false;
+
+        // a hash of the content of the model file or buffers, computed when the model is loaded.
+        // `0` when the content couldn't be read
+        uint64_t contentFingerprint = 0;
 
         bool disposed = false;
         bool memoryDisposed = false;
@@ -48,6 +72,7 @@ class AddonModel : public Napi::ObjectWrap<AddonModel> {
         Napi::Value Dispose(const Napi::CallbackInfo& info);
         Napi::Value Tokenize(const Napi::CallbackInfo& info);
         Napi::Value Detokenize(const Napi::CallbackInfo& info);
+        Napi::Value CountTokens(const Napi::CallbackInfo& info);
         Napi::Value GetTrainContextSize(const Napi::CallbackInfo& info);
         Napi::Value GetEmbeddingVectorSize(const Napi::CallbackInfo& info);
         Napi::Value GetTotalSize(const Napi::CallbackInfo& info);
@@ -71,6 +96,9 @@ class AddonModel : public Napi::ObjectWrap<AddonModel> {
         Napi::Value ShouldPrependBosToken(const Napi::CallbackInfo& info);
         Napi::Value ShouldAppendEosToken(const Napi::CallbackInfo& info);
         Napi::Value GetModelSize(const Napi::CallbackInfo& info);
+        Napi::Value GetShareHandle(const Napi::CallbackInfo& info);
+        Napi::Value GetSharedModelReused(const Napi::CallbackInfo& info);
+        Napi::Value GetLoadReport(const Napi::CallbackInfo& info);
 
         static void init(Napi::Object exports);
 };
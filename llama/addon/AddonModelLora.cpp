@@ -62,9 +62,17 @@ void AddonModelLora::disposeMemory() {
     memoryDisposed = true;
 
     if (lora_adapter != nullptr) {
-        llama_adapter_lora_free(lora_adapter);
+        if (sharedModel != nullptr) {
+            std::lock_guard<std::mutex> adaptersLock(sharedModel->adaptersMutex);
+            llama_adapter_lora_free(lora_adapter);
+        } else {
+            llama_adapter_lora_free(lora_adapter);
+        }
+
         lora_adapter = nullptr;
     }
+
+    sharedModel.reset();
 }
 
 void AddonModelLora::disposeMT(bool skipErase) {
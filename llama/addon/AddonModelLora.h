@@ -1,14 +1,23 @@
 #pragma once
+#include <cstdint>
+#include <memory>
 #include <mutex>
 #include "llama.h"
 #include "napi.h"
 #include "addonGlobals.h"
+#include "AddonModelRegistry.h"
 
 class AddonModelLora : public Napi::ObjectWrap<AddonModelLora> {
     public:
         AddonModel* model;
         llama_adapter_lora * lora_adapter;
+
+        // keeps the model of the adapter loaded until the adapter is freed
+        std::shared_ptr<AddonSharedModel> sharedModel;
         std::string loraFilePath;
+
+        // a hash of the content of the adapter file, computed when the adapter is loaded
+        uint64_t contentFingerprint = 0;
         uint32_t usages = 0;
         std::mutex disposeMutex;
         bool disposed = false;
@@ -0,0 +1,409 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "gguf.h"
+#include "llama.h"
+#include "AddonMappedFile.h"
+#include "AddonModelPrefetch.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#if defined(__linux__) && !defined(MADV_POPULATE_READ)
+#define MADV_POPULATE_READ 22
+#endif
+
+static constexpr std::size_t prefetchChunkSize = 16 * 1024 * 1024;
+static constexpr std::size_t defaultMaxPrefetchThreads = 8;
+static constexpr auto prefetchProgressReportInterval = std::chrono::milliseconds(50);
+
+struct AddonModelPrefetchRange {
+    std::size_t fileIndex;
+    std::size_t offset;
+    std::size_t size;
+
+    // the position of the range in the layer order of the model
+    int64_t layerOrder;
+    std::size_t numaNode = 0;
+};
+
+static std::size_t getPageSize() {
+#ifdef _WIN32
+    SYSTEM_INFO systemInfo;
+    GetSystemInfo(&systemInfo);
+    return static_cast<std::size_t>(systemInfo.dwPageSize);
+#else
+    const long pageSize = sysconf(_SC_PAGESIZE);
+    return pageSize > 0
+        ? static_cast<std::size_t>(pageSize)
+        : 4096;
+#endif
+}
+
+// token embeddings and other global tensors are used first, the layers are used in order, and the output tensors are used last
+static int64_t getTensorLayerOrder(const std::string& tensorName) {
+    static const std::string layerTensorPrefix = "blk.";
+
+    if (tensorName.rfind(layerTensorPrefix, 0) == 0) {
+        const auto dotIndex = tensorName.find('.', layerTensorPrefix.size());
+        try {
+            return std::stoll(tensorName.substr(layerTensorPrefix.size(), dotIndex - layerTensorPrefix.size())) + 1;
+        } catch (...) {
+            return 0;
+        }
+    }
+
+    if (tensorName.rfind("output", 0) == 0) {
+        return std::numeric_limits<int64_t>::max();
+    }
+
+    return 0;
+}
+
+static std::vector<std::string> getModelFilePaths(const std::string& modelPath) {
+    std::vector<std::string> res = {modelPath};
+
+    gguf_init_params params = {
+        /*.no_alloc = */ true,
+        /*.ctx      = */ nullptr,
+    };
+    gguf_context* ggufContext = gguf_init_from_file(modelPath.c_str(), params);
+    if (ggufContext == nullptr) {
+        return res;
+    }
+
+    const int64_t splitCountKey = gguf_find_key(ggufContext, "split.count");
+    const int splitCount = splitCountKey < 0
+        ? 0
+        : gguf_get_val_u16(ggufContext, splitCountKey);
+    gguf_free(ggufContext);
+
+    if (splitCount <= 1) {
+        return res;
+    }
+
+    std::vector<char> splitPrefix(modelPath.size() + 1, 0);
+    if (llama_split_prefix(splitPrefix.data(), splitPrefix.size(), modelPath.c_str(), 0, splitCount) <= 0) {
+        return res;
+    }
+
+    std::vector<char> splitPath(modelPath.size() + 64, 0);
+    for (int i = 1; i < splitCount; i++) {
+        llama_split_path(splitPath.data(), splitPath.size(), splitPrefix.data(), i, splitCount);
+        res.emplace_back(splitPath.data());
+    }
+
+    return res;
+}
+
+static void addModelFileTensorRanges(const std::string& filePath, std::size_t fileIndex, std::vector<AddonModelPrefetchRange>& ranges) {
+    gguf_init_params params = {
+        /*.no_alloc = */ true,
+        /*.ctx      = */ nullptr,
+    };
+    gguf_context* ggufContext = gguf_init_from_file(filePath.c_str(), params);
+    if (ggufContext == nullptr) {
+        return;
+    }
+
+    const std::size_t dataOffset = gguf_get_data_offset(ggufContext);
+    const int64_t tensorCount = gguf_get_n_tensors(ggufContext);
+    for (int64_t i = 0; i < tensorCount; i++) {
+        const std::size_t size = gguf_get_tensor_size(ggufContext, i);
+        if (size == 0) {
+            continue;
+        }
+
+        ranges.push_back(AddonModelPrefetchRange {
+            fileIndex,
+            dataOffset + gguf_get_tensor_offset(ggufContext, i),
+            size,
+            getTensorLayerOrder(gguf_get_tensor_name(ggufContext, i))
+        });
+    }
+
+    gguf_free(ggufContext);
+}
+
+#ifdef __linux__
+static std::vector<cpu_set_t> getNumaNodeCpuSets() {
+    std::vector<cpu_set_t> res;
+
+    for (std::size_t node = 0; ; node++) {
+        std::ifstream cpuListFile("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        if (!cpuListFile.is_open()) {
+            break;
+        }
+
+        std::string cpuList;
+        std::getline(cpuListFile, cpuList);
+
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+
+        // the CPU list is formatted as comma separated CPU numbers and ranges, like "0-15,32-47"
+        std::size_t start = 0;
+        while (start < cpuList.size()) {
+            std::size_t end = cpuList.find(',', start);
+            if (end == std::string::npos) {
+                end = cpuList.size();
+            }
+
+            const std::string item = cpuList.substr(start, end - start);
+            const std::size_t dashIndex = item.find('-');
+            try {
+                const int firstCpu = std::stoi(item.substr(0, dashIndex));
+                const int lastCpu = dashIndex == std::string::npos
+                    ? firstCpu
+                    : std::stoi(item.substr(dashIndex + 1));
+
+                for (int cpu = firstCpu; cpu <= lastCpu && cpu < CPU_SETSIZE; cpu++) {
+                    CPU_SET(cpu, &cpuSet);
+                }
+            } catch (...) {
+                // ignore malformed items
+            }
+
+            start = end + 1;
+        }
+
+        if (CPU_COUNT(&cpuSet) > 0) {
+            res.push_back(cpuSet);
+        }
+    }
+
+    return res;
+}
+#endif
+
+// read every page of the given range, so the OS loads it into the page cache.
+// the pages are allocated on the NUMA node of the reading thread
+static void prefetchRange(const uint8_t* data, std::size_t size, std::size_t pageSize, std::atomic<bool>& populateReadSupported) {
+#ifdef __linux__
+    if (populateReadSupported) {
+        const uintptr_t start = reinterpret_cast<uintptr_t>(data);
+        const uintptr_t alignedStart = start - (start % pageSize);
+        if (madvise(reinterpret_cast<void*>(alignedStart), size + (start - alignedStart), MADV_POPULATE_READ) == 0) {
+            return;
+        }
+
+        // `MADV_POPULATE_READ` is only supported since Linux 5.14
+        populateReadSupported = false;
+    }
+#else
+    (void)populateReadSupported;
+#endif
+
+    volatile uint8_t sink = 0;
+    for (std::size_t offset = 0; offset < size; offset += pageSize) {
+        sink = sink + data[offset];
+    }
+
+    if (size > 0) {
+        sink = sink + data[size - 1];
+    }
+}
+
+bool addonPrefetchModelFile(
+    const std::string& modelPath,
+    const AddonModelPrefetchOptions& options,
+    const std::function<void(float)>& onProgress,
+    const std::function<bool()>& shouldAbort,
+    AddonThreadResourceUsage* threadsResourceUsage
+) {
+    const std::vector<std::string> filePaths = getModelFilePaths(modelPath);
+
+    std::vector<AddonModelPrefetchRange> tensorRanges;
+    for (std::size_t i = 0; i < filePaths.size(); i++) {
+        addModelFileTensorRanges(filePaths[i], i, tensorRanges);
+    }
+
+    if (tensorRanges.empty()) {
+        return true;
+    }
+
+    std::vector<std::unique_ptr<AddonMappedFile>> mappedFiles;
+    for (const auto& filePath : filePaths) {
+        auto mappedFile = std::make_unique<AddonMappedFile>();
+        if (!mappedFile->open(filePath)) {
+            // the model load itself will report the file error
+            return true;
+        }
+
+        mappedFiles.push_back(std::move(mappedFile));
+    }
+
+    std::sort(tensorRanges.begin(), tensorRanges.end(), [](const auto& a, const auto& b) {
+        if (a.layerOrder != b.layerOrder) {
+            return a.layerOrder < b.layerOrder;
+        }
+
+        if (a.fileIndex != b.fileIndex) {
+            return a.fileIndex < b.fileIndex;
+        }
+
+        return a.offset < b.offset;
+    });
+
+    std::size_t numaNodeCount = 1;
+#ifdef __linux__
+    std::vector<cpu_set_t> numaNodeCpuSets;
+    if (options.distributeAcrossNumaNodes) {
+        numaNodeCpuSets = getNumaNodeCpuSets();
+        numaNodeCount = std::max<std::size_t>(1, numaNodeCpuSets.size());
+    }
+#endif
+
+    // assign contiguous layer spans to the NUMA nodes, and split the tensor ranges into chunks
+    // that the threads of each node pick up in the layer order
+    std::vector<int64_t> layerOrders;
+    for (const auto& range : tensorRanges) {
+        if (layerOrders.empty() || layerOrders.back() != range.layerOrder) {
+            layerOrders.push_back(range.layerOrder);
+        }
+    }
+
+    std::vector<std::vector<AddonModelPrefetchRange>> nodeChunks(numaNodeCount);
+    std::size_t totalSize = 0;
+    std::size_t layerIndex = 0;
+    for (const auto& range : tensorRanges) {
+        while (layerOrders[layerIndex] != range.layerOrder) {
+            layerIndex++;
+        }
+
+        const std::size_t numaNode = (layerIndex * numaNodeCount) / layerOrders.size();
+        const auto& mappedFile = mappedFiles[range.fileIndex];
+        if (range.offset >= mappedFile->size()) {
+            continue;
+        }
+
+        const std::size_t rangeSize = std::min(range.size, mappedFile->size() - range.offset);
+        auto& chunks = nodeChunks[numaNode];
+
+        for (std::size_t offset = 0; offset < rangeSize; offset += prefetchChunkSize) {
+            const std::size_t chunkOffset = range.offset + offset;
+            const std::size_t chunkSize = std::min(prefetchChunkSize, rangeSize - offset);
+
+            auto* lastChunk = chunks.empty()
+                ? nullptr
+                : &chunks.back();
+            if (lastChunk != nullptr && lastChunk->fileIndex == range.fileIndex &&
+                lastChunk->offset + lastChunk->size == chunkOffset && lastChunk->size + chunkSize <= prefetchChunkSize
+            ) {
+                lastChunk->size += chunkSize;
+            } else {
+                chunks.push_back(AddonModelPrefetchRange {range.fileIndex, chunkOffset, chunkSize, range.layerOrder, numaNode});
+            }
+        }
+
+        totalSize += rangeSize;
+    }
+
+    if (totalSize == 0) {
+        return true;
+    }
+
+    std::size_t threadCount = options.threads;
+    if (threadCount == 0) {
+        threadCount = std::min<std::size_t>(defaultMaxPrefetchThreads, std::max(1u, std::thread::hardware_concurrency()));
+    }
+
+    const std::size_t pageSize = getPageSize();
+    std::atomic<bool> populateReadSupported = true;
+    std::atomic<bool> aborted = false;
+    std::atomic<std::size_t> prefetchedSize = 0;
+    std::vector<std::atomic<std::size_t>> nextNodeChunkIndexes(numaNodeCount);
+    for (auto& nextChunkIndex : nextNodeChunkIndexes) {
+        nextChunkIndex = 0;
+    }
+
+    std::mutex doneMutex;
+    std::condition_variable doneCondition;
+    std::size_t runningThreads = 0;
+
+    const auto prefetchNodeChunks = [&](std::size_t numaNode) {
+        const AddonThreadResourceUsage startThreadUsage = addonGetThreadResourceUsage();
+
+#ifdef __linux__
+        if (numaNode < numaNodeCpuSets.size()) {
+            pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &numaNodeCpuSets[numaNode]);
+        }
+#endif
+
+        const auto& chunks = nodeChunks[numaNode];
+        auto& nextChunkIndex = nextNodeChunkIndexes[numaNode];
+
+        while (!aborted) {
+            const std::size_t chunkIndex = nextChunkIndex++;
+            if (chunkIndex >= chunks.size()) {
+                break;
+            }
+
+            const auto& chunk = chunks[chunkIndex];
+            prefetchRange(mappedFiles[chunk.fileIndex]->data() + chunk.offset, chunk.size, pageSize, populateReadSupported);
+            prefetchedSize += chunk.size;
+        }
+
+        const AddonThreadResourceUsage endThreadUsage = addonGetThreadResourceUsage();
+
+        std::lock_guard<std::mutex> lock(doneMutex);
+        if (threadsResourceUsage != nullptr) {
+            addonAddThreadResourceUsage(*threadsResourceUsage, startThreadUsage, endThreadUsage);
+        }
+
+        runningThreads--;
+        doneCondition.notify_all();
+    };
+
+    std::vector<std::thread> threads;
+    for (std::size_t numaNode = 0; numaNode < numaNodeCount; numaNode++) {
+        const std::size_t nodeThreadCount = std::max<std::size_t>(1, threadCount / numaNodeCount);
+
+        for (std::size_t i = 0; i < nodeThreadCount; i++) {
+            {
+                std::lock_guard<std::mutex> lock(doneMutex);
+                runningThreads++;
+            }
+
+            threads.emplace_back(prefetchNodeChunks, numaNode);
+        }
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(doneMutex);
+        while (runningThreads > 0) {
+            doneCondition.wait_for(lock, prefetchProgressReportInterval);
+
+            if (!aborted && shouldAbort()) {
+                aborted = true;
+            }
+
+            lock.unlock();
+            onProgress(static_cast<float>(static_cast<double>(prefetchedSize.load()) / static_cast<double>(totalSize)));
+            lock.lock();
+        }
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    return !aborted;
+}
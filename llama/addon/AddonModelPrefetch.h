@@ -0,0 +1,27 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <string>
+
+#include "AddonLoadReport.h"
+
+struct AddonModelPrefetchOptions {
+    // the number of threads to read the model file with. `0` uses a default based on the number of CPU cores
+    std::size_t threads = 0;
+
+    // spread the prefetched layers across the NUMA nodes of the system, in the same way the "distribute" NUMA strategy spreads the computation
+    bool distributeAcrossNumaNodes = false;
+};
+
+// read the tensor data of a GGUF model file (and of its other split files) into the OS page cache, in the order of the model layers,
+// so loading it with mmap and evaluating it right afterward doesn't stall on page faults.
+// `onProgress` is called from the calling thread with the prefetched fraction of the tensor data.
+// the resource usage of the prefetch threads is added to `threadsResourceUsage` when it's given.
+// returns `false` when the prefetch was aborted
+bool addonPrefetchModelFile(
+    const std::string& modelPath,
+    const AddonModelPrefetchOptions& options,
+    const std::function<void(float)>& onProgress,
+    const std::function<bool()>& shouldAbort,
+    AddonThreadResourceUsage* threadsResourceUsage = nullptr
+);
@@ -0,0 +1,133 @@
+#include <sstream>
+#include <unordered_map>
+
+#include "AddonModelRegistry.h"
+
+struct AddonSharedModelRegistryEntry {
+    // held while the model of the entry is being loaded, so concurrent loads of the same key reuse the same model
+    std::mutex loadMutex;
+    std::weak_ptr<AddonSharedModel> model;
+};
+
+struct AddonSharedModelRegistry {
+    std::mutex mutex;
+    std::unordered_map<std::string, std::shared_ptr<AddonSharedModelRegistryEntry>> entriesByKey;
+    std::unordered_map<uint64_t, std::weak_ptr<AddonSharedModel>> modelsById;
+    uint64_t nextModelId = 1;
+};
+
+// intentionally never freed, since shared models may be released while the process exits
+static AddonSharedModelRegistry& getRegistry() {
+    static AddonSharedModelRegistry* registry = new AddonSharedModelRegistry();
+    return *registry;
+}
+
+AddonSharedModel::AddonSharedModel(uint64_t id, std::string key, llama_model* model)
+    : id(id),
+      key(std::move(key)),
+      model(model) {
+}
+
+AddonSharedModel::~AddonSharedModel() {
+    {
+        auto& registry = getRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.modelsById.erase(id);
+    }
+
+    llama_model_free(model);
+}
+
+std::string addonGetSharedModelKey(
+    const std::string& modelPath, const llama_model_params& params, const std::vector<llama_model_kv_override>& kvOverrides
+) {
+    std::ostringstream key;
+    key << modelPath
+        << '\n' << params.n_gpu_layers
+        << ':' << params.split_mode
+        << ':' << params.main_gpu
+        << ':' << params.vocab_only
+        << ':' << params.use_mmap
+        << ':' << params.use_direct_io
+        << ':' << params.use_mlock
+        << ':' << params.check_tensors;
+
+    for (const auto& kvOverride : kvOverrides) {
+        if (kvOverride.key[0] == 0) {
+            continue;
+        }
+
+        key << '\n' << kvOverride.key << '=' << kvOverride.tag << ':';
+        switch (kvOverride.tag) {
+            case LLAMA_KV_OVERRIDE_TYPE_INT: key << kvOverride.val_i64; break;
+            case LLAMA_KV_OVERRIDE_TYPE_FLOAT: key << kvOverride.val_f64; break;
+            case LLAMA_KV_OVERRIDE_TYPE_BOOL: key << kvOverride.val_bool; break;
+            case LLAMA_KV_OVERRIDE_TYPE_STR: key << kvOverride.val_str; break;
+        }
+    }
+
+    return key.str();
+}
+
+std::shared_ptr<AddonSharedModel> addonAcquireSharedModel(
+    const std::string& key, bool reuseLoadedModel, const std::function<llama_model*()>& loadModel, bool& reusedLoadedModel
+) {
+    auto& registry = getRegistry();
+    reusedLoadedModel = false;
+    std::shared_ptr<AddonSharedModelRegistryEntry> entry;
+
+    {
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        auto& existingEntry = registry.entriesByKey[key];
+        if (existingEntry == nullptr) {
+            existingEntry = std::make_shared<AddonSharedModelRegistryEntry>();
+        }
+
+        entry = existingEntry;
+    }
+
+    std::unique_lock<std::mutex> loadLock(entry->loadMutex, std::defer_lock);
+    if (reuseLoadedModel) {
+        loadLock.lock();
+
+        auto loadedModel = entry->model.lock();
+        if (loadedModel != nullptr) {
+            reusedLoadedModel = true;
+            return loadedModel;
+        }
+    }
+
+    llama_model* model = loadModel();
+    if (model == nullptr) {
+        return nullptr;
+    }
+
+    std::shared_ptr<AddonSharedModel> sharedModel;
+    {
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        sharedModel = std::make_shared<AddonSharedModel>(registry.nextModelId++, key, model);
+        registry.modelsById[sharedModel->id] = sharedModel;
+    }
+
+    if (!loadLock.owns_lock()) {
+        loadLock.lock();
+    }
+
+    if (entry->model.expired()) {
+        entry->model = sharedModel;
+    }
+
+    return sharedModel;
+}
+
+std::shared_ptr<AddonSharedModel> addonFindSharedModel(uint64_t id) {
+    auto& registry = getRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    auto modelIterator = registry.modelsById.find(id);
+    if (modelIterator == registry.modelsById.end()) {
+        return nullptr;
+    }
+
+    return modelIterator->second.lock();
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "llama.h"
+
+// a loaded `llama_model` that the `AddonModel` instances of all the Node.js environments (worker threads) of the process can use.
+// the model is freed when the last instance that uses it releases it
+class AddonSharedModel {
+    public:
+        const uint64_t id;
+        const std::string key;
+        llama_model* const model;
+
+        // LoRA adapters are registered on the model when they're created and freed,
+        // so creating and freeing them from multiple environments at the same time has to be serialized
+        std::mutex adaptersMutex;
+
+        AddonSharedModel(uint64_t id, std::string key, llama_model* model);
+        ~AddonSharedModel();
+
+        AddonSharedModel(const AddonSharedModel&) = delete;
+        AddonSharedModel& operator=(const AddonSharedModel&) = delete;
+};
+
+// the registry key of a model file loaded with the given parameters
+std::string addonGetSharedModelKey(
+    const std::string& modelPath, const llama_model_params& params, const std::vector<llama_model_kv_override>& kvOverrides
+);
+
+// register a model that `loadModel` loads.
+// when `reuseLoadedModel` is `true` and a model with the same key is already loaded, it's returned instead of loading the model again,
+// and concurrent loads of the same key wait for each other to reuse the same model.
+// `reusedLoadedModel` is set to whether an already loaded model was returned.
+// returns `nullptr` when `loadModel` fails to load the model
+std::shared_ptr<AddonSharedModel> addonAcquireSharedModel(
+    const std::string& key, bool reuseLoadedModel, const std::function<llama_model*()>& loadModel, bool& reusedLoadedModel
+);
+
+// returns `nullptr` when the model with the given id is no longer loaded
+std::shared_ptr<AddonSharedModel> addonFindSharedModel(uint64_t id);
@@ -0,0 +1,339 @@
+#include <algorithm>
+
+#include "AddonPrefixCache.h"
+
+AddonPrefixCache::AddonPrefixCache() {}
+
+std::size_t AddonPrefixCache::getSequenceLength(llama_seq_id sequenceId) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    const auto entry = sequences.find(sequenceId);
+    if (entry == sequences.end()) {
+        return 0;
+    }
+
+    return entry->second.tokens.size();
+}
+
+std::size_t AddonPrefixCache::getSequenceCommonPrefixLength(llama_seq_id sequenceId, const llama_token* tokens, std::size_t tokensCount) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    const auto entry = sequences.find(sequenceId);
+    if (entry == sequences.end()) {
+        return 0;
+    }
+
+    const auto& sequenceTokens = entry->second.tokens;
+    const std::size_t maxLength = std::min(sequenceTokens.size(), tokensCount);
+    std::size_t length = 0;
+    while (length < maxLength && sequenceTokens[length] == tokens[length]) {
+        length++;
+    }
+
+    return length;
+}
+
+std::vector<llama_token> AddonPrefixCache::getSequenceTokens(llama_seq_id sequenceId) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    const auto entry = sequences.find(sequenceId);
+    if (entry == sequences.end()) {
+        return {};
+    }
+
+    return entry->second.tokens;
+}
+
+uint64_t AddonPrefixCache::getSequenceAdaptersKey(llama_seq_id sequenceId) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    const auto entry = sequences.find(sequenceId);
+    if (entry == sequences.end()) {
+        return unknownAdaptersKey;
+    }
+
+    return entry->second.adaptersKey;
+}
+
+void AddonPrefixCache::setSequenceTokens(llama_seq_id sequenceId, const llama_token* tokens, std::size_t tokensCount, uint64_t adaptersKey) {
+    std::lock_guard<std::mutex> lock(mutex);
+    replaceSequenceTokens(sequenceId, std::vector<llama_token>(tokens, tokens + tokensCount), adaptersKey);
+}
+
+void AddonPrefixCache::appendSequenceTokens(
+    llama_seq_id sequenceId, llama_pos startPos, const llama_token* tokens, std::size_t tokensCount, uint64_t adaptersKey
+) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (tokensCount == 0 || startPos < 0) {
+        return;
+    }
+
+    auto entry = sequences.find(sequenceId);
+    const std::size_t currentLength = entry == sequences.end() ? 0 : entry->second.tokens.size();
+
+    if (static_cast<std::size_t>(startPos) > currentLength) {
+        // the new tokens are not contiguous with the known prefix of the sequence
+        return;
+    }
+
+    if (entry != sequences.end() && startPos > 0 && entry->second.adaptersKey != adaptersKey) {
+        // the new tokens are evaluated with other adapters than the known prefix of the sequence,
+        // so only the prefix is kept, and following tokens are not contiguous with it anymore
+        std::vector<llama_token> newTokens(entry->second.tokens.begin(), entry->second.tokens.begin() + startPos);
+        replaceSequenceTokens(sequenceId, std::move(newTokens), entry->second.adaptersKey);
+        return;
+    }
+
+    if (entry != sequences.end() && static_cast<std::size_t>(startPos) == currentLength) {
+        // fast path: when the sequence ends at a leaf that only it owns, extend the leaf edge in place
+        AddonPrefixCacheNode* node = &root;
+        std::size_t i = 0;
+        const auto& sequenceTokens = entry->second.tokens;
+        while (i < sequenceTokens.size()) {
+            auto child = node->children.find(sequenceTokens[i]);
+            if (child == node->children.end()) {
+                break;
+            }
+
+            node = child->second.get();
+            i += node->edge.size();
+        }
+
+        if (node != &root && i == sequenceTokens.size() && node->children.empty() && node->sequences.size() == 1) {
+            node->edge.insert(node->edge.end(), tokens, tokens + tokensCount);
+            entry->second.tokens.insert(entry->second.tokens.end(), tokens, tokens + tokensCount);
+            entry->second.lastUsed = ++usageCounter;
+            return;
+        }
+    }
+
+    std::vector<llama_token> newTokens;
+    newTokens.reserve(startPos + tokensCount);
+    if (entry != sequences.end()) {
+        newTokens.assign(entry->second.tokens.begin(), entry->second.tokens.begin() + startPos);
+    }
+    newTokens.insert(newTokens.end(), tokens, tokens + tokensCount);
+
+    replaceSequenceTokens(sequenceId, std::move(newTokens), adaptersKey);
+}
+
+void AddonPrefixCache::truncateSequence(llama_seq_id sequenceId, llama_pos length) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto entry = sequences.find(sequenceId);
+    if (entry == sequences.end() || entry->second.tokens.size() <= static_cast<std::size_t>(std::max<llama_pos>(0, length))) {
+        return;
+    }
+
+    std::vector<llama_token> newTokens(entry->second.tokens.begin(), entry->second.tokens.begin() + std::max<llama_pos>(0, length));
+    replaceSequenceTokens(sequenceId, std::move(newTokens), entry->second.adaptersKey);
+}
+
+void AddonPrefixCache::removeSequence(llama_seq_id sequenceId) {
+    std::lock_guard<std::mutex> lock(mutex);
+    replaceSequenceTokens(sequenceId, {}, unknownAdaptersKey);
+}
+
+AddonPrefixCacheMatch AddonPrefixCache::findLongestPrefix(
+    const llama_token* tokens, std::size_t tokensCount, uint64_t adaptersKey, llama_seq_id excludedSequenceId
+) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (adaptersKey == unknownAdaptersKey) {
+        return {};
+    }
+
+    // prefer the most recently used sequence, as it's the least likely to be evicted soon
+    auto pickSequence = [&](const AddonPrefixCacheNode* node) {
+        llama_seq_id bestSequenceId = -1;
+        uint64_t bestLastUsed = 0;
+
+        for (const llama_seq_id sequenceId : node->sequences) {
+            const SequenceEntry& entry = sequences[sequenceId];
+            if (sequenceId == excludedSequenceId || entry.adaptersKey != adaptersKey) {
+                continue;
+            }
+
+            const uint64_t lastUsed = entry.lastUsed;
+            if (bestSequenceId == -1 || lastUsed > bestLastUsed) {
+                bestSequenceId = sequenceId;
+                bestLastUsed = lastUsed;
+            }
+        }
+
+        return bestSequenceId;
+    };
+
+    AddonPrefixCacheMatch bestMatch;
+    const AddonPrefixCacheNode* node = &root;
+    std::size_t i = 0;
+    while (i < tokensCount) {
+        const auto child = node->children.find(tokens[i]);
+        if (child == node->children.end()) {
+            break;
+        }
+
+        const AddonPrefixCacheNode* childNode = child->second.get();
+        std::size_t matchLength = 0;
+        while (matchLength < childNode->edge.size() && i + matchLength < tokensCount &&
+            childNode->edge[matchLength] == tokens[i + matchLength]
+        ) {
+            matchLength++;
+        }
+
+        // the sequences of a node are a subset of the sequences of its parent, so there's no point in going deeper
+        const llama_seq_id sequenceId = pickSequence(childNode);
+        if (sequenceId == -1) {
+            break;
+        }
+
+        bestMatch.sequenceId = sequenceId;
+        bestMatch.length = i + matchLength;
+
+        if (matchLength < childNode->edge.size()) {
+            break;
+        }
+
+        node = childNode;
+        i += matchLength;
+    }
+
+    return bestMatch;
+}
+
+void AddonPrefixCache::markSequenceUsed(llama_seq_id sequenceId) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto entry = sequences.find(sequenceId);
+    if (entry != sequences.end()) {
+        entry->second.lastUsed = ++usageCounter;
+    }
+}
+
+llama_seq_id AddonPrefixCache::getLeastRecentlyUsedSequence(const std::vector<llama_seq_id>& sequenceIds) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    llama_seq_id leastRecentlyUsedSequenceId = -1;
+    uint64_t leastRecentlyUsedLastUsed = 0;
+    for (const llama_seq_id sequenceId : sequenceIds) {
+        const auto entry = sequences.find(sequenceId);
+        const uint64_t lastUsed = entry == sequences.end() ? 0 : entry->second.lastUsed;
+
+        if (leastRecentlyUsedSequenceId == -1 || lastUsed < leastRecentlyUsedLastUsed) {
+            leastRecentlyUsedSequenceId = sequenceId;
+            leastRecentlyUsedLastUsed = lastUsed;
+        }
+    }
+
+    return leastRecentlyUsedSequenceId;
+}
+
+void AddonPrefixCache::insertPath(llama_seq_id sequenceId, const std::vector<llama_token>& tokens) {
+    AddonPrefixCacheNode* node = &root;
+    std::size_t i = 0;
+
+    while (i < tokens.size()) {
+        auto child = node->children.find(tokens[i]);
+        if (child == node->children.end()) {
+            auto newNode = std::make_unique<AddonPrefixCacheNode>();
+            newNode->parent = node;
+            newNode->edge.assign(tokens.begin() + i, tokens.end());
+            newNode->sequences.insert(sequenceId);
+            node->children.emplace(tokens[i], std::move(newNode));
+            return;
+        }
+
+        AddonPrefixCacheNode* childNode = child->second.get();
+        std::size_t matchLength = 0;
+        while (matchLength < childNode->edge.size() && i + matchLength < tokens.size() &&
+            childNode->edge[matchLength] == tokens[i + matchLength]
+        ) {
+            matchLength++;
+        }
+
+        if (matchLength < childNode->edge.size()) {
+            // split the edge so the sequence diverges (or ends) exactly at a node
+            auto middleNode = std::make_unique<AddonPrefixCacheNode>();
+            middleNode->parent = node;
+            middleNode->edge.assign(childNode->edge.begin(), childNode->edge.begin() + matchLength);
+            middleNode->sequences = childNode->sequences;
+
+            std::unique_ptr<AddonPrefixCacheNode> movedChildNode = std::move(child->second);
+            movedChildNode->edge.erase(movedChildNode->edge.begin(), movedChildNode->edge.begin() + matchLength);
+            movedChildNode->parent = middleNode.get();
+
+            const llama_token movedChildKey = movedChildNode->edge[0];
+            middleNode->children.emplace(movedChildKey, std::move(movedChildNode));
+
+            childNode = middleNode.get();
+            child->second = std::move(middleNode);
+        }
+
+        childNode->sequences.insert(sequenceId);
+        node = childNode;
+        i += matchLength;
+    }
+}
+
+void AddonPrefixCache::removePath(llama_seq_id sequenceId, const std::vector<llama_token>& tokens) {
+    std::vector<AddonPrefixCacheNode*> path;
+    AddonPrefixCacheNode* node = &root;
+    std::size_t i = 0;
+
+    while (i < tokens.size()) {
+        auto child = node->children.find(tokens[i]);
+        if (child == node->children.end()) {
+            break;
+        }
+
+        node = child->second.get();
+        node->sequences.erase(sequenceId);
+        path.push_back(node);
+        i += node->edge.size();
+    }
+
+    for (auto pathNode = path.rbegin(); pathNode != path.rend(); ++pathNode) {
+        AddonPrefixCacheNode* currentNode = *pathNode;
+
+        if (currentNode->sequences.empty()) {
+            // the children of a node without sequences have no sequences either, so they're freed with it
+            currentNode->parent->children.erase(currentNode->edge[0]);
+            continue;
+        }
+
+        if (currentNode->children.size() == 1 && currentNode->children.begin()->second->sequences.size() == currentNode->sequences.size()) {
+            // no sequence ends at this node anymore, so merge its only child into it
+            std::unique_ptr<AddonPrefixCacheNode> onlyChild = std::move(currentNode->children.begin()->second);
+            currentNode->children.clear();
+
+            currentNode->edge.insert(currentNode->edge.end(), onlyChild->edge.begin(), onlyChild->edge.end());
+            currentNode->children = std::move(onlyChild->children);
+            for (auto& [key, grandChild] : currentNode->children) {
+                grandChild->parent = currentNode;
+            }
+        }
+    }
+}
+
+void AddonPrefixCache::replaceSequenceTokens(llama_seq_id sequenceId, std::vector<llama_token> tokens, uint64_t adaptersKey) {
+    auto entry = sequences.find(sequenceId);
+    if (entry != sequences.end()) {
+        removePath(sequenceId, entry->second.tokens);
+    }
+
+    if (tokens.empty()) {
+        if (entry != sequences.end()) {
+            sequences.erase(entry);
+        }
+
+        return;
+    }
+
+    insertPath(sequenceId, tokens);
+
+    SequenceEntry& sequenceEntry = sequences[sequenceId];
+    sequenceEntry.tokens = std::move(tokens);
+    sequenceEntry.adaptersKey = adaptersKey;
+    sequenceEntry.lastUsed = ++usageCounter;
+}
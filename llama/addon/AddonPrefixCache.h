@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "llama.h"
+
+struct AddonPrefixCacheNode {
+    AddonPrefixCacheNode* parent = nullptr;
+    std::vector<llama_token> edge; // the tokens from the parent node to this node
+    std::unordered_map<llama_token, std::unique_ptr<AddonPrefixCacheNode>> children;
+    std::unordered_set<llama_seq_id> sequences; // the sequences that have the entire path from the root to this node in the KV cache
+};
+
+struct AddonPrefixCacheMatch {
+    llama_seq_id sequenceId = -1;
+    std::size_t length = 0;
+};
+
+// a radix tree of the token prefixes that are present in the KV cache of the context sequences.
+// every sequence is mapped to the tokens at positions [0, length) of its KV cache,
+// and to a key of the LoRA adapters these tokens were evaluated with, since the cells depend on them
+class AddonPrefixCache {
+    public:
+        // the key of sequences whose cells were loaded from an external state, so they're never reused
+        static constexpr uint64_t unknownAdaptersKey = UINT64_MAX;
+
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t reusedTokens = 0;
+
+        AddonPrefixCache();
+
+        std::size_t getSequenceLength(llama_seq_id sequenceId);
+        std::size_t getSequenceCommonPrefixLength(llama_seq_id sequenceId, const llama_token* tokens, std::size_t tokensCount);
+        std::vector<llama_token> getSequenceTokens(llama_seq_id sequenceId);
+        uint64_t getSequenceAdaptersKey(llama_seq_id sequenceId);
+
+        void setSequenceTokens(llama_seq_id sequenceId, const llama_token* tokens, std::size_t tokensCount, uint64_t adaptersKey);
+        void appendSequenceTokens(
+            llama_seq_id sequenceId, llama_pos startPos, const llama_token* tokens, std::size_t tokensCount, uint64_t adaptersKey
+        );
+        void truncateSequence(llama_seq_id sequenceId, llama_pos length);
+        void removeSequence(llama_seq_id sequenceId);
+
+        // find the sequence with the longest prefix of the given tokens that was evaluated with the given adapters,
+        // other than `excludedSequenceId`
+        AddonPrefixCacheMatch findLongestPrefix(
+            const llama_token* tokens, std::size_t tokensCount, uint64_t adaptersKey, llama_seq_id excludedSequenceId
+        );
+
+        void markSequenceUsed(llama_seq_id sequenceId);
+
+        // returns the least recently used sequence out of the given sequences
+        llama_seq_id getLeastRecentlyUsedSequence(const std::vector<llama_seq_id>& sequenceIds);
+
+    private:
+        struct SequenceEntry {
+            std::vector<llama_token> tokens;
+            uint64_t adaptersKey = 0;
+            uint64_t lastUsed = 0;
+        };
+
+        std::mutex mutex;
+        AddonPrefixCacheNode root;
+        std::unordered_map<llama_seq_id, SequenceEntry> sequences;
+        uint64_t usageCounter = 0;
+
+        void insertPath(llama_seq_id sequenceId, const std::vector<llama_token>& tokens);
+        void removePath(llama_seq_id sequenceId, const std::vector<llama_token>& tokens);
+        void replaceSequenceTokens(llama_seq_id sequenceId, std::vector<llama_token> tokens, uint64_t adaptersKey);
+};
@@ -0,0 +1,469 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+
+#include "AddonSequenceStateFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// file layout:
+// [header][tokens][zero padding up to `dataOffset`][state data][chunk checksums][checksum of the chunk checksums]
+static constexpr char sequenceStateFileMagic[8] = {'N', 'L', 'C', 'S', 'E', 'Q', 'S', 'T'};
+static constexpr uint32_t sequenceStateFileVersion = 1;
+static constexpr std::size_t sequenceStateFileHeaderSize = 64;
+
+// the alignment of the state data offset and of every write to the file, as required for direct I/O
+static constexpr std::size_t sequenceStateFileAlignment = 4096;
+
+static constexpr std::size_t sequenceStateFileMaxChunkSize = 1024 * 1024 * 1024;
+
+struct SequenceStateFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t chunkSize;
+    uint64_t modelFingerprint;
+    uint64_t tokenCount;
+    uint64_t stateSize;
+    uint64_t dataOffset;
+    uint32_t tokensChecksum;
+    uint32_t reserved[2];
+    uint32_t headerChecksum;
+};
+static_assert(sizeof(SequenceStateFileHeader) == sequenceStateFileHeaderSize, "Unexpected sequence state file header size");
+
+static inline uint64_t alignUp(uint64_t value, uint64_t alignment) {
+    return ((value + alignment - 1) / alignment) * alignment;
+}
+
+// a sequential file writer that only issues large writes from an aligned staging buffer,
+// so the file can be opened for direct I/O that bypasses the page cache
+class AlignedFileWriter {
+    public:
+        ~AlignedFileWriter() {
+            closeFile();
+        }
+
+        bool open(const std::string& filePath, bool directIo) {
+            stagingStorage.resize(addonSequenceStateFileChunkSize + sequenceStateFileAlignment);
+            const uintptr_t storageAddress = reinterpret_cast<uintptr_t>(stagingStorage.data());
+            staging = stagingStorage.data() + (alignUp(storageAddress, sequenceStateFileAlignment) - storageAddress);
+
+#ifdef _WIN32
+            const std::wstring widePath = addonToWidePath(filePath);
+            if (directIo) {
+                file = CreateFileW(
+                    widePath.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING, nullptr
+                );
+                alignedWrites = file != INVALID_HANDLE_VALUE;
+            }
+
+            if (file == INVALID_HANDLE_VALUE) {
+                file = CreateFileW(
+                    widePath.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr
+                );
+            }
+
+            return file != INVALID_HANDLE_VALUE;
+#else
+            const int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+
+#ifdef O_DIRECT
+            if (directIo) {
+                fd = ::open(filePath.c_str(), flags | O_DIRECT, 0644);
+                alignedWrites = fd != -1;
+            }
+#endif
+
+            if (fd == -1) {
+                fd = ::open(filePath.c_str(), flags, 0644);
+            }
+
+#ifdef F_NOCACHE
+            if (directIo && fd != -1) {
+                fcntl(fd, F_NOCACHE, 1);
+            }
+#endif
+
+            return fd != -1;
+#endif
+        }
+
+        bool write(const uint8_t* data, std::size_t size) {
+            while (size > 0) {
+                const std::size_t copySize = std::min(size, addonSequenceStateFileChunkSize - stagingUsed);
+                std::memcpy(staging + stagingUsed, data, copySize);
+                stagingUsed += copySize;
+                logicalSize += copySize;
+                data += copySize;
+                size -= copySize;
+
+                if (stagingUsed == addonSequenceStateFileChunkSize && !flushStaging()) {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        bool writeZeros(std::size_t size) {
+            while (size > 0) {
+                const std::size_t zeroSize = std::min(size, addonSequenceStateFileChunkSize - stagingUsed);
+                std::memset(staging + stagingUsed, 0, zeroSize);
+                stagingUsed += zeroSize;
+                logicalSize += zeroSize;
+                size -= zeroSize;
+
+                if (stagingUsed == addonSequenceStateFileChunkSize && !flushStaging()) {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        // flush the remaining data, trim the alignment padding of the last write, and fsync the file
+        bool finish() {
+            if (!flushStaging()) {
+                return false;
+            }
+
+#ifdef _WIN32
+            if (writtenSize != logicalSize) {
+                FILE_END_OF_FILE_INFO endOfFileInfo;
+                endOfFileInfo.EndOfFile.QuadPart = static_cast<LONGLONG>(logicalSize);
+                if (!SetFileInformationByHandle(file, FileEndOfFileInfo, &endOfFileInfo, sizeof(endOfFileInfo))) {
+                    return false;
+                }
+            }
+
+            if (!FlushFileBuffers(file)) {
+                return false;
+            }
+#else
+            if (writtenSize != logicalSize && ftruncate(fd, static_cast<off_t>(logicalSize)) != 0) {
+                return false;
+            }
+
+#ifdef F_FULLFSYNC
+            if (fcntl(fd, F_FULLFSYNC) == 0) {
+                return closeFile();
+            }
+#endif
+
+            if (fsync(fd) != 0) {
+                return false;
+            }
+#endif
+
+            return closeFile();
+        }
+
+        bool closeFile() {
+            bool closed = true;
+
+#ifdef _WIN32
+            if (file != INVALID_HANDLE_VALUE) {
+                closed = CloseHandle(file) != 0;
+                file = INVALID_HANDLE_VALUE;
+            }
+#else
+            if (fd != -1) {
+                closed = ::close(fd) == 0;
+                fd = -1;
+            }
+#endif
+
+            return closed;
+        }
+
+        uint64_t size() const {
+            return logicalSize;
+        }
+
+    private:
+        std::vector<uint8_t> stagingStorage;
+        uint8_t* staging = nullptr;
+        std::size_t stagingUsed = 0;
+        uint64_t writtenSize = 0;
+        uint64_t logicalSize = 0;
+        bool alignedWrites = false;
+
+#ifdef _WIN32
+        HANDLE file = INVALID_HANDLE_VALUE;
+#else
+        int fd = -1;
+#endif
+
+        bool flushStaging() {
+            if (stagingUsed == 0) {
+                return true;
+            }
+
+            std::size_t writeSize = stagingUsed;
+            if (alignedWrites && writeSize % sequenceStateFileAlignment != 0) {
+                // only the last write can be partial, and the padding is trimmed in `finish`
+                const std::size_t alignedSize = alignUp(writeSize, sequenceStateFileAlignment);
+                std::memset(staging + writeSize, 0, alignedSize - writeSize);
+                writeSize = alignedSize;
+            }
+
+            std::size_t offset = 0;
+            while (offset < writeSize) {
+#ifdef _WIN32
+                DWORD written = 0;
+                if (!WriteFile(file, staging + offset, static_cast<DWORD>(writeSize - offset), &written, nullptr) || written == 0) {
+                    return false;
+                }
+#else
+                const ssize_t written = ::write(fd, staging + offset, writeSize - offset);
+                if (written < 0 && errno == EINTR) {
+                    continue;
+                } else if (written <= 0) {
+                    return false;
+                }
+#endif
+
+                offset += static_cast<std::size_t>(written);
+            }
+
+#if defined(__linux__) && defined(SYNC_FILE_RANGE_WRITE)
+            if (!alignedWrites) {
+                // start writing back the page cache right away, so the final fsync doesn't have to flush the entire file
+                sync_file_range(fd, static_cast<off_t>(writtenSize), static_cast<off_t>(writeSize), SYNC_FILE_RANGE_WRITE);
+            }
+#endif
+
+            writtenSize += writeSize;
+            stagingUsed = 0;
+
+            return true;
+        }
+};
+
+static std::string getTemporaryFilePath(const std::string& filePath) {
+    static std::atomic<uint64_t> temporaryFileCounter(0);
+
+#ifdef _WIN32
+    const unsigned long processId = GetCurrentProcessId();
+#else
+    const unsigned long processId = static_cast<unsigned long>(getpid());
+#endif
+
+    return filePath + ".tmp-" + std::to_string(processId) + "-" + std::to_string(temporaryFileCounter.fetch_add(1));
+}
+
+static bool replaceFile(const std::string& sourcePath, const std::string& targetPath) {
+#ifdef _WIN32
+    return MoveFileExW(
+        addonToWidePath(sourcePath).c_str(), addonToWidePath(targetPath).c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH
+    ) != 0;
+#else
+    if (std::rename(sourcePath.c_str(), targetPath.c_str()) != 0) {
+        return false;
+    }
+
+    // persist the rename itself
+    const std::size_t separatorIndex = targetPath.find_last_of('/');
+    const std::string directoryPath = separatorIndex == std::string::npos
+        ? "."
+        : (separatorIndex == 0 ? "/" : targetPath.substr(0, separatorIndex));
+
+    const int directoryFd = ::open(directoryPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (directoryFd != -1) {
+        fsync(directoryFd);
+        ::close(directoryFd);
+    }
+
+    return true;
+#endif
+}
+
+std::size_t addonWriteSequenceStateFile(
+    const std::string& filePath,
+    uint64_t modelFingerprint,
+    const int32_t* tokens,
+    std::size_t tokenCount,
+    const uint8_t* stateData,
+    std::size_t stateSize,
+    bool directIo,
+    const AddonSequenceStateFileProgressCallback& onProgress,
+    std::string& error
+) {
+    const std::size_t tokensSize = tokenCount * sizeof(int32_t);
+    const uint64_t dataOffset = alignUp(sequenceStateFileHeaderSize + tokensSize, sequenceStateFileAlignment);
+    const std::size_t chunkCount = (stateSize + addonSequenceStateFileChunkSize - 1) / addonSequenceStateFileChunkSize;
+
+    SequenceStateFileHeader header{};
+    std::memcpy(header.magic, sequenceStateFileMagic, sizeof(header.magic));
+    header.version = sequenceStateFileVersion;
+    header.chunkSize = static_cast<uint32_t>(addonSequenceStateFileChunkSize);
+    header.modelFingerprint = modelFingerprint;
+    header.tokenCount = tokenCount;
+    header.stateSize = stateSize;
+    header.dataOffset = dataOffset;
+    header.tokensChecksum = addonCrc32(reinterpret_cast<const uint8_t*>(tokens), tokensSize);
+    header.headerChecksum = addonCrc32(reinterpret_cast<const uint8_t*>(&header), offsetof(SequenceStateFileHeader, headerChecksum));
+
+    const std::string temporaryFilePath = getTemporaryFilePath(filePath);
+    AlignedFileWriter writer;
+
+    auto fail = [&](const char* message) -> std::size_t {
+        error = message;
+        writer.closeFile();
+        addonRemoveFile(temporaryFilePath);
+        return 0;
+    };
+
+    if (!writer.open(temporaryFilePath, directIo)) {
+        return fail("Failed to create the state file");
+    }
+
+    if (!writer.write(reinterpret_cast<const uint8_t*>(&header), sizeof(header)) ||
+        !writer.write(reinterpret_cast<const uint8_t*>(tokens), tokensSize) ||
+        !writer.writeZeros(static_cast<std::size_t>(dataOffset - writer.size()))
+    ) {
+        return fail("Failed to write the state file");
+    }
+
+    std::vector<uint32_t> chunkChecksums(chunkCount);
+    for (std::size_t i = 0; i < chunkCount; i++) {
+        const std::size_t chunkStart = i * addonSequenceStateFileChunkSize;
+        const std::size_t chunkSize = std::min(addonSequenceStateFileChunkSize, stateSize - chunkStart);
+
+        chunkChecksums[i] = addonCrc32(stateData + chunkStart, chunkSize);
+        if (!writer.write(stateData + chunkStart, chunkSize)) {
+            return fail("Failed to write the state file");
+        }
+
+        if (onProgress) {
+            onProgress(static_cast<float>(chunkStart + chunkSize) / static_cast<float>(stateSize) * 0.99f);
+        }
+    }
+
+    const uint32_t chunkChecksumsChecksum = addonCrc32(reinterpret_cast<const uint8_t*>(chunkChecksums.data()), chunkCount * sizeof(uint32_t));
+    if (!writer.write(reinterpret_cast<const uint8_t*>(chunkChecksums.data()), chunkCount * sizeof(uint32_t)) ||
+        !writer.write(reinterpret_cast<const uint8_t*>(&chunkChecksumsChecksum), sizeof(chunkChecksumsChecksum))
+    ) {
+        return fail("Failed to write the state file");
+    }
+
+    const std::size_t fileSize = static_cast<std::size_t>(writer.size());
+    if (!writer.finish()) {
+        return fail("Failed to flush the state file to disk");
+    }
+
+    if (!replaceFile(temporaryFilePath, filePath)) {
+        return fail("Failed to move the state file into place");
+    }
+
+    if (onProgress) {
+        onProgress(1);
+    }
+
+    return fileSize;
+}
+
+bool addonIsSequenceStateFile(const AddonMappedFile& file) {
+    return file.size() >= sizeof(sequenceStateFileMagic) &&
+        std::memcmp(file.data(), sequenceStateFileMagic, sizeof(sequenceStateFileMagic)) == 0;
+}
+
+bool addonReadSequenceStateFile(
+    const AddonMappedFile& file,
+    uint64_t modelFingerprint,
+    const AddonSequenceStateFileProgressCallback& onProgress,
+    AddonSequenceStateFileContent& content,
+    std::string& error
+) {
+    const uint8_t* fileData = file.data();
+    const std::size_t fileSize = file.size();
+
+    if (!addonIsSequenceStateFile(file) || fileSize < sequenceStateFileHeaderSize) {
+        error = "The state file is corrupted";
+        return false;
+    }
+
+    SequenceStateFileHeader header;
+    std::memcpy(&header, fileData, sizeof(header));
+
+    if (header.version != sequenceStateFileVersion) {
+        error = "The state file was created by an unsupported version";
+        return false;
+    }
+
+    if (header.headerChecksum != addonCrc32(fileData, offsetof(SequenceStateFileHeader, headerChecksum)) ||
+        header.chunkSize == 0 || header.chunkSize > sequenceStateFileMaxChunkSize ||
+        header.tokenCount > fileSize / sizeof(int32_t) || header.stateSize > fileSize ||
+        header.dataOffset != alignUp(sequenceStateFileHeaderSize + header.tokenCount * sizeof(int32_t), sequenceStateFileAlignment)
+    ) {
+        error = "The state file is corrupted";
+        return false;
+    }
+
+    if (header.modelFingerprint != modelFingerprint) {
+        error = "The state file was created using a different model";
+        return false;
+    }
+
+    const std::size_t tokensSize = static_cast<std::size_t>(header.tokenCount) * sizeof(int32_t);
+    const std::size_t stateSize = static_cast<std::size_t>(header.stateSize);
+    const std::size_t chunkSize = header.chunkSize;
+    const std::size_t chunkCount = (stateSize + chunkSize - 1) / chunkSize;
+    const std::size_t checksumsOffset = static_cast<std::size_t>(header.dataOffset) + stateSize;
+
+    if (fileSize != checksumsOffset + (chunkCount + 1) * sizeof(uint32_t)) {
+        error = "The state file is corrupted or incomplete";
+        return false;
+    }
+
+    if (header.tokensChecksum != addonCrc32(fileData + sequenceStateFileHeaderSize, tokensSize)) {
+        error = "The state file is corrupted";
+        return false;
+    }
+
+    std::vector<uint32_t> chunkChecksums(chunkCount);
+    uint32_t chunkChecksumsChecksum;
+    if (chunkCount > 0) {
+        std::memcpy(chunkChecksums.data(), fileData + checksumsOffset, chunkCount * sizeof(uint32_t));
+    }
+    std::memcpy(&chunkChecksumsChecksum, fileData + checksumsOffset + chunkCount * sizeof(uint32_t), sizeof(chunkChecksumsChecksum));
+
+    if (chunkChecksumsChecksum != addonCrc32(reinterpret_cast<const uint8_t*>(chunkChecksums.data()), chunkCount * sizeof(uint32_t))) {
+        error = "The state file is corrupted";
+        return false;
+    }
+
+    const uint8_t* stateData = fileData + header.dataOffset;
+    for (std::size_t i = 0; i < chunkCount; i++) {
+        const std::size_t chunkStart = i * chunkSize;
+        const std::size_t currentChunkSize = std::min(chunkSize, stateSize - chunkStart);
+
+        if (chunkChecksums[i] != addonCrc32(stateData + chunkStart, currentChunkSize)) {
+            error = "The state file is corrupted";
+            return false;
+        }
+
+        if (onProgress) {
+            onProgress(static_cast<float>(chunkStart + currentChunkSize) / static_cast<float>(stateSize));
+        }
+    }
+
+    content.modelFingerprint = header.modelFingerprint;
+    content.tokens.resize(static_cast<std::size_t>(header.tokenCount));
+    if (tokensSize > 0) {
+        std::memcpy(content.tokens.data(), fileData + sequenceStateFileHeaderSize, tokensSize);
+    }
+    content.stateData = stateData;
+    content.stateSize = stateSize;
+
+    return true;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "AddonMappedFile.h"
+
+// the size of each checksummed chunk of the state data, and of each write to the file
+constexpr std::size_t addonSequenceStateFileChunkSize = 4 * 1024 * 1024;
+
+using AddonSequenceStateFileProgressCallback = std::function<void(float progress)>;
+
+struct AddonSequenceStateFileContent {
+    uint64_t modelFingerprint = 0;
+    std::vector<int32_t> tokens;
+
+    // points into the mapped file
+    const uint8_t* stateData = nullptr;
+    std::size_t stateSize = 0;
+};
+
+// write a sequence state file into a temporary file next to `filePath`, fsync it, and then atomically rename it to `filePath`.
+// the state data is split into checksummed chunks, and is written using large aligned writes (with direct I/O when `directIo` is set).
+// returns the size of the written file, or `0` with an `error` on failure
+std::size_t addonWriteSequenceStateFile(
+    const std::string& filePath,
+    uint64_t modelFingerprint,
+    const int32_t* tokens,
+    std::size_t tokenCount,
+    const uint8_t* stateData,
+    std::size_t stateSize,
+    bool directIo,
+    const AddonSequenceStateFileProgressCallback& onProgress,
+    std::string& error
+);
+
+// whether the mapped file starts with the header of a sequence state file written by `addonWriteSequenceStateFile`
+bool addonIsSequenceStateFile(const AddonMappedFile& file);
+
+// validate the header and the checksums of all the chunks of a mapped sequence state file before exposing its content.
+// returns `false` with an `error` when the file is corrupted or doesn't match the given model fingerprint
+bool addonReadSequenceStateFile(
+    const AddonMappedFile& file,
+    uint64_t modelFingerprint,
+    const AddonSequenceStateFileProgressCallback& onProgress,
+    AddonSequenceStateFileContent& content,
+    std::string& error
+);
@@ -0,0 +1,555 @@
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "common/common.h"
+#include "gguf.h"
+#include "llama.h"
+
+#include "addonGlobals.h"
+#include "AddonGgufMetadata.h"
+#include "AddonTokenizer.h"
+
+static std::mutex tokenizerVocabRegistryMutex;
+static std::unordered_map<uint32_t, std::weak_ptr<AddonTokenizerVocab>> tokenizerVocabRegistry;
+static uint32_t lastTokenizerVocabShareHandle = 0;
+
+AddonTokenizerVocab::~AddonTokenizerVocab() {
+    if (model != nullptr) {
+        llama_model_free(model);
+        model = nullptr;
+        vocab = nullptr;
+    }
+}
+
+static void markUnexpectedTokenizerTensorDataAccess(struct ggml_tensor * /* tensor */, void * userData) {
+    auto * accessedTensorData = static_cast<bool *>(userData);
+    if (accessedTensorData != nullptr) {
+        *accessedTensorData = true;
+    }
+}
+
+static Napi::Value tokensToNapiValue(const Napi::Env& env, const std::vector<llama_token>& tokens) {
+    Napi::Uint32Array result = Napi::Uint32Array::New(env, tokens.size());
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        result[i] = static_cast<uint32_t>(tokens[i]);
+    }
+
+    return result;
+}
+
+Napi::Value addonDetokenizeToNapiValue(
+    const Napi::Env& env, const llama_vocab* vocab, const Napi::Uint32Array& tokens, bool decodeSpecialTokens
+) {
+    std::string result;
+    result.resize(std::max(result.capacity(), tokens.ElementLength()));
+
+    int n_chars = llama_detokenize(vocab, (llama_token*)tokens.Data(), tokens.ElementLength(), &result[0], result.size(), false, decodeSpecialTokens);
+    if (n_chars < 0) {
+        result.resize(-n_chars);
+        n_chars = llama_detokenize(vocab, (llama_token*)tokens.Data(), tokens.ElementLength(), &result[0], result.size(), false, decodeSpecialTokens);
+        GGML_ASSERT(n_chars <= result.size());  // whitespace trimming is performed after per-token detokenization
+    }
+
+    result.resize(n_chars);
+
+    return Napi::String::New(env, result);
+}
+
+int32_t addonCountTokens(const llama_vocab* vocab, const std::string& text, bool specialTokens) {
+    if (text.empty()) {
+        return 0;
+    }
+
+    // when given no output buffer, `llama_tokenize` returns the negated number of tokens
+    // the text would produce, so the token ids are never copied out of the tokenizer
+    const int32_t res = llama_tokenize(vocab, text.data(), text.size(), nullptr, 0, false, specialTokens);
+    return res < 0 ? -res : res;
+}
+
+static std::string detokenizeToString(const llama_vocab* vocab, const std::vector<llama_token>& tokens, bool decodeSpecialTokens) {
+    std::string result;
+    result.resize(std::max(result.capacity(), tokens.size()));
+
+    int n_chars = llama_detokenize(vocab, tokens.data(), tokens.size(), &result[0], result.size(), false, decodeSpecialTokens);
+    if (n_chars < 0) {
+        result.resize(-n_chars);
+        n_chars = llama_detokenize(vocab, tokens.data(), tokens.size(), &result[0], result.size(), false, decodeSpecialTokens);
+        GGML_ASSERT(n_chars <= result.size());  // whitespace trimming is performed after per-token detokenization
+    }
+
+    result.resize(n_chars);
+    return result;
+}
+
+static std::size_t countLeadingSpaces(const std::string& text) {
+    std::size_t count = 0;
+    while (count < text.size() && text[count] == ' ') {
+        count++;
+    }
+
+    return count;
+}
+
+static bool startsWithTokens(const std::vector<llama_token>& tokens, const std::vector<llama_token>& prefix) {
+    return tokens.size() >= prefix.size() && std::equal(prefix.begin(), prefix.end(), tokens.begin());
+}
+
+// the text is tokenized after a workaround token, so tokenizers that add a space prefix to the text
+// don't add it to the beginning of the text, and the workaround tokens are then removed from the tokenized output
+std::vector<llama_token> addonTokenizeWithTrimmedLeadingSpace(
+    const llama_vocab* vocab, const std::string& text, bool specialTokens, const AddonTrimLeadingSpaceOptions& options
+) {
+    if (text.empty()) {
+        return {};
+    }
+
+    static const std::string workaroundTokensString = "\n";
+
+    if (specialTokens) {
+        const std::size_t textLeadingSpaces = countLeadingSpaces(text);
+
+        if (options.workaroundToken != LLAMA_TOKEN_NULL && !options.workaroundTokenString.empty()) {
+            std::vector<llama_token> tokens = common_tokenize(vocab, options.workaroundTokenString + text, false, true);
+            const auto workaroundTokenPos = std::find(tokens.begin(), tokens.end(), options.workaroundToken);
+            const std::size_t workaroundTokenIndex = workaroundTokenPos - tokens.begin();
+
+            if (workaroundTokenPos != tokens.end() && workaroundTokenIndex <= 1) {
+                tokens.erase(tokens.begin(), tokens.begin() + workaroundTokenIndex + 1);
+
+                if (countLeadingSpaces(detokenizeToString(vocab, tokens, true)) == textLeadingSpaces) {
+                    return tokens;
+                }
+            }
+        }
+
+        const std::vector<llama_token> workaroundTokens = common_tokenize(vocab, workaroundTokensString, false, true);
+
+        if (text.rfind(workaroundTokensString, 0) == 0) {
+            std::vector<llama_token> tokens = common_tokenize(vocab, text, false, true);
+            if (detokenizeToString(vocab, tokens, true).rfind(workaroundTokensString, 0) == 0) {
+                return tokens;
+            }
+        }
+
+        std::vector<llama_token> tokens = common_tokenize(vocab, workaroundTokensString + text, false, true);
+        if (!workaroundTokens.empty() && startsWithTokens(tokens, workaroundTokens)) {
+            tokens.erase(tokens.begin(), tokens.begin() + workaroundTokens.size());
+
+            if (countLeadingSpaces(detokenizeToString(vocab, tokens, true)) == textLeadingSpaces) {
+                return tokens;
+            }
+        }
+    } else {
+        const std::vector<llama_token> workaroundTokens = common_tokenize(vocab, workaroundTokensString, false, false);
+
+        if (text.rfind(workaroundTokensString, 0) == 0) {
+            std::vector<llama_token> tokens = common_tokenize(vocab, text, false, false);
+            if (detokenizeToString(vocab, tokens, false).rfind(workaroundTokensString, 0) == 0) {
+                return tokens;
+            }
+        }
+
+        std::vector<llama_token> tokens = common_tokenize(vocab, workaroundTokensString + text, false, false);
+        if (!workaroundTokens.empty() && startsWithTokens(tokens, workaroundTokens)) {
+            tokens.erase(tokens.begin(), tokens.begin() + workaroundTokens.size());
+            return tokens;
+        }
+    }
+
+    // only use the tokenized output if it can be corrected, otherwise fallback to the default tokenization
+    return common_tokenize(vocab, text, false, specialTokens);
+}
+
+static AddonTrimLeadingSpaceOptions getTrimLeadingSpaceOptions(const Napi::CallbackInfo& info, std::size_t index) {
+    AddonTrimLeadingSpaceOptions trimLeadingSpaceOptions;
+    if (info.Length() > index && info[index].IsObject()) {
+        const Napi::Object options = info[index].As<Napi::Object>();
+        trimLeadingSpaceOptions.enabled = true;
+
+        if (options.Has("workaroundToken") && options.Get("workaroundToken").IsNumber()) {
+            trimLeadingSpaceOptions.workaroundToken = options.Get("workaroundToken").As<Napi::Number>().Int32Value();
+        }
+
+        if (options.Has("workaroundTokenString") && options.Get("workaroundTokenString").IsString()) {
+            trimLeadingSpaceOptions.workaroundTokenString = options.Get("workaroundTokenString").As<Napi::String>().Utf8Value();
+        }
+    }
+
+    return trimLeadingSpaceOptions;
+}
+
+Napi::Value addonTokenizeForNapiCallbackInfo(const Napi::CallbackInfo& info, const llama_vocab* vocab) {
+    const std::string text = info[0].As<Napi::String>().Utf8Value();
+    const bool specialTokens = info[1].As<Napi::Boolean>().Value();
+    const AddonTrimLeadingSpaceOptions trimLeadingSpaceOptions = getTrimLeadingSpaceOptions(info, 2);
+
+    return tokensToNapiValue(
+        info.Env(),
+        trimLeadingSpaceOptions.enabled
+            ? addonTokenizeWithTrimmedLeadingSpace(vocab, text, specialTokens, trimLeadingSpaceOptions)
+            : common_tokenize(vocab, text, false, specialTokens)
+    );
+}
+
+Napi::Value addonCountTokensForNapiCallbackInfo(const Napi::CallbackInfo& info, const llama_vocab* vocab) {
+    const Napi::Env env = info.Env();
+    const Napi::Value value = info[0];
+    const bool specialTokens = info[1].As<Napi::Boolean>().Value();
+
+    const AddonTrimLeadingSpaceOptions trimLeadingSpaceOptions = getTrimLeadingSpaceOptions(info, 2);
+
+    const auto countTextTokens = [&](const std::string& text) -> int32_t {
+        return trimLeadingSpaceOptions.enabled
+            ? addonTokenizeWithTrimmedLeadingSpace(vocab, text, specialTokens, trimLeadingSpaceOptions).size()
+            : addonCountTokens(vocab, text, specialTokens);
+    };
+
+    if (value.IsArray()) {
+        const Napi::Array texts = value.As<Napi::Array>();
+        Napi::Uint32Array result = Napi::Uint32Array::New(env, texts.Length());
+
+        for (uint32_t i = 0; i < texts.Length(); i++) {
+            result[i] = countTextTokens(texts.Get(i).As<Napi::String>().Utf8Value());
+        }
+
+        return result;
+    }
+
+    return Napi::Number::New(env, countTextTokens(value.As<Napi::String>().Utf8Value()));
+}
+
+class AddonTokenizerInitWorker : public Napi::AsyncWorker {
+    public:
+        AddonTokenizer* tokenizer;
+        AddonGgufMetadata* ggufMetadata;
+        gguf_context_ptr tokenizerMetadata;
+
+        AddonTokenizerInitWorker(const Napi::Env& env, AddonTokenizer* tokenizer, AddonGgufMetadata* ggufMetadata)
+            : Napi::AsyncWorker(env, "AddonTokenizerInitWorker"),
+              tokenizer(tokenizer),
+              ggufMetadata(ggufMetadata),
+              deferred(Napi::Promise::Deferred::New(env)) {
+            tokenizer->Ref();
+            ggufMetadata->Ref();
+        }
+        ~AddonTokenizerInitWorker() {
+            tokenizer->Unref();
+            ggufMetadata->Unref();
+        }
+
+        Napi::Promise GetPromise() {
+            return deferred.Promise();
+        }
+
+    protected:
+        Napi::Promise::Deferred deferred;
+        std::shared_ptr<AddonTokenizerVocab> tokenizerVocab;
+
+        void Execute() {
+            try {
+                if (ggufMetadata->disposed || ggufMetadata->ggufMetadata.get() == nullptr) {
+                    SetError("GGUF metadata is disposed");
+                    return;
+                }
+
+                // copy only the KV pairs and leave the tensor infos behind,
+                // so the tokenizer never keeps tensor metadata in memory
+                tokenizerMetadata.reset(gguf_init_empty());
+                if (tokenizerMetadata.get() != nullptr) {
+                    gguf_set_kv(tokenizerMetadata.get(), ggufMetadata->ggufMetadata.get());
+                }
+
+                if (tokenizerMetadata.get() == nullptr || gguf_get_n_kv(tokenizerMetadata.get()) == 0) {
+                    SetError("GGUF metadata is disposed or empty");
+                    return;
+                }
+
+                llama_model_params modelParams = llama_model_default_params();
+                modelParams.vocab_only = true;
+                modelParams.use_mmap = false;
+                modelParams.use_mlock = false;
+                modelParams.no_alloc = true;
+                modelParams.n_gpu_layers = 0;
+
+                bool accessedTensorData = false;
+                llama_model* model = llama_model_init_from_user(
+                    tokenizerMetadata.get(),
+                    markUnexpectedTokenizerTensorDataAccess,
+                    &accessedTensorData,
+                    modelParams
+                );
+
+                // the vocab keeps its own copy of the tokenizer arrays
+                tokenizerMetadata.reset();
+
+                if (model == nullptr) {
+                    SetError("Failed to load the tokenizer from the GGUF metadata");
+                    return;
+                } else if (accessedTensorData) {
+                    llama_model_free(model);
+                    SetError("Unexpected tensor data access when loading a tokenizer from GGUF metadata");
+                    return;
+                }
+
+                tokenizerVocab = std::make_shared<AddonTokenizerVocab>();
+                tokenizerVocab->model = model;
+                tokenizerVocab->vocab = llama_model_get_vocab(model);
+            } catch (const std::exception& e) {
+                SetError(e.what());
+            } catch(...) {
+                SetError("Unknown error when calling \"llama_model_init_from_user\"");
+            }
+        }
+        void OnOK() {
+            {
+                std::lock_guard<std::mutex> lock(tokenizer->disposeMutex);
+
+                if (tokenizer->disposed) {
+                    deferred.Reject(Napi::Error::New(Env(), "Tokenizer was disposed before it finished loading").Value());
+                    return;
+                }
+
+                tokenizer->tokenizerVocab = tokenizerVocab;
+                tokenizer->vocab = tokenizerVocab->vocab;
+            }
+
+            deferred.Resolve(Env().Undefined());
+        }
+        void OnError(const Napi::Error& err) {
+            deferred.Reject(err.Value());
+        }
+};
+
+AddonTokenizer::AddonTokenizer(const Napi::CallbackInfo& info) : Napi::ObjectWrap<AddonTokenizer>(info) {
+
+}
+AddonTokenizer::~AddonTokenizer() {
+    dispose();
+}
+
+void AddonTokenizer::dispose() {
+    std::shared_ptr<AddonTokenizerVocab> currentTokenizerVocab;
+
+    {
+        std::lock_guard<std::mutex> lock(disposeMutex);
+
+        if (disposed) {
+            return;
+        }
+
+        disposed = true;
+        vocab = nullptr;
+        currentTokenizerVocab.swap(tokenizerVocab);
+    }
+
+    // the vocab is freed here only if no other environment has attached to it
+    currentTokenizerVocab.reset();
+}
+
+Napi::Value AddonTokenizer::Init(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Tokenizer is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    } else if (vocab != nullptr) {
+        Napi::Error::New(info.Env(), "Tokenizer is already initialized").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    if (info.Length() == 0 || !info[0].IsObject()) {
+        Napi::TypeError::New(info.Env(), "Expected a GGUF metadata object as the first argument").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    AddonGgufMetadata* ggufMetadata = Napi::ObjectWrap<AddonGgufMetadata>::Unwrap(info[0].As<Napi::Object>());
+    if (ggufMetadata == nullptr || ggufMetadata->disposed || ggufMetadata->ggufMetadata.get() == nullptr) {
+        Napi::TypeError::New(info.Env(), "Invalid GGUF metadata object").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    AddonTokenizerInitWorker* worker = new AddonTokenizerInitWorker(info.Env(), this, ggufMetadata);
+    worker->Queue();
+    return worker->GetPromise();
+}
+
+Napi::Value AddonTokenizer::Attach(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Tokenizer is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    } else if (vocab != nullptr) {
+        Napi::Error::New(info.Env(), "Tokenizer is already initialized").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    const uint32_t handle = info[0].As<Napi::Number>().Uint32Value();
+    std::shared_ptr<AddonTokenizerVocab> sharedTokenizerVocab;
+
+    {
+        std::lock_guard<std::mutex> lock(tokenizerVocabRegistryMutex);
+        auto pos = tokenizerVocabRegistry.find(handle);
+        if (pos != tokenizerVocabRegistry.end()) {
+            sharedTokenizerVocab = pos->second.lock();
+
+            if (sharedTokenizerVocab == nullptr) {
+                tokenizerVocabRegistry.erase(pos);
+            }
+        }
+    }
+
+    if (sharedTokenizerVocab == nullptr) {
+        return Napi::Boolean::New(info.Env(), false);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(disposeMutex);
+        tokenizerVocab = sharedTokenizerVocab;
+        vocab = sharedTokenizerVocab->vocab;
+        shareHandle = handle;
+    }
+
+    return Napi::Boolean::New(info.Env(), true);
+}
+
+Napi::Value AddonTokenizer::GetShareHandle(const Napi::CallbackInfo& info) {
+    if (disposed || tokenizerVocab == nullptr) {
+        Napi::Error::New(info.Env(), "Tokenizer is not initialized").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    if (shareHandle == 0) {
+        std::lock_guard<std::mutex> lock(tokenizerVocabRegistryMutex);
+
+        // drop entries of vocabs that are no longer alive
+        for (auto it = tokenizerVocabRegistry.begin(); it != tokenizerVocabRegistry.end();) {
+            if (it->second.expired()) {
+                it = tokenizerVocabRegistry.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        shareHandle = ++lastTokenizerVocabShareHandle;
+        tokenizerVocabRegistry[shareHandle] = tokenizerVocab;
+    }
+
+    return Napi::Number::New(info.Env(), shareHandle);
+}
+
+Napi::Value AddonTokenizer::Dispose(const Napi::CallbackInfo& info) {
+    dispose();
+    return info.Env().Undefined();
+}
+
+Napi::Value AddonTokenizer::Tokenize(const Napi::CallbackInfo& info) {
+    if (vocab == nullptr) {
+        Napi::Error::New(info.Env(), "Tokenizer is not initialized").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    return addonTokenizeForNapiCallbackInfo(info, vocab);
+}
+
+Napi::Value AddonTokenizer::Detokenize(const Napi::CallbackInfo& info) {
+    if (vocab == nullptr) {
+        Napi::Error::New(info.Env(), "Tokenizer is not initialized").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    Napi::Uint32Array tokens = info[0].As<Napi::Uint32Array>();
+    bool decodeSpecialTokens = info.Length() > 1
+        ? info[1].As<Napi::Boolean>().Value()
+        : false;
+
+    return addonDetokenizeToNapiValue(info.Env(), vocab, tokens, decodeSpecialTokens);
+}
+
+Napi::Value AddonTokenizer::CountTokens(const Napi::CallbackInfo& info) {
+    if (vocab == nullptr) {
+        Napi::Error::New(info.Env(), "Tokenizer is not initialized").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    return addonCountTokensForNapiCallbackInfo(info, vocab);
+}
+
+Napi::Value AddonTokenizer::GetVocabularySize(const Napi::CallbackInfo& info) {
+    if (vocab == nullptr) {
+        Napi::Error::New(info.Env(), "Tokenizer is not initialized").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    return Napi::Number::New(info.Env(), llama_vocab_n_tokens(vocab));
+}
+
+Napi::Value AddonTokenizer::GetTokenAttributes(const Napi::CallbackInfo& info) {
+    if (vocab == nullptr) {
+        Napi::Error::New(info.Env(), "Tokenizer is not initialized").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    if (info[0].IsNumber() == false) {
+        return Napi::Number::From(info.Env(), int32_t(LLAMA_TOKEN_ATTR_UNDEFINED));
+    }
+
+    int token = info[0].As<Napi::Number>().Int32Value();
+    auto tokenAttributes = llama_vocab_get_attr(vocab, token);
+
+    return Napi::Number::From(info.Env(), int32_t(tokenAttributes));
+}
+
+Napi::Value AddonTokenizer::IsEogToken(const Napi::CallbackInfo& info) {
+    if (vocab == nullptr) {
+        Napi::Error::New(info.Env(), "Tokenizer is not initialized").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    if (info[0].IsNumber() == false) {
+        return Napi::Boolean::New(info.Env(), false);
+    }
+
+    int token = info[0].As<Napi::Number>().Int32Value();
+
+    return Napi::Boolean::New(info.Env(), llama_vocab_is_eog(vocab, token));
+}
+
+Napi::Value AddonTokenizer::ShouldPrependBosToken(const Napi::CallbackInfo& info) {
+    if (vocab == nullptr) {
+        Napi::Error::New(info.Env(), "Tokenizer is not initialized").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    return Napi::Boolean::New(info.Env(), llama_vocab_get_add_bos(vocab));
+}
+
+Napi::Value AddonTokenizer::ShouldAppendEosToken(const Napi::CallbackInfo& info) {
+    if (vocab == nullptr) {
+        Napi::Error::New(info.Env(), "Tokenizer is not initialized").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    return Napi::Boolean::New(info.Env(), llama_vocab_get_add_eos(vocab));
+}
+
+void AddonTokenizer::init(Napi::Object exports) {
+    exports.Set(
+        "AddonTokenizer",
+        DefineClass(
+            exports.Env(),
+            "AddonTokenizer",
+            {
+                InstanceMethod("init", &AddonTokenizer::Init),
+                InstanceMethod("attach", &AddonTokenizer::Attach),
+                InstanceMethod("getShareHandle", &AddonTokenizer::GetShareHandle),
+                InstanceMethod("tokenize", &AddonTokenizer::Tokenize),
+                InstanceMethod("detokenize", &AddonTokenizer::Detokenize),
+                InstanceMethod("countTokens", &AddonTokenizer::CountTokens),
+                InstanceMethod("getVocabularySize", &AddonTokenizer::GetVocabularySize),
+                InstanceMethod("getTokenAttributes", &AddonTokenizer::GetTokenAttributes),
+                InstanceMethod("isEogToken", &AddonTokenizer::IsEogToken),
+                InstanceMethod("shouldPrependBosToken", &AddonTokenizer::ShouldPrependBosToken),
+                InstanceMethod("shouldAppendEosToken", &AddonTokenizer::ShouldAppendEosToken),
+                InstanceMethod("dispose", &AddonTokenizer::Dispose),
+            }
+        )
+    );
+}
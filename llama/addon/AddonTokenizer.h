@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "llama.h"
+#include "napi.h"
+#include "addonGlobals.h"
+
+// a vocab-only `llama_model` that holds no tensor metadata.
+// shared between all the `AddonTokenizer` instances (across all environments) that attached to it
+struct AddonTokenizerVocab {
+    llama_model* model = nullptr;
+    const llama_vocab* vocab = nullptr;
+
+    AddonTokenizerVocab() = default;
+    ~AddonTokenizerVocab();
+};
+
+// shared by `AddonModel` and `AddonTokenizer`
+Napi::Value addonDetokenizeToNapiValue(
+    const Napi::Env& env, const llama_vocab* vocab, const Napi::Uint32Array& tokens, bool decodeSpecialTokens
+);
+
+int32_t addonCountTokens(const llama_vocab* vocab, const std::string& text, bool specialTokens);
+
+struct AddonTrimLeadingSpaceOptions {
+    bool enabled = false;
+
+    // the token (and its text) to tokenize before the text when special tokens are tokenized
+    llama_token workaroundToken = LLAMA_TOKEN_NULL;
+    std::string workaroundTokenString;
+};
+
+// implements the `"trimLeadingSpace"` option of `LlamaModel.tokenize` and `LlamaModel.countTokens`
+std::vector<llama_token> addonTokenizeWithTrimmedLeadingSpace(
+    const llama_vocab* vocab, const std::string& text, bool specialTokens, const AddonTrimLeadingSpaceOptions& options
+);
+
+// arguments: `(text: string, specialTokens: boolean, trimLeadingSpace?: {workaroundToken?, workaroundTokenString?})`
+Napi::Value addonTokenizeForNapiCallbackInfo(const Napi::CallbackInfo& info, const llama_vocab* vocab);
+
+// arguments: `(text: string | string[], specialTokens: boolean, trimLeadingSpace?: {workaroundToken?, workaroundTokenString?})`
+Napi::Value addonCountTokensForNapiCallbackInfo(const Napi::CallbackInfo& info, const llama_vocab* vocab);
+
+class AddonTokenizer : public Napi::ObjectWrap<AddonTokenizer> {
+    public:
+        std::shared_ptr<AddonTokenizerVocab> tokenizerVocab;
+        const llama_vocab* vocab = nullptr;
+        uint32_t shareHandle = 0;
+        std::mutex disposeMutex;
+        bool disposed = false;
+
+        AddonTokenizer(const Napi::CallbackInfo& info);
+        ~AddonTokenizer();
+        void dispose();
+
+        Napi::Value Init(const Napi::CallbackInfo& info);
+        Napi::Value Attach(const Napi::CallbackInfo& info);
+        Napi::Value GetShareHandle(const Napi::CallbackInfo& info);
+        Napi::Value Dispose(const Napi::CallbackInfo& info);
+
+        Napi::Value Tokenize(const Napi::CallbackInfo& info);
+        Napi::Value Detokenize(const Napi::CallbackInfo& info);
+        Napi::Value CountTokens(const Napi::CallbackInfo& info);
+        Napi::Value GetVocabularySize(const Napi::CallbackInfo& info);
+        Napi::Value GetTokenAttributes(const Napi::CallbackInfo& info);
+        Napi::Value IsEogToken(const Napi::CallbackInfo& info);
+        Napi::Value ShouldPrependBosToken(const Napi::CallbackInfo& info);
+        Napi::Value ShouldAppendEosToken(const Napi::CallbackInfo& info);
+
+        static void init(Napi::Object exports);
+};
@@ -1,14 +1,17 @@
 #include <atomic>
 #include <cstdlib>
 #include <mutex>
+#include <unordered_set>
 
 #include "AddonContext.h"
+#include "AddonGgufHeader.h"
 #include "AddonGgufMetadata.h"
 #include "AddonGrammar.h"
 #include "AddonGrammarEvaluationState.h"
 #include "AddonModel.h"
 #include "AddonModelLora.h"
 #include "AddonSampler.h"
+#include "AddonTokenizer.h"
 #include "addonGlobals.h"
 #include "globals/addonLog.h"
 #include "globals/addonProgress.h"
@@ -18,9 +21,12 @@
 #include "globals/getSystemMemoryInfo.h"
 #include "globals/addonEnv.h"
 
+// the addon is loaded once per process and the llama.cpp backend is shared by all the Node.js environments (worker threads) that use it,
+// so the backend is initialized by the first environment that initializes it and is freed after the last one disposes it
 std::mutex backendMutex;
 bool backendInitialized = false;
-bool backendDisposed = false;
+std::unordered_set<napi_env> backendEnvs;
+std::unordered_set<napi_env> disposedBackendEnvs;
 
 Napi::Value systemInfo(const Napi::CallbackInfo& info) {
     return Napi::String::From(info.Env(), llama_print_system_info());
@@ -126,18 +132,10 @@ class AddonBackendLoadWorker : public Napi::AsyncWorker {
             try {
                 std::lock_guard<std::mutex> lock(backendMutex);
 
-                llama_backend_init();
-
-                try {
-                    if (backendDisposed) {
-                        llama_backend_free();
-                    } else {
-                        backendInitialized = true;
-                    }
-                } catch (const std::exception& e) {
-                    SetError(e.what());
-                } catch(...) {
-                    SetError("Unknown error when calling \"llama_backend_free\"");
+                // the environment may have been disposed before this worker ran
+                if (!backendInitialized && !backendEnvs.empty()) {
+                    llama_backend_init();
+                    backendInitialized = true;
                 }
             } catch (const std::exception& e) {
                 SetError(e.what());
@@ -174,7 +172,7 @@ class AddonBackendUnloadWorker : public Napi::AsyncWorker {
             try {
                 std::lock_guard<std::mutex> lock(backendMutex);
 
-                if (backendInitialized) {
+                if (backendInitialized && backendEnvs.empty()) {
                     backendInitialized = false;
                     llama_backend_free();
                 }
@@ -246,7 +244,11 @@ Napi::Value markLoaded(const Napi::CallbackInfo& info) {
 Napi::Value addonInit(const Napi::CallbackInfo& info) {
     std::lock_guard<std::mutex> lock(backendMutex);
 
-    if (backendInitialized) {
+    if (disposedBackendEnvs.count(info.Env()) == 0) {
+        backendEnvs.insert(info.Env());
+    }
+
+    if (backendInitialized || backendEnvs.count(info.Env()) == 0) {
         Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(info.Env());
         deferred.Resolve(info.Env().Undefined());
         return deferred.Promise();
@@ -260,33 +262,32 @@ Napi::Value addonInit(const Napi::CallbackInfo& info) {
 Napi::Value addonDispose(const Napi::CallbackInfo& info) {
     std::lock_guard<std::mutex> lock(backendMutex);
 
-    if (backendDisposed) {
+    if (disposedBackendEnvs.count(info.Env()) != 0) {
         Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(info.Env());
         deferred.Resolve(info.Env().Undefined());
         return deferred.Promise();
     }
 
-    backendDisposed = true;
+    disposedBackendEnvs.insert(info.Env());
+    backendEnvs.erase(info.Env());
 
     AddonBackendUnloadWorker* worker = new AddonBackendUnloadWorker(info.Env());
     worker->Queue();
     return worker->GetPromise();
 }
 
-static void addonFreeLlamaBackend() {
+static void addonReleaseLlamaBackend(napi_env env) {
     std::lock_guard<std::mutex> lock(backendMutex);
-    if (backendDisposed) {
-        return;
-    }
+    backendEnvs.erase(env);
+    disposedBackendEnvs.erase(env);
 
-    backendDisposed = true;
-    if (backendInitialized) {
+    if (backendInitialized && backendEnvs.empty()) {
         backendInitialized = false;
         llama_backend_free();
     }
 }
-static void addonFreeLlamaBackendFromFinalizer(Napi::Env env, int* data) {
-    addonFreeLlamaBackend();
+static void addonReleaseLlamaBackendFromCleanupHook(napi_env__* env) {
+    addonReleaseLlamaBackend(env);
 }
 
 Napi::Object registerCallback(Napi::Env env, Napi::Object exports) {
@@ -301,6 +302,8 @@ Napi::Object registerCallback(Napi::Env env, Napi::Object exports) {
         Napi::PropertyDescriptor::Function("getBlockSizeForGgmlType", addonGetBlockSizeForGgmlType),
         Napi::PropertyDescriptor::Function("getTypeSizeForGgmlType", addonGetTypeSizeForGgmlType),
         Napi::PropertyDescriptor::Function("getGgmlGraphOverheadCustom", addonGetGgmlGraphOverheadCustom),
+        Napi::PropertyDescriptor::Function("estimateContextResourceGrid", addonEstimateContextResourceGrid),
+        Napi::PropertyDescriptor::Function("readGgufFileHeaders", addonReadGgufFileHeaders),
         Napi::PropertyDescriptor::Function("getConsts", addonGetConsts),
         Napi::PropertyDescriptor::Function("setLogger", setLogger),
         Napi::PropertyDescriptor::Function("setLoggerLogLevel", setLoggerLogLevel),
@@ -326,11 +329,11 @@ Napi::Object registerCallback(Napi::Env env, Napi::Object exports) {
     AddonContext::init(exports);
     AddonContextSequenceCheckpoint::init(exports);
     AddonSampler::init(exports);
+    AddonTokenizer::init(exports);
 
     llama_log_set(addonLlamaCppLogCallback, nullptr);
 
-    exports.AddFinalizer(addonFreeLlamaBackendFromFinalizer, static_cast<int*>(nullptr));
-    env.AddCleanupHook(addonFreeLlamaBackend);
+    env.AddCleanupHook(addonReleaseLlamaBackendFromCleanupHook, static_cast<napi_env__*>(env));
     return exports;
 }
 
@@ -8,6 +8,7 @@ class AddonModelData;
 class AddonContext;
 class AddonGrammar;
 class AddonGrammarEvaluationState;
+class AddonTokenizer;
 
 void adjustNapiExternalMemoryAdd(Napi::Env env, uint64_t size);
 void adjustNapiExternalMemorySubtract(Napi::Env env, uint64_t size);
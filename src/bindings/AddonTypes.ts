@@ -1,5 +1,5 @@
 import {Token} from "../types.js";
-import {LlamaNuma} from "./types.js";
+import {LlamaLoadReport, LlamaNuma} from "./types.js";
 
 export type AddonModelParams = {
     gpuLayers?: number,
@@ -7,6 +7,17 @@ export type AddonModelParams = {
     noAlloc?: boolean,
     useMmap?: boolean,
     useDirectIo?: boolean,
+    prefetch?: boolean,
+    prefetchThreads?: number,
+
+    // the NUMA strategy the prefetched pages are placed according to
+    prefetchNumaStrategy?: Exclude<LlamaNuma, false>,
+
+    // reuse a model that's already loaded from the same file with the same parameters in this process
+    shared?: boolean,
+
+    // attach to a model loaded in another thread of this process instead of loading the model file
+    shareHandle?: number,
     useMlock?: boolean,
     checkTensors?: boolean,
     overridesList?: Array<[key: string, value: number | bigint | boolean | string, type: 0 | 1 | undefined]>
@@ -20,11 +31,17 @@ export type AddonContextParams = {
     logitsAll?: boolean,
     embeddings?: boolean,
     ranking?: boolean,
+    tokenEmbeddings?: boolean,
     threads?: number,
     performanceTracking?: boolean,
     kvCacheKeyType?: number,
     kvCacheValueType?: number,
-    swaFullCache?: boolean
+    swaFullCache?: boolean,
+    prefixCache?: boolean,
+
+    // the total number of cells of a KV cache that is shared by all the sequences, which enables preemption.
+    // ignored on models that don't support preemption
+    preemptionKvCacheSize?: number
 };
 
 export type BindingModule = {
@@ -47,6 +64,9 @@ export type BindingModule = {
     AddonContextSequenceCheckpoint: {
         new (): AddonContextSequenceCheckpoint
     },
+    AddonTokenizer: {
+        new (): AddonTokenizer
+    },
     AddonGrammar: {
         new (grammarPath: string, params?: {
             addonExports?: BindingModule,
@@ -72,6 +92,16 @@ export type BindingModule = {
     getBlockSizeForGgmlType(ggmlType: number): number | undefined,
     getTypeSizeForGgmlType(ggmlType: number): number | undefined,
     getGgmlGraphOverheadCustom(size: number, grads: boolean): number,
+
+    // `configs` packs 8 values per configuration, and the result packs the cpuRam and gpuVram of each configuration (`-1` on failure)
+    estimateContextResourceGrid(model: AddonModel, configs: Int32Array, maxParallelism: number): Promise<Float64Array>,
+    readGgufFileHeaders(filePaths: string[], options?: {
+        readTensorInfo?: boolean,
+        ignoreKeys?: string[],
+        lazyArrayMinLength?: number,
+        maxParallelism?: number
+    }): Promise<AddonGgufFileHeader[]>,
+
     getConsts(): {
         ggmlMaxDims: number,
         ggmlTypeF16Size: number,
@@ -118,13 +148,20 @@ export type AddonGgufMetadata = {
     dispose(): Promise<void>
 };
 
+export type AddonTrimLeadingSpaceOptions = {
+    workaroundToken?: Token,
+    workaroundTokenString?: string
+};
+
 export type AddonModel = {
     init(source?: AddonGgufMetadata): Promise<boolean>,
     loadLora(lora: AddonModelLora): Promise<void>,
     abortActiveModelLoad(): void,
     dispose(): Promise<void>,
-    tokenize(text: string, specialTokens: boolean): Uint32Array,
+    tokenize(text: string, specialTokens: boolean, trimLeadingSpace?: AddonTrimLeadingSpaceOptions): Uint32Array,
     detokenize(tokens: Uint32Array, specialTokens?: boolean): string,
+    countTokens(text: string, specialTokens: boolean, trimLeadingSpace?: AddonTrimLeadingSpaceOptions): number,
+    countTokens(texts: string[], specialTokens: boolean, trimLeadingSpace?: AddonTrimLeadingSpaceOptions): Uint32Array,
     getTrainContextSize(): number,
     getEmbeddingVectorSize(): number,
     getTotalSize(): number,
@@ -148,7 +185,30 @@ export type AddonModel = {
     getVocabularyType(): number,
     shouldPrependBosToken(): boolean,
     shouldAppendEosToken(): boolean,
-    getModelSize(): number
+    getModelSize(): number,
+    getShareHandle(): number | undefined,
+
+    // whether the model weights were already loaded by another model in this process
+    getSharedModelReused(): boolean,
+
+    // `undefined` until the model is loaded
+    getLoadReport(): LlamaLoadReport | undefined
+};
+
+export type AddonTokenizer = {
+    init(source: AddonGgufMetadata): Promise<void>,
+    attach(shareHandle: number): boolean, // attach to a tokenizer loaded by another thread in this process
+    getShareHandle(): number,
+    dispose(): void,
+    tokenize(text: string, specialTokens: boolean, trimLeadingSpace?: AddonTrimLeadingSpaceOptions): Uint32Array,
+    detokenize(tokens: Uint32Array, specialTokens?: boolean): string,
+    countTokens(text: string, specialTokens: boolean, trimLeadingSpace?: AddonTrimLeadingSpaceOptions): number,
+    countTokens(texts: string[], specialTokens: boolean, trimLeadingSpace?: AddonTrimLeadingSpaceOptions): Uint32Array,
+    getVocabularySize(): number,
+    getTokenAttributes(token: Token): number,
+    isEogToken(token: Token): boolean,
+    shouldPrependBosToken(): boolean,
+    shouldAppendEosToken(): boolean
 };
 
 export type AddonContext = {
@@ -163,6 +223,13 @@ export type AddonContext = {
         logitIndexes: Uint32Array,
     ): Uint32Array, // returns an array with batchLogitIndex for each item in the logitIndexes array
     decodeBatch(): Promise<void>,
+
+    // decodes synthetic batches and clears the whole KV cache afterward. times are in milliseconds
+    warmup(batchSizes: number[], sequences: number): Promise<{
+        weightsWarmupTime: number,
+        batches: {batchSize: number, sequences: number, decodeTime: number}[],
+        memoryClearTime: number
+    }>,
     sampleToken(batchLogitIndex: BatchLogitIndex, sampler: AddonSampler): Promise<Token | -1>,
     sampleToken(
         batchLogitIndex: BatchLogitIndex,
@@ -180,28 +247,133 @@ export type AddonContext = {
 
     getSequenceKvCacheMinPosition(sequenceId: number): number,
     getSequenceKvCacheMaxPosition(sequenceId: number): number,
-    getEmbedding(inputTokensLength: number, maxVectorSize?: number): Float64Array,
+
+    // copies the longest prefix of the given tokens that another sequence evaluated with the same LoRA adapters has in its cache
+    // into this sequence, and returns the length of the tokens prefix the sequence now has in its cache
+    reuseSequencePrefix(
+        sequenceId: number, tokens: Uint32Array, currentLength: number, loras?: AddonModelLora[], scales?: number[]
+    ): number,
+
+    // evicts the cache of the least recently used sequence out of the given ones and returns its id
+    takeLeastRecentlyUsedPrefixCacheSequence(sequenceIds: Uint32Array): number,
+    getPrefixCacheStats(): {
+        enabled: boolean,
+        hits: number,
+        misses: number,
+        reusedTokens: number
+    },
+
+    // a hex hash of the model and the context options that affect the layout of sequence states,
+    // and of the LoRA adapters and scales that affect their content when given
+    getStateFingerprint(loras?: AddonModelLora[], scales?: number[]): string,
+
+    // sequences with a lower priority are preempted first. a priority of `0` marks a sequence that is only kept for the prefix cache
+    setSequencePreemptionPriority(sequenceId: number, priority: number): void,
+    getPreemptionStats(): {
+        enabled: boolean,
+        preemptions: number,
+        droppedSequences: number,
+        swapIns: number,
+        swappedSequences: number,
+        swappedSize: number
+    },
+    getEmbedding(inputTokensLength: number, maxVectorSize?: number): Float32Array,
+
+    // `format` is the same as in `evaluateEmbeddings`
+    getEmbedding(inputTokensLength: number, maxVectorSize: number | undefined, format: number): {
+        vectors: Float32Array | Int8Array | Uint8Array,
+        scale: number
+    },
+
+    // returns a matrix of `(endPos - startPos) x vectorSize` of the token embeddings of the sequence from the last decoded batch.
+    // startPos in inclusive, endPos is exclusive
+    getTokenEmbeddings(
+        sequenceId: number, startPos: number, endPos: number, maxVectorSize?: number, normalize?: boolean
+    ): Float32Array,
+
+    // evaluates the inputs in batches of up to `sequenceIds.length` inputs at once, and returns a matrix of `inputs x vectorSize`.
+    // `format`: 0 = float32, 1 = normalized float32, 2 = int8 (with a scale per vector), 3 = binary (a bit per value, MSB first)
+    evaluateEmbeddings(
+        tokens: Uint32Array,
+        inputLengths: Uint32Array,
+        sequenceIds: Uint32Array,
+        maxVectorSize?: number,
+        format?: number
+    ): Promise<{
+        vectorSize: number,
+        vectors: Float32Array | Int8Array | Uint8Array,
+        scales?: Float32Array
+    }>,
+
+    // evaluates `prefixTokens` followed by the tokens of each input, in batches of up to `sequenceIds.length` inputs at once,
+    // and returns the ranking score of every input.
+    // the prefix is decoded once and copied to the sequences of every batch when the ranking pooling of the model allows it
+    rankBatch(
+        prefixTokens: Uint32Array,
+        tokens: Uint32Array,
+        inputLengths: Uint32Array,
+        sequenceIds: Uint32Array,
+        applySigmoid: boolean
+    ): Promise<Float32Array>,
     getStateSize(): number,
     getMemoryBreakdown(): {
         cpuRam: number,
         gpuVram: number
     },
+
+    // `undefined` until the context is loaded
+    getLoadReport(): LlamaLoadReport | undefined,
+
+    // `sequencePositions` holds the min and max positions of every sequence id, or `-1` for empty sequences.
+    // `swappedSequences` holds `1` for every sequence id that is preempted and swapped out.
+    // should only be called while no other thread uses the context
+    getKvCacheStats(): {
+        totalCells: number,
+        unified: boolean,
+        keyBytesPerCell: number,
+        valueBytesPerCell: number,
+        sequencePositions: Int32Array,
+        swappedSequences: Uint8Array
+    },
     getThreads(): number,
     setThreads(threads: number): void,
     printTimings(): void,
     ensureDraftContextIsCompatibleForSpeculative(draftContext: AddonContext): void,
-    saveSequenceStateToFile(filePath: string, sequenceId: number, tokens: Uint32Array): Promise<number>,
-    loadSequenceStateFromFile(filePath: string, sequenceId: number, maxContextSize: number): Promise<Uint32Array>,
+    saveSequenceStateToFile(filePath: string, sequenceId: number, tokens: Uint32Array, options?: {
+        directIo?: boolean,
+        onProgress?(progress: number): void,
+
+        // a state exported using `exportSequenceState`, which is written without accessing the context
+        state?: Uint8Array
+    }): Promise<number>,
+    loadSequenceStateFromFile(
+        filePath: string, sequenceId: number, maxContextSize: number, onProgress?: (progress: number) => void
+    ): Promise<Uint32Array>,
+
+    // reads and validates a state file saved by `saveSequenceStateToFile` without accessing the context,
+    // so the state can be loaded later using `importSequenceState`
+    readSequenceStateFile(filePath: string, maxContextSize: number): Promise<{tokens: Uint32Array, state: Uint8Array}>,
+    exportSequenceState(sequenceId: number): Promise<Uint8Array>,
+    importSequenceState(sequenceId: number, data: Uint8Array, tokens: Uint32Array): Promise<void>,
+    transferSequenceState(sequenceId: number, targetContext: AddonContext, targetSequenceId: number, tokens: Uint32Array): Promise<void>,
     setLoras(loras: AddonModelLora[], scales: number[]): void,
 
     restoreCheckpoint(checkpoint: AddonContextSequenceCheckpoint, maxPosIndex: number): Promise<boolean>
 };
 
 export type AddonContextSequenceCheckpoint = {
-    init(context: AddonContext, sequenceId: number): Promise<void>,
+    init(
+        context: AddonContext, sequenceId: number, compressionLevel?: number,
+        deltaParent?: AddonContextSequenceCheckpoint // store only the difference from the state of this checkpoint when it's small enough
+    ): Promise<void>,
+    spillToFile(filePath: string): Promise<boolean>, // moves the data from memory to the given file
     dispose(): void,
 
     get size(): number,
+    get rawSize(): number, // the size of the state data before compression
+    get compressed(): boolean,
+    get spilled(): boolean,
+    get isDelta(): boolean,
     get minPos(): number,
     get maxPos(): number
 };
@@ -244,6 +416,45 @@ export type AddonSampler = {
     }): void
 };
 
+// the header of each file is parsed separately, so a file that cannot be parsed only has an `error`
+export type AddonGgufFileHeader = {
+    error: string
+} | {
+    error?: undefined,
+    version: number,
+    tensorCount: bigint,
+    metadataSize: number,
+    keys: string[],
+    values: AddonGgufValue[],
+
+    // set only when the tensor info is read
+    tensorInfoSize?: number,
+    infoEndOffset?: number,
+    tensorNames?: string[],
+    tensorDimensionCounts?: Uint32Array,
+    tensorDimensions?: BigUint64Array, // the dimensions of all the tensors, one after the other
+    tensorTypes?: Uint32Array,
+    tensorOffsets?: BigUint64Array
+};
+
+export type AddonGgufValue = number | bigint | boolean | string | AddonGgufArrayValue;
+export type AddonGgufArrayValue = {
+    type: number, // `GgufValueType`
+    values: Uint8Array | Int8Array | Uint16Array | Int16Array | Uint32Array | Int32Array | Float32Array | Float64Array |
+        BigUint64Array | BigInt64Array | AddonGgufArrayValue[],
+
+    // for string arrays, `values` holds the UTF-8 bytes of all the strings,
+    // and this holds the start offset of each string followed by the end offset of the last one
+    stringOffsets?: Uint32Array
+} | {
+    // a lazy array that was skipped, with the location of its items in the file
+    type: number, // `GgufValueType`
+    values?: undefined,
+    length: number,
+    offset: number,
+    byteLength: number
+};
+
 export type AddonModelLora = {
     usages: number,
     readonly filePath: string,
@@ -8,6 +8,7 @@ import {DisposeGuard} from "../utils/DisposeGuard.js";
 import {GbnfJsonDefList, GbnfJsonSchema} from "../utils/gbnfJson/types.js";
 import {LlamaJsonSchemaGrammar} from "../evaluator/LlamaJsonSchemaGrammar.js";
 import {LlamaGrammar, LlamaGrammarOptions} from "../evaluator/LlamaGrammar.js";
+import {LlamaTokenizer, LlamaTokenizerOptions} from "../evaluator/LlamaTokenizer.js";
 import {ThreadsSplitter} from "../utils/ThreadsSplitter.js";
 import {getLlamaClasses, LlamaClasses} from "../utils/getLlamaClasses.js";
 import {getTempDir, FsPathHandle} from "../utils/getTempDir.js";
@@ -496,6 +497,22 @@ export class Llama {
         });
     }
 
+    /**
+     * Load only the tokenizer of a model from the metadata of its GGUF file, without loading the model weights.
+     *
+     * Useful for counting and tokenizing text (for example, in a worker that prepares prompts) without the memory cost of a model.
+     */
+    public async loadTokenizer(options: LlamaTokenizerOptions) {
+        this._ensureNotDisposed();
+
+        const preventDisposalHandle = this._backendDisposeGuard.createPreventDisposalHandle();
+        try {
+            return await LlamaTokenizer._create(options, {_llama: this});
+        } finally {
+            preventDisposalHandle.dispose();
+        }
+    }
+
     /* eslint-disable @stylistic/max-len */
     /**
      * @see [Using a JSON Schema Grammar](https://node-llama-cpp.withcat.ai/guide/grammar#json-schema) tutorial
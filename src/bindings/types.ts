@@ -47,6 +47,113 @@ export type RamState = {
     wired: number
 };
 
+/**
+ * A breakdown of the time and resources it took to load a model or to create a context.
+ *
+ * The CPU times only include the threads that did the load (including the prefetch threads) on Linux, macOS and Windows.
+ *
+ * The I/O counters (`readBytes`, `majorPageFaults`, `minorPageFaults` and `blockIoWaitTime`) only include the threads that did the load
+ * on Linux. On other platforms they are of the entire process, so work done in parallel by other parts of the process is included.
+ * See `ioCountersScope` for which one was used.
+ */
+export type LlamaLoadReport = {
+    /** The total load time in milliseconds */
+    totalTime: number,
+
+    /**
+     * The time each phase of the load took in milliseconds, in the order they ran.
+     *
+     * The phases of a model load are:
+     * - **`prefetch`** - reading the model file into the OS page cache (when the `prefetch` option is enabled)
+     * - **`initialization`** - reading the metadata and the vocabulary, creating the tensors and allocating the model buffers
+     * - **`tensorData`** - reading the tensor data into the model buffers,
+     * including repacking the weights, uploading them to the GPU and locking them in memory when `useMlock` is enabled
+     * - **`finalization`** - the work `llama.cpp` does after the tensor data is loaded
+     * - **`attach`** - using model weights that were already loaded by another model in this process
+     *
+     * A context has a single **`initialization`** phase,
+     * since `llama.cpp` creates the KV cache and reserves the compute graphs in a single call.
+     */
+    phases: Array<{
+        name: "prefetch" | "initialization" | "tensorData" | "finalization" | "attach" | "load" | (string & {}),
+        time: number
+    }>,
+
+    /**
+     * The number of bytes read from the storage during the load.
+     * Reads served from the OS page cache are not included (except on Windows, where all the reads are included)
+     */
+    readBytes: number,
+
+    /** The average rate of `readBytes` over the total load time, in bytes per second */
+    readThroughput: number,
+
+    /** The size of the loaded tensor data in bytes. Only set for models that loaded their tensor data */
+    tensorDataSize?: number,
+
+    /** The rate the tensor data was loaded at during the `tensorData` phase, in bytes per second */
+    tensorDataThroughput?: number,
+
+    /**
+     * A breakdown of the `tensorData` phase time by what the loading thread did, in milliseconds.
+     *
+     * `llama.cpp` reads, transforms and locks the data of each tensor together,
+     * so this is measured by the CPU time counters of the loading thread.
+     *
+     * Only set for models that loaded their tensor data, on platforms with per-thread CPU time counters.
+     */
+    tensorDataBreakdown?: {
+        /** Processing the tensor data, such as repacking, dequantizing and copying the weights (the CPU time in user mode) */
+        transformTime: number,
+
+        /** Handling page faults and locking the weights in memory when `useMlock` is enabled (the CPU time in the kernel) */
+        kernelTime: number,
+
+        /** Waiting for the storage to read the tensor data and for the GPU to receive it (the rest of the phase time) */
+        waitTime: number
+    },
+
+    /** The CPU time the load spent in user mode, in milliseconds */
+    userCpuTime: number,
+
+    /** The CPU time the load spent in the kernel (such as handling page faults), in milliseconds */
+    systemCpuTime: number,
+
+    /**
+     * The number of page faults that had to read from the storage.
+     * Always `0` on Windows, where all the page faults are counted in `minorPageFaults`
+     */
+    majorPageFaults: number,
+    minorPageFaults: number,
+
+    /**
+     * The time the load waited for the storage (including page faults that read from it), in milliseconds.
+     *
+     * Only available on Linux when the delay accounting of the kernel is enabled (`kernel.task_delayacct`), otherwise it's `0`
+     */
+    blockIoWaitTime: number,
+
+    /**
+     * Whether the I/O counters (`readBytes`, `majorPageFaults`, `minorPageFaults` and `blockIoWaitTime`)
+     * only include the threads that did the load (`"threads"`, on Linux), or the entire process (`"process"`)
+     */
+    ioCountersScope: "threads" | "process",
+
+    /** The size of the buffers that were allocated for each buffer type */
+    buffers: Array<{
+        bufferType: string,
+
+        /** The total size of the buffers in bytes */
+        size: number,
+
+        /** The size of the KV cache buffers in bytes. Only set for contexts */
+        kvCacheSize?: number,
+
+        /** The size of the compute buffers in bytes. Only set for contexts */
+        computeSize?: number
+    }>
+};
+
 export function parseNodeLlamaCppGpuOption(option: (typeof nodeLlamaCppGpuOptions)[number] | (typeof nodeLlamaCppGpuOffStringOptions)[number]): BuildGpu | "auto" {
     function optionIsGpuOff(opt: typeof option): opt is (typeof nodeLlamaCppGpuOffStringOptions)[number] {
         return nodeLlamaCppGpuOffStringOptions.includes(opt as (typeof nodeLlamaCppGpuOffStringOptions)[number]);
@@ -165,3 +272,12 @@ export const enum LlamaLocks {
 export function doesLlamaBackendNeedAddonInitLock(gpu: LlamaGpuType): boolean {
     return gpu === "vulkan";
 }
+
+/**
+ * Whether multiple contexts can be created concurrently from different threads with the given backend.
+ *
+ * Only the CPU backend is known to support this, since the GPU backends share device state between contexts.
+ */
+export function canLlamaBackendCreateContextsConcurrently(gpu: LlamaGpuType): boolean {
+    return gpu === false;
+}
@@ -228,6 +228,7 @@ export const InspectEstimateCommand: CommandModule<object, InspectEstimateComman
             noSuccessLiveStatus: true
         }, async () => {
             return await readGgufFileInfo(resolvedGgufPath, {
+                lazyMetadataArrays: true,
                 fetchHeaders: resolvedModelDestination.type === "file"
                     ? undefined
                     : headers
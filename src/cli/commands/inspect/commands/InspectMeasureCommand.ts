@@ -268,7 +268,8 @@ export const InspectMeasureCommand: CommandModule<object, InspectMeasureCommand>
         console.info();
 
         const ggufMetadata = await readGgufFileInfo(resolvedGgufPath, {
-            sourceType: "filesystem"
+            sourceType: "filesystem",
+            lazyMetadataArrays: true
         });
         const ggufInsights = await GgufInsights.from(ggufMetadata, llama);
         const totalVram = (await llama._getRawVramState()).total;
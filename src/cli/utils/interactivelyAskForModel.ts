@@ -115,7 +115,9 @@ export async function interactivelyAskForModel({
                         try {
                             const ggufFileInfo = await readGgufFileInfo(filePath, {
                                 sourceType: "filesystem",
-                                signal: activeInteractionController.signal
+                                signal: activeInteractionController.signal,
+                                llama,
+                                lazyMetadataArrays: true
                             });
                             ggufInsights = await GgufInsights.from(ggufFileInfo, llama);
                         } catch (err) {
@@ -1,5 +1,9 @@
 import path from "path";
-import {acquireLock, AsyncDisposeAggregator, DisposeAggregator, DisposedError, EventRelay, Lock, withLock} from "lifecycle-utils";
+import fs from "fs-extra";
+import {nanoid} from "nanoid";
+import {
+    acquireLock, AsyncDisposeAggregator, DisposeAggregator, DisposedError, EventRelay, isLockActive, Lock, withLock
+} from "lifecycle-utils";
 import {removeNullFields} from "../../utils/removeNullFields.js";
 import {Token} from "../../types.js";
 import {AddonContext, AddonModelLora, BatchLogitIndex} from "../../bindings/AddonTypes.js";
@@ -14,22 +18,25 @@ import {ThreadsSplitterConsumer} from "../../utils/ThreadsSplitter.js";
 import {pushAll} from "../../utils/pushAll.js";
 import {safeEventCallback} from "../../utils/safeEventCallback.js";
 import {GgufArchitectureType} from "../../gguf/types/GgufMetadataTypes.js";
-import {LlamaLocks, LlamaLogLevel} from "../../bindings/types.js";
+import {LlamaLoadReport, LlamaLocks, LlamaLogLevel} from "../../bindings/types.js";
 import {GgmlType, resolveGgmlTypeOption} from "../../gguf/types/GgufTensorInfoTypes.js";
 import {MemoryMarking} from "../../bindings/utils/MemoryOrchestrator.js";
 import {
     BatchingOptions, BatchItem, ContextShiftOptions, ContextTokensDeleteRange, ControlledEvaluateIndexOutput, ControlledEvaluateInputItem,
     EvaluationPriority, LlamaContextOptions, LlamaContextSequenceDryRepeatPenalty, LlamaContextSequenceRepeatPenalty, PrioritizedBatchItem,
-    SequenceEvaluateMetadataOptions, SequenceEvaluateOptions, SequenceEvaluateOutput
+    SequenceEvaluateMetadataOptions, SequenceEvaluateOptions, SequenceEvaluateOutput, LlamaContextSequenceState, LlamaContextKvCacheStats,
+    LlamaContextLoraAdapter, LlamaContextWarmupResult
 } from "./types.js";
 import {resolveBatchItemsPrioritizationStrategy} from "./utils/resolveBatchItemsPrioritizationStrategy.js";
 import {LlamaSampler} from "./LlamaSampler.js";
 import {TokenPredictor} from "./TokenPredictor.js";
 import {padSafeContextSize} from "./utils/padSafeContextSize.js";
 import {LlamaContextSequenceCheckpoints} from "./LlamaContextSequenceCheckpoints.js";
+import {LlamaPromptCache, LlamaPromptCacheStats} from "./LlamaPromptCache.js";
 import type {Llama} from "../../bindings/Llama.js";
 
 const defaultLoraScale = 1;
+const defaultMaxConsecutiveLoraAdapterBatches = 4;
 const shrinkRetriesMinContextSize = 4096;
 const defaultMaxPunishTokens = 64;
 const defaultFailedCreationRemedy = {
@@ -41,8 +48,17 @@ const defaultDryRepeatPenalitySequenceBreakers = ["\n", ":", '"', "*"];
 const defaultCheckpointOptions: Required<SequenceCheckpointOptions> = {
     max: 32,
     interval: 8192,
-    maxMemory: null
+    maxMemory: null,
+    compression: false,
+    diskSpill: false,
+    deltas: false
 };
+const defaultCheckpointsKeepInMemory = 2;
+const defaultCheckpointsMaxDeltaChainLength = 8;
+const defaultCheckpointCompressionLevel = 1;
+const defaultPromptCacheMaxSize = 4 * 1024 * 1024 * 1024; // 4GB
+const defaultPromptCacheMinTokens = 256;
+const sequenceStateTransferLock = {};
 
 export const internalCheckpoints = {
     speculative: {
@@ -82,11 +98,18 @@ export class LlamaContext {
     /** @internal */ private readonly _unusedSequenceIds: number[] = [];
     /** @internal */ private readonly _batchingOptions: Required<BatchingOptions>;
     /** @internal */ public readonly _swaFullCache: boolean = false;
+    /** @internal */ public readonly _prefixCache: boolean = false;
+    /** @internal */ private readonly _preemption: boolean = false;
+    /** @internal */ public _promptCache?: LlamaPromptCache;
     /** @internal */ private readonly _queuedDecodeSequenceIds = new Set<number>();
     /** @internal */ private readonly _queuedDecodes: InternalQueuedDecode[] = [];
     /** @internal */ private readonly _disposeAggregator = new AsyncDisposeAggregator();
     /** @internal */ private readonly _modelPreventDisposalHandle: DisposalPreventionHandle;
-    /** @internal */ private readonly _loraAdapters = new Set<AddonModelLora>();
+    /** @internal */ private readonly _loraAdapterUsages = new Map<AddonModelLora, number>();
+    /** @internal */ public _defaultLoraAdapterSet: LoraAdapterSet = emptyLoraAdapterSet;
+    /** @internal */ private _activeLoraAdapterSet: LoraAdapterSet = emptyLoraAdapterSet;
+    /** @internal */ private _consecutiveLoraAdapterSetBatches: number = 0;
+    /** @internal */ private _loraAdapterSetSwitches: number = 0;
     /** @internal */ public _vramConsumptionMarking?: MemoryMarking;
     /** @internal */ public _ramConsumptionMarking?: MemoryMarking;
     /** @internal */ private _nextGeneratedSequenceId = 0;
@@ -97,6 +120,9 @@ export class LlamaContext {
     /** @internal */ private _currentDispatchBatchHandle: object = {};
     /** @internal */ private _allocatedContextSize?: number;
     /** @internal */ private _disposed: boolean = false;
+    /** @internal */ private _loadReport?: LlamaLoadReport;
+    /** @internal */ private _kvCacheStats?: LlamaContextKvCacheStats;
+    /** @internal */ private _kvCacheStatsRequested: boolean = false;
 
     public readonly onDispose = new EventRelay<void>();
 
@@ -112,14 +138,18 @@ export class LlamaContext {
         threads,
         batching: {
             dispatchSchedule: batchingDispatchSchedule = "nextCycle",
-            itemPrioritizationStrategy: batchingItemsPrioritizationStrategy = "maximumParallelism"
+            itemPrioritizationStrategy: batchingItemsPrioritizationStrategy = "maximumParallelism",
+            maxConsecutiveLoraAdapterBatches: batchingMaxConsecutiveLoraAdapterBatches = defaultMaxConsecutiveLoraAdapterBatches
         } = {},
         swaFullCache = _model.defaultContextSwaFullCache,
+        prefixCache = false,
+        preemption = false,
         performanceTracking = false,
         experimentalKvCacheKeyType,
         experimentalKvCacheValueType,
         _embeddings,
-        _ranking
+        _ranking,
+        _tokenEmbeddings
     }: LlamaContextOptions & {
         sequences: number,
         contextSize: number,
@@ -158,6 +188,20 @@ export class LlamaContext {
         this._kvCacheKeyType = experimentalKvCacheKeyType;
         this._kvCacheValueType = experimentalKvCacheValueType;
         this._swaFullCache = !!swaFullCache;
+
+        // the KV cache size is clamped to the size the context memory is estimated and reserved for
+        const preemptionKvCacheSize = preemption === false
+            ? undefined
+            : padSafeContextSize(
+                Math.min(
+                    this._contextSize * this._totalSequences,
+                    Math.max(
+                        this._contextSize,
+                        (preemption === true ? undefined : preemption.kvCacheSize) ?? this._contextSize * this._totalSequences
+                    )
+                ),
+                "up"
+            );
         this._ctx = new this._llama._bindings.AddonContext(this._model._model, removeNullFields({
             contextSize: padSafeContextSize(this._contextSize * this._totalSequences, "up"), // each sequence needs its own <contextSize> of cells
             batchSize: this._batchSize + (
@@ -172,14 +216,20 @@ export class LlamaContext {
             threads: this._idealThreads,
             embeddings: _embeddings,
             ranking: _ranking,
+            tokenEmbeddings: _tokenEmbeddings,
             performanceTracking: this._performanceTracking,
             kvCacheKeyType: this._kvCacheKeyType,
             kvCacheValueType: this._kvCacheValueType,
-            swaFullCache: this._swaFullCache
+            swaFullCache: this._swaFullCache,
+            prefixCache,
+            preemptionKvCacheSize
         }));
+        this._prefixCache = prefixCache && this._ctx.getPrefixCacheStats().enabled;
+        this._preemption = preemptionKvCacheSize != null && this._ctx.getPreemptionStats().enabled;
         this._batchingOptions = {
             dispatchSchedule: batchingDispatchSchedule,
-            itemPrioritizationStrategy: batchingItemsPrioritizationStrategy
+            itemPrioritizationStrategy: batchingItemsPrioritizationStrategy,
+            maxConsecutiveLoraAdapterBatches: Math.max(1, batchingMaxConsecutiveLoraAdapterBatches)
         };
 
         this._reclaimUnusedSequenceId = this._reclaimUnusedSequenceId.bind(this);
@@ -199,6 +249,11 @@ export class LlamaContext {
         this._disposeAggregator.add(async () => {
             await this._backendContextDisposeGuard.acquireDisposeLock();
             await this._ctx.dispose();
+
+            for (const addonLora of this._loraAdapterUsages.keys())
+                this._model._releaseLora(addonLora);
+
+            this._loraAdapterUsages.clear();
             this._vramConsumptionMarking?.dispose();
             this._ramConsumptionMarking?.dispose();
             this._modelPreventDisposalHandle.dispose();
@@ -282,10 +337,115 @@ export class LlamaContext {
         return this._allocatedContextSize;
     }
 
+    /**
+     * Get the size of the KV cache of the context and the range of positions each of its sequences holds.
+     *
+     * The KV cache can only be read while the context isn't used to evaluate anything,
+     * so while an evaluation is in progress, this returns the stats from the last time the context wasn't in use,
+     * and they're updated once the current batch finishes evaluating.
+     * It's cheap enough to be called before scheduling every evaluation.
+     */
+    public getKvCacheStats(): LlamaContextKvCacheStats {
+        this._ensureNotDisposed();
+
+        if (this._kvCacheStats != null && isLockActive([this as LlamaContext, "context"])) {
+            this._kvCacheStatsRequested = true;
+            return this._kvCacheStats;
+        }
+
+        return this._readKvCacheStats();
+    }
+
     public get totalSequences(): number {
         return this._totalSequences;
     }
 
+    /**
+     * Statistics of the `prefixCache` option.
+     *
+     * `enabled` is `false` when the option is not enabled or has no effect on the current model.
+     */
+    public get prefixCacheStats(): {
+        enabled: boolean,
+        hits: number,
+        misses: number,
+
+        /** The number of tokens that were copied from the cache of other sequences instead of being evaluated */
+        reusedTokens: number
+    } {
+        this._ensureNotDisposed();
+
+        return this._ctx.getPrefixCacheStats();
+    }
+
+    /**
+     * Statistics of the `promptCache` option.
+     *
+     * `enabled` is `false` when the option is not enabled.
+     */
+    public get promptCacheStats(): LlamaPromptCacheStats {
+        this._ensureNotDisposed();
+
+        if (this._promptCache == null)
+            return {
+                enabled: false,
+                hits: 0,
+                misses: 0,
+                hitRatio: 0,
+                reusedTokens: 0,
+                entries: 0,
+                size: 0
+            };
+
+        return this._promptCache.stats;
+    }
+
+    /**
+     * The number of times the LoRA adapters of the context were switched between batches
+     * to evaluate sequences that use different LoRA adapters.
+     *
+     * Batches are grouped by the LoRA adapters their sequences use to keep this number low.
+     * See `.setLoraAdapters()` on {@link LlamaContextSequence} for more details.
+     */
+    public get loraAdapterSwitches(): number {
+        return this._loraAdapterSetSwitches;
+    }
+
+    /**
+     * A breakdown of the time and resources it took to create this context, including the size of its KV cache and compute buffers
+     */
+    public get loadReport(): LlamaLoadReport | undefined {
+        return this._loadReport;
+    }
+
+    /**
+     * Statistics of the `preemption` option.
+     *
+     * `enabled` is `false` when the option is not enabled or has no effect on the current model.
+     */
+    public get preemptionStats(): {
+        enabled: boolean,
+
+        /** The number of times a sequence was swapped out to the RAM to free cells for a batch */
+        preemptions: number,
+
+        /** The number of times the cache of a disposed sequence that was kept by the `prefixCache` option was dropped to free cells */
+        droppedSequences: number,
+
+        /** The number of times a preempted sequence was swapped back into the KV cache */
+        swapIns: number,
+
+        /** The number of sequences that are currently swapped out */
+        swappedSequences: number,
+
+        /** The total size of the states of the sequences that are currently swapped out in bytes */
+        swappedSize: number
+    } {
+        this._ensureNotDisposed();
+
+        return this._ctx.getPreemptionStats();
+    }
+
     public get sequencesLeft() {
         return this._totalSequences - this._nextGeneratedSequenceId + this._unusedSequenceIds.length;
     }
@@ -355,7 +515,79 @@ export class LlamaContext {
              *
              * Defaults to `null` (no memory limit).
              */
-            maxMemory?: number | null
+            maxMemory?: number | null,
+
+            /**
+             * Compress the checkpoints in memory to fit more of them in the same memory budget.
+             *
+             * The compression is lossless and done on a background thread when taking a checkpoint,
+             * and the decompression is done when restoring a checkpoint.
+             * Checkpoints that don't compress well are stored uncompressed.
+             *
+             * The checkpoints are compressed using zstd.
+             * Set to an object with a `level` (`1`-`19`) to trade compression speed for a better compression ratio.
+             *
+             * Defaults to `false`.
+             */
+            compression?: boolean | {
+                /**
+                 * Defaults to `1`.
+                 */
+                level?: number
+            },
+
+            /**
+             * Spill older checkpoints to files in a directory to keep more checkpoints without holding them all in memory.
+             *
+             * The most recent checkpoints are kept in memory, and older ones are written to files in the background.
+             * Restoring a spilled checkpoint maps its file into memory and restores the state directly from it.
+             *
+             * When enabled, the `maxMemory` option only applies to the checkpoints kept in memory,
+             * and checkpoints that exceed it are spilled instead of being freed.
+             * When spilling fails (for example, when the disk is full), a warning is logged
+             * and the oldest checkpoints are freed to keep the memory usage under `maxMemory`.
+             *
+             * Spill files are checksummed, so a spill file that was modified or partially written is not restored,
+             * and the sequence state is evaluated again instead.
+             *
+             * The files are deleted when their checkpoints are freed.
+             *
+             * Defaults to `false`.
+             */
+            diskSpill?: false | {
+                /**
+                 * The directory to write the checkpoint files to.
+                 * It will be created if it doesn't exist.
+                 */
+                directory: string,
+
+                /**
+                 * The number of the most recent checkpoints to keep in memory.
+                 *
+                 * Defaults to `2`.
+                 */
+                keepInMemory?: number
+            },
+
+            /**
+             * Store new checkpoints as the difference from the previous checkpoint when it makes them much smaller.
+             *
+             * When consecutive checkpoints share most of their state, this avoids storing the same data multiple times.
+             * Restoring a delta checkpoint reconstructs its state from the chain of checkpoints it's based on,
+             * and the data of checkpoints that other checkpoints are based on is kept until those checkpoints are freed.
+             *
+             * Defaults to `false`.
+             */
+            deltas?: boolean | {
+                /**
+                 * The maximum number of delta checkpoints in a chain before a full checkpoint is stored.
+                 *
+                 * Longer chains save more memory but make restoring a checkpoint slower.
+                 *
+                 * Defaults to `8`.
+                 */
+                maxChainLength?: number
+            }
         },
 
         /** @internal */
@@ -420,12 +652,17 @@ export class LlamaContext {
             };
 
             const getOrderedQueuedDecodes = (
-                prioritizationStrategy: ReturnType<typeof resolveBatchItemsPrioritizationStrategy>
+                prioritizationStrategy: ReturnType<typeof resolveBatchItemsPrioritizationStrategy>,
+                loraAdapterSet: LoraAdapterSet
             ): null | CurrentBatchItem[] => {
                 const batchItemToQueuedDecodeMap = new Map<BatchItem, InternalQueuedDecode>();
                 const batchItemsList: BatchItem[] = [];
 
                 for (const queuedDecode of this._queuedDecodes) {
+                    // a batch can only be evaluated with a single set of LoRA adapters
+                    if (queuedDecode.loraAdapterSet.key !== loraAdapterSet.key)
+                        continue;
+
                     const batchItem: BatchItem = {
                         tokens: queuedDecode.tokens,
                         logits: queuedDecode.logits,
@@ -521,6 +758,9 @@ export class LlamaContext {
                     TokenMeter.useTokens(queuedDecode.tokenMeter, numberOfOutputTokens, "output");
 
                     try {
+                        if (this._preemption)
+                            this._ctx.setSequencePreemptionPriority(queuedDecode.sequenceId, queuedDecode.evaluationPriority);
+
                         batchLogitIndexes = this._ctx.addToBatch(
                             queuedDecode.sequenceId,
                             queuedDecode.firstTokenSequenceIndex,
@@ -580,6 +820,10 @@ export class LlamaContext {
 
                         await this._ctx.decodeBatch();
                         consumerHandle?.dispose();
+
+                        // the KV cache stats that were requested during the evaluation are updated while nothing else uses the context
+                        if (this._kvCacheStatsRequested)
+                            this._readKvCacheStats();
                     } catch (err) {
                         consumerHandle?.dispose();
                         this._dispatchErrorForQueuedDecodesAndDequeue(currentQueuedDecodeItems, err);
@@ -664,7 +908,8 @@ export class LlamaContext {
             this._reserveThreads();
             try {
                 while (shouldHaveAnotherLoop) {
-                    const orderedQueuedDecodes = getOrderedQueuedDecodes(prioritizationStrategy);
+                    const loraAdapterSet = this._getNextBatchLoraAdapterSet();
+                    const orderedQueuedDecodes = getOrderedQueuedDecodes(prioritizationStrategy, loraAdapterSet);
                     if (orderedQueuedDecodes == null) return; // all queued items are rejected and dequeued when we get here
 
                     const {
@@ -686,6 +931,21 @@ export class LlamaContext {
                         decodeLock = await acquireLock([decodeSyncWorkaround.vulkanLock, "decode"]);
 
                     try {
+                        if (loraAdapterSet !== this._activeLoraAdapterSet) {
+                            try {
+                                this._applyLoraAdapterSet(loraAdapterSet);
+                                this._loraAdapterSetSwitches++;
+                            } catch (err) {
+                                this._dispatchErrorForQueuedDecodesAndDequeue(
+                                    new Set(currentBatchItems.map((item) => item.queuedDecode)),
+                                    err
+                                );
+                                shouldHaveAnotherLoop = this._queuedDecodes.length > 0;
+                                continue;
+                            }
+                        }
+
+                        this._consecutiveLoraAdapterSetBatches++;
                         await decodeTokenBatchItems(currentBatchItems, currentBatchSize);
 
                         shouldHaveAnotherLoop = this._queuedDecodes.length > 0;
@@ -718,30 +978,239 @@ export class LlamaContext {
         await new Promise((accept) => setTimeout(accept, 0)); // wait for the logs to finish printing
     }
 
+    /**
+     * Decode synthetic batches of the given sizes to load the model weights into memory
+     * and allocate the compute graphs of these batch shapes ahead of time,
+     * so the first real evaluation doesn't have to pay for it.
+     *
+     * The whole KV cache of the context is cleared afterward,
+     * so this can only be used when the context has no sequences in use.
+     * The prefix cache of the `prefixCache` option is cleared as well.
+     */
+    public async warmup({
+        batchSizes = [this._batchSize],
+        sequences = 1
+    }: {
+        /**
+         * The sizes of the batches to decode.
+         * Every size has to be at most the `batchSize` of the context.
+         *
+         * Defaults to the `batchSize` of the context.
+         */
+        batchSizes?: number[],
+
+        /**
+         * The number of sequences to split the tokens of each batch between.
+         *
+         * Defaults to `1`.
+         */
+        sequences?: number
+    } = {}): Promise<LlamaContextWarmupResult> {
+        this._ensureNotDisposed();
+
+        if (sequences < 1 || sequences > this._totalSequences)
+            throw new RangeError(`The number of warmup sequences must be between 1 and ${this._totalSequences}`);
+
+        for (const batchSize of batchSizes) {
+            if (batchSize < 1 || batchSize > this._batchSize)
+                throw new RangeError(`The warmup batch size must be between 1 and ${this._batchSize}`);
+        }
+
+        return await this._runNativeDecodeJob(async () => {
+            if (this._nextGeneratedSequenceId - this._unusedSequenceIds.length > 0)
+                throw new Error("Cannot warm up a context that has sequences in use");
+
+            return await this._ctx.warmup(batchSizes, sequences);
+        });
+    }
+
+    /**
+     * Run a native call that decodes batches on the context outside of the batching of `dispatchPendingBatch`,
+     * while holding the context lock and the same guards the decoding of batches in `dispatchPendingBatch` holds
+     * @internal
+     */
+    public async _runNativeDecodeJob<T>(job: () => Promise<T>): Promise<T> {
+        return await withLock([this as LlamaContext, "context"], async () => {
+            this._ensureNotDisposed();
+
+            const preventDisposalHandle = this._backendContextDisposeGuard.createPreventDisposalHandle();
+            let decodeLock: Lock | undefined;
+            try {
+                // this is a workaround to prevent Vulkan from crashing the process when decoding on multiple contexts in parallel
+                if (this._llama.gpu === "vulkan")
+                    decodeLock = await acquireLock([decodeSyncWorkaround.vulkanLock, "decode"]);
+
+                return await job();
+            } finally {
+                decodeLock?.dispose();
+                preventDisposalHandle.dispose();
+            }
+        });
+    }
+
+    /** @internal */
+    private _readKvCacheStats(): LlamaContextKvCacheStats {
+        const {
+            totalCells, unified, keyBytesPerCell, valueBytesPerCell, sequencePositions, swappedSequences
+        } = this._ctx.getKvCacheStats();
+
+        const sequences: LlamaContextKvCacheStats["sequences"] = [];
+        for (let sequenceId = 0; sequenceId < swappedSequences.length; sequenceId++) {
+            const maxPosition = sequencePositions[sequenceId * 2 + 1]!;
+            const swapped = swappedSequences[sequenceId] === 1;
+
+            if (maxPosition >= 0 || swapped)
+                sequences.push({
+                    sequenceId,
+                    minPosition: sequencePositions[sequenceId * 2]!,
+                    maxPosition,
+                    swapped
+                });
+        }
+
+        this._kvCacheStatsRequested = false;
+        this._kvCacheStats = {
+            totalCells,
+            unified,
+            keyBytesPerCell,
+            valueBytesPerCell,
+            sequences
+        };
+
+        return this._kvCacheStats;
+    }
+
     /** @internal */
     public async _decodeTokens<T>({
-        sequenceId, firstTokenSequenceIndex, tokens, logits, evaluationPriority = defaultEvaluationPriority, tokenMeter, afterBatchAction
+        sequenceId, firstTokenSequenceIndex, tokens, logits, evaluationPriority = defaultEvaluationPriority, tokenMeter, loraAdapterSet,
+        afterBatchAction
     }: {
         sequenceId: number, firstTokenSequenceIndex: number, tokens: Token[], logits: (true | undefined)[],
-        evaluationPriority?: EvaluationPriority, tokenMeter: TokenMeter,
+        evaluationPriority?: EvaluationPriority, tokenMeter: TokenMeter, loraAdapterSet?: LoraAdapterSet,
         afterBatchAction?: ((sequenceStateLength: number) => Promise<void> | void)
     }, logitDataMapper: ((batchLogitIndex: BatchLogitIndex, tokenIndex: number) => T | Promise<T>)): Promise<[index: number, value: T][]> {
-        return await new Promise((accept, reject) => {
-            this._queuedDecodes.push({
-                sequenceId,
-                tokens,
-                logits,
-                firstTokenSequenceIndex,
-                evaluationPriority,
-                tokenMeter,
-                response: [accept, reject],
-                logitDataMapper,
-                afterBatchAction
+        const resolvedLoraAdapterSet = loraAdapterSet ?? this._defaultLoraAdapterSet;
+
+        // keep the adapters loaded until the item is evaluated, even if the sequence switches to other adapters in the meantime
+        this._retainLoraAdapterSet(resolvedLoraAdapterSet);
+        try {
+            return await new Promise((accept, reject) => {
+                this._queuedDecodes.push({
+                    sequenceId,
+                    tokens,
+                    logits,
+                    firstTokenSequenceIndex,
+                    evaluationPriority,
+                    tokenMeter,
+                    loraAdapterSet: resolvedLoraAdapterSet,
+                    response: [accept, reject],
+                    logitDataMapper,
+                    afterBatchAction
+                });
+                this._queuedDecodeSequenceIds.add(sequenceId);
+
+                this._scheduleDecode();
             });
-            this._queuedDecodeSequenceIds.add(sequenceId);
+        } finally {
+            this._releaseLoraAdapterSet(resolvedLoraAdapterSet);
+        }
+    }
 
-            this._scheduleDecode();
-        });
+    /** @internal */
+    public async _acquireLoraAdapterSet(loras: readonly LlamaContextLoraAdapter[]): Promise<LoraAdapterSet> {
+        const adapters: AddonModelLora[] = [];
+        const scales: number[] = [];
+
+        try {
+            // acquiring an adapter pins it in the model's adapter cache, so loading the next adapters cannot evict it
+            for (const {filePath, scale} of loras) {
+                adapters.push(await this._model._acquireLora(filePath));
+                scales.push(scale ?? defaultLoraScale);
+            }
+
+            this._ensureNotDisposed();
+        } catch (err) {
+            for (const adapter of adapters)
+                this._model._releaseLora(adapter);
+
+            throw err;
+        }
+
+        // the context holds a single pin of each adapter in the model's adapter cache while any of its adapter sets use it
+        for (const adapter of adapters) {
+            const usages = this._loraAdapterUsages.get(adapter);
+            if (usages != null)
+                this._model._releaseLora(adapter);
+
+            this._loraAdapterUsages.set(adapter, (usages ?? 0) + 1);
+        }
+
+        return {
+            key: adapters.map((adapter, index) => adapter.filePath + "\0" + scales[index]).join("\n"),
+            adapters,
+            scales
+        };
+    }
+
+    /** @internal */
+    public _releaseLoraAdapterSet(loraAdapterSet: LoraAdapterSet) {
+        if (this._disposed)
+            return;
+
+        for (const adapter of loraAdapterSet.adapters) {
+            const usages = (this._loraAdapterUsages.get(adapter) ?? 0) - 1;
+
+            if (usages > 0)
+                this._loraAdapterUsages.set(adapter, usages);
+            else if (this._loraAdapterUsages.delete(adapter))
+                this._model._releaseLora(adapter);
+        }
+    }
+
+    /** @internal */
+    private _retainLoraAdapterSet(loraAdapterSet: LoraAdapterSet) {
+        for (const adapter of loraAdapterSet.adapters)
+            this._loraAdapterUsages.set(adapter, (this._loraAdapterUsages.get(adapter) ?? 0) + 1);
+    }
+
+    /** @internal */
+    private _applyLoraAdapterSet(loraAdapterSet: LoraAdapterSet) {
+        const previousLoraAdapterSet = this._activeLoraAdapterSet;
+
+        this._ctx.setLoras(loraAdapterSet.adapters, loraAdapterSet.scales);
+        this._retainLoraAdapterSet(loraAdapterSet);
+        this._activeLoraAdapterSet = loraAdapterSet;
+        this._consecutiveLoraAdapterSetBatches = 0;
+
+        this._releaseLoraAdapterSet(previousLoraAdapterSet);
+    }
+
+    /**
+     * Keep evaluating the queued items that use the current LoRA adapters for up to `maxConsecutiveLoraAdapterBatches` batches,
+     * and then switch to the adapters of the queued item that has waited the longest, so no adapters can starve the others
+     * @internal
+     */
+    private _getNextBatchLoraAdapterSet(): LoraAdapterSet {
+        const activeLoraAdapterSet = this._activeLoraAdapterSet;
+        let hasActiveLoraAdapterSetItems = false;
+        let longestWaitingLoraAdapterSet: LoraAdapterSet | undefined;
+
+        for (const queuedDecode of this._queuedDecodes) {
+            if (queuedDecode.loraAdapterSet.key === activeLoraAdapterSet.key)
+                hasActiveLoraAdapterSetItems = true;
+            else if (longestWaitingLoraAdapterSet == null)
+                longestWaitingLoraAdapterSet = queuedDecode.loraAdapterSet;
+        }
+
+        if (longestWaitingLoraAdapterSet == null)
+            return activeLoraAdapterSet;
+        else if (
+            hasActiveLoraAdapterSetItems &&
+            this._consecutiveLoraAdapterSetBatches < this._batchingOptions.maxConsecutiveLoraAdapterBatches
+        )
+            return activeLoraAdapterSet;
+
+        return longestWaitingLoraAdapterSet;
     }
 
     /** @internal */
@@ -753,7 +1222,12 @@ export class LlamaContext {
             if (this._disposed)
                 return;
 
-            this._ctx.disposeSequence(sequenceId);
+            // with the prefix cache, the cache of the sequence is kept for reuse until its cells are needed
+            if (!this._prefixCache)
+                this._ctx.disposeSequence(sequenceId);
+            else if (this._preemption)
+                this._ctx.setSequencePreemptionPriority(sequenceId, 0);
+
             this._unusedSequenceIds.push(sequenceId);
             this._onReclaimUnusedSequenceId.dispatchEvent();
         });
@@ -761,7 +1235,16 @@ export class LlamaContext {
 
     /** @internal */
     private _popSequenceId(): number | null {
-        if (this._unusedSequenceIds.length > 0)
+        // with the prefix cache, reclaimed sequences are used only after all the other sequences are used,
+        // and then the least recently used one is evicted from the cache first
+        if (this._prefixCache && this._unusedSequenceIds.length > 0 && this._nextGeneratedSequenceId >= this._totalSequences) {
+            const sequenceId = this._ctx.takeLeastRecentlyUsedPrefixCacheSequence(Uint32Array.from(this._unusedSequenceIds));
+            this._unusedSequenceIds.splice(this._unusedSequenceIds.indexOf(sequenceId), 1);
+
+            return sequenceId;
+        }
+
+        if (this._unusedSequenceIds.length > 0 && !this._prefixCache)
             return this._unusedSequenceIds.shift()!;
 
         if (this._nextGeneratedSequenceId < this._totalSequences) {
@@ -833,27 +1316,13 @@ export class LlamaContext {
     }
 
     /** @internal */
-    private async _setLoras(loras: Array<{
-        filePath: string,
-        scale?: number
-    }>) {
-        const addonLoras: AddonModelLora[] = [];
-        const addonScales: number[] = [];
-
-        for (const {filePath, scale} of loras) {
-            const lora = await this._model._getOrLoadLora(filePath);
-            addonLoras.push(lora);
-            addonScales.push(scale ?? defaultLoraScale);
-        }
-
-        this._ctx.setLoras(addonLoras, addonScales);
+    private async _setLoras(loras: LlamaContextLoraAdapter[]) {
+        const loraAdapterSet = await this._acquireLoraAdapterSet(loras);
+        const previousDefaultLoraAdapterSet = this._defaultLoraAdapterSet;
 
-        for (const addonLora of addonLoras) {
-            if (!this._loraAdapters.has(addonLora)) {
-                this._loraAdapters.add(addonLora);
-                addonLora.usages++;
-            }
-        }
+        this._defaultLoraAdapterSet = loraAdapterSet;
+        this._releaseLoraAdapterSet(previousDefaultLoraAdapterSet);
+        this._applyLoraAdapterSet(loraAdapterSet);
     }
 
     /** @internal */
@@ -997,12 +1466,30 @@ export class LlamaContext {
                 } else if (!contextLoaded)
                     throw new Error("Failed to create context");
 
+                context._loadReport = context._ctx.getLoadReport();
+                context._readKvCacheStats();
+
                 const memoryBreakdown = context._ctx.getMemoryBreakdown();
                 context._vramConsumptionMarking = _model._llama._vramOrchestrator.markAllocation(memoryBreakdown.gpuVram);
                 context._ramConsumptionMarking = _model._llama._ramOrchestrator.markAllocation(memoryBreakdown.cpuRam);
                 contextCreationVramReservation?.dispose?.();
                 contextCreationRamReservation?.dispose?.();
 
+                if (options.promptCache != null) {
+                    try {
+                        const promptCache = await LlamaPromptCache._create({
+                            directory: options.promptCache.directory,
+                            maxSize: options.promptCache.maxSize ?? defaultPromptCacheMaxSize,
+                            minTokens: Math.max(1, options.promptCache.minTokens ?? defaultPromptCacheMinTokens)
+                        });
+                        context._promptCache = promptCache;
+                        context._disposeAggregator.add(() => promptCache.flush());
+                    } catch (err) {
+                        await context.dispose();
+                        throw err;
+                    }
+                }
+
                 if (loraOptions != null && loraOptions.adapters.length > 0) {
                     try {
                         await context._setLoras(loraOptions.adapters);
@@ -1066,13 +1553,14 @@ export class LlamaContext {
 }
 
 export class LlamaContextSequence {
-    /** @internal */ private readonly _sequenceId: number;
+    /** @internal */ public readonly _sequenceId: number;
     /** @internal */ private readonly _gcRegistry: FinalizationRegistry<number>;
     /** @internal */ private readonly _context: LlamaContext;
     /** @internal */ private readonly _contextShift: Required<ContextShiftOptions>;
     /** @internal */ private readonly _tokenPredictor?: TokenPredictor;
-    /** @internal */ private readonly _checkpoints = new LlamaContextSequenceCheckpoints();
+    /** @internal */ public readonly _checkpoints = new LlamaContextSequenceCheckpoints();
     /** @internal */ private readonly _checkpointOptions: Required<SequenceCheckpointOptions>;
+    /** @internal */ public _checkpointsSpillPromise: Promise<void> = Promise.resolve();
     /** @internal */ private readonly _tokenMeter: TokenMeter;
     /** @internal */ private readonly _disposeAggregator = new DisposeAggregator();
     /** @internal */ private readonly _lock = {};
@@ -1088,6 +1576,7 @@ export class LlamaContextSequence {
     /** @internal */ private _unusedTokenPredictions: number = 0;
     /** @internal */ private _validatedTokenPredictions: number = 0;
     /** @internal */ private _refutedTokenPredictions: number = 0;
+    /** @internal */ private _loraAdapterSet?: LoraAdapterSet;
     /** @internal */ private _disposed = false;
 
     public readonly onDispose = new EventRelay<void>();
@@ -1110,7 +1599,10 @@ export class LlamaContextSequence {
         this._checkpointOptions = {
             max: checkpoints?.max ?? defaultCheckpointOptions.max,
             interval: checkpoints?.interval ?? defaultCheckpointOptions.interval,
-            maxMemory: checkpoints?.maxMemory ?? defaultCheckpointOptions.maxMemory
+            maxMemory: checkpoints?.maxMemory ?? defaultCheckpointOptions.maxMemory,
+            compression: checkpoints?.compression ?? defaultCheckpointOptions.compression,
+            diskSpill: checkpoints?.diskSpill ?? defaultCheckpointOptions.diskSpill,
+            deltas: checkpoints?.deltas ?? defaultCheckpointOptions.deltas
         };
         this._gcRegistry = new FinalizationRegistry(this._context._reclaimUnusedSequenceId);
 
@@ -1127,6 +1619,11 @@ export class LlamaContextSequence {
         this._disposeAggregator.add(() => {
             this._checkpoints.clearAllCheckpoints();
             this._context._reclaimUnusedSequenceId(this._sequenceId);
+
+            if (this._loraAdapterSet != null) {
+                this._context._releaseLoraAdapterSet(this._loraAdapterSet);
+                delete this._loraAdapterSet;
+            }
         });
 
         if (this._tokenPredictor != null)
@@ -1185,6 +1682,37 @@ export class LlamaContextSequence {
         return this._tokenMeter;
     }
 
+    /**
+     * Use other LoRA adapters for the next evaluations of this sequence instead of the ones of the context.
+     * Pass `undefined` to use the LoRA adapters of the context again, or an empty array to use no LoRA adapters.
+     *
+     * A batch can only be evaluated with a single set of LoRA adapters,
+     * so the items of sequences that use different adapters are grouped into separate batches.
+     * See the `maxConsecutiveLoraAdapterBatches` batching option of the context for more details.
+     *
+     * The tokens that are already evaluated on the sequence are not evaluated again with the new adapters.
+     */
+    public async setLoraAdapters(adapters?: readonly LlamaContextLoraAdapter[]) {
+        this._ensureNotDisposed();
+
+        const loraAdapterSet = adapters == null
+            ? undefined
+            : await this._context._acquireLoraAdapterSet(adapters);
+
+        if (this._disposed) {
+            if (loraAdapterSet != null)
+                this._context._releaseLoraAdapterSet(loraAdapterSet);
+
+            throw new DisposedError();
+        }
+
+        const previousLoraAdapterSet = this._loraAdapterSet;
+        this._loraAdapterSet = loraAdapterSet;
+
+        if (previousLoraAdapterSet != null)
+            this._context._releaseLoraAdapterSet(previousLoraAdapterSet);
+    }
+
     /**
      * The token predictor used when creating this sequence.
      */
@@ -1813,29 +2341,57 @@ export class LlamaContextSequence {
     /* eslint-disable @stylistic/max-len */
     /**
      * Save the current context sequence evaluation state to a file.
+     *
+     * The state is written to a temporary file that replaces the given file only after it was fully written and flushed to the disk,
+     * so an existing file is never left partially overwritten.
      * @see [Saving and restoring a context sequence evaluation state](https://node-llama-cpp.withcat.ai/guide/chat-session#save-and-restore-with-context-sequence-state)
      */
-    public async saveStateToFile(filePath: string) {
+    public async saveStateToFile(filePath: string, {
+        directIo = false,
+        onProgress
+    }: {
+        /**
+         * Write the file using direct I/O that bypasses the OS page cache, when supported by the file system.
+         *
+         * Useful when saving large states, to avoid evicting other data from the page cache.
+         *
+         * Defaults to `false`.
+         */
+        directIo?: boolean,
+
+        /**
+         * Called with the progress of writing the file, from `0` to `1`
+         */
+        onProgress?(progress: number): void
+    } = {}) {
         /* eslint-enable @stylistic/max-len */
         this._ensureNotDisposed();
 
         const resolvedPath = path.resolve(process.cwd(), filePath);
 
         const evaluatorLock = await acquireLock([this._lock, "evaluate"]);
-        const contextLock = await acquireLock([this._context, "context"]);
 
         try {
             this._ensureNotDisposed();
 
+            const tokens = Uint32Array.from(this.contextTokens);
+
+            // the state is written to the disk after the context lock is released, so other sequences can keep evaluating meanwhile
+            const state = await withLock([this._context, "context"], () => {
+                this._ensureNotDisposed();
+
+                return this._context._ctx.exportSequenceState(this._sequenceId);
+            });
+
             // TODO: save checkpoints to disk
             const fileSize = await this._context._ctx.saveSequenceStateToFile(
                 resolvedPath,
                 this._sequenceId,
-                Uint32Array.from(this.contextTokens)
+                tokens,
+                {directIo, onProgress, state}
             );
             return {fileSize};
         } finally {
-            contextLock.dispose();
             evaluatorLock.dispose();
         }
     }
@@ -1846,19 +2402,27 @@ export class LlamaContextSequence {
      *
      * Trying to load a state file with a longer context size than the current sequence's context size will fail and throw an error.
      *
-     * You must ensure that the file was created from the exact same model, otherwise, using this function may crash the process.
+     * The file is fully validated against its checksums and the current model before the sequence state is replaced,
+     * so when the validation fails, the current state of the sequence is kept.
+     * State files created by older versions don't include this information,
+     * so you must ensure that the file was created from the exact same model, otherwise, using this function may crash the process.
      * @see [Saving and restoring a context sequence evaluation state](https://node-llama-cpp.withcat.ai/guide/chat-session#save-and-restore-with-context-sequence-state)
      */
-    public async loadStateFromFile(filePath: string, acceptRisk: {
+    public async loadStateFromFile(filePath: string, options: {
         /**
          * Loading a state file created using a different model may crash the process.
          *
          * You must accept this risk to use this feature.
          */
-        acceptRisk: true
+        acceptRisk: true,
+
+        /**
+         * Called with the progress of loading the file, from `0` to `1`
+         */
+        onProgress?(progress: number): void
     }) {
         /* eslint-enable @stylistic/max-len */
-        if (!acceptRisk.acceptRisk)
+        if (!options.acceptRisk)
             throw new Error("The `acceptRisk` option must be set to `true` to use this feature");
 
         this._ensureNotDisposed();
@@ -1875,19 +2439,30 @@ export class LlamaContextSequence {
             await this._abortTokenPredictor(true);
             this._ensureNotDisposed();
 
-            this._loadedTokenPredictions.length = 0;
-            this._nextTokenIndex = 0;
-            this._contextTokens = [];
-
-            const tokens = Array.from(
-                await this._context._ctx.loadSequenceStateFromFile(resolvedPath, this._sequenceId, this.contextSize)
-            ) as Token[];
+            let tokens: Token[];
+            try {
+                tokens = Array.from(
+                    await this._context._ctx.loadSequenceStateFromFile(
+                        resolvedPath,
+                        this._sequenceId,
+                        this.contextSize,
+                        options.onProgress
+                    )
+                ) as Token[];
+            } catch (err) {
+                // the file is validated before the sequence state is replaced, so an invalid file leaves the current state as it is.
+                // only a failure to load a validated file into the context clears the sequence state
+                if ((err as {sequenceStateCleared?: boolean} | undefined)?.sequenceStateCleared === true) {
+                    this._checkpoints.clearAllCheckpoints();
+                    this._loadedTokenPredictions.length = 0;
+                    this._nextTokenIndex = 0;
+                    this._contextTokens = [];
+                }
 
-            if (tokens.length > this.contextSize) {
-                this._context._ctx.disposeSequence(this._sequenceId);
-                throw new Error("The given state file is too large for the current context size");
+                throw err;
             }
 
+            this._checkpoints.clearAllCheckpoints();
             this._contextTokens = tokens;
             this._nextTokenIndex = tokens.length;
             this._loadedTokenPredictions.length = 0;
@@ -1897,6 +2472,148 @@ export class LlamaContextSequence {
         }
     }
 
+    /**
+     * Export the current context sequence evaluation state into memory.
+     *
+     * The exported state can later be loaded into a context sequence of the same model
+     * using {@link importState `.importState(...)`}.
+     */
+    public async exportState(): Promise<LlamaContextSequenceState> {
+        this._ensureNotDisposed();
+
+        const evaluatorLock = await acquireLock([this._lock, "evaluate"]);
+        const contextLock = await acquireLock([this._context, "context"]);
+
+        try {
+            this._ensureNotDisposed();
+
+            const tokens = this.contextTokens;
+            const data = await this._context._ctx.exportSequenceState(this._sequenceId);
+
+            return {tokens, data};
+        } finally {
+            contextLock.dispose();
+            evaluatorLock.dispose();
+        }
+    }
+
+    /**
+     * Load a context sequence evaluation state that was exported using {@link exportState `.exportState()`}.
+     *
+     * Trying to load a state with a longer context size than the current sequence's context size will fail and throw an error.
+     *
+     * You must ensure that the state was exported from a context of the exact same model,
+     * otherwise, using this function may crash the process.
+     */
+    public async importState(state: LlamaContextSequenceState, acceptRisk: {
+        /**
+         * Loading a state created using a different model may crash the process.
+         *
+         * You must accept this risk to use this feature.
+         */
+        acceptRisk: true
+    }) {
+        if (!acceptRisk.acceptRisk)
+            throw new Error("The `acceptRisk` option must be set to `true` to use this feature");
+
+        this._ensureNotDisposed();
+
+        if (state.tokens.length > this.contextSize)
+            throw new Error("The given state is too large for the current context size");
+
+        const evaluatorLock = await acquireLock([this._lock, "evaluate"]);
+        const contextLock = await acquireLock([this._context, "context"]);
+
+        try {
+            this._ensureNotDisposed();
+
+            await this._prepareForExternalStateLoad();
+
+            const tokens = state.tokens.slice();
+            await this._context._ctx.importSequenceState(this._sequenceId, state.data, Uint32Array.from(tokens));
+
+            // drop evaluated token predictions that may have been included in the state
+            this._context._ctx.removeTokenCellsFromSequence(this._sequenceId, tokens.length, -1);
+
+            this._contextTokens = tokens;
+            this._nextTokenIndex = tokens.length;
+        } finally {
+            contextLock.dispose();
+            evaluatorLock.dispose();
+        }
+    }
+
+    /**
+     * Copy the current context sequence evaluation state into another context sequence,
+     * replacing the state of the target sequence.
+     *
+     * The state is copied directly between the contexts without passing through JavaScript,
+     * so it's cheaper than using {@link exportState `.exportState()`} and {@link importState `.importState(...)`}.
+     *
+     * The target context sequence must belong to a context of the same model.
+     */
+    public async transferStateTo(targetSequence: LlamaContextSequence) {
+        this._ensureNotDisposed();
+        targetSequence._ensureNotDisposed();
+
+        if (targetSequence === this)
+            return;
+
+        if (targetSequence.model !== this.model)
+            throw new Error("The target context sequence must belong to a context of the same model");
+
+        if (this._contextTokens.length > targetSequence.contextSize)
+            throw new Error("The target context sequence is too small for the current state");
+
+        // transfers acquire the locks of two sequences, so they're serialized to avoid a deadlock between opposite transfers
+        const transferLock = await acquireLock([sequenceStateTransferLock, "transfer"]);
+        const evaluatorLock = await acquireLock([this._lock, "evaluate"]);
+        const targetEvaluatorLock = await acquireLock([targetSequence._lock, "evaluate"]);
+        const contextLock = await acquireLock([this._context, "context"]);
+        const targetContextLock = targetSequence._context === this._context
+            ? undefined
+            : await acquireLock([targetSequence._context, "context"]);
+
+        try {
+            this._ensureNotDisposed();
+            targetSequence._ensureNotDisposed();
+
+            await targetSequence._prepareForExternalStateLoad();
+
+            const tokens = this.contextTokens;
+            await this._context._ctx.transferSequenceState(
+                this._sequenceId,
+                targetSequence._context._ctx,
+                targetSequence._sequenceId,
+                Uint32Array.from(tokens)
+            );
+
+            // drop evaluated token predictions that may have been included in the state
+            targetSequence._context._ctx.removeTokenCellsFromSequence(targetSequence._sequenceId, tokens.length, -1);
+
+            targetSequence._contextTokens = tokens;
+            targetSequence._nextTokenIndex = tokens.length;
+        } finally {
+            targetContextLock?.dispose();
+            contextLock.dispose();
+            targetEvaluatorLock.dispose();
+            evaluatorLock.dispose();
+            transferLock.dispose();
+        }
+    }
+
+    /** @internal */
+    private async _prepareForExternalStateLoad() {
+        this._tokenPredictorOwner = {};
+        await this._abortTokenPredictor(true);
+        this._ensureNotDisposed();
+
+        this._checkpoints.clearAllCheckpoints();
+        this._loadedTokenPredictions.length = 0;
+        this._nextTokenIndex = 0;
+        this._contextTokens = [];
+    }
+
     /**
      * When reusing a prefix evaluation state is not possible for the current context sequence
      * (like in contexts from recurrent and hybrid models,
@@ -1962,6 +2679,23 @@ export class LlamaContextSequence {
         return this._checkpoints.memoryUsage;
     }
 
+    /**
+     * The total size in bytes of all the checkpoints currently held for this context sequence before compression,
+     * including checkpoints that were spilled to disk
+     */
+    public get checkpointsRawMemoryUsage() {
+        return this._checkpoints.rawMemoryUsage;
+    }
+
+    /**
+     * The total size in bytes of the checkpoints of this context sequence that were spilled to disk.
+     *
+     * See the `checkpoints.diskSpill` option of {@link LlamaContext.getSequence `.getSequence()`} for more details.
+     */
+    public get checkpointsDiskUsage() {
+        return this._checkpoints.diskUsage;
+    }
+
     /**
      * Check how many tokens will be evaluated when trying to restore to checkpoint at a given index
      */
@@ -1984,16 +2718,50 @@ export class LlamaContextSequence {
         return Math.max(0, tokenIndex - checkpoint.maxPos);
     }
 
+    /** @internal */
+    private _getCheckpointCompressionLevel() {
+        const compression = this._checkpointOptions.compression;
+        if (compression === false)
+            return 0;
+        else if (compression === true)
+            return defaultCheckpointCompressionLevel;
+
+        return Math.max(1, Math.min(19, Math.floor(compression.level ?? defaultCheckpointCompressionLevel)));
+    }
+
+    /** @internal */
+    private _acquireCheckpointDeltaParent() {
+        const deltas = this._checkpointOptions.deltas;
+        if (deltas === false)
+            return undefined;
+
+        const maxChainLength = deltas === true
+            ? defaultCheckpointsMaxDeltaChainLength
+            : Math.max(0, deltas.maxChainLength ?? defaultCheckpointsMaxDeltaChainLength);
+
+        return this._checkpoints.acquireDeltaParent(maxChainLength);
+    }
+
     /** @internal */
     private async _takeCheckpoint(name: string | undefined, maxNamedCheckpoints: number) {
         if (!this.needsCheckpoints || this._nextTokenIndex === 0 || this._checkpoints.hasCheckpoint(name, this._nextTokenIndex - 1))
             return;
 
-        if (this._checkpointOptions.maxMemory != null)
+        const diskSpill = this._checkpointOptions.diskSpill;
+        if (this._checkpointOptions.maxMemory != null && diskSpill === false)
             this._checkpoints.prepareMemoryForIncomingCheckpoint(this._checkpointOptions.maxMemory);
 
+        const deltaParent = this._acquireCheckpointDeltaParent();
         const checkpoint = new this.model._llama._bindings.AddonContextSequenceCheckpoint();
-        await checkpoint.init(this._context._ctx, this._sequenceId);
+        try {
+            await checkpoint.init(this._context._ctx, this._sequenceId, this._getCheckpointCompressionLevel(), deltaParent);
+        } catch (err) {
+            if (deltaParent != null)
+                this._checkpoints.releaseDeltaParent(deltaParent);
+
+            throw err;
+        }
+
         if (this._nextTokenIndex - 1 !== checkpoint.maxPos)
             this.model._llama._log(
                 LlamaLogLevel.warn,
@@ -2004,10 +2772,43 @@ export class LlamaContextSequence {
             name,
             maxNamedCheckpoints,
             checkpoint,
-            currentMaxPos: checkpoint.maxPos
+            currentMaxPos: checkpoint.maxPos,
+            deltaParent
         });
 
-        if (this._checkpointOptions.maxMemory != null)
+        if (diskSpill !== false)
+            this._checkpointsSpillPromise = this._checkpointsSpillPromise
+                .then(() => this._spillColdCheckpoints(diskSpill));
+        else if (this._checkpointOptions.maxMemory != null)
+            this._checkpoints.pruneToKeepUnderMemoryUsage(this._checkpointOptions.maxMemory);
+    }
+
+    /** @internal */
+    private async _spillColdCheckpoints({directory, keepInMemory = defaultCheckpointsKeepInMemory}: {
+        directory: string,
+        keepInMemory?: number
+    }) {
+        let spilledAll = false;
+        const onError = (error: unknown) => {
+            this.model._llama._log(LlamaLogLevel.warn, `Failed to spill a checkpoint to disk: ${String(error)}`);
+        };
+
+        try {
+            const resolvedDirectory = path.resolve(process.cwd(), directory);
+            await fs.ensureDir(resolvedDirectory);
+
+            spilledAll = await this._checkpoints.spillColdCheckpoints({
+                keepInMemory: Math.max(0, keepInMemory),
+                maxMemoryUsage: this._checkpointOptions.maxMemory,
+                getFilePath: () => path.join(resolvedDirectory, `checkpoint-${process.pid}-${this._sequenceId}-${nanoid()}.bin`),
+                onError
+            });
+        } catch (err) {
+            onError(err);
+        }
+
+        // checkpoints that couldn't be spilled are pruned instead, so they don't grow past the memory limit
+        if (!spilledAll && this._checkpointOptions.maxMemory != null)
             this._checkpoints.pruneToKeepUnderMemoryUsage(this._checkpointOptions.maxMemory);
     }
 
@@ -2580,9 +3381,113 @@ export class LlamaContextSequence {
             return logitDataMapper(batchLogitIndex, currentTokenIndex + (contextStateTokenIndex - this._nextTokenIndex));
         };
 
+        // tokens we need logits for have to be evaluated, so only the tokens before them can be reused
+        const getMaxReusableTokens = () => {
+            const firstLogitIndex = tokenLogitsLeftToDecode.findIndex((logit) => logit === true);
+            return Math.min(
+                firstLogitIndex < 0 ? tokensLeftToDecode.length : firstLogitIndex,
+                this._context.contextSize - 1 - this._nextTokenIndex
+            );
+        };
+
+        if (this._context._prefixCache && this._loadedTokenPredictions.length === 0 && tokensLeftToDecode.length > 0) {
+            const maxReusableTokens = getMaxReusableTokens();
+
+            if (maxReusableTokens > 0) {
+                const reusedLength = await withLock([this._context, "context"], async () => {
+                    this._ensureNotDisposed();
+
+                    // the cells depend on the LoRA adapters they were evaluated with, so only prefixes of the same adapters are reused
+                    const loraAdapterSet = this._loraAdapterSet ?? this._context._defaultLoraAdapterSet;
+
+                    return this._context._ctx.reuseSequencePrefix(
+                        this._sequenceId,
+                        Uint32Array.from([...this._contextTokens, ...tokensLeftToDecode.slice(0, maxReusableTokens)]),
+                        this._nextTokenIndex,
+                        loraAdapterSet.adapters,
+                        loraAdapterSet.scales
+                    );
+                });
+
+                const reusedTokensCount = Math.min(maxReusableTokens, reusedLength - this._nextTokenIndex);
+                if (reusedTokensCount > 0) {
+                    const reusedTokens = tokensLeftToDecode.splice(0, reusedTokensCount);
+                    tokenLogitsLeftToDecode.splice(0, reusedTokensCount);
+
+                    this._nextTokenIndex += reusedTokensCount;
+                    currentTokenIndex += reusedTokensCount;
+                    this._contextTokens = this._contextTokens.concat(reusedTokens);
+                }
+            }
+        }
+
+        const promptCache = this._context._promptCache;
+        const promptCacheFingerprint = promptCache == null
+            ? undefined
+            : this._getPromptCacheFingerprint();
+        let tokensLeftUntilPromptCacheStore: number | undefined = undefined;
+        if (promptCache != null && promptCacheFingerprint != null && this._loadedTokenPredictions.length === 0) {
+            const maxReusableTokens = getMaxReusableTokens();
+
+            if (maxReusableTokens >= promptCache.minTokens) {
+                const cachedPrefix = promptCache.findLongestPrefix(
+                    this._contextTokens.concat(tokensLeftToDecode.slice(0, maxReusableTokens)),
+                    this._nextTokenIndex + promptCache.minTokens,
+                    promptCacheFingerprint
+                );
+
+                if (cachedPrefix == null)
+                    promptCache.markMiss();
+                else {
+                    const reusedTokensCount = await this._loadPromptCachePrefix(
+                        promptCache, cachedPrefix, tokensLeftToDecode.slice(0, cachedPrefix.tokenCount - this._nextTokenIndex)
+                    );
+
+                    if (reusedTokensCount > 0) {
+                        const reusedTokens = tokensLeftToDecode.splice(0, reusedTokensCount);
+                        tokenLogitsLeftToDecode.splice(0, reusedTokensCount);
+
+                        this._nextTokenIndex += reusedTokensCount;
+                        currentTokenIndex += reusedTokensCount;
+                        this._contextTokens = this._contextTokens.concat(reusedTokens);
+
+                        promptCache.markHit(cachedPrefix.key, reusedTokensCount);
+                    } else {
+                        promptCache.markMiss();
+
+                        if (reusedTokensCount < 0) {
+                            const tokensToEvaluateAgain = this._contextTokens;
+                            const tokensLeft = tokensLeftToDecode.splice(0);
+                            const tokenLogitsLeft = tokenLogitsLeftToDecode.splice(0);
+
+                            pushAll(tokensLeftToDecode, tokensToEvaluateAgain);
+                            pushAll(tokensLeftToDecode, tokensLeft);
+                            pushAll(tokenLogitsLeftToDecode, tokensToEvaluateAgain.map(() => undefined));
+                            pushAll(tokenLogitsLeftToDecode, tokenLogitsLeft);
+
+                            currentTokenIndex -= tokensToEvaluateAgain.length;
+                            this._nextTokenIndex = 0;
+                            this._contextTokens = [];
+                        }
+                    }
+                }
+            }
+
+            // store the state of the prompt right before the tokens we need logits for,
+            // so evaluating the same prompt again can load all the tokens that don't need to be evaluated
+            const tokensToEvaluateBeforeLogits = getMaxReusableTokens();
+            if (tokensToEvaluateBeforeLogits >= promptCache.minTokens)
+                tokensLeftUntilPromptCacheStore = tokensToEvaluateBeforeLogits;
+        }
+
         while (tokensLeftToDecode.length > 0) {
             this._ensureNotDisposed();
 
+            if (promptCache != null && promptCacheFingerprint != null && tokensLeftUntilPromptCacheStore === 0) {
+                tokensLeftUntilPromptCacheStore = undefined;
+                await this._storePromptCachePrefix(promptCache, promptCacheFingerprint);
+            }
+
             let freeSpace = this._context.contextSize - 1 - this._nextTokenIndex;
 
             if (freeSpace <= 0) {
@@ -2593,8 +3498,13 @@ export class LlamaContextSequence {
                     throw new Error("Failed to free up space for new tokens");
             }
 
-            const tokensToDecode = tokensLeftToDecode.splice(0, freeSpace);
-            const tokensLogits = tokenLogitsLeftToDecode.slice(0, tokensToDecode.length);
+            const tokensToDecode = tokensLeftToDecode.splice(
+                0,
+                tokensLeftUntilPromptCacheStore != null
+                    ? Math.min(freeSpace, tokensLeftUntilPromptCacheStore)
+                    : freeSpace
+            );
+            const tokensLogits = tokenLogitsLeftToDecode.splice(0, tokensToDecode.length);
 
             const generatedLogits = await this._context._decodeTokens({
                 sequenceId: this._sequenceId,
@@ -2603,6 +3513,7 @@ export class LlamaContextSequence {
                 logits: tokensLogits,
                 evaluationPriority,
                 tokenMeter,
+                loraAdapterSet: this._loraAdapterSet,
                 afterBatchAction
             }, normalizedLogitDataMapper);
 
@@ -2612,11 +3523,97 @@ export class LlamaContextSequence {
             this._nextTokenIndex += tokensToDecode.length;
             currentTokenIndex += tokensToDecode.length;
             this._contextTokens = this._contextTokens.concat(tokensToDecode);
+
+            if (tokensLeftUntilPromptCacheStore != null)
+                tokensLeftUntilPromptCacheStore -= tokensToDecode.length;
         }
 
+        if (promptCache != null && promptCacheFingerprint != null && tokensLeftUntilPromptCacheStore === 0)
+            await this._storePromptCachePrefix(promptCache, promptCacheFingerprint);
+
         return res;
     }
 
+    /**
+     * Load a cached prompt prefix state into the sequence, replacing its current state.
+     *
+     * The file is read and validated before taking the context lock, so other sequences can keep evaluating meanwhile,
+     * and the lock is only held while the state is set into the context.
+     *
+     * Returns the number of tokens that were loaded on top of the current context tokens,
+     * `0` when the cached state couldn't be loaded,
+     * or `-1` when the sequence state was cleared and the current context tokens have to be evaluated again.
+     * @internal
+     */
+    private async _loadPromptCachePrefix(
+        promptCache: LlamaPromptCache,
+        cachedPrefix: {key: string, tokenCount: number, filePath: string},
+        expectedNewTokens: Token[]
+    ) {
+        const expectedTokens = this._contextTokens.concat(expectedNewTokens);
+
+        let cachedState: {tokens: Uint32Array, state: Uint8Array};
+        try {
+            cachedState = await this._context._ctx.readSequenceStateFile(cachedPrefix.filePath, this.contextSize);
+        } catch (err) {
+            await promptCache.removeEntry(cachedPrefix.key);
+            return 0;
+        }
+
+        // a hash collision found the state of other tokens
+        const loadedTokens = Array.from(cachedState.tokens) as Token[];
+        if (loadedTokens.length !== expectedTokens.length || loadedTokens.some((token, index) => token !== expectedTokens[index])) {
+            await promptCache.removeEntry(cachedPrefix.key);
+            return 0;
+        }
+
+        return await withLock([this._context, "context"], async () => {
+            this._ensureNotDisposed();
+
+            try {
+                await this._context._ctx.importSequenceState(this._sequenceId, cachedState.state, cachedState.tokens);
+            } catch (err) {
+                // llama.cpp clears the sequence when it fails to set a state into it
+                await promptCache.removeEntry(cachedPrefix.key);
+                this._context._ctx.disposeSequence(this._sequenceId);
+                this._checkpoints.clearAllCheckpoints();
+                return -1;
+            }
+
+            this._checkpoints.clearAllCheckpoints();
+            return expectedNewTokens.length;
+        });
+    }
+
+    /**
+     * The state is exported while holding the context lock,
+     * and is written to the disk after the lock is released so other sequences can keep evaluating meanwhile
+     * @internal
+     */
+    private async _storePromptCachePrefix(promptCache: LlamaPromptCache, fingerprint: string) {
+        const tokens = this._contextTokens.slice();
+
+        await promptCache.storePrefix(tokens, fingerprint, async (filePath) => {
+            const state = await withLock([this._context, "context"], () => {
+                this._ensureNotDisposed();
+
+                return this._context._ctx.exportSequenceState(this._sequenceId);
+            });
+
+            return await this._context._ctx.saveSequenceStateToFile(filePath, this._sequenceId, Uint32Array.from(tokens), {state});
+        });
+    }
+
+    /**
+     * The fingerprint of the model, the context options and the LoRA adapters that the state of this sequence is evaluated with
+     * @internal
+     */
+    private _getPromptCacheFingerprint() {
+        const loraAdapterSet = this._loraAdapterSet ?? this._context._defaultLoraAdapterSet;
+
+        return this._context._ctx.getStateFingerprint(loraAdapterSet.adapters, loraAdapterSet.scales);
+    }
+
     /** @internal */
     private async _freeUpSpaceForTokens(contextShiftOptions: Required<ContextShiftOptions>) {
         this._ensureNotDisposed();
@@ -2704,7 +3701,21 @@ type InternalQueuedDecode = {
     tokenMeter: TokenMeter,
     response: [accept: (res: any) => void, reject: (reason: unknown) => void],
     logitDataMapper: ((batchLogitIndex: BatchLogitIndex, tokenIndex: number) => any | Promise<any>),
-    afterBatchAction?: ((sequenceStateLength: number) => Promise<void> | void)
+    afterBatchAction?: ((sequenceStateLength: number) => Promise<void> | void),
+    loraAdapterSet: LoraAdapterSet
+};
+
+type LoraAdapterSet = {
+    // adapter sets with the same key apply the same adapters with the same scales
+    key: string,
+    adapters: AddonModelLora[],
+    scales: number[]
+};
+
+const emptyLoraAdapterSet: LoraAdapterSet = {
+    key: "",
+    adapters: [],
+    scales: []
 };
 
 type CurrentBatchItem = {
@@ -2715,7 +3726,17 @@ type CurrentBatchItem = {
 type SequenceCheckpointOptions = {
     max?: number,
     interval?: number | false,
-    maxMemory?: number | null
+    maxMemory?: number | null,
+    compression?: boolean | {
+        level?: number
+    },
+    diskSpill?: false | {
+        directory: string,
+        keepInMemory?: number
+    },
+    deltas?: boolean | {
+        maxChainLength?: number
+    }
 };
 
 function getTokenBiasesForAddon(tokenBias: undefined | TokenBias | (() => TokenBias), currentModel: LlamaModel) {
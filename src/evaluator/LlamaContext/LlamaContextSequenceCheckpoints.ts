@@ -4,28 +4,86 @@ export class LlamaContextSequenceCheckpoints {
     private _checkpoints: Array<[name: string | undefined, checkpoint: AddonContextSequenceCheckpoint]> = [];
     private _namedCheckpoints = new Map<string | undefined, number>();
     private _memoryUsage = 0;
+    private _diskUsage = 0;
+    private _spilledCheckpoints = new Set<AddonContextSequenceCheckpoint>();
+    private _spillingCheckpoints = new Set<AddonContextSequenceCheckpoint>();
+    private _checkpointSizes = new Map<AddonContextSequenceCheckpoint, number>();
+
+    // the data of a checkpoint that delta checkpoints depend on is retained until they're disposed
+    private _deltaParents = new Map<AddonContextSequenceCheckpoint, AddonContextSequenceCheckpoint>();
+    private _deltaDependents = new Map<AddonContextSequenceCheckpoint, number>();
+    private _retainedCheckpoints = new Set<AddonContextSequenceCheckpoint>();
 
     public storeCheckpoint({
         name,
         maxNamedCheckpoints,
         checkpoint,
-        currentMaxPos
+        currentMaxPos,
+        deltaParent
     }: {
         name: string | undefined,
         maxNamedCheckpoints: number,
         checkpoint: AddonContextSequenceCheckpoint,
-        currentMaxPos: number
+        currentMaxPos: number,
+
+        /** A checkpoint acquired using `acquireDeltaParent` that was used to create the new checkpoint */
+        deltaParent?: AddonContextSequenceCheckpoint
     }) {
         // TODO: if a named checkpoint is on the same index as the current checkpoint,
         //  reuse the same underlying checkpoint data instead of having it get duplicated
-        if (this.hasCheckpoint(name, currentMaxPos))
+        if (this.hasCheckpoint(name, currentMaxPos)) {
+            checkpoint.dispose();
+
+            if (deltaParent != null)
+                this.releaseDeltaParent(deltaParent);
+
             return;
+        }
 
         const existingCheckpointsCount = this._getCheckpointsCount(name);
         this._pruneOldCheckpoints(name, existingCheckpointsCount - maxNamedCheckpoints + 1);
         this._checkpoints.push([name, checkpoint]);
         this._resizeCheckpointsCount(name, 1);
+        this._checkpointSizes.set(checkpoint, checkpoint.size);
         this._memoryUsage += checkpoint.size;
+
+        if (deltaParent != null) {
+            if (checkpoint.isDelta)
+                this._deltaParents.set(checkpoint, deltaParent);
+            else
+                this.releaseDeltaParent(deltaParent);
+        }
+    }
+
+    /**
+     * Get the last checkpoint to use as the parent of a new delta checkpoint,
+     * as long as its chain of delta parents is shorter than `maxChainLength`.
+     *
+     * The returned checkpoint must be released using `releaseDeltaParent`,
+     * unless it's passed to `storeCheckpoint` as the `deltaParent` of the new checkpoint.
+     */
+    public acquireDeltaParent(maxChainLength: number) {
+        const [, lastCheckpoint] = this._checkpoints.at(-1) ?? [];
+        if (lastCheckpoint == null || this._getDeltaChainLength(lastCheckpoint) >= maxChainLength)
+            return undefined;
+
+        this._deltaDependents.set(lastCheckpoint, (this._deltaDependents.get(lastCheckpoint) ?? 0) + 1);
+        return lastCheckpoint;
+    }
+
+    public releaseDeltaParent(checkpoint: AddonContextSequenceCheckpoint) {
+        const dependents = this._deltaDependents.get(checkpoint);
+        if (dependents == null)
+            return;
+        else if (dependents > 1) {
+            this._deltaDependents.set(checkpoint, dependents - 1);
+            return;
+        }
+
+        this._deltaDependents.delete(checkpoint);
+
+        if (this._retainedCheckpoints.delete(checkpoint))
+            this._releaseCheckpointUsage(checkpoint);
     }
 
     public hasCheckpoint(name: string | undefined, maxPos: number) {
@@ -62,7 +120,17 @@ export class LlamaContextSequenceCheckpoints {
 
         this._checkpoints.length = 0;
         this._namedCheckpoints.clear();
+        this._spilledCheckpoints.clear();
+        this._checkpointSizes.clear();
+        this._deltaParents.clear();
+        this._deltaDependents.clear();
+        this._retainedCheckpoints.clear();
         this._memoryUsage = 0;
+        this._diskUsage = 0;
+    }
+
+    public get checkpoints(): AddonContextSequenceCheckpoint[] {
+        return this._checkpoints.map(([, checkpoint]) => checkpoint);
     }
 
     public get lastCheckpointIndex(): number {
@@ -90,6 +158,18 @@ export class LlamaContextSequenceCheckpoints {
         return this._memoryUsage;
     }
 
+    public get diskUsage() {
+        return this._diskUsage;
+    }
+
+    public get rawMemoryUsage() {
+        let res = 0;
+        for (const [, checkpoint] of this._checkpoints)
+            res += checkpoint.rawSize;
+
+        return res;
+    }
+
     public prepareMemoryForIncomingCheckpoint(maxMemoryUsage: number) {
         const [, lastCheckpoint] = this._checkpoints[this._checkpoints.length - 1] ?? [];
         if (lastCheckpoint == null)
@@ -100,8 +180,7 @@ export class LlamaContextSequenceCheckpoints {
             if (firstCheckpoint == null)
                 break;
 
-            this._memoryUsage -= firstCheckpoint.size;
-            firstCheckpoint.dispose();
+            this._disposeCheckpoint(firstCheckpoint);
             this._resizeCheckpointsCount(name, -1);
         }
     }
@@ -112,8 +191,7 @@ export class LlamaContextSequenceCheckpoints {
             if (checkpoint == null)
                 break;
 
-            this._memoryUsage -= checkpoint.size;
-            checkpoint.dispose();
+            this._disposeCheckpoint(checkpoint);
             this._resizeCheckpointsCount(checkpointName, -1);
         }
     }
@@ -127,13 +205,107 @@ export class LlamaContextSequenceCheckpoints {
             if (checkpoint == null || checkpoint.maxPos <= minMaxPos)
                 break;
 
-            this._memoryUsage -= checkpoint.size;
-            checkpoint.dispose();
+            this._disposeCheckpoint(checkpoint);
             this._resizeCheckpointsCount(name, -1);
             this._checkpoints.pop();
         }
     }
 
+    /**
+     * Spill the checkpoints that are not among the `keepInMemory` most recent ones,
+     * or that exceed the `maxMemoryUsage` of the in-memory checkpoints, to files.
+     * @returns whether all the checkpoints that had to be spilled were spilled
+     */
+    public async spillColdCheckpoints({
+        keepInMemory,
+        maxMemoryUsage,
+        getFilePath,
+        onError
+    }: {
+        keepInMemory: number,
+        maxMemoryUsage: number | null,
+        getFilePath(): string,
+        onError(error: unknown): void
+    }) {
+        const checkpointsToSpill: AddonContextSequenceCheckpoint[] = [];
+        let keptCount = 0;
+        let keptMemoryUsage = 0;
+
+        for (let i = this._checkpoints.length - 1; i >= 0; i--) {
+            const [, checkpoint] = this._checkpoints[i]!;
+            if (this._spilledCheckpoints.has(checkpoint) || this._spillingCheckpoints.has(checkpoint))
+                continue;
+
+            if (keptCount < keepInMemory && (maxMemoryUsage == null || keptMemoryUsage + checkpoint.size <= maxMemoryUsage)) {
+                keptCount++;
+                keptMemoryUsage += checkpoint.size;
+                continue;
+            }
+
+            checkpointsToSpill.push(checkpoint);
+        }
+
+        let failed = false;
+        await Promise.all(
+            checkpointsToSpill.map(async (checkpoint) => {
+                this._spillingCheckpoints.add(checkpoint);
+
+                try {
+                    const spilled = await checkpoint.spillToFile(getFilePath());
+                    const size = this._checkpointSizes.get(checkpoint);
+                    if (!spilled || size == null)
+                        return;
+
+                    this._spilledCheckpoints.add(checkpoint);
+                    this._memoryUsage -= size;
+                    this._diskUsage += size;
+                } catch (err) {
+                    failed = true;
+                    onError(err);
+                } finally {
+                    this._spillingCheckpoints.delete(checkpoint);
+                }
+            })
+        );
+
+        return !failed;
+    }
+
+    private _disposeCheckpoint(checkpoint: AddonContextSequenceCheckpoint) {
+        checkpoint.dispose();
+
+        if (this._deltaDependents.has(checkpoint)) {
+            this._retainedCheckpoints.add(checkpoint);
+            return;
+        }
+
+        this._releaseCheckpointUsage(checkpoint);
+    }
+
+    private _releaseCheckpointUsage(checkpoint: AddonContextSequenceCheckpoint) {
+        const size = this._checkpointSizes.get(checkpoint) ?? 0;
+        this._checkpointSizes.delete(checkpoint);
+
+        if (this._spilledCheckpoints.delete(checkpoint))
+            this._diskUsage -= size;
+        else
+            this._memoryUsage -= size;
+
+        const deltaParent = this._deltaParents.get(checkpoint);
+        if (deltaParent != null) {
+            this._deltaParents.delete(checkpoint);
+            this.releaseDeltaParent(deltaParent);
+        }
+    }
+
+    private _getDeltaChainLength(checkpoint: AddonContextSequenceCheckpoint) {
+        let length = 0;
+        for (let parent = this._deltaParents.get(checkpoint); parent != null; parent = this._deltaParents.get(parent))
+            length++;
+
+        return length;
+    }
+
     private _getCheckpointsCount(name: string | undefined) {
         return this._namedCheckpoints.get(name) ?? 0;
     }
@@ -160,8 +332,7 @@ export class LlamaContextSequenceCheckpoints {
             if (checkpointName !== name)
                 continue;
 
-            this._memoryUsage -= checkpoint.size;
-            checkpoint.dispose();
+            this._disposeCheckpoint(checkpoint);
             this._checkpoints.splice(i, 1);
             this._resizeCheckpointsCount(name, -1);
             i--;
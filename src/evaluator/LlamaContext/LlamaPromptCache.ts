@@ -0,0 +1,363 @@
+import path from "path";
+import fs from "fs-extra";
+import {nanoid} from "nanoid";
+import {Token} from "../../types.js";
+
+const indexFileName = "index.json";
+const indexFileVersion = 1;
+
+type PromptCacheIndexEntry = {
+    key: string,
+
+    /** The fingerprint of the model, the context options and the LoRA adapters the state was created with */
+    fingerprint: string,
+    prefixHash: string,
+    tokenCount: number,
+
+    /** The size of the state file in bytes */
+    size: number,
+    lastUsed: number
+};
+
+type PromptCacheIndexFile = {
+    version: number,
+    entries: PromptCacheIndexEntry[]
+};
+
+export type LlamaPromptCacheStats = {
+    enabled: boolean,
+    hits: number,
+    misses: number,
+
+    /** The ratio of prompt evaluations that loaded a cached prefix, out of all the prompt evaluations that looked one up */
+    hitRatio: number,
+
+    /** The number of tokens that were loaded from the cache instead of being evaluated */
+    reusedTokens: number,
+
+    /** The number of cached prefixes of all the models in the cache directory */
+    entries: number,
+
+    /** The total size of the cached prefixes in the cache directory in bytes */
+    size: number
+};
+
+/**
+ * A size-bounded cache of sequence state files on the disk,
+ * keyed by the fingerprint of the model, the context options and the LoRA adapters,
+ * and by a rolling hash of the token prefix the state was evaluated from.
+ *
+ * The index of the cache is merged with the index file on the disk whenever it's saved,
+ * so multiple contexts and processes can share the same cache directory.
+ */
+export class LlamaPromptCache {
+    public readonly directory: string;
+    public readonly maxSize: number;
+    public readonly minTokens: number;
+    private readonly _entries = new Map<string, PromptCacheIndexEntry>();
+    private readonly _removedKeys = new Set<string>();
+    private _indexSavePromise: Promise<void> = Promise.resolve();
+    private _indexSaveScheduled: boolean = false;
+    private _hits: number = 0;
+    private _misses: number = 0;
+    private _reusedTokens: number = 0;
+
+    private constructor({
+        directory,
+        maxSize,
+        minTokens
+    }: {
+        directory: string,
+        maxSize: number,
+        minTokens: number
+    }) {
+        this.directory = directory;
+        this.maxSize = maxSize;
+        this.minTokens = minTokens;
+    }
+
+    /**
+     * Find the longest cached prefix of the given tokens that has at least `minTokenCount` tokens
+     * and was created with the given state fingerprint
+     */
+    public findLongestPrefix(tokens: Token[], minTokenCount: number, fingerprint: string) {
+        const tokenCounts = new Set<number>();
+        for (const entry of this._entries.values()) {
+            if (entry.fingerprint === fingerprint && entry.tokenCount >= minTokenCount && entry.tokenCount <= tokens.length)
+                tokenCounts.add(entry.tokenCount);
+        }
+
+        if (tokenCounts.size === 0)
+            return undefined;
+
+        const prefixHashes = getTokenPrefixHashes(tokens, tokenCounts);
+        const sortedTokenCounts = [...tokenCounts].sort((a, b) => b - a);
+
+        for (const tokenCount of sortedTokenCounts) {
+            const key = this._getKey(fingerprint, prefixHashes.get(tokenCount)!, tokenCount);
+            const entry = this._entries.get(key);
+
+            if (entry != null)
+                return {
+                    key,
+                    tokenCount,
+                    filePath: this._getFilePath(key)
+                };
+        }
+
+        return undefined;
+    }
+
+    /**
+     * Store the state of the given token prefix in the cache.
+     * Failing to store the state doesn't throw, since the cache is only an optimization.
+     * @param tokens
+     * @param fingerprint - the state fingerprint of the model, the context options and the LoRA adapters the state was created with
+     * @param saveState - save the sequence state to the given file path and return its size
+     */
+    public async storePrefix(tokens: Token[], fingerprint: string, saveState: (filePath: string) => Promise<number>) {
+        const [prefixHash] = getTokenPrefixHashes(tokens, new Set([tokens.length])).values();
+        const key = this._getKey(fingerprint, prefixHash!, tokens.length);
+
+        const existingEntry = this._entries.get(key);
+        if (existingEntry != null) {
+            existingEntry.lastUsed = Date.now();
+            this._scheduleIndexSave();
+            return;
+        }
+
+        try {
+            const filePath = this._getFilePath(key);
+            const size = await saveState(filePath);
+
+            if (size > this.maxSize) {
+                await fs.remove(filePath);
+                return;
+            }
+
+            this._removedKeys.delete(key);
+            this._entries.set(key, {
+                key,
+                fingerprint,
+                prefixHash: prefixHash!,
+                tokenCount: tokens.length,
+                size,
+                lastUsed: Date.now()
+            });
+            this._scheduleIndexSave();
+        } catch (err) {
+            // the cache is only an optimization, so failing to store a state shouldn't fail the evaluation
+        }
+    }
+
+    public markHit(key: string, reusedTokens: number) {
+        this._hits++;
+        this._reusedTokens += reusedTokens;
+
+        const entry = this._entries.get(key);
+        if (entry != null) {
+            entry.lastUsed = Date.now();
+            this._scheduleIndexSave();
+        }
+    }
+
+    public markMiss() {
+        this._misses++;
+    }
+
+    /**
+     * Remove an entry whose file turned out to be missing or invalid
+     */
+    public async removeEntry(key: string) {
+        this._scheduleIndexSave();
+        await this._deleteEntry(key);
+    }
+
+    public get stats(): LlamaPromptCacheStats {
+        let size = 0;
+        for (const entry of this._entries.values())
+            size += entry.size;
+
+        const lookups = this._hits + this._misses;
+
+        return {
+            enabled: true,
+            hits: this._hits,
+            misses: this._misses,
+            hitRatio: lookups === 0
+                ? 0
+                : this._hits / lookups,
+            reusedTokens: this._reusedTokens,
+            entries: this._entries.size,
+            size
+        };
+    }
+
+    /**
+     * Wait for pending index saves to finish
+     */
+    public async flush() {
+        await this._indexSavePromise;
+    }
+
+    private _getKey(fingerprint: string, prefixHash: string, tokenCount: number) {
+        return `${fingerprint}-${prefixHash}-${tokenCount}`;
+    }
+
+    private _getFilePath(key: string) {
+        return path.join(this.directory, key + ".bin");
+    }
+
+    private _scheduleIndexSave() {
+        if (this._indexSaveScheduled)
+            return;
+
+        this._indexSaveScheduled = true;
+        this._indexSavePromise = this._indexSavePromise
+            .then(async () => {
+                this._indexSaveScheduled = false;
+                await this._saveIndex();
+            })
+            .catch(() => {
+                // the cache keeps working in memory when the index file cannot be written
+            });
+    }
+
+    private async _saveIndex() {
+        for (const entry of await readIndexEntries(this.directory)) {
+            if (this._removedKeys.has(entry.key))
+                continue;
+
+            const existingEntry = this._entries.get(entry.key);
+            if (existingEntry == null)
+                this._entries.set(entry.key, entry);
+            else
+                existingEntry.lastUsed = Math.max(existingEntry.lastUsed, entry.lastUsed);
+        }
+
+        await this._evictLeastRecentlyUsedEntries();
+
+        const indexFile: PromptCacheIndexFile = {
+            version: indexFileVersion,
+            entries: [...this._entries.values()]
+        };
+
+        const indexFilePath = path.join(this.directory, indexFileName);
+        const temporaryIndexFilePath = `${indexFilePath}.tmp-${process.pid}-${nanoid()}`;
+
+        try {
+            await fs.writeJson(temporaryIndexFilePath, indexFile);
+            await fs.rename(temporaryIndexFilePath, indexFilePath);
+        } catch (err) {
+            await fs.remove(temporaryIndexFilePath)
+                .catch(() => void 0);
+            throw err;
+        }
+    }
+
+    private async _deleteEntry(key: string) {
+        this._entries.delete(key);
+        this._removedKeys.add(key);
+
+        await fs.remove(this._getFilePath(key))
+            .catch(() => void 0);
+    }
+
+    private async _evictLeastRecentlyUsedEntries() {
+        let size = 0;
+        for (const entry of this._entries.values())
+            size += entry.size;
+
+        if (size <= this.maxSize)
+            return;
+
+        const entries = [...this._entries.values()].sort((a, b) => a.lastUsed - b.lastUsed);
+        for (const entry of entries) {
+            if (size <= this.maxSize)
+                break;
+
+            size -= entry.size;
+            await this._deleteEntry(entry.key);
+        }
+    }
+
+    public static async _create({
+        directory,
+        maxSize,
+        minTokens
+    }: {
+        directory: string,
+        maxSize: number,
+        minTokens: number
+    }) {
+        const resolvedDirectory = path.resolve(process.cwd(), directory);
+        await fs.ensureDir(resolvedDirectory);
+
+        const promptCache = new LlamaPromptCache({
+            directory: resolvedDirectory,
+            maxSize,
+            minTokens
+        });
+
+        for (const entry of await readIndexEntries(resolvedDirectory))
+            promptCache._entries.set(entry.key, entry);
+
+        return promptCache;
+    }
+}
+
+async function readIndexEntries(directory: string): Promise<PromptCacheIndexEntry[]> {
+    try {
+        const indexFile: PromptCacheIndexFile = await fs.readJson(path.join(directory, indexFileName));
+        if (indexFile?.version !== indexFileVersion || !Array.isArray(indexFile.entries))
+            return [];
+
+        return indexFile.entries.filter((entry) => (
+            typeof entry?.key === "string" &&
+            typeof entry.fingerprint === "string" &&
+            typeof entry.prefixHash === "string" &&
+            typeof entry.tokenCount === "number" &&
+            typeof entry.size === "number" &&
+            typeof entry.lastUsed === "number"
+        ));
+    } catch (err) {
+        return [];
+    }
+}
+
+/**
+ * Compute a 64-bit rolling hash of the given tokens, and return its value after each of the given prefix lengths
+ */
+function getTokenPrefixHashes(tokens: Token[], prefixLengths: Set<number>) {
+    const res = new Map<number, string>();
+    let hash1 = 0x9747b28c;
+    let hash2 = 0x1b873593;
+
+    if (prefixLengths.has(0))
+        res.set(0, formatPrefixHash(hash1, hash2));
+
+    for (let i = 0; i < tokens.length && res.size < prefixLengths.size; i++) {
+        hash1 = mixTokenIntoHash(hash1, tokens[i]!, 0x85ebca6b);
+        hash2 = mixTokenIntoHash(hash2, tokens[i]!, 0xc2b2ae35);
+
+        if (prefixLengths.has(i + 1))
+            res.set(i + 1, formatPrefixHash(hash1, hash2));
+    }
+
+    return res;
+}
+
+// a MurmurHash3 round
+function mixTokenIntoHash(hash: number, token: number, seed: number) {
+    let mixedToken = Math.imul(token ^ seed, 0xcc9e2d51);
+    mixedToken = (mixedToken << 15) | (mixedToken >>> 17);
+    mixedToken = Math.imul(mixedToken, 0x1b873593);
+
+    hash ^= mixedToken;
+    hash = (hash << 13) | (hash >>> 19);
+    return (Math.imul(hash, 5) + 0xe6546b64) | 0;
+}
+
+function formatPrefixHash(hash1: number, hash2: number) {
+    return (hash1 >>> 0).toString(16).padStart(8, "0") + (hash2 >>> 0).toString(16).padStart(8, "0");
+}
@@ -149,6 +149,85 @@ export type LlamaContextOptions = {
      */
     swaFullCache?: boolean,
 
+    /**
+     * Reuse the evaluation cache of token prefixes that are shared between the context sequences.
+     *
+     * When a sequence evaluates tokens that start with a prefix another sequence of this context already evaluated
+     * (like a shared system prompt), the cache of that prefix is copied from the other sequence instead of evaluating it again.
+     * The cache of disposed sequences is kept for reuse until their cells are needed for new sequences,
+     * where the least recently used ones are evicted first.
+     *
+     * Prefixes are only reused from sequences that evaluated them with the same LoRA adapters and scales,
+     * and prefixes of states that were loaded from a file or imported are not reused by other sequences.
+     *
+     * This option has no effect on recurrent and hybrid models,
+     * or on models that use SWA (Sliding Window Attention) when the `swaFullCache` option is not enabled.
+     *
+     * Defaults to `false`.
+     */
+    prefixCache?: boolean,
+
+    /**
+     * Persist the evaluation state of prompts to a cache directory on the disk,
+     * and load the longest cached prefix of a prompt instead of evaluating it again, also across process restarts.
+     *
+     * The cached states are keyed by the content of the model file, the context options that affect the state,
+     * the LoRA adapters and scales of the sequence, and a hash of the tokens of the prompt prefix,
+     * so a cache directory can be shared between different models, contexts and processes.
+     *
+     * Sequence states are large (about 100MB for 1K tokens on an 8B model),
+     * so this is most useful for long prompts that are evaluated repeatedly, like long system prompts or documents.
+     *
+     * Disabled by default.
+     */
+    promptCache?: {
+        /** The directory to store the cached states in */
+        directory: string,
+
+        /**
+         * The maximum total size of the cached states in the directory in bytes.
+         * The least recently used states are removed when this size is exceeded.
+         *
+         * Defaults to 4GB.
+         */
+        maxSize?: number,
+
+        /**
+         * The minimum number of prompt tokens that have to be evaluated for their state to be stored,
+         * and the minimum number of tokens that loading a cached state has to save.
+         *
+         * Defaults to `256`.
+         */
+        minTokens?: number
+    },
+
+    /**
+     * Share the KV cache between all the context sequences instead of reserving `contextSize` cells for each of them,
+     * and when there are no free cells left for a batch, preempt the sequences with the lowest evaluation priority
+     * (and then the least recently evaluated ones) by swapping their state out to the RAM.
+     * A preempted sequence is swapped back in the next time it's used.
+     *
+     * This allows using more sequences than the KV cache can hold at once, instead of sizing the context for the worst case,
+     * at the cost of copying the state of preempted sequences in and out of the KV cache.
+     *
+     * Use `context.preemptionStats` to see how often sequences are preempted.
+     *
+     * This option has no effect on recurrent and hybrid models.
+     *
+     * Defaults to `false`.
+     */
+    preemption?: boolean | {
+        /**
+         * The total number of tokens the shared KV cache can hold for all the sequences together.
+         *
+         * Cannot be smaller than `contextSize` or larger than `contextSize * sequences`,
+         * and values outside this range are clamped to it.
+         *
+         * Defaults to `contextSize * sequences`.
+         */
+        kvCacheSize?: number
+    },
+
     /**
      * Load the provided LoRA adapters onto the context.
      * LoRA adapters are used to modify the weights of a pretrained model to adapt to new tasks or domains
@@ -156,17 +235,13 @@ export type LlamaContextOptions = {
      *
      * If a string is provided, it will be treated as a path to a single LoRA adapter file.
      *
-     * The adapters will be released from memory once the model (not just the context) is disposed.
+     * The adapters stay loaded in the LoRA adapter cache of the model after the context is disposed,
+     * and are released from memory according to the `loraAdapterCache` option of the model, or once the model is disposed.
+     *
+     * Sequences of the context can use other adapters by calling `.setLoraAdapters()` on them.
      */
     lora?: string | {
-        adapters: Array<{
-            filePath: string,
-
-            /**
-             * Defaults to `1`
-             */
-            scale?: number
-        }>,
+        adapters: LlamaContextLoraAdapter[],
 
         /**
          * Called with the LoRA adapters load percentage when the LoRA adapters are being loaded.
@@ -229,7 +304,13 @@ export type LlamaContextOptions = {
      * ranking mode
      * @internal
      */
-    _ranking?: boolean
+    _ranking?: boolean,
+
+    /**
+     * embedding mode with an embedding for every token (no pooling)
+     * @internal
+     */
+    _tokenEmbeddings?: boolean
 };
 export type LlamaContextSequenceRepeatPenalty = {
     /** Tokens to lower the predication probability of to be the next predicted token */
@@ -340,7 +421,28 @@ export type BatchingOptions = {
      *
      * Defaults to `"maximumParallelism"`.
      */
-    itemPrioritizationStrategy?: "maximumParallelism" | "firstInFirstOut" | CustomBatchingPrioritizationStrategy
+    itemPrioritizationStrategy?: "maximumParallelism" | "firstInFirstOut" | CustomBatchingPrioritizationStrategy,
+
+    /**
+     * The maximum number of consecutive batches to evaluate with the same LoRA adapters
+     * while items of sequences that use other LoRA adapters are waiting to be evaluated.
+     *
+     * A batch can only be evaluated with a single set of LoRA adapters,
+     * so items are grouped by the LoRA adapters of their sequences, and the adapters are switched only between groups.
+     * When this limit is reached, the adapters are switched to the ones of the item that has waited the longest.
+     *
+     * Defaults to `4`.
+     */
+    maxConsecutiveLoraAdapterBatches?: number
+};
+
+export type LlamaContextLoraAdapter = {
+    filePath: string,
+
+    /**
+     * Defaults to `1`
+     */
+    scale?: number
 };
 
 /**
@@ -375,6 +477,73 @@ export type ContextTokensDeleteRange = {
     end: number
 };
 
+export type LlamaContextSequenceState = {
+    /**
+     * The tokens that the state was evaluated from
+     */
+    tokens: Token[],
+
+    /**
+     * The serialized evaluation state of the context sequence
+     */
+    data: Uint8Array
+};
+
+export type LlamaContextKvCacheStats = {
+    /** The total number of cells in the KV cache of the context, across all of its sequences */
+    totalCells: number,
+
+    /** Whether all the sequences share the same cells, which is the case when the `preemption` option is enabled */
+    unified: boolean,
+
+    /** The size of the keys a single cell holds across all the model layers, in bytes */
+    keyBytesPerCell: number,
+
+    /** The size of the values a single cell holds across all the model layers, in bytes */
+    valueBytesPerCell: number,
+
+    /**
+     * The sequences that have tokens in the context state or are swapped out of it.
+     *
+     * llama.cpp only exposes the range of positions each sequence holds, not the cells it occupies,
+     * so the cells of a sequence can only be estimated from its positions.
+     * For example, cells that are shared by multiple sequences (when the `prefixCache` option is enabled)
+     * are part of the positions of every sequence that shares them.
+     */
+    sequences: Array<{
+        sequenceId: number,
+
+        /** `-1` when the sequence has no tokens */
+        minPosition: number,
+
+        /** `-1` when the sequence has no tokens */
+        maxPosition: number,
+
+        /** Whether the sequence was preempted and its state is swapped out to the RAM */
+        swapped: boolean
+    }>
+};
+
+export type LlamaContextWarmupResult = {
+    /**
+     * The time it took to decode a single token with all the weights of the model (such as all the experts of MoE models),
+     * which loads the weights into memory, in milliseconds
+     */
+    weightsWarmupTime: number,
+
+    /** The time it took to decode each of the synthetic batches, in milliseconds */
+    batches: Array<{
+        batchSize: number,
+
+        /** The number of sequences the tokens of the batch were split between */
+        sequences: number,
+        decodeTime: number
+    }>,
+
+    /** The total time it took to clear the KV cache between the synthetic batches and after them, in milliseconds */
+    memoryClearTime: number
+};
+
 export type SequenceEvaluateOptions = {
     temperature?: number, minP?: number, topK?: number, topP?: number,
 
@@ -1,5 +1,11 @@
 export type LlamaEmbeddingOptions = {
-    vector: readonly number[]
+    /**
+     * The embedding vector.
+     *
+     * A `Float32Array` is used as is without copying it, so it shouldn't be modified afterward.
+     * An array of numbers is copied and keeps its full precision.
+     */
+    vector: readonly number[] | Float32Array
 };
 
 export type LlamaEmbeddingJSON = {
@@ -8,10 +14,41 @@ export type LlamaEmbeddingJSON = {
 };
 
 export class LlamaEmbedding {
-    public readonly vector: readonly number[];
+    /** @internal */ private readonly _sourceVector: readonly number[] | Float32Array;
+    /** @internal */ private _vector?: readonly number[];
+    /** @internal */ private _float32Vector?: Float32Array;
 
     public constructor(options: LlamaEmbeddingOptions) {
-        this.vector = Object.freeze(options.vector.slice());
+        if (options.vector instanceof Float32Array) {
+            this._sourceVector = options.vector;
+            this._float32Vector = options.vector;
+        } else {
+            const vector = Object.freeze(options.vector.slice());
+
+            this._sourceVector = vector;
+            this._vector = vector;
+        }
+    }
+
+    public get vector(): readonly number[] {
+        if (this._vector == null)
+            this._vector = Object.freeze(Array.from(this._sourceVector));
+
+        return this._vector;
+    }
+
+    /**
+     * The embedding vector as a `Float32Array`, without creating an array of numbers.
+     *
+     * When the embedding was created from an array of numbers, the values are rounded to 32-bit floats.
+     *
+     * Do not modify the returned array.
+     */
+    public get float32Vector(): Float32Array {
+        if (this._float32Vector == null)
+            this._float32Vector = Float32Array.from(this._sourceVector);
+
+        return this._float32Vector;
     }
 
     public toJSON(): LlamaEmbeddingJSON {
@@ -28,15 +65,18 @@ export class LlamaEmbedding {
      * @returns A value between 0 and 1 representing the similarity between the embedding vectors,
      * where 1 means the embeddings are identical.
      */
-    public calculateCosineSimilarity(other: LlamaEmbedding | LlamaEmbeddingJSON | readonly number[]) {
-        const otherVector = other instanceof Array
-            ? other
-            : other.vector;
+    public calculateCosineSimilarity(other: LlamaEmbedding | LlamaEmbeddingJSON | readonly number[] | Float32Array) {
+        const thisVector = this._sourceVector;
+        const otherVector = other instanceof LlamaEmbedding
+            ? other._sourceVector
+            : (other instanceof Array || other instanceof Float32Array)
+                ? other
+                : other.vector;
 
         if (otherVector == null)
             throw new Error("Other vector is null");
-        else if (otherVector.length !== this.vector.length) {
-            if (otherVector.length === 0 || this.vector.length === 0)
+        else if (otherVector.length !== thisVector.length) {
+            if (otherVector.length === 0 || thisVector.length === 0)
                 return 0;
             else
                 throw new Error("Vectors have different lengths");
@@ -45,10 +85,13 @@ export class LlamaEmbedding {
         let dotProduct = 0;
         let thisMagnitude = 0;
         let otherMagnitude = 0;
-        for (let i = 0; i < this.vector.length; i++) {
-            dotProduct += this.vector[i]! * otherVector[i]!;
-            thisMagnitude += Math.pow(this.vector[i]!, 2);
-            otherMagnitude += Math.pow(otherVector[i]!, 2);
+        for (let i = 0; i < thisVector.length; i++) {
+            const thisValue = thisVector[i]!;
+            const otherValue = otherVector[i]!;
+
+            dotProduct += thisValue * otherValue;
+            thisMagnitude += thisValue * thisValue;
+            otherMagnitude += otherValue * otherValue;
         }
 
         if (thisMagnitude === 0 && otherMagnitude === 0)
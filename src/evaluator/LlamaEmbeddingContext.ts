@@ -28,6 +28,25 @@ export type LlamaEmbeddingContextOptions = {
     /** prompt processing batch size */
     batchSize?: number,
 
+    /**
+     * The number of inputs to evaluate in parallel when using `getEmbeddingsFor`.
+     *
+     * Each sequence reserves its own context space, so the context memory usage grows with the number of sequences.
+     *
+     * Defaults to `1`.
+     */
+    sequences?: number,
+
+    /**
+     * Disable pooling so an embedding is produced for every token of the input,
+     * to use with `getTokenEmbeddingsFor` for late-interaction retrieval (like ColBERT).
+     *
+     * When enabled, `getEmbeddingFor` returns the embedding of the last token of the input.
+     *
+     * Defaults to `false`.
+     */
+    tokenEmbeddings?: boolean,
+
     /**
      * number of threads to use to evaluate tokens.
      * set to 0 to use the maximum threads supported by the current machine hardware
@@ -46,12 +65,95 @@ export type LlamaEmbeddingContextOptions = {
     ignoreMemorySafetyChecks?: boolean
 };
 
+/**
+ * - **`"float32"`** - the raw embedding vectors.
+ * - **`"normalizedFloat32"`** - L2-normalized embedding vectors, so the dot product of two vectors is their cosine similarity.
+ * - **`"int8"`** - scalar-quantized embedding vectors, where each value is `vectors[i] * scales[vectorIndex]`.
+ * - **`"binary"`** - a single bit per value that is set when the value is positive,
+ * with the first value in the most significant bit of the first byte of each vector.
+ */
+export type LlamaEmbeddingMatrixFormat = "float32" | "normalizedFloat32" | "int8" | "binary";
+
+export type LlamaEmbeddingMatrixOptions<Format extends LlamaEmbeddingMatrixFormat = LlamaEmbeddingMatrixFormat> = {
+    /**
+     * The format to return the embedding vectors in.
+     *
+     * The conversion is done natively, so quantized formats avoid transferring the full vectors to JavaScript.
+     *
+     * Defaults to `"float32"`.
+     */
+    format?: Format
+};
+
+export type LlamaEmbeddingMatrix<Format extends LlamaEmbeddingMatrixFormat = "float32"> = {
+    readonly format: Format,
+
+    /** The length of each embedding vector */
+    readonly vectorSize: number,
+
+    /**
+     * The number of items in `vectors` each embedding vector occupies.
+     *
+     * Equals `vectorSize` for all formats except `"binary"`, where it's `Math.ceil(vectorSize / 8)`.
+     */
+    readonly vectorStride: number,
+
+    /**
+     * The embedding vectors of all the inputs, one after the other, in the order of the inputs.
+     *
+     * The embedding of the input at index `i` is `vectors.subarray(i * vectorStride, (i + 1) * vectorStride)`.
+     * Empty inputs have a vector of zeros.
+     */
+    readonly vectors: Format extends "int8"
+        ? Int8Array
+        : Format extends "binary"
+            ? Uint8Array
+            : Float32Array
+} & (Format extends "int8" ? {
+    /** The scale of each vector, where the value of the item `j` of the vector `i` is `vectors[i * vectorStride + j] * scales[i]` */
+    readonly scales: Float32Array
+} : {});
+
+export type LlamaTokenEmbeddingsOptions = {
+    /**
+     * Normalize every token embedding vector to a unit length (L2 normalization),
+     * so the dot product of two vectors is their cosine similarity.
+     *
+     * Defaults to `false`.
+     */
+    normalize?: boolean,
+
+    /**
+     * Truncate every token embedding vector to this size.
+     * Useful for models trained with Matryoshka representation learning.
+     *
+     * Defaults to the model's embedding vector size.
+     */
+    maxVectorSize?: number
+};
+
+export type LlamaTokenEmbeddings = {
+    /** The tokens of the input, including the beginning and end tokens that were added to it */
+    readonly tokens: readonly Token[],
+
+    /** The length of each token embedding vector */
+    readonly vectorSize: number,
+
+    /**
+     * The embedding vectors of all the tokens, one after the other.
+     *
+     * The embedding of the token at index `i` is `vectors.subarray(i * vectorSize, (i + 1) * vectorSize)`.
+     */
+    readonly vectors: Float32Array
+};
+
 /**
  * @see [Using Embedding](https://node-llama-cpp.withcat.ai/guide/embedding) tutorial
  */
 export class LlamaEmbeddingContext {
     /** @internal */ public readonly _llamaContext: LlamaContext;
     /** @internal */ private readonly _sequence: LlamaContextSequence;
+    /** @internal */ private readonly _sequences: LlamaContextSequence[];
     /** @internal */ private readonly _disposeAggregator = new AsyncDisposeAggregator();
 
     public readonly onDispose = new EventRelay<void>();
@@ -63,6 +165,10 @@ export class LlamaEmbeddingContext {
     }) {
         this._llamaContext = _llamaContext;
         this._sequence = this._llamaContext.getSequence();
+        this._sequences = [this._sequence];
+
+        while (this._llamaContext.sequencesLeft > 0)
+            this._sequences.push(this._llamaContext.getSequence());
 
         this._disposeAggregator.add(
             this._llamaContext.onDispose.createListener(() => {
@@ -76,25 +182,79 @@ export class LlamaEmbeddingContext {
     }
 
     public async getEmbeddingFor(input: Token[] | string | LlamaText) {
-        const resolvedInput = tokenizeInput(input, this._llamaContext.model.tokenizer, undefined, true);
+        const resolvedInput = this._resolveInput(input);
 
-        if (resolvedInput.length > this._llamaContext.contextSize)
-            throw new Error(
-                "Input is longer than the context size. " +
-                "Try to increase the context size or use another model that supports longer contexts."
-            );
-        else if (resolvedInput.length === 0)
+        if (resolvedInput.length === 0)
             return new LlamaEmbedding({
                 vector: []
             });
 
-        const beginningToken = resolveBeginningTokenToPrepend(this.model.vocabularyType, this.model.tokens);
-        if (beginningToken != null && resolvedInput[0] !== beginningToken)
-            resolvedInput.unshift(beginningToken);
+        return await withLock([this as LlamaEmbeddingContext, "evaluate"], async () => {
+            return new LlamaEmbedding({
+                vector: await this._evaluateSequenceEmbedding(resolvedInput)
+            });
+        });
+    }
 
-        const endToken = resolveEndTokenToAppend(this.model.vocabularyType, this.model.tokens);
-        if (endToken != null && resolvedInput.at(-1) !== endToken)
-            resolvedInput.push(endToken);
+    /**
+     * Get the embeddings of multiple inputs.
+     *
+     * The inputs are packed together and evaluated in parallel on all the context sequences (see the `sequences` option),
+     * which is much faster than calling `getEmbeddingFor` for each input separately.
+     */
+    public async getEmbeddingsFor(inputs: readonly (Token[] | string | LlamaText)[]): Promise<LlamaEmbedding[]> {
+        const resolvedInputs = inputs.map((input) => this._resolveInput(input));
+        const {vectorSize, vectors} = await this._getEmbeddingMatrixForResolvedInputs(resolvedInputs, "float32");
+
+        return resolvedInputs.map((resolvedInput, index) => (
+            new LlamaEmbedding({
+                vector: resolvedInput.length === 0
+                    ? []
+                    : vectors.subarray(index * vectorSize, (index + 1) * vectorSize)
+            })
+        ));
+    }
+
+    /**
+     * Same as `getEmbeddingsFor`, but returns the embedding vectors of all the inputs in a single contiguous typed array.
+     *
+     * Prefer this over `getEmbeddingsFor` when embedding a large number of inputs, to avoid creating an object for each vector.
+     * Use the `format` option to get normalized or quantized vectors that are ready to be stored in a vector database.
+     */
+    public async getEmbeddingMatrixFor<const Format extends LlamaEmbeddingMatrixFormat = "float32">(
+        inputs: readonly (Token[] | string | LlamaText)[],
+        {format = "float32" as Format}: LlamaEmbeddingMatrixOptions<Format> = {}
+    ): Promise<LlamaEmbeddingMatrix<Format>> {
+        return await this._getEmbeddingMatrixForResolvedInputs(
+            inputs.map((input) => this._resolveInput(input)),
+            format
+        );
+    }
+
+    /**
+     * Get the embedding of every token of the input, for late-interaction retrieval (like ColBERT).
+     *
+     * Requires the context to be created with the `tokenEmbeddings` option,
+     * or a model that doesn't pool its embeddings.
+     */
+    public async getTokenEmbeddingsFor(
+        input: Token[] | string | LlamaText,
+        {normalize = false, maxVectorSize}: LlamaTokenEmbeddingsOptions = {}
+    ): Promise<LlamaTokenEmbeddings> {
+        const resolvedInput = this._resolveInput(input);
+        const vectorSize = Math.min(this.model.embeddingVectorSize, maxVectorSize ?? this.model.embeddingVectorSize);
+
+        if (resolvedInput.length === 0)
+            return {
+                tokens: [],
+                vectorSize,
+                vectors: new Float32Array(0)
+            };
+        else if (resolvedInput.length > this._llamaContext.batchSize)
+            throw new Error(
+                "Input is longer than the batch size, so its token embeddings cannot be evaluated together. " +
+                "Try to increase the batch size."
+            );
 
         return await withLock([this as LlamaEmbeddingContext, "evaluate"], async () => {
             await this._sequence.eraseContextTokenRanges([{
@@ -102,18 +262,19 @@ export class LlamaEmbeddingContext {
                 end: this._sequence.nextTokenIndex
             }]);
 
-            const iterator = this._sequence.evaluate(resolvedInput, {_noSampling: true});
-            // eslint-disable-next-line @typescript-eslint/no-unused-vars
-            for await (const token of iterator) {
-                break; // only generate one token to get embeddings
-            }
+            await this._sequence.evaluateWithoutGeneratingNewTokens(resolvedInput);
 
-            const embedding = this._llamaContext._ctx.getEmbedding(resolvedInput.length);
-            const embeddingVector = Array.from(embedding);
-
-            return new LlamaEmbedding({
-                vector: embeddingVector
-            });
+            return {
+                tokens: resolvedInput,
+                vectorSize,
+                vectors: this._llamaContext._ctx.getTokenEmbeddings(
+                    this._sequence._sequenceId,
+                    0,
+                    resolvedInput.length,
+                    vectorSize,
+                    normalize
+                )
+            };
         });
     }
 
@@ -134,6 +295,144 @@ export class LlamaEmbeddingContext {
         return this._llamaContext.model;
     }
 
+    /** @internal */
+    private _resolveInput(input: Token[] | string | LlamaText) {
+        const resolvedInput = tokenizeInput(input, this._llamaContext.model.tokenizer, undefined, true);
+
+        if (resolvedInput.length > this._llamaContext.contextSize)
+            throw new Error(
+                "Input is longer than the context size. " +
+                "Try to increase the context size or use another model that supports longer contexts."
+            );
+        else if (resolvedInput.length === 0)
+            return resolvedInput;
+
+        const beginningToken = resolveBeginningTokenToPrepend(this.model.vocabularyType, this.model.tokens);
+        if (beginningToken != null && resolvedInput[0] !== beginningToken)
+            resolvedInput.unshift(beginningToken);
+
+        const endToken = resolveEndTokenToAppend(this.model.vocabularyType, this.model.tokens);
+        if (endToken != null && resolvedInput.at(-1) !== endToken)
+            resolvedInput.push(endToken);
+
+        return resolvedInput;
+    }
+
+    /** @internal */
+    private async _evaluateSequenceEmbedding(resolvedInput: Token[]) {
+        await this._evaluateSequence(resolvedInput);
+
+        return this._llamaContext._ctx.getEmbedding(resolvedInput.length);
+    }
+
+    /** @internal */
+    private async _evaluateSequence(resolvedInput: Token[]) {
+        await this._sequence.eraseContextTokenRanges([{
+            start: 0,
+            end: this._sequence.nextTokenIndex
+        }]);
+
+        const iterator = this._sequence.evaluate(resolvedInput, {_noSampling: true});
+        // eslint-disable-next-line @typescript-eslint/no-unused-vars
+        for await (const token of iterator) {
+            break; // only generate one token to get embeddings
+        }
+    }
+
+    /** @internal */
+    private async _getEmbeddingMatrixForResolvedInputs<const Format extends LlamaEmbeddingMatrixFormat>(
+        resolvedInputs: Token[][],
+        format: Format
+    ): Promise<LlamaEmbeddingMatrix<Format>> {
+        const vectorSize = this.model.embeddingVectorSize;
+        const vectorStride = getEmbeddingMatrixFormatVectorStride(format, vectorSize);
+        const vectors = createEmbeddingMatrixFormatArray(format, resolvedInputs.length * vectorStride);
+        const scales = format === "int8"
+            ? new Float32Array(resolvedInputs.length)
+            : undefined;
+        const createResult = () => ({
+            format,
+            vectorSize,
+            vectorStride,
+            vectors,
+            ...(scales != null ? {scales} : {})
+        }) as LlamaEmbeddingMatrix<Format>;
+
+        if (resolvedInputs.length === 0)
+            return createResult();
+
+        const batchSize = this._llamaContext.batchSize;
+        const batchedInputIndexes: number[] = [];
+        const longInputIndexes: number[] = [];
+        for (let i = 0; i < resolvedInputs.length; i++) {
+            const inputLength = resolvedInputs[i]!.length;
+
+            if (inputLength === 0)
+                continue;
+            else if (inputLength <= batchSize)
+                batchedInputIndexes.push(i);
+            else
+                longInputIndexes.push(i);
+        }
+
+        return await withLock([this as LlamaEmbeddingContext, "evaluate"], async () => {
+            if (batchedInputIndexes.length > 0) {
+                for (const sequence of this._sequences)
+                    await sequence.eraseContextTokenRanges([{
+                        start: 0,
+                        end: sequence.nextTokenIndex
+                    }]);
+
+                const inputLengths = Uint32Array.from(batchedInputIndexes, (index) => resolvedInputs[index]!.length);
+                const tokens = new Uint32Array(inputLengths.reduce((sum, length) => sum + length, 0));
+                let tokensOffset = 0;
+                for (const index of batchedInputIndexes) {
+                    tokens.set(resolvedInputs[index]!, tokensOffset);
+                    tokensOffset += resolvedInputs[index]!.length;
+                }
+
+                const batchedResult = await this._llamaContext._runNativeDecodeJob(() => (
+                    this._llamaContext._ctx.evaluateEmbeddings(
+                        tokens,
+                        inputLengths,
+                        Uint32Array.from(this._sequences, (sequence) => sequence._sequenceId),
+                        vectorSize,
+                        embeddingMatrixFormatToAddonFormat[format]
+                    )
+                ));
+
+                for (let i = 0; i < batchedInputIndexes.length; i++) {
+                    const inputIndex = batchedInputIndexes[i]!;
+
+                    vectors.set(
+                        batchedResult.vectors.subarray(i * vectorStride, (i + 1) * vectorStride),
+                        inputIndex * vectorStride
+                    );
+
+                    if (scales != null && batchedResult.scales != null)
+                        scales[inputIndex] = batchedResult.scales[i]!;
+                }
+            }
+
+            // inputs that don't fit in a single batch are evaluated on their own
+            for (const index of longInputIndexes) {
+                await this._evaluateSequence(resolvedInputs[index]!);
+                const result = this._llamaContext._ctx.getEmbedding(
+                    resolvedInputs[index]!.length,
+                    vectorSize,
+                    embeddingMatrixFormatToAddonFormat[format]
+                );
+
+                vectors.set(result.vectors, index * vectorStride);
+
+                if (scales != null)
+                    scales[index] = result.scale;
+            }
+
+            return createResult();
+        });
+    }
+
     /** @internal */
     public static async _create({
         _model
@@ -142,6 +441,8 @@ export class LlamaEmbeddingContext {
     }, {
         contextSize,
         batchSize,
+        sequences,
+        tokenEmbeddings = false,
         threads = 6,
         createSignal,
         ignoreMemorySafetyChecks
@@ -152,10 +453,12 @@ export class LlamaEmbeddingContext {
         const llamaContext = await _model.createContext({
             contextSize,
             batchSize,
+            sequences,
             threads,
             createSignal,
             ignoreMemorySafetyChecks,
-            _embeddings: true
+            _embeddings: true,
+            _tokenEmbeddings: tokenEmbeddings
         });
 
         return new LlamaEmbeddingContext({
@@ -163,3 +466,26 @@ export class LlamaEmbeddingContext {
         });
     }
 }
+
+const embeddingMatrixFormatToAddonFormat = {
+    float32: 0,
+    normalizedFloat32: 1,
+    int8: 2,
+    binary: 3
+} as const satisfies Record<LlamaEmbeddingMatrixFormat, number>;
+
+function getEmbeddingMatrixFormatVectorStride(format: LlamaEmbeddingMatrixFormat, vectorSize: number) {
+    if (format === "binary")
+        return Math.ceil(vectorSize / 8);
+
+    return vectorSize;
+}
+
+function createEmbeddingMatrixFormatArray(format: LlamaEmbeddingMatrixFormat, length: number) {
+    if (format === "int8")
+        return new Int8Array(length);
+    else if (format === "binary")
+        return new Uint8Array(length);
+
+    return new Float32Array(length);
+}
@@ -3,9 +3,11 @@ import path from "path";
 import {acquireLock, AsyncDisposeAggregator, DisposedError, EventRelay, withLock} from "lifecycle-utils";
 import {removeNullFields} from "../../utils/removeNullFields.js";
 import {Token, Tokenizer} from "../../types.js";
-import {AddonModel, AddonModelLora, ModelTypeDescription} from "../../bindings/AddonTypes.js";
+import {AddonGgufMetadata, AddonModel, AddonModelLora, ModelTypeDescription} from "../../bindings/AddonTypes.js";
 import {DisposalPreventionHandle, DisposeGuard} from "../../utils/DisposeGuard.js";
-import {LlamaLocks, LlamaLogLevel, LlamaVocabularyType, LlamaVocabularyTypeValues} from "../../bindings/types.js";
+import {
+    LlamaLoadReport, LlamaLocks, LlamaLogLevel, LlamaVocabularyType, LlamaVocabularyTypeValues
+} from "../../bindings/types.js";
 import {GgufFileInfo} from "../../gguf/types/GgufFileInfoTypes.js";
 import {readGgufFileInfo} from "../../gguf/readGgufFileInfo.js";
 import {GgufInsights, GgufInsightsResourceRequirements} from "../../gguf/insights/GgufInsights.js";
@@ -22,6 +24,8 @@ import {LlamaRankingContext, LlamaRankingContextOptions} from "../LlamaRankingCo
 import {GgmlType, resolveGgmlTypeOption} from "../../gguf/types/GgufTensorInfoTypes.js";
 import {MemoryMarking} from "../../bindings/utils/MemoryOrchestrator.js";
 import {TokenAttribute, TokenAttributes} from "./utils/TokenAttributes.js";
+import {LlamaLoraAdapterCache, LlamaLoraAdapterCacheStats} from "./utils/LlamaLoraAdapterCache.js";
+import {getFileDescriptorPath} from "./utils/getFileDescriptorPath.js";
 import type {Llama} from "../../bindings/Llama.js";
 import type {BuiltinSpecialTokenValue} from "../../utils/LlamaText.js";
 
@@ -29,6 +33,27 @@ export type LlamaModelOptions = {
     /** path to the model on the filesystem */
     modelPath: string,
 
+    /**
+     * Load the model from memory instead of from the file at `modelPath`.
+     * `modelPath` is then only used to identify the model (in logs, warnings and share handles) and is never read.
+     *
+     * - **`Buffer`** - the content of a GGUF file, or an array of buffers with all the parts of a split GGUF file, in order.
+     * The tensor data is copied from the buffers right into the model memory, without writing it to a file first.
+     * The model doesn't reference the buffers after it's loaded.
+     * - **`{fileDescriptor: number}`** - an open file descriptor of a GGUF file,
+     * such as a `memfd` or a POSIX shared memory object received from another process.
+     * The file is memory-mapped like a model file on the filesystem, so when mmap is used,
+     * the weights that stay on the CPU are used in-place without copying them.
+     * Keep the file descriptor open until the model is disposed.
+     * Only supported on Linux and macOS.
+     * On macOS, the file is read through a duplicate of the file descriptor that shares its file offset,
+     * so the offset of the file descriptor changes while the model is loading,
+     * and reads and writes that depend on the offset of the file descriptor shouldn't be done until the model is loaded.
+     *
+     * Cannot be used together with the `shared` option.
+     */
+    modelSource?: Buffer | readonly Buffer[] | {fileDescriptor: number},
+
     /**
      * Number of layers to store in VRAM.
      * - **`"auto"`** - adapt to the current VRAM state and try to fit as many layers as possible in it.
@@ -96,6 +121,54 @@ export type LlamaModelOptions = {
      */
     useDirectIo?: boolean,
 
+    /**
+     * Read the model weights into the OS page cache using multiple threads before loading the model with mmap,
+     * in the order of the model layers.
+     *
+     * Without this, the model weights are paged in on demand the first time they're used,
+     * so the first evaluations after a cold start stall on page faults.
+     *
+     * When the `numa` option of `getLlama` is set to `"distribute"`, the layers are spread evenly across the NUMA nodes of the system.
+     * With the other NUMA strategies, the weights are placed on the NUMA nodes the process is allowed to run on.
+     *
+     * The prefetch progress is reported as the first half of the `onLoadProgress` progress.
+     *
+     * Only applies when mmap is used.
+     *
+     * Defaults to `false`.
+     */
+    prefetch?: boolean | {
+        /**
+         * The number of threads to read the model file with.
+         *
+         * Defaults to the number of CPU cores, up to 8.
+         */
+        threads?: number
+    },
+
+    /**
+     * Reuse the weights of a model that's already loaded from the same file with the same options in this process
+     * (including models loaded in other `worker_threads`) instead of loading the model file again.
+     *
+     * The model weights are freed when the last model that uses them is disposed.
+     *
+     * Since the `gpuLayers` and `useMmap` options are resolved based on the current memory state,
+     * set them explicitly to reuse a model that's loaded in another thread, or use the `shareHandle` option instead.
+     *
+     * Defaults to `false`.
+     */
+    shared?: boolean,
+
+    /**
+     * Attach to a model that's loaded in another thread of this process instead of loading the model file,
+     * using a handle created by calling `.getShareHandle()` on it.
+     *
+     * The model file is only read for its metadata, and the `gpuLayers`, `useMmap` and `vocabOnly` options are taken from the handle.
+     *
+     * Loading fails if the model the handle was created from, and all the other models that use its weights, are disposed.
+     */
+    shareHandle?: LlamaModelShareHandle,
+
     /**
      * Force the system to keep the model in the RAM/VRAM.
      * Use with caution as this can crash your system if the available resources are insufficient.
@@ -110,6 +183,23 @@ export type LlamaModelOptions = {
      */
     checkTensors?: boolean,
 
+    /**
+     * Options for the cache of LoRA adapters that contexts created with this model use.
+     *
+     * Adapters are loaded when a context first uses them and stay loaded while any context uses them.
+     * Adapters that aren't used by any context are unloaded in least recently used order
+     * when the total size of the loaded adapters exceeds `maxSize`.
+     */
+    loraAdapterCache?: {
+        /**
+         * The total size in bytes of the LoRA adapters to keep loaded.
+         * Adapters that are used by contexts are never unloaded, so the total size may exceed this value.
+         *
+         * Defaults to `Infinity`, so adapters are never unloaded.
+         */
+        maxSize?: number
+    },
+
     /**
      * Enable flash attention by default for contexts created with this model.
      * Only works with models that support flash attention.
@@ -186,6 +276,21 @@ export type LlamaModelOptions = {
      */
     ignoreMemorySafetyChecks?: boolean,
 
+    /**
+     * Don't decode large metadata arrays (such as `tokenizer.ggml.tokens` and `tokenizer.ggml.merges`) when reading the model file info,
+     * and read their items from the model file only when anything other than their `length` is accessed.
+     *
+     * This reduces the time and memory it takes to load models with large vocabularies,
+     * but the lazy arrays in `model.fileInfo` are `Proxy` objects that cannot be passed to `structuredClone`
+     * or `postMessage`, their items are read synchronously from the model file when accessed,
+     * and the model file has to stay available at `modelPath` for them to be accessed.
+     *
+     * Has no effect when the `modelSource` option is used.
+     *
+     * Defaults to `false`.
+     */
+    lazyMetadataArrays?: boolean,
+
     /**
      * Metadata overrides to load the model with.
      *
@@ -196,6 +301,22 @@ export type LlamaModelOptions = {
     metadataOverrides?: OverridesObject<GgufMetadata, number | bigint | boolean | string>
 };
 
+/**
+ * A handle to a loaded model that can be passed to other `worker_threads` (using `postMessage`)
+ * to use the same model weights in them.
+ *
+ * Create it by calling `.getShareHandle()` on a model, and pass it to the `shareHandle` option of `.loadModel()`.
+ */
+export type LlamaModelShareHandle = {
+    readonly modelPath: string,
+    readonly gpuLayers: number,
+    readonly useMmap: boolean,
+    readonly vocabOnly: boolean,
+
+    /** The identifier of the loaded model weights in this process */
+    readonly handle: number
+};
+
 const defaultUseMmap = "auto" as const satisfies NonNullable<LlamaModelOptions["useMmap"]>;
 const defaultUseDirectIo = false;
 const defaultContextFlashAttentionOptionDefault = "auto" as const satisfies NonNullable<LlamaModelOptions["defaultContextFlashAttention"]>;
@@ -212,6 +333,7 @@ export class LlamaModel {
     /** @internal */ public readonly _backendModelDisposeGuard: DisposeGuard;
     /** @internal */ private readonly _tokens: LlamaModelTokens;
     /** @internal */ private readonly _modelPath: string;
+    /** @internal */ private readonly _modelFilePath: string;
     /** @internal */ private readonly _fileInfo: GgufFileInfo;
     /** @internal */ private readonly _fileInsights: GgufInsights;
     /** @internal */ private readonly _gpuLayers: number;
@@ -227,9 +349,9 @@ export class LlamaModel {
     /** @internal */ private readonly _defaultContextKvCacheKeyType: GgmlType;
     /** @internal */ private readonly _defaultContextKvCacheValueType: GgmlType;
     /** @internal */ private readonly _flashAttentionSupported: boolean;
-    /** @internal */ private readonly _loraAdapters = new Map<string, AddonModelLora>();
-    /** @internal */ public _vramConsumptionMarking?: MemoryMarking;
-    /** @internal */ public _ramConsumptionMarking?: MemoryMarking;
+    /** @internal */ private readonly _loraAdapterCache: LlamaLoraAdapterCache;
+    /** @internal */ private _loadReport?: LlamaLoadReport;
+    /** @internal */ private _memoryConsumptionMarking?: SharedModelMemoryMarking;
     /** @internal */ private _typeDescription?: ModelTypeDescription;
     /** @internal */ private _trainContextSize?: number;
     /** @internal */ private _embeddingVectorSize?: number;
@@ -239,13 +361,14 @@ export class LlamaModel {
     public readonly onDispose = new EventRelay<void>();
 
     private constructor({
-        modelPath, gpuLayers, vocabOnly = false, useMmap, useDirectIo, useMlock = false, checkTensors, onLoadProgress, loadSignal,
-        metadataOverrides
+        modelPath, gpuLayers, vocabOnly = false, useMmap, useDirectIo, prefetch = false, shared = false, shareHandle, useMlock = false,
+        checkTensors, loraAdapterCache, onLoadProgress, loadSignal, metadataOverrides
     }: LlamaModelOptions & {
         gpuLayers: number,
         useMmap: boolean
     }, {
         _llama,
+        _modelFilePath,
         _fileInfo,
         _fileInsights,
         _defaultContextFlashAttentionOptionEnabled,
@@ -258,6 +381,7 @@ export class LlamaModel {
         _loadPercentageMultiplier
     }: {
         _llama: Llama,
+        _modelFilePath?: string,
         _fileInfo: GgufFileInfo,
         _fileInsights: GgufInsights,
         _defaultContextFlashAttentionOptionEnabled: "auto" | boolean,
@@ -272,6 +396,7 @@ export class LlamaModel {
         this._llama = _llama;
         this._fileInfo = _fileInfo;
         this._modelPath = path.resolve(process.cwd(), modelPath);
+        this._modelFilePath = _modelFilePath ?? this._modelPath;
         this._fileInsights = _fileInsights;
         this._gpuLayers = gpuLayers;
         this._useMmap = useMmap ?? false;
@@ -285,12 +410,21 @@ export class LlamaModel {
         this._defaultContextKvCacheValueType = _defaultContextKvCacheValueType;
         this._flashAttentionSupported = _flashAttentionSupported;
         const overridesList = ggufMetadataOverridesToList(metadataOverrides);
-        this._model = new this._llama._bindings.AddonModel(this._modelPath, removeNullFields({
+        this._model = new this._llama._bindings.AddonModel(this._modelFilePath, removeNullFields({
             addonExports: this._llama._bindings,
             gpuLayers,
             vocabOnly: this._vocabOnly,
             useMmap,
             useDirectIo,
+            prefetch: prefetch !== false && useMmap,
+            prefetchThreads: typeof prefetch === "object"
+                ? prefetch.threads
+                : undefined,
+            prefetchNumaStrategy: _llama.numa === false
+                ? undefined
+                : _llama.numa,
+            shared,
+            shareHandle: shareHandle?.handle,
             useMlock: _llama.supportsMlock
                 ? useMlock
                 : undefined,
@@ -311,6 +445,11 @@ export class LlamaModel {
                 : undefined
         }));
         this._tokens = LlamaModelTokens._create(this._model, this._disposedState);
+        this._loraAdapterCache = new LlamaLoraAdapterCache({
+            model: this._model,
+            bindings: this._llama._bindings,
+            maxSize: loraAdapterCache?.maxSize
+        });
         this._filename = path.basename(modelPath);
 
         this._disposeAggregator.add(() => {
@@ -326,8 +465,7 @@ export class LlamaModel {
         this._disposeAggregator.add(async () => {
             await this._backendModelDisposeGuard.acquireDisposeLock();
             await this._model.dispose();
-            this._vramConsumptionMarking?.dispose();
-            this._ramConsumptionMarking?.dispose();
+            this._memoryConsumptionMarking?.release();
             this._llamaPreventDisposalHandle.dispose();
         });
 
@@ -335,8 +473,10 @@ export class LlamaModel {
         this.detokenize = this.detokenize.bind(this);
         this.isSpecialToken = this.isSpecialToken.bind(this);
         this.isEogToken = this.isEogToken.bind(this);
+        this.countTokens = this.countTokens.bind(this);
 
         (this.tokenize as Tokenizer as Writable<Tokenizer>).detokenize = this.detokenize;
+        (this.tokenize as Tokenizer as Writable<Tokenizer>).countTokens = this.countTokens;
         (this.tokenize as Tokenizer).isSpecialToken = this.isSpecialToken;
         (this.tokenize as Tokenizer).isEogToken = this.isEogToken;
 
@@ -400,6 +540,59 @@ export class LlamaModel {
         return this._useMmap;
     }
 
+    /**
+     * Create a handle that can be passed to other `worker_threads` (using `postMessage`)
+     * to load this model in them without loading its weights again, using the `shareHandle` option of `.loadModel()`.
+     *
+     * The model weights stay loaded as long as any model that uses them isn't disposed.
+     */
+    public getShareHandle(): LlamaModelShareHandle {
+        this._ensureNotDisposed();
+
+        const handle = this._model.getShareHandle();
+        if (handle == null)
+            throw new Error("This model cannot be shared");
+
+        return {
+            modelPath: this._modelPath,
+            gpuLayers: this._gpuLayers,
+            useMmap: this._useMmap,
+            vocabOnly: this._vocabOnly,
+            handle
+        };
+    }
+
+    /**
+     * Load the given LoRA adapters in the background, so contexts that use them later don't have to wait for them to load.
+     *
+     * Preloaded adapters that aren't used by any context may be unloaded to keep the size of the LoRA adapter cache within its budget.
+     * See the `loraAdapterCache` option of `.loadModel()` for more details.
+     */
+    public async preloadLoraAdapters(filePaths: string | string[]) {
+        this._ensureNotDisposed();
+
+        await this._loraAdapterCache.preload(
+            typeof filePaths === "string"
+                ? [filePaths]
+                : filePaths
+        );
+    }
+
+    /**
+     * A breakdown of the time and resources it took to load this model,
+     * to find out whether the storage, the tensor data processing or the memory allocation is the bottleneck of the load
+     */
+    public get loadReport(): LlamaLoadReport | undefined {
+        return this._loadReport;
+    }
+
+    /**
+     * Usage statistics of the LoRA adapter cache of this model
+     */
+    public get loraAdapterCacheStats(): LlamaLoraAdapterCacheStats {
+        return this._loraAdapterCache.stats;
+    }
+
     /**
      * Total model size in memory in bytes.
      *
@@ -464,77 +657,8 @@ export class LlamaModel {
             throw new Error(`Unknown builtin special token: ${builtinToken}`);
         }
 
-        if (options === "trimLeadingSpace") {
-            if (specialTokens) {
-                const countLeadingSpaces = (text: string) => {
-                    let count = 0;
-                    for (; count < text.length; count++) {
-                        if (text[count] !== " ")
-                            break;
-                    }
-                    return count;
-                };
-                const textLeadingSpaces = countLeadingSpaces(text);
-                const [workaroundToken, workaroundTokenString] = (this.tokens.bos != null && this.tokens.bosString != null)
-                    ? [this.tokens.bos, this.tokens.bosString]
-                    : (this.tokens.eos != null && this.tokens.eosString != null)
-                        ? [this.tokens.eos, this.tokens.eosString]
-                        : (this.tokens.nl != null && this.tokens.nlString != null)
-                            ? [this.tokens.nl, this.tokens.nlString]
-                            : (this.tokens.eot != null && this.tokens.eotString != null)
-                                ? [this.tokens.eot, this.tokens.eotString]
-                                : [null, null];
-
-                if (workaroundToken != null && workaroundTokenString != null) {
-                    const tokens = Array.from(this._model.tokenize(workaroundTokenString + text, true)) as Token[];
-                    const workaroundTokenIndex = tokens.indexOf(workaroundToken);
-
-                    // only use the tokenized output if it can be corrected, otherwise fallback to the default tokenization
-                    if (workaroundTokenIndex >= 0 && workaroundTokenIndex <= 1) {
-                        tokens.splice(0, workaroundTokenIndex + 1);
-
-                        if (countLeadingSpaces(this.detokenize(tokens, true)) === textLeadingSpaces)
-                            return tokens;
-                    }
-                }
-
-                const workaroundTokensString = "\n";
-                const workaroundTokens = Array.from(this._model.tokenize(workaroundTokensString, true)) as Token[];
-
-                if (text.startsWith(workaroundTokensString)) {
-                    const tokens = Array.from(this._model.tokenize(text, true)) as Token[];
-                    if (this.detokenize(tokens, true).startsWith(workaroundTokensString))
-                        return tokens;
-                }
-
-                const tokens = Array.from(this._model.tokenize(workaroundTokensString + text, true)) as Token[];
-
-                // only use the tokenized output if it can be corrected, otherwise fallback to the default tokenization
-                if (workaroundTokens.length > 0 && workaroundTokens.every((token, index) => tokens[index] === token)) {
-                    tokens.splice(0, workaroundTokens.length);
-
-                    if (countLeadingSpaces(this.detokenize(tokens, true)) === textLeadingSpaces)
-                        return tokens;
-                }
-            } else {
-                const workaroundTokensString = "\n";
-                const workaroundTokens = Array.from(this._model.tokenize(workaroundTokensString, false)) as Token[];
-
-                if (text.startsWith(workaroundTokensString)) {
-                    const tokens = Array.from(this._model.tokenize(text, false)) as Token[];
-                    if (this.detokenize(tokens, false).startsWith(workaroundTokensString))
-                        return tokens;
-                }
-
-                const tokens = Array.from(this._model.tokenize(workaroundTokensString + text, false)) as Token[];
-
-                // only use the tokenized output if it can be corrected, otherwise fallback to the default tokenization
-                if (workaroundTokens.length > 0 && workaroundTokens.every((token, index) => tokens[index] === token)) {
-                    tokens.splice(0, workaroundTokens.length);
-                    return tokens;
-                }
-            }
-        }
+        if (options === "trimLeadingSpace")
+            return Array.from(this._model.tokenize(text, specialTokens, this._getTrimLeadingSpaceWorkaroundToken())) as Token[];
 
         return Array.from(this._model.tokenize(text, specialTokens)) as Token[];
     }
@@ -577,6 +701,35 @@ export class LlamaModel {
         return this._model.detokenize(Uint32Array.from(tokens), Boolean(specialTokens));
     }
 
+    /**
+     * Get the number of tokens the given text would be tokenized to, without creating the tokens array.
+     *
+     * The result is the same as `model.tokenize(text, specialTokens, options).length`.
+     * @param text - the text to count the tokens of.
+     * When given an array of texts, the tokens of each text are counted separately in a single call to the native addon.
+     * @param [specialTokens] - whether to tokenize text that correspond to special tokens to those tokens.
+     * See `tokenize` for more details.
+     * @param [options] - additional options for tokenization.
+     * See `tokenize` for more details.
+     */
+    public countTokens(text: string, specialTokens?: boolean, options?: "trimLeadingSpace"): number;
+    public countTokens(text: readonly string[], specialTokens?: boolean, options?: "trimLeadingSpace"): number[];
+    public countTokens(text: string | readonly string[], specialTokens: boolean = false, options?: "trimLeadingSpace"): number | number[] {
+        this._ensureNotDisposed();
+
+        const trimLeadingSpace = options === "trimLeadingSpace"
+            ? this._getTrimLeadingSpaceWorkaroundToken()
+            : undefined;
+
+        if (typeof text !== "string")
+            return Array.from(this._model.countTokens(text as string[], Boolean(specialTokens), trimLeadingSpace));
+
+        if (text === "")
+            return 0;
+
+        return this._model.countTokens(text, Boolean(specialTokens), trimLeadingSpace);
+    }
+
     public getTokenAttributes(token: Token): TokenAttributes {
         if (token == null)
             throw new Error("Token cannot be null");
@@ -751,6 +904,20 @@ export class LlamaModel {
         return this._vocabularyType;
     }
 
+    /** @internal */
+    private _getTrimLeadingSpaceWorkaroundToken(): {workaroundToken?: Token, workaroundTokenString?: string} {
+        if (this.tokens.bos != null && this.tokens.bosString != null)
+            return {workaroundToken: this.tokens.bos, workaroundTokenString: this.tokens.bosString};
+        else if (this.tokens.eos != null && this.tokens.eosString != null)
+            return {workaroundToken: this.tokens.eos, workaroundTokenString: this.tokens.eosString};
+        else if (this.tokens.nl != null && this.tokens.nlString != null)
+            return {workaroundToken: this.tokens.nl, workaroundTokenString: this.tokens.nlString};
+        else if (this.tokens.eot != null && this.tokens.eotString != null)
+            return {workaroundToken: this.tokens.eot, workaroundTokenString: this.tokens.eotString};
+
+        return {};
+    }
+
     /** @internal */
     private _ensureNotDisposed() {
         if (this._disposedState.disposed)
@@ -758,21 +925,18 @@ export class LlamaModel {
     }
 
     /** @internal */
-    public async _getOrLoadLora(filePath: string) {
-        const resolvedPath = path.resolve(process.cwd(), filePath);
-        if (this._loraAdapters.has(resolvedPath))
-            return this._loraAdapters.get(resolvedPath)!;
+    public async _acquireLora(filePath: string) {
+        this._ensureNotDisposed();
 
-        return await withLock([this._loraAdapters, "modify"], async () => {
-            if (this._loraAdapters.has(resolvedPath))
-                return this._loraAdapters.get(resolvedPath)!;
+        return await this._loraAdapterCache.acquire(filePath);
+    }
 
-            const lora = new this._llama._bindings.AddonModelLora(this._model, resolvedPath);
-            await this._model.loadLora(lora);
-            this._loraAdapters.set(resolvedPath, lora);
+    /** @internal */
+    public _releaseLora(lora: AddonModelLora) {
+        if (this._disposedState.disposed)
+            return;
 
-            return lora;
-        });
+        this._loraAdapterCache.release(lora);
     }
 
     /** @internal */
@@ -787,16 +951,37 @@ export class LlamaModel {
             experimentalDefaultContextKvCacheKeyType,
             experimentalDefaultContextKvCacheValueType
         } = modelOptions;
-        const useMmap = !_llama.supportsMmap
+        const modelSource = modelOptions.modelSource;
+        const modelSourceBuffers = (modelSource == null || "fileDescriptor" in modelSource)
+            ? undefined
+            : Buffer.isBuffer(modelSource)
+                ? [modelSource]
+                : modelSource;
+        const modelFilePath = (modelSource != null && "fileDescriptor" in modelSource)
+            ? getFileDescriptorPath(modelSource.fileDescriptor)
+            : undefined;
+
+        // there's no file to map when loading from buffers
+        const useMmap = (!_llama.supportsMmap || modelSourceBuffers != null)
             ? false
             : typeof modelOptions.useMmap === "boolean"
                 ? modelOptions.useMmap
                 : defaultUseMmap;
         const useDirectIo = modelOptions.useDirectIo ?? defaultUseDirectIo;
+        const shareHandle = modelOptions.shareHandle;
 
-        const fileInfo = await readGgufFileInfo(modelOptions.modelPath, {
+        if (shareHandle != null && path.resolve(process.cwd(), modelOptions.modelPath) !== shareHandle.modelPath)
+            throw new Error("The share handle was created for a different model file");
+        else if (modelSource != null && modelOptions.shared)
+            throw new Error("The `shared` option cannot be used together with the `modelSource` option");
+
+        const fileInfo = await readGgufFileInfo(modelSourceBuffers ?? modelFilePath ?? modelOptions.modelPath, {
             sourceType: "filesystem",
-            signal: loadSignal
+            signal: loadSignal,
+            llama: _llama,
+
+            // a file descriptor path refers to another file after the file descriptor is closed, so it's always read eagerly
+            lazyMetadataArrays: modelSource == null && (modelOptions.lazyMetadataArrays ?? false)
         });
         applyGgufMetadataOverrides(fileInfo, modelOptions.metadataOverrides);
         const ggufInsights = await GgufInsights.from(fileInfo, _llama);
@@ -818,68 +1003,82 @@ export class LlamaModel {
         let gpuLayers: number;
         let resolvedUseMmap: boolean;
         let resourceRequirementsEstimation: GgufInsightsResourceRequirements;
-        const simulatorSession = ggufInsights._createSimulatorSession();
         let layersResolutionLoadedPercentage = 0;
-        try {
-            let lastProgressSteps = 0;
-            const onProgressPercentagePerStep = figuringGpuLayersValueLoadPercentage.percentagePerStep + (
-                modelOptions.onLoadProgress == null
-                    ? 0
-                    : (
-                        Math.min(1, ggufInsights.modelSize / (await _llama._ramOrchestrator.getMemoryState()).total) *
-                        figuringGpuLayersValueLoadPercentage.percentagePerStepModelMemorySize
-                    )
-            );
+        if (shareHandle != null) {
+            // the weights are already loaded, so no memory has to be reserved for them
+            gpuLayers = shareHandle.gpuLayers;
+            resolvedUseMmap = shareHandle.useMmap;
+            resourceRequirementsEstimation = {cpuRam: 0, gpuVram: 0};
+        } else {
+            const simulatorSession = ggufInsights._createSimulatorSession();
+            try {
+                let lastProgressSteps = 0;
+                const onProgressPercentagePerStep = figuringGpuLayersValueLoadPercentage.percentagePerStep + (
+                    modelOptions.onLoadProgress == null
+                        ? 0
+                        : (
+                            Math.min(1, ggufInsights.modelSize / (await _llama._ramOrchestrator.getMemoryState()).total) *
+                            figuringGpuLayersValueLoadPercentage.percentagePerStepModelMemorySize
+                        )
+                );
             
-            const layersResolutionStartTime = Date.now();
-            const layersResolution = await ggufInsights.configurationResolver.resolveModelGpuLayersV2(modelOptions.gpuLayers, {
-                ignoreMemorySafetyChecks: modelOptions.ignoreMemorySafetyChecks,
-                defaultContextFlashAttention: resolvedDefaultContextFlashAttention,
-                defaultContextSwaFullCache: resolvedDefaultContextSwaFullCache,
-                defaultContextKvCacheKeyType: resolvedDefaultContextKvCacheKeyType,
-                defaultContextKvCacheValueType: resolvedDefaultContextKvCacheValueType,
-                useMmap,
-                signal: loadSignal,
-                onProgress: modelOptions.onLoadProgress == null
-                    ? undefined
-                    : (steps: number, totalSteps: number) => {
-                        if (steps === totalSteps && (totalSteps - lastProgressSteps) / totalSteps >= 0.2)
-                            return; // skip a too big jump in the progress bar at the end of the loading progress
-
-                        lastProgressSteps = steps;
-
-                        if (totalSteps * onProgressPercentagePerStep >= figuringGpuLayersValueLoadPercentage.maxPercentage)
-                            layersResolutionLoadedPercentage = (steps / totalSteps) * figuringGpuLayersValueLoadPercentage.maxPercentage;
-                        else
-                            layersResolutionLoadedPercentage = steps * onProgressPercentagePerStep;
-
-                        modelOptions.onLoadProgress?.(layersResolutionLoadedPercentage);
-                    },
+                const layersResolutionStartTime = Date.now();
+                const layersResolution = await ggufInsights.configurationResolver.resolveModelGpuLayersV2(modelOptions.gpuLayers, {
+                    ignoreMemorySafetyChecks: modelOptions.ignoreMemorySafetyChecks,
+                    defaultContextFlashAttention: resolvedDefaultContextFlashAttention,
+                    defaultContextSwaFullCache: resolvedDefaultContextSwaFullCache,
+                    defaultContextKvCacheKeyType: resolvedDefaultContextKvCacheKeyType,
+                    defaultContextKvCacheValueType: resolvedDefaultContextKvCacheValueType,
+                    useMmap,
+                    signal: loadSignal,
+                    onProgress: modelOptions.onLoadProgress == null
+                        ? undefined
+                        : (steps: number, totalSteps: number) => {
+                            if (steps === totalSteps && (totalSteps - lastProgressSteps) / totalSteps >= 0.2)
+                                return; // skip a too big jump in the progress bar at the end of the loading progress
+
+                            lastProgressSteps = steps;
+
+                            if (totalSteps * onProgressPercentagePerStep >= figuringGpuLayersValueLoadPercentage.maxPercentage)
+                                layersResolutionLoadedPercentage = (steps / totalSteps) * figuringGpuLayersValueLoadPercentage.maxPercentage;
+                            else
+                                layersResolutionLoadedPercentage = steps * onProgressPercentagePerStep;
+
+                            modelOptions.onLoadProgress?.(layersResolutionLoadedPercentage);
+                        },
     
-                _simulatorSession: simulatorSession
-            });
-            const layersResolutionEndTime = Date.now();
-            if (_llama._shouldLog(LlamaLogLevel.debug))
-                _llama._log(LlamaLogLevel.debug, "Resolved model gpu layers. " + [
-                    `duration=${(layersResolutionEndTime - layersResolutionStartTime) / 1000}s`,
-                    `layers=${layersResolution.gpuLayers}`,
-                    `useMmap=${useMmap}`,
-                    `modelPath=${modelOptions.modelPath}`
-                ].join(" "));
-
-            gpuLayers = layersResolution.gpuLayers;
-            resolvedUseMmap = layersResolution.useMmap;
-            resourceRequirementsEstimation = await ggufInsights.estimateModelResourceRequirementsV2({
-                gpuLayers,
-                useMmap: resolvedUseMmap,
+                    _simulatorSession: simulatorSession
+                });
+                const layersResolutionEndTime = Date.now();
+                if (_llama._shouldLog(LlamaLogLevel.debug))
+                    _llama._log(LlamaLogLevel.debug, "Resolved model gpu layers. " + [
+                        `duration=${(layersResolutionEndTime - layersResolutionStartTime) / 1000}s`,
+                        `layers=${layersResolution.gpuLayers}`,
+                        `useMmap=${useMmap}`,
+                        `modelPath=${modelOptions.modelPath}`
+                    ].join(" "));
+
+                gpuLayers = layersResolution.gpuLayers;
+                resolvedUseMmap = layersResolution.useMmap;
+                resourceRequirementsEstimation = await ggufInsights.estimateModelResourceRequirementsV2({
+                    gpuLayers,
+                    useMmap: resolvedUseMmap,
                 
-                _simulatorSession: simulatorSession
-            });
-        } finally {
-            simulatorSession.dispose();
+                    _simulatorSession: simulatorSession
+                });
+            } finally {
+                simulatorSession.dispose();
+            }
         }
 
-        const model = new LlamaModel({...modelOptions, gpuLayers, useMmap: resolvedUseMmap, useDirectIo}, {
+        const model = new LlamaModel({
+            ...modelOptions,
+            gpuLayers,
+            useMmap: resolvedUseMmap,
+            useDirectIo,
+            vocabOnly: shareHandle?.vocabOnly ?? modelOptions.vocabOnly
+        }, {
+            _modelFilePath: modelFilePath,
             _fileInfo: fileInfo,
             _fileInsights: ggufInsights,
             _llama,
@@ -924,11 +1123,18 @@ export class LlamaModel {
 
         logWarnings(ggufInsights.getWarnings(modelOptions.modelPath));
 
+        let sourceBuffersMetadata: AddonGgufMetadata | undefined;
         try {
+            // the weights of a model attached using a share handle are already loaded
+            if (modelSourceBuffers != null && shareHandle == null) {
+                sourceBuffersMetadata = new _llama._bindings.AddonGgufMetadata();
+                await sourceBuffersMetadata.init([...modelSourceBuffers]);
+            }
+
             const initLock = await acquireLock([_llama._memoryLock, LlamaLocks.addonInit]);
             let modelLoaded: boolean = false;
             try {
-                modelLoaded = await model._model.init();
+                modelLoaded = await model._model.init(sourceBuffersMetadata);
             } finally {
                 initLock.dispose();
             }
@@ -942,12 +1148,11 @@ export class LlamaModel {
                 throw new Error("Failed to load model");
 
             loadSignal?.removeEventListener("abort", onAbort);
+            model._loadReport = model._model.getLoadReport();
 
             logWarnings(model.getWarnings());
 
-            const memoryBreakdown = model._model.getMemoryBreakdown();
-            model._vramConsumptionMarking = _llama._vramOrchestrator.markAllocation(memoryBreakdown.gpuVram);
-            model._ramConsumptionMarking = _llama._ramOrchestrator.markAllocation(memoryBreakdown.cpuRam);
+            model._memoryConsumptionMarking = SharedModelMemoryMarking.acquire(_llama, model._model);
             modelCreationVramReservation?.dispose?.();
             modelCreationRamReservation?.dispose?.();
 
@@ -956,6 +1161,9 @@ export class LlamaModel {
             loadSignal?.removeEventListener("abort", onAbort);
             modelCreationVramReservation?.dispose?.();
             modelCreationRamReservation?.dispose?.();
+
+            // release the references to the source buffers
+            void sourceBuffersMetadata?.dispose();
         }
     }
 }
@@ -1396,6 +1604,69 @@ function ggufMetadataOverridesToList(overrides?: OverridesObject<GgufMetadata, n
     return res;
 }
 
+/**
+ * The memory of model weights marked on the memory orchestrators of a `Llama` instance.
+ *
+ * Models that share the same weights (using the `shared` or `shareHandle` options) mark their memory once per `Llama` instance,
+ * and the marking is kept until the last of these models is disposed.
+ * Each `worker_threads` thread has its own `Llama` instance, so the shared weights are accounted for in every thread that uses them.
+ */
+class SharedModelMemoryMarking {
+    /** @internal */ private static readonly _markings = new WeakMap<Llama, Map<number, SharedModelMemoryMarking>>();
+    /** @internal */ private readonly _llamaMarkings?: Map<number, SharedModelMemoryMarking>;
+    /** @internal */ private readonly _shareHandle?: number;
+    /** @internal */ private readonly _vramMarking: MemoryMarking;
+    /** @internal */ private readonly _ramMarking: MemoryMarking;
+    /** @internal */ private _references: number = 1;
+
+    private constructor(llama: Llama, model: AddonModel, llamaMarkings?: Map<number, SharedModelMemoryMarking>, shareHandle?: number) {
+        const memoryBreakdown = model.getMemoryBreakdown();
+
+        this._llamaMarkings = llamaMarkings;
+        this._shareHandle = shareHandle;
+        this._vramMarking = llama._vramOrchestrator.markAllocation(memoryBreakdown.gpuVram);
+        this._ramMarking = llama._ramOrchestrator.markAllocation(memoryBreakdown.cpuRam);
+    }
+
+    public release() {
+        if (this._references === 0)
+            return;
+
+        this._references--;
+        if (this._references > 0)
+            return;
+
+        this._vramMarking.dispose();
+        this._ramMarking.dispose();
+
+        if (this._llamaMarkings != null && this._shareHandle != null && this._llamaMarkings.get(this._shareHandle) === this)
+            this._llamaMarkings.delete(this._shareHandle);
+    }
+
+    public static acquire(llama: Llama, model: AddonModel) {
+        const shareHandle = model.getShareHandle();
+        if (shareHandle == null)
+            return new SharedModelMemoryMarking(llama, model);
+
+        let llamaMarkings = SharedModelMemoryMarking._markings.get(llama);
+        if (llamaMarkings == null) {
+            llamaMarkings = new Map();
+            SharedModelMemoryMarking._markings.set(llama, llamaMarkings);
+        }
+
+        const existingMarking = llamaMarkings.get(shareHandle);
+        if (existingMarking != null) {
+            existingMarking._references++;
+            return existingMarking;
+        }
+
+        const marking = new SharedModelMemoryMarking(llama, model, llamaMarkings, shareHandle);
+        llamaMarkings.set(shareHandle, marking);
+
+        return marking;
+    }
+}
+
 function disposeModelIfReferenced(modelRef: WeakRef<LlamaModel>) {
     const model = modelRef.deref();
 
@@ -0,0 +1,202 @@
+import path from "path";
+import process from "process";
+import fs from "fs-extra";
+import {AddonModel, AddonModelLora, BindingModule} from "../../../bindings/AddonTypes.js";
+
+type LoraAdapterCacheEntry = {
+    filePath: string,
+    lora: AddonModelLora,
+
+    /** The size of the adapter file in bytes */
+    size: number,
+
+    /** Resolves when the adapter is loaded */
+    loadPromise: Promise<void>,
+    loaded: boolean
+};
+
+export type LlamaLoraAdapterCacheStats = {
+    /** The number of times a loaded (or loading) adapter was used */
+    hits: number,
+
+    /** The number of times an adapter had to be loaded, including preloads */
+    misses: number,
+
+    /** The number of adapters that were unloaded to stay within the cache budget */
+    evictions: number,
+
+    /** The number of adapters that are currently loaded or being loaded */
+    adapters: number,
+
+    /** The number of adapters that are currently used by contexts, and thus cannot be evicted */
+    pinnedAdapters: number,
+
+    /** The total size of the adapters in the cache in bytes */
+    size: number,
+
+    /** The size budget of the cache in bytes */
+    maxSize: number
+};
+
+/**
+ * Keeps the LoRA adapters of a model loaded while they're used,
+ * and unloads the least recently used adapters that aren't used by any context when the total size of the loaded adapters exceeds `maxSize`.
+ *
+ * The `usages` counter of an adapter pins it in the cache.
+ */
+export class LlamaLoraAdapterCache {
+    public readonly maxSize: number;
+    /** @internal */ private readonly _model: AddonModel;
+    /** @internal */ private readonly _bindings: BindingModule;
+
+    // ordered from the least recently used to the most recently used
+    /** @internal */ private readonly _entries = new Map<string, LoraAdapterCacheEntry>();
+    /** @internal */ private _size: number = 0;
+    /** @internal */ private _hits: number = 0;
+    /** @internal */ private _misses: number = 0;
+    /** @internal */ private _evictions: number = 0;
+
+    public constructor({
+        model,
+        bindings,
+        maxSize = Infinity
+    }: {
+        model: AddonModel,
+        bindings: BindingModule,
+        maxSize?: number
+    }) {
+        this._model = model;
+        this._bindings = bindings;
+        this.maxSize = maxSize;
+    }
+
+    /**
+     * Get the loaded adapter of the given file, loading it if needed, and pin it until `release` is called with it
+     */
+    public async acquire(filePath: string) {
+        const entry = this._getOrLoad(filePath);
+        entry.lora.usages++;
+
+        try {
+            await entry.loadPromise;
+        } catch (err) {
+            entry.lora.usages--;
+            throw err;
+        }
+
+        return entry.lora;
+    }
+
+    /**
+     * Unpin an adapter that was returned by `acquire`, and evict unused adapters if the cache is over its budget
+     */
+    public release(lora: AddonModelLora) {
+        if (lora.usages > 0)
+            lora.usages--;
+
+        this._evictUnused();
+    }
+
+    /**
+     * Load the adapters of the given files in the background without pinning them,
+     * so using them later doesn't have to wait for them to load
+     */
+    public async preload(filePaths: readonly string[]) {
+        const entries = filePaths.map((filePath) => this._getOrLoad(filePath));
+        await Promise.all(entries.map((entry) => entry.loadPromise));
+    }
+
+    public get stats(): LlamaLoraAdapterCacheStats {
+        let pinnedAdapters = 0;
+        for (const entry of this._entries.values()) {
+            if (entry.lora.usages > 0)
+                pinnedAdapters++;
+        }
+
+        return {
+            hits: this._hits,
+            misses: this._misses,
+            evictions: this._evictions,
+            adapters: this._entries.size,
+            pinnedAdapters,
+            size: this._size,
+            maxSize: this.maxSize
+        };
+    }
+
+    /** @internal */
+    private _getOrLoad(filePath: string) {
+        const resolvedPath = path.resolve(process.cwd(), filePath);
+        const existingEntry = this._entries.get(resolvedPath);
+
+        if (existingEntry != null) {
+            this._hits++;
+
+            // move the entry to the end of the map to mark it as the most recently used
+            this._entries.delete(resolvedPath);
+            this._entries.set(resolvedPath, existingEntry);
+            return existingEntry;
+        }
+
+        this._misses++;
+
+        const lora = new this._bindings.AddonModelLora(this._model, resolvedPath);
+        const entry: LoraAdapterCacheEntry = {
+            filePath: resolvedPath,
+            lora,
+            size: 0,
+            loadPromise: Promise.resolve(),
+            loaded: false
+        };
+        entry.loadPromise = this._load(entry);
+        this._entries.set(resolvedPath, entry);
+
+        return entry;
+    }
+
+    /** @internal */
+    private async _load(entry: LoraAdapterCacheEntry) {
+        try {
+            const [stat] = await Promise.all([
+                fs.stat(entry.filePath),
+                this._model.loadLora(entry.lora)
+            ]);
+
+            entry.size = stat.size;
+            entry.loaded = true;
+            this._size += entry.size;
+        } catch (err) {
+            if (this._entries.get(entry.filePath) === entry)
+                this._entries.delete(entry.filePath);
+
+            if (!entry.lora.disposed)
+                void entry.lora.dispose()
+                    .catch(() => void 0);
+
+            throw err;
+        }
+
+        this._evictUnused();
+    }
+
+    /** @internal */
+    private _evictUnused() {
+        if (this._size <= this.maxSize)
+            return;
+
+        for (const entry of [...this._entries.values()]) {
+            if (this._size <= this.maxSize)
+                break;
+
+            if (!entry.loaded || entry.lora.usages > 0)
+                continue;
+
+            this._entries.delete(entry.filePath);
+            this._size -= entry.size;
+            this._evictions++;
+
+            void entry.lora.dispose()
+                .catch(() => void 0);
+        }
+    }
+}
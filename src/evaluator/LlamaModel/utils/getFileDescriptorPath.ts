@@ -0,0 +1,22 @@
+import process from "process";
+
+/**
+ * Get a path that opens the file that the given file descriptor of this process refers to,
+ * including files that don't have a path on the filesystem, such as a `memfd` or a POSIX shared memory object.
+ */
+export function getFileDescriptorPath(fileDescriptor: number) {
+    if (!Number.isInteger(fileDescriptor) || fileDescriptor < 0)
+        throw new Error(`Invalid file descriptor: ${fileDescriptor}`);
+
+    // on Linux, opening `/proc/self/fd/<fd>` creates a new open file description of the same file,
+    // so reading the file doesn't move the offset of the given file descriptor
+    if (process.platform === "linux")
+        return `/proc/self/fd/${fileDescriptor}`;
+
+    // on macOS, opening `/dev/fd/<fd>` duplicates the given file descriptor,
+    // so the file is read through the same open file description and reading it moves the offset of the given file descriptor
+    if (process.platform === "darwin")
+        return `/dev/fd/${fileDescriptor}`;
+
+    throw new Error(`Loading a model from a file descriptor is not supported on ${process.platform}`);
+}
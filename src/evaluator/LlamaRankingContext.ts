@@ -29,6 +29,15 @@ export type LlamaRankingContextOptions = {
     /** prompt processing batch size */
     batchSize?: number,
 
+    /**
+     * The number of documents to evaluate in parallel when using `rankAll`, `rankBatch` or `rankAndSort`.
+     *
+     * Each sequence reserves its own context space, so the context memory usage grows with the number of sequences.
+     *
+     * Defaults to `1`.
+     */
+    sequences?: number,
+
     /**
      * number of threads to use to evaluate tokens.
      * set to 0 to use the maximum threads supported by the current machine hardware
@@ -70,6 +79,7 @@ export class LlamaRankingContext {
     /** @internal */ private readonly _llamaContext: LlamaContext;
     /** @internal */ private readonly _template: string | undefined;
     /** @internal */ private readonly _sequence: LlamaContextSequence;
+    /** @internal */ private readonly _sequences: LlamaContextSequence[];
     /** @internal */ private readonly _disposeAggregator = new AsyncDisposeAggregator();
 
     public readonly onDispose = new EventRelay<void>();
@@ -84,6 +94,10 @@ export class LlamaRankingContext {
         this._llamaContext = _llamaContext;
         this._template = _template;
         this._sequence = this._llamaContext.getSequence();
+        this._sequences = [this._sequence];
+
+        while (this._llamaContext.sequencesLeft > 0)
+            this._sequences.push(this._llamaContext.getSequence());
 
         this._disposeAggregator.add(
             this._llamaContext.onDispose.createListener(() => {
@@ -122,7 +136,20 @@ export class LlamaRankingContext {
      * @returns an array of ranking scores between 0 and 1 representing the probability that the document is relevant to the query.
      */
     public async rankAll(query: Token[] | string | LlamaText, documents: Array<Token[] | string | LlamaText>): Promise<number[]> {
-        const resolvedTokens = documents.map((document) => this._getEvaluationInput(query, document));
+        return Array.from(await this.rankBatch(query, documents));
+    }
+
+    /**
+     * Same as `rankAll`, but returns the ranking scores in a `Float32Array`.
+     *
+     * The documents are evaluated together in the same batch on all the context sequences (see the `sequences` option),
+     * and the tokens of the query are tokenized only once.
+     */
+    public async rankBatch(query: Token[] | string | LlamaText, documents: Array<Token[] | string | LlamaText>): Promise<Float32Array> {
+        const resolvedQuery = query instanceof Array
+            ? query
+            : tokenizeInput(query, this._llamaContext.model.tokenizer, "trimLeadingSpace", false);
+        const resolvedTokens = documents.map((document) => this._getEvaluationInput(resolvedQuery, document));
         const maxInputTokensLength = resolvedTokens.reduce((max, tokens) => Math.max(max, tokens.length), 0);
 
         if (maxInputTokensLength > this._llamaContext.contextSize)
@@ -131,12 +158,8 @@ export class LlamaRankingContext {
                 `Try to increase the context size to at least ${maxInputTokensLength + 1} ` +
                 "or use another model that supports longer contexts."
             );
-        else if (resolvedTokens.length === 0)
-            return [];
 
-        return await Promise.all(
-            resolvedTokens.map((tokens) => this._evaluateRankingForInput(tokens))
-        );
+        return await this._evaluateRankingForInputs(resolvedTokens);
     }
 
     /**
@@ -257,6 +280,67 @@ export class LlamaRankingContext {
         });
     }
 
+    /** @internal */
+    private async _evaluateRankingForInputs(inputs: Token[][]): Promise<Float32Array> {
+        const scores = new Float32Array(inputs.length);
+        const batchSize = this._llamaContext.batchSize;
+        const batchedInputIndexes: number[] = [];
+        const longInputIndexes: number[] = [];
+
+        for (let i = 0; i < inputs.length; i++) {
+            const inputLength = inputs[i]!.length;
+
+            if (inputLength === 0)
+                continue;
+            else if (inputLength <= batchSize)
+                batchedInputIndexes.push(i);
+            else
+                longInputIndexes.push(i);
+        }
+
+        if (batchedInputIndexes.length > 0) {
+            // every input keeps at least one token of its own, so its score is read from a token that is evaluated for it
+            const prefixLength = Math.min(
+                getCommonPrefixLength(batchedInputIndexes.map((index) => inputs[index]!)),
+                Math.min(...batchedInputIndexes.map((index) => inputs[index]!.length)) - 1
+            );
+            const inputLengths = Uint32Array.from(batchedInputIndexes, (index) => inputs[index]!.length - prefixLength);
+            const tokens = new Uint32Array(inputLengths.reduce((sum, length) => sum + length, 0));
+            let tokensOffset = 0;
+            for (const index of batchedInputIndexes) {
+                tokens.set(inputs[index]!.slice(prefixLength), tokensOffset);
+                tokensOffset += inputs[index]!.length - prefixLength;
+            }
+
+            const batchedScores = await withLock([this as LlamaRankingContext, "evaluate"], async () => {
+                for (const sequence of this._sequences)
+                    await sequence.eraseContextTokenRanges([{
+                        start: 0,
+                        end: sequence.nextTokenIndex
+                    }]);
+
+                return await this._llamaContext._runNativeDecodeJob(() => (
+                    this._llamaContext._ctx.rankBatch(
+                        Uint32Array.from(inputs[batchedInputIndexes[0]!]!.slice(0, prefixLength)),
+                        tokens,
+                        inputLengths,
+                        Uint32Array.from(this._sequences, (sequence) => sequence._sequenceId),
+                        !this._currentArchRankingAlreadyNormalized
+                    )
+                ));
+            });
+
+            for (let i = 0; i < batchedInputIndexes.length; i++)
+                scores[batchedInputIndexes[i]!] = batchedScores[i]!;
+        }
+
+        // inputs that don't fit in a single batch are evaluated on their own
+        for (const index of longInputIndexes)
+            scores[index] = await this._evaluateRankingForInput(inputs[index]!);
+
+        return scores;
+    }
+
     /** @internal */
     private get _currentArchRankingAlreadyNormalized() {
         const architecture = this.model.fileInfo.metadata?.general?.architecture;
@@ -273,6 +357,7 @@ export class LlamaRankingContext {
     }, {
         contextSize,
         batchSize,
+        sequences,
         threads = 6,
         createSignal,
         template,
@@ -299,6 +384,7 @@ export class LlamaRankingContext {
         const llamaContext = await _model.createContext({
             contextSize,
             batchSize,
+            sequences,
             threads,
             createSignal,
             ignoreMemorySafetyChecks,
@@ -316,3 +402,21 @@ export class LlamaRankingContext {
 function logitToSigmoid(logit: number) {
     return 1 / (1 + Math.exp(-logit));
 }
+
+function getCommonPrefixLength(inputs: Token[][]) {
+    if (inputs.length === 0)
+        return 0;
+
+    const firstInput = inputs[0]!;
+    let prefixLength = firstInput.length;
+    for (let i = 1; i < inputs.length && prefixLength > 0; i++) {
+        const input = inputs[i]!;
+        const maxLength = Math.min(prefixLength, input.length);
+
+        prefixLength = 0;
+        while (prefixLength < maxLength && input[prefixLength] === firstInput[prefixLength])
+            prefixLength++;
+    }
+
+    return prefixLength;
+}
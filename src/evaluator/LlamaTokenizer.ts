@@ -0,0 +1,217 @@
+import path from "path";
+import process from "process";
+import {DisposeAggregator, DisposedError, EventRelay} from "lifecycle-utils";
+import {AddonTokenizer} from "../bindings/AddonTypes.js";
+import {DisposalPreventionHandle} from "../utils/DisposeGuard.js";
+import {Token} from "../types.js";
+import type {Llama} from "../bindings/Llama.js";
+
+export type LlamaTokenizerOptions = {
+    /**
+     * Path to a GGUF model file on the filesystem.
+     *
+     * Only the metadata of the file is read, and the tokenizer doesn't keep the tensor info in memory.
+     */
+    modelPath: string,
+
+    /**
+     * Attach to a tokenizer that's loaded in another thread of this process instead of loading it again,
+     * using a handle created by calling `.getShareHandle()` on it.
+     *
+     * Loading fails if all the tokenizers that use the handle's vocabulary are disposed.
+     */
+    shareHandle?: LlamaTokenizerShareHandle
+};
+
+/**
+ * A handle to a loaded tokenizer that can be passed to other `worker_threads` (using `postMessage`)
+ * to use the same vocabulary in them.
+ *
+ * Create it by calling `.getShareHandle()` on a tokenizer, and pass it to the `shareHandle` option of `.loadTokenizer()`.
+ */
+export type LlamaTokenizerShareHandle = {
+    readonly modelPath: string,
+    readonly handle: number
+};
+
+/**
+ * A tokenizer loaded from the metadata of a GGUF model file, without loading the model weights.
+ *
+ * Create it by calling `llama.loadTokenizer(...)`.
+ */
+export class LlamaTokenizer {
+    /** @internal */ private readonly _llama: Llama;
+    /** @internal */ private readonly _tokenizer: AddonTokenizer;
+    /** @internal */ private readonly _modelPath: string;
+    /** @internal */ private readonly _llamaPreventDisposalHandle: DisposalPreventionHandle;
+    /** @internal */ private readonly _disposeAggregator = new DisposeAggregator();
+    /** @internal */ private _disposed: boolean = false;
+
+    public readonly onDispose = new EventRelay<void>();
+
+    private constructor({modelPath}: LlamaTokenizerOptions, {_llama}: {_llama: Llama}) {
+        this._llama = _llama;
+        this._modelPath = path.resolve(process.cwd(), modelPath);
+        this._tokenizer = new this._llama._bindings.AddonTokenizer();
+        this._llamaPreventDisposalHandle = this._llama._backendDisposeGuard.createPreventDisposalHandle();
+
+        this._disposeAggregator.add(
+            this._llama.onDispose.createListener(() => {
+                this.dispose();
+            })
+        );
+        this._disposeAggregator.add(() => {
+            this._tokenizer.dispose();
+            this._llamaPreventDisposalHandle.dispose();
+        });
+        this._disposeAggregator.add(this.onDispose.dispatchEvent);
+    }
+
+    public dispose() {
+        if (this._disposed)
+            return;
+
+        this._disposed = true;
+        this._disposeAggregator.dispose();
+    }
+
+    /** @hidden */
+    public [Symbol.dispose]() {
+        this.dispose();
+    }
+
+    public get disposed() {
+        return this._disposed;
+    }
+
+    public get modelPath() {
+        return this._modelPath;
+    }
+
+    public get vocabularySize(): number {
+        this._ensureNotDisposed();
+
+        return this._tokenizer.getVocabularySize();
+    }
+
+    public get shouldPrependBosToken(): boolean {
+        this._ensureNotDisposed();
+
+        return this._tokenizer.shouldPrependBosToken();
+    }
+
+    public get shouldAppendEosToken(): boolean {
+        this._ensureNotDisposed();
+
+        return this._tokenizer.shouldAppendEosToken();
+    }
+
+    /**
+     * Transform text into tokens that can be fed to a model of the same vocabulary
+     * @param text - the text to tokenize
+     * @param [specialTokens] - if set to true, text that correspond to special tokens will be tokenized to those tokens.
+     * For example, `<s>` will be tokenized to the BOS token if `specialTokens` is set to `true`,
+     * otherwise it will be tokenized to tokens that corresponds to the plaintext `<s>` string.
+     */
+    public tokenize(text: string, specialTokens: boolean = false): Token[] {
+        this._ensureNotDisposed();
+
+        if (text === "")
+            return [];
+
+        return Array.from(this._tokenizer.tokenize(text, specialTokens)) as Token[];
+    }
+
+    /**
+     * Transform tokens into text
+     * @param tokens - the tokens to detokenize.
+     * @param [specialTokens] - if set to `true`, special tokens will be detokenized to their corresponding token text representation.
+     */
+    public detokenize(tokens: readonly Token[], specialTokens: boolean = false): string {
+        this._ensureNotDisposed();
+
+        if (tokens.length === 0)
+            return "";
+
+        return this._tokenizer.detokenize(Uint32Array.from(tokens), specialTokens);
+    }
+
+    /**
+     * Get the number of tokens the given text would be tokenized to, without creating the tokens array.
+     *
+     * The result is the same as `tokenizer.tokenize(text, specialTokens).length`.
+     * @param text - the text to count the tokens of.
+     * When given an array of texts, the tokens of each text are counted separately in a single call to the native addon.
+     * @param [specialTokens] - whether to tokenize text that correspond to special tokens to those tokens.
+     */
+    public countTokens(text: string, specialTokens?: boolean): number;
+    public countTokens(text: readonly string[], specialTokens?: boolean): number[];
+    public countTokens(text: string | readonly string[], specialTokens: boolean = false): number | number[] {
+        this._ensureNotDisposed();
+
+        if (typeof text !== "string")
+            return Array.from(this._tokenizer.countTokens(text as string[], specialTokens));
+
+        if (text === "")
+            return 0;
+
+        return this._tokenizer.countTokens(text, specialTokens);
+    }
+
+    public isEogToken(token: Token): boolean {
+        this._ensureNotDisposed();
+
+        return this._tokenizer.isEogToken(token);
+    }
+
+    /**
+     * Create a handle that can be passed to other `worker_threads` (using `postMessage`)
+     * to attach to this tokenizer in them without loading it again, using the `shareHandle` option of `.loadTokenizer()`.
+     *
+     * The vocabulary stays loaded as long as any tokenizer that uses it isn't disposed.
+     */
+    public getShareHandle(): LlamaTokenizerShareHandle {
+        this._ensureNotDisposed();
+
+        return {
+            modelPath: this._modelPath,
+            handle: this._tokenizer.getShareHandle()
+        };
+    }
+
+    /** @internal */
+    private _ensureNotDisposed() {
+        if (this._disposed)
+            throw new DisposedError();
+    }
+
+    /** @internal */
+    public static async _create(options: LlamaTokenizerOptions, {_llama}: {_llama: Llama}) {
+        const {shareHandle} = options;
+        const tokenizer = new LlamaTokenizer(options, {_llama});
+
+        try {
+            if (shareHandle != null) {
+                if (tokenizer._modelPath !== shareHandle.modelPath)
+                    throw new Error("The share handle was created for a different model file");
+                else if (!tokenizer._tokenizer.attach(shareHandle.handle))
+                    throw new Error("The shared tokenizer is no longer loaded");
+
+                return tokenizer;
+            }
+
+            const ggufMetadata = new _llama._bindings.AddonGgufMetadata();
+            try {
+                await ggufMetadata.init([tokenizer._modelPath]);
+                await tokenizer._tokenizer.init(ggufMetadata);
+            } finally {
+                void ggufMetadata.dispose();
+            }
+
+            return tokenizer;
+        } catch (err) {
+            tokenizer.dispose();
+            throw err;
+        }
+    }
+}
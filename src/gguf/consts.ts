@@ -13,3 +13,6 @@ export const noDirectSubNestingGGufMetadataKeys: readonly string[] = [
     "general.license",
     "tokenizer.chat_template"
 ];
+
+// metadata arrays with at least this many items are only decoded when accessed when reading GGUF files with `lazyMetadataArrays`
+export const lazyGgufMetadataArrayMinLength = 1024;
@@ -0,0 +1,34 @@
+import {GgufReadOffset} from "../utils/GgufReadOffset.js";
+import {GgufFileReader} from "./GgufFileReader.js";
+
+type GgufBufferFileReaderOptions = {
+    buffer: Buffer
+};
+
+export class GgufBufferFileReader extends GgufFileReader {
+    public constructor({buffer}: GgufBufferFileReaderOptions) {
+        super();
+        this._buffer = buffer;
+    }
+
+    public readByteRange(offset: number | GgufReadOffset, length: number) {
+        const readOffset = GgufReadOffset.resolveReadOffset(offset);
+        const endOffset = readOffset.offset + length;
+
+        if (endOffset > this._buffer.length)
+            throw new Error("Expected buffer to be long enough for the requested byte range");
+
+        // copied, so a file info that holds the result doesn't keep the entire buffer (including the tensor data) from being released
+        const res = Buffer.from(this._buffer.subarray(readOffset.offset, endOffset));
+        readOffset.moveBy(length);
+        return res;
+    }
+
+    protected ensureHasByteRange(offset: number | GgufReadOffset, length: number) {
+        const readOffset = GgufReadOffset.resolveReadOffset(offset);
+        const endOffset = readOffset.offset + length;
+
+        if (endOffset > this._buffer.length)
+            throw new Error("Expected buffer to be long enough for the requested byte range");
+    }
+}
@@ -1,7 +1,9 @@
 import {acquireLock, withLock} from "lifecycle-utils";
 import bytes from "bytes";
 import {Llama} from "../../bindings/Llama.js";
-import {doesLlamaBackendNeedAddonInitLock, LlamaLocks, LlamaLogLevel} from "../../bindings/types.js";
+import {
+    canLlamaBackendCreateContextsConcurrently, doesLlamaBackendNeedAddonInitLock, LlamaLocks, LlamaLogLevel
+} from "../../bindings/types.js";
 import {getLlamaWithoutBackend} from "../../bindings/utils/getLlamaWithoutBackend.js";
 import {getDefaultContextBatchSize, getDefaultContextSequences} from "../../evaluator/LlamaContext/LlamaContext.js";
 import {GgufFileInfo} from "../types/GgufFileInfoTypes.js";
@@ -22,6 +24,30 @@ export type GgufInsightsResourceRequirements = {
     gpuVram: number
 };
 
+type ContextResourceRequirementsOptions = {
+    contextSize: number, modelGpuLayers: number, batchSize?: number, sequences?: number, isEmbeddingContext?: boolean,
+    flashAttention?: LlamaContextOptions["flashAttention"], swaFullCache?: boolean,
+    kvCacheKeyType?: GgmlType, kvCacheValueType?: GgmlType,
+    useMmap?: boolean,
+
+    /** @internal */
+    _simulatorSession?: GgufInsightsSimulatorSession
+};
+
+type ContextResourceGridConfig = {
+    contextSize: number,
+    batchSize: number,
+    sequences: number,
+    isEmbeddingContext?: boolean,
+    flashAttention?: LlamaContextOptions["flashAttention"],
+    swaFullCache?: boolean,
+    kvCacheKeyType?: GgmlType,
+    kvCacheValueType?: GgmlType
+};
+
+// the number of values of each configuration in the packed configurations array of `estimateContextResourceGrid`
+const contextResourceGridConfigSize = 8;
+
 export class GgufInsights {
     /** @internal */ public readonly _llama: Llama;
     /** @internal */ private readonly _modelSize: number;
@@ -34,7 +60,7 @@ export class GgufInsights {
     /** @internal */ private readonly _configurationResolver: GgufInsightsConfigurationResolver;
     /** @internal */ private readonly _tokens: GgufInsightsTokens;
     /** @internal */ private readonly _exactModelResourceRequirementsCache = new LruCache<string, GgufInsightsResourceRequirements>(40);
-    /** @internal */ private readonly _exactContextResourceRequirementsCache = new LruCache<string, GgufInsightsResourceRequirements>(40);
+    /** @internal */ private readonly _exactContextResourceRequirementsCache = new LruCache<string, GgufInsightsResourceRequirements>(128);
     /** @internal */ private readonly _simulationSession: GgufInsightsSimulatorSession;
     /** @internal */ private readonly _locks = {};
 
@@ -724,15 +750,9 @@ export class GgufInsights {
         };
     }
 
-    public async estimateContextResourceRequirementsV2(options: {
-        contextSize: number, modelGpuLayers: number, batchSize?: number, sequences?: number, isEmbeddingContext?: boolean,
-        flashAttention?: LlamaContextOptions["flashAttention"], swaFullCache?: boolean,
-        kvCacheKeyType?: GgmlType, kvCacheValueType?: GgmlType,
-        useMmap?: boolean,
-
-        /** @internal */
-        _simulatorSession?: GgufInsightsSimulatorSession
-    }): Promise<GgufInsightsResourceRequirements> {
+    public async estimateContextResourceRequirementsV2(
+        options: ContextResourceRequirementsOptions
+    ): Promise<GgufInsightsResourceRequirements> {
         const {
             contextSize, modelGpuLayers, batchSize, sequences, isEmbeddingContext = false, flashAttention = "auto",
             swaFullCache = false,
@@ -765,6 +785,41 @@ export class GgufInsights {
                 this._llama._log(LlamaLogLevel.warn, error?.message ?? String(error));
         }
 
+        return this._estimateContextResourceRequirementsHeuristically(options);
+    }
+
+    /**
+     * Estimate the resource requirements of many context configurations at once.
+     *
+     * The configurations that are not cached are simulated together in a single native call for each model GPU layers count,
+     * and the estimation heuristic is used for configurations that cannot be simulated.
+     * @internal
+     */
+    public async _estimateContextResourceRequirementsGrid(
+        optionsList: ContextResourceRequirementsOptions[]
+    ): Promise<GgufInsightsResourceRequirements[]> {
+        let simulationResults: Array<GgufInsightsResourceRequirements | null> = optionsList.map(() => null);
+
+        try {
+            simulationResults = await this._simulateContextResourceUsageGrid(optionsList);
+        } catch (error: any) {
+            if (optionsList.some((options) => options._simulatorSession?.disposed))
+                this._llama._log(LlamaLogLevel.debug, error?.message ?? String(error));
+            else
+                this._llama._log(LlamaLogLevel.warn, error?.message ?? String(error));
+        }
+
+        return simulationResults.map((simulationResult, index) => (
+            simulationResult ?? this._estimateContextResourceRequirementsHeuristically(optionsList[index]!)
+        ));
+    }
+
+    /** @internal */
+    private _estimateContextResourceRequirementsHeuristically({
+        contextSize, modelGpuLayers, batchSize, sequences, isEmbeddingContext = false, flashAttention = "auto",
+        swaFullCache = false,
+        kvCacheKeyType = GgmlType.F16, kvCacheValueType = GgmlType.F16
+    }: ContextResourceRequirementsOptions) {
         return this.estimateContextResourceRequirements({
             contextSize,
             modelGpuLayers,
@@ -785,35 +840,13 @@ export class GgufInsights {
 
     /** @internal */
     public async _simulateContextResourceUsage({
-        contextSize, modelGpuLayers, batchSize, sequences, isEmbeddingContext = false, flashAttention = "auto",
-        swaFullCache = false, useMmap = this._getUseMmap(),
-        kvCacheKeyType = GgmlType.F16, kvCacheValueType = GgmlType.F16,
-        simulatorSession = this._simulationSession
-    }: {
-        contextSize: number, modelGpuLayers: number, batchSize?: number, sequences?: number, isEmbeddingContext?: boolean,
-        flashAttention?: LlamaContextOptions["flashAttention"], swaFullCache?: boolean, useMmap?: boolean,
-        kvCacheKeyType?: GgmlType, kvCacheValueType?: GgmlType,
+        simulatorSession = this._simulationSession,
+        ...options
+    }: Omit<ContextResourceRequirementsOptions, "_simulatorSession"> & {
         simulatorSession?: GgufInsightsSimulatorSession
     }): Promise<GgufInsightsResourceRequirements | null> {
-        if (sequences == null) sequences = getDefaultContextSequences();
-        if (batchSize == null) batchSize = getDefaultContextBatchSize({contextSize, sequences});
-
-        const kvUnified = false;
+        const {cacheKey, useMmap, config} = this._getContextResourceSimulationConfig(options);
 
-        const cacheKey = [
-            contextSize,
-            modelGpuLayers,
-            batchSize,
-            sequences,
-            Number(isEmbeddingContext),
-            flashAttention === "auto"
-                ? "auto"
-                : String(flashAttention),
-            Number(swaFullCache),
-            Number(useMmap),
-            kvCacheKeyType,
-            kvCacheValueType
-        ].join(":");
         const cachedValue = this._exactContextResourceRequirementsCache.get(cacheKey);
         if (cachedValue != null)
             return {...cachedValue};
@@ -830,28 +863,11 @@ export class GgufInsights {
     
             let contextResources: GgufInsightsResourceRequirements;
             try {
-                const paddedContextSize = padSafeContextSize(contextSize, "up");
-                const actualContextSize = kvUnified
-                    ? padSafeContextSize(sequences * contextSize, "up")
-                    : sequences * paddedContextSize;
-                const actualBatchSize = Math.max(batchSize, sequences) + (
-                    (!swaFullCache && this.swaSize != null && this.swaSize > 0)
-                        ? 1 // +1 to handle edge cases with SWA KV cache
-                        : 0
-                );
-
                 contextResources = await simulatorSession.estimateContextResources({
                     modelSource: simulatorSource,
-                    gpuLayers: modelGpuLayers,
-                    contextSize: actualContextSize,
-                    batchSize: actualBatchSize,
-                    sequences,
-                    isEmbeddingContext,
-                    flashAttention,
-                    swaFullCache,
+                    gpuLayers: options.modelGpuLayers,
                     useMmap,
-                    kvCacheKeyType,
-                    kvCacheValueType
+                    ...config
                 });
             } catch (error: any) {
                 throw new Error("Failed simulating context resource usage. Falling back to estimation heuristic. Error: " + (error?.message ?? String(error)));
@@ -869,6 +885,144 @@ export class GgufInsights {
         }
     }
 
+    /**
+     * Simulate the resource usage of many context configurations,
+     * evaluating all the uncached configurations that share a simulator session, GPU layers count and mmap usage in a single native call.
+     *
+     * Configurations that could not be simulated are resolved to `null`
+     * @internal
+     */
+    public async _simulateContextResourceUsageGrid(
+        optionsList: ContextResourceRequirementsOptions[]
+    ): Promise<Array<GgufInsightsResourceRequirements | null>> {
+        const res: Array<GgufInsightsResourceRequirements | null> = optionsList.map(() => null);
+        const groups = new Map<GgufInsightsSimulatorSession, Map<string, {
+            gpuLayers: number,
+            useMmap: boolean,
+            items: Map<string, {config: ContextResourceGridConfig, indexes: number[]}>
+        }>>();
+
+        for (let i = 0; i < optionsList.length; i++) {
+            const {_simulatorSession: simulatorSession = this._simulationSession, ...options} = optionsList[i]!;
+            const {cacheKey, useMmap, config} = this._getContextResourceSimulationConfig(options);
+
+            const cachedValue = this._exactContextResourceRequirementsCache.get(cacheKey);
+            if (cachedValue != null) {
+                res[i] = {...cachedValue};
+                continue;
+            }
+
+            if (!groups.has(simulatorSession))
+                groups.set(simulatorSession, new Map());
+
+            const sessionGroups = groups.get(simulatorSession)!;
+            const groupKey = `${options.modelGpuLayers}:${Number(useMmap)}`;
+            if (!sessionGroups.has(groupKey))
+                sessionGroups.set(groupKey, {gpuLayers: options.modelGpuLayers, useMmap, items: new Map()});
+
+            const groupItems = sessionGroups.get(groupKey)!.items;
+            if (!groupItems.has(cacheKey))
+                groupItems.set(cacheKey, {config, indexes: []});
+
+            groupItems.get(cacheKey)!.indexes.push(i);
+        }
+
+        if (groups.size === 0)
+            return res;
+
+        const simulatorSource = await this._resolveSimulatorSource();
+        if (simulatorSource == null)
+            return res;
+
+        for (const [simulatorSession, sessionGroups] of groups) {
+            for (const {gpuLayers, useMmap, items} of sessionGroups.values()) {
+                const cacheKeys = [...items.keys()];
+
+                let gridResults: Array<GgufInsightsResourceRequirements | null>;
+                try {
+                    gridResults = await simulatorSession.estimateContextResourceGrid({
+                        modelSource: simulatorSource,
+                        gpuLayers,
+                        useMmap,
+                        configs: cacheKeys.map((cacheKey) => items.get(cacheKey)!.config)
+                    });
+                } catch (error: any) {
+                    throw new Error("Failed simulating context resource usage. Falling back to estimation heuristic. Error: " + (error?.message ?? String(error)));
+                }
+
+                for (let i = 0; i < cacheKeys.length; i++) {
+                    const cacheKey = cacheKeys[i]!;
+                    const gridResult = gridResults[i];
+                    if (gridResult == null)
+                        continue;
+
+                    const resourceRequirements = {
+                        cpuRam: gridResult.cpuRam,
+                        gpuVram: gridResult.gpuVram
+                    } satisfies GgufInsightsResourceRequirements;
+                    this._exactContextResourceRequirementsCache.set(cacheKey, resourceRequirements);
+
+                    for (const index of items.get(cacheKey)!.indexes)
+                        res[index] = {...resourceRequirements};
+                }
+            }
+        }
+
+        return res;
+    }
+
+    /** @internal */
+    private _getContextResourceSimulationConfig({
+        contextSize, modelGpuLayers, batchSize, sequences, isEmbeddingContext = false, flashAttention = "auto",
+        swaFullCache = false, useMmap = this._getUseMmap(),
+        kvCacheKeyType = GgmlType.F16, kvCacheValueType = GgmlType.F16
+    }: Omit<ContextResourceRequirementsOptions, "_simulatorSession">) {
+        if (sequences == null) sequences = getDefaultContextSequences();
+        if (batchSize == null) batchSize = getDefaultContextBatchSize({contextSize, sequences});
+
+        const kvUnified = false;
+
+        const cacheKey = [
+            contextSize,
+            modelGpuLayers,
+            batchSize,
+            sequences,
+            Number(isEmbeddingContext),
+            flashAttention === "auto"
+                ? "auto"
+                : String(flashAttention),
+            Number(swaFullCache),
+            Number(useMmap),
+            kvCacheKeyType,
+            kvCacheValueType
+        ].join(":");
+
+        const paddedContextSize = padSafeContextSize(contextSize, "up");
+        const actualContextSize = kvUnified
+            ? padSafeContextSize(sequences * contextSize, "up")
+            : sequences * paddedContextSize;
+        const actualBatchSize = Math.max(batchSize, sequences) + (
+            (!swaFullCache && this.swaSize != null && this.swaSize > 0)
+                ? 1 // +1 to handle edge cases with SWA KV cache
+                : 0
+        );
+
+        return {
+            cacheKey,
+            useMmap,
+            config: {
+                contextSize: actualContextSize,
+                batchSize: actualBatchSize,
+                sequences,
+                isEmbeddingContext,
+                flashAttention,
+                swaFullCache,
+                kvCacheKeyType,
+                kvCacheValueType
+            } satisfies ContextResourceGridConfig
+        };
+    }
+
     /**
      * Get the split tensor resources for CPU and GPU based on the number of GPU layers
      * @internal
@@ -1290,6 +1444,91 @@ export class GgufInsightsSimulatorSession {
         }
     }
 
+    /**
+     * Estimate the resources of many context configurations in a single native call,
+     * creating the contexts of the configurations without allocating their memory.
+     *
+     * The contexts are only created in parallel on the CPU backend, since creating contexts concurrently isn't safe on GPU backends.
+     *
+     * Configurations that a context cannot be created with are resolved to `null`
+     */
+    public async estimateContextResourceGrid({
+        modelSource,
+        gpuLayers,
+        useMmap = false,
+        configs
+    }: {
+        modelSource: string | AddonGgufMetadata,
+        gpuLayers: number,
+        useMmap?: boolean,
+        configs: ContextResourceGridConfig[]
+    }): Promise<Array<GgufInsightsResourceRequirements | null>> {
+        if (configs.length === 0)
+            return [];
+
+        const model = await this._getModel({source: modelSource, gpuLayers, useMmap});
+
+        const packedConfigs = new Int32Array(configs.length * contextResourceGridConfigSize);
+        for (let i = 0; i < configs.length; i++) {
+            const {
+                contextSize, batchSize, sequences, isEmbeddingContext = false, flashAttention = "auto", swaFullCache = false,
+                kvCacheKeyType = GgmlType.F16, kvCacheValueType = GgmlType.F16
+            } = configs[i]!;
+
+            packedConfigs.set([
+                contextSize,
+                batchSize,
+                sequences,
+                Number(isEmbeddingContext),
+                flashAttention === "auto"
+                    ? 2
+                    : Number(flashAttention),
+                Number(swaFullCache),
+                kvCacheKeyType,
+                kvCacheValueType
+            ], i * contextResourceGridConfigSize);
+        }
+
+        const needsInitLock = doesLlamaBackendNeedAddonInitLock(this._llama.gpu);
+        const loadingLock = needsInitLock
+            ? await acquireLock([this._llama._memoryLock, LlamaLocks.addonInit])
+            : undefined;
+        const disposeLogLevelOverride = this._llama._createLogLevelOverride(LlamaLogLevel.error);
+        let packedResults: Float64Array;
+        try {
+            packedResults = await this._llama._bindings.estimateContextResourceGrid(
+                model,
+                packedConfigs,
+                canLlamaBackendCreateContextsConcurrently(this._llama.gpu)
+                    ? this._llama.cpuMathCores
+                    : 1
+            );
+        } finally {
+            disposeLogLevelOverride();
+            loadingLock?.dispose();
+        }
+
+        const res = configs.map((config, index): GgufInsightsResourceRequirements | null => {
+            const cpuRam = packedResults[index * 2]!;
+            const gpuVram = packedResults[index * 2 + 1]!;
+
+            if (cpuRam < 0 || gpuVram < 0)
+                return null;
+
+            return {cpuRam, gpuVram};
+        });
+
+        if (this._llama._shouldLog(LlamaLogLevel.debug))
+            this._llama._log(LlamaLogLevel.debug, "Simulating context resource usage grid. " + [
+                `gpuLayers=${gpuLayers}`,
+                `useMmap=${useMmap}`,
+                `configs=${configs.length}`,
+                `failedConfigs=${res.filter((item) => item == null).length}`
+            ].join(" "));
+
+        return res;
+    }
+
     public [Symbol.asyncDispose]() {
         return this.dispose();
     }
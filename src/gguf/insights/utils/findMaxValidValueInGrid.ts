@@ -0,0 +1,80 @@
+/**
+ * Find the highest integer value in the given range that passes the test, assuming that if a value is valid, all the lower values are valid too.
+ *
+ * Each step tests evenly spaced values across the remaining range together, so a test that can evaluate many values at once
+ * (for example, in a single native call) narrows the range by a factor of `gridSize` per call instead of halving it.
+ * The `maxValue` is tested alone first, since it's valid in most cases.
+ */
+export async function findMaxValidValueInGrid<T>({
+    minValue,
+    maxValue,
+    gridSize = 16,
+    test
+}: {
+    minValue: number,
+    maxValue: number,
+    gridSize?: number,
+
+    /**
+     * Test the given ascending values.
+     * Return a result for every valid value, or `null` for every invalid value.
+     */
+    test(values: number[]): Promise<Array<T | null>>
+}): Promise<{value: number, result: T} | null> {
+    if (maxValue < minValue)
+        return null;
+
+    const [maxValueResult] = await test([maxValue]);
+    if (maxValueResult != null)
+        return {value: maxValue, result: maxValueResult};
+
+    let highestValid: {value: number, result: T} | null = null;
+    let lowestInvalidValue = maxValue;
+
+    while (true) {
+        const rangeStart = highestValid == null
+            ? minValue
+            : highestValid.value + 1;
+        const rangeEnd = lowestInvalidValue - 1;
+
+        if (rangeStart > rangeEnd)
+            break;
+
+        const values = getEvenlySpacedValues(rangeStart, rangeEnd, gridSize);
+        const results = await test(values);
+
+        let highestValidIndex = -1;
+        for (let i = values.length - 1; i >= 0; i--) {
+            if (results[i] != null) {
+                highestValidIndex = i;
+                break;
+            }
+        }
+
+        if (highestValidIndex < 0) {
+            lowestInvalidValue = values[0]!;
+            continue;
+        }
+
+        highestValid = {value: values[highestValidIndex]!, result: results[highestValidIndex]!};
+        lowestInvalidValue = values[highestValidIndex + 1] ?? lowestInvalidValue;
+    }
+
+    return highestValid;
+}
+
+function getEvenlySpacedValues(start: number, end: number, maxCount: number) {
+    const count = Math.max(1, Math.min(maxCount, end - start + 1));
+    if (count === 1)
+        return [end];
+
+    const res: number[] = [];
+    for (let i = 0; i < count; i++) {
+        const value = start + Math.round(((end - start) * i) / (count - 1));
+
+        if (res.length === 0 || res.at(-1)! < value)
+            res.push(value);
+    }
+
+    return res;
+}
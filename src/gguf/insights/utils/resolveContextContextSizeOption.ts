@@ -5,6 +5,7 @@ import {minAllowedContextSizeInCalculations} from "../../../config.js";
 import {getDefaultContextBatchSize, getDefaultModelContextSize} from "../../../evaluator/LlamaContext/LlamaContext.js";
 import {InsufficientMemoryError} from "../../../utils/InsufficientMemoryError.js";
 import {getRamUsageFromUnifiedVram} from "./getRamUsageFromUnifiedVram.js";
+import {findMaxValidValueInGrid} from "./findMaxValidValueInGrid.js";
 import type {GgmlType} from "../../types/GgufTensorInfoTypes.js";
 
 const defaultMaxContextSizeSwapUse = 2048;
@@ -113,62 +114,47 @@ export async function resolveContextContextSizeOption(options: {
                     minAllowedContextSizeInCalculations
                 );
 
-            let highestCompatibleContextSize: number | null = null;
-            let step = -Math.max(1, Math.floor((maxContextSize - minContextSize) / 4));
-            for (let testContextSize = maxContextSize; testContextSize >= minContextSize && testContextSize <= maxContextSize;) {
-                const contextResourceRequirements = await modelFileInsights.estimateContextResourceRequirementsV2({
-                    contextSize: testContextSize,
-                    batchSize: batchSize ?? getDefaultContextBatchSize({contextSize: testContextSize, sequences}),
-                    modelGpuLayers: modelGpuLayers,
-                    sequences,
-                    flashAttention,
-                    kvCacheKeyType,
-                    kvCacheValueType,
-                    swaFullCache,
-                    isEmbeddingContext,
-
-                    _simulatorSession: simulatorSession,
-                    useMmap
-                });
-
-                if (contextResourceRequirements.gpuVram <= vramState.free &&
-                    contextResourceRequirements.cpuRam <= (
-                        ramState.free - getRamUsageFromUnifiedVram(contextResourceRequirements.gpuVram, vramState) + (
-                            testContextSize <= maxContextSizeSwapUse
-                                ? swapState.free
-                                : 0
-                        )
-                    )
-                ) {
-                    if (highestCompatibleContextSize == null || testContextSize >= highestCompatibleContextSize) {
-                        highestCompatibleContextSize = testContextSize;
-
-                        if (step === -1 || testContextSize === maxContextSize)
-                            break;
-                        else if (step < 0)
-                            step = Math.max(1, Math.floor(-step / 2));
-                    } else if (testContextSize < highestCompatibleContextSize) {
-                        testContextSize = highestCompatibleContextSize;
-                        step = Math.max(1, Math.floor(Math.abs(step) / 2));
-                    }
-                } else if (step > 0)
-                    step = -Math.max(1, Math.floor(step / 2));
-
-                if (testContextSize == minContextSize && step === -1)
-                    break;
-
-                testContextSize += step;
-                if (testContextSize < minContextSize) {
-                    testContextSize = minContextSize;
-                    step = Math.max(1, Math.floor(Math.abs(step) / 2));
-                } else if (testContextSize > maxContextSize) {
-                    testContextSize = maxContextSize;
-                    step = -Math.max(1, Math.floor(Math.abs(step) / 2));
+            const highestCompatibleContextSize = await findMaxValidValueInGrid({
+                minValue: minContextSize,
+                maxValue: maxContextSize,
+                async test(testContextSizes) {
+                    const contextResourceRequirementsList = await modelFileInsights._estimateContextResourceRequirementsGrid(
+                        testContextSizes.map((testContextSize) => ({
+                            contextSize: testContextSize,
+                            batchSize: batchSize ?? getDefaultContextBatchSize({contextSize: testContextSize, sequences}),
+                            modelGpuLayers: modelGpuLayers,
+                            sequences,
+                            flashAttention,
+                            kvCacheKeyType,
+                            kvCacheValueType,
+                            swaFullCache,
+                            isEmbeddingContext,
+
+                            _simulatorSession: simulatorSession,
+                            useMmap
+                        }))
+                    );
+
+                    return contextResourceRequirementsList.map((contextResourceRequirements, index) => {
+                        const testContextSize = testContextSizes[index]!;
+                        const isCompatible = contextResourceRequirements.gpuVram <= vramState.free &&
+                            contextResourceRequirements.cpuRam <= (
+                                ramState.free - getRamUsageFromUnifiedVram(contextResourceRequirements.gpuVram, vramState) + (
+                                    testContextSize <= maxContextSizeSwapUse
+                                        ? swapState.free
+                                        : 0
+                                )
+                            );
+
+                        return isCompatible
+                            ? contextResourceRequirements
+                            : null;
+                    });
                 }
-            }
+            });
 
             if (highestCompatibleContextSize != null)
-                return highestCompatibleContextSize;
+                return highestCompatibleContextSize.value;
 
             if (ignoreMemorySafetyChecks)
                 return minContextSize;
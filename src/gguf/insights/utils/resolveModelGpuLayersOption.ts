@@ -6,6 +6,7 @@ import {getDefaultContextBatchSize, getDefaultModelContextSize} from "../../../e
 import {minAllowedContextSizeInCalculations} from "../../../config.js";
 import {ProgressTracker, ProgressTrackerTask} from "../../../utils/ProgressTracker.js";
 import {scoreLevels} from "./scoreLevels.js";
+import {findMaxValidValueInGrid} from "./findMaxValidValueInGrid.js";
 import type {LlamaContextOptions} from "../../../evaluator/LlamaContext/types.js";
 import type {GgmlType} from "../../types/GgufTensorInfoTypes.js";
 import type {GgufInsights, GgufInsightsSimulatorSession} from "../GgufInsights.js";
@@ -469,86 +470,38 @@ async function findMaxPossibleContextSizeForVram({
 }) {
     const maxContextSize = getDefaultModelContextSize({trainContextSize: ggufInsights.trainContextSize});
 
-    return findMaxValidValue({
-        maxValue: maxContextSize,
+    const res = await findMaxValidValueInGrid({
         minValue: minAllowedContextSizeInCalculations,
-        minStep: 1,
-        async test(contextSize) {
-            const contextVram = (await ggufInsights.estimateContextResourceRequirementsV2({
-                contextSize,
-                batchSize: getDefaultContextBatchSize({contextSize, sequences: 1}),
-                modelGpuLayers: gpuLayers,
-                sequences: 1,
-                isEmbeddingContext,
-                flashAttention,
-                kvCacheKeyType,
-                kvCacheValueType,
-                swaFullCache,
-
-                _simulatorSession: simulatorSession,
-                useMmap: useMmap
-            })).gpuVram;
-
-            if (contextVram <= vram)
-                return {
+        maxValue: maxContextSize,
+        async test(contextSizes) {
+            const contextResourceRequirementsList = await ggufInsights._estimateContextResourceRequirementsGrid(
+                contextSizes.map((contextSize) => ({
                     contextSize,
-                    vram: contextVram
-                };
+                    batchSize: getDefaultContextBatchSize({contextSize, sequences: 1}),
+                    modelGpuLayers: gpuLayers,
+                    sequences: 1,
+                    isEmbeddingContext,
+                    flashAttention,
+                    kvCacheKeyType,
+                    kvCacheValueType,
+                    swaFullCache,
+
+                    _simulatorSession: simulatorSession,
+                    useMmap: useMmap
+                }))
+            );
+
+            return contextResourceRequirementsList.map((contextResourceRequirements, index) => {
+                if (contextResourceRequirements.gpuVram <= vram)
+                    return {
+                        contextSize: contextSizes[index]!,
+                        vram: contextResourceRequirements.gpuVram
+                    };
 
-            return null;
+                return null;
+            });
         }
     });
-}
-
-async function findMaxValidValue<T>({
-    maxValue,
-    minValue,
-    minStep = 1,
-    test
-}: {
-    maxValue: number,
-    minValue: number,
-    minStep?: number,
-    test(value: number): Promise<T | null>
-}): Promise<T | null> {
-    let step = -Math.max(minStep, Math.floor((maxValue - minValue) / 4));
-    let bestValue: null | {value: number, result: T} = null;
-
-    for (let value = maxValue; value >= minValue;) {
-        const result: T | null = (bestValue != null && value === bestValue.value)
-            ? bestValue.result
-            : await test(value);
-
-        if (result != null && (bestValue == null || value >= bestValue.value)) {
-            bestValue = {value: value, result: result};
-
-            if (step === -minStep || value === maxValue)
-                break;
-            else if (step < 0)
-                step = Math.max(minStep, Math.floor(-step / 2));
-        } else if (bestValue != null && value < bestValue.value) {
-            value = bestValue.value;
-            step = Math.max(minStep, Math.floor(Math.abs(step) / 2));
-        } else if (step > 0)
-            step = -Math.max(minStep, Math.floor(step / 2));
-
-        if (value === minValue && step === -minStep)
-            break;
-
-        value += step;
-        if (value < minValue) {
-            value = bestValue != null
-                ? Math.max(bestValue.value, minValue)
-                : minValue;
-            step = Math.max(minStep, Math.floor(Math.abs(step) / 2));
-        } else if (value > maxValue) {
-            value = maxValue;
-            step = -Math.max(minStep, Math.floor(Math.abs(step) / 2));
-        }
-    }
-
-    if (bestValue != null)
-        return bestValue.result;
 
-    return null;
+    return res?.result ?? null;
 }
@@ -1,4 +1,5 @@
-import {GgufFileReader} from "../fileReaders/GgufFileReader.js";
+import {GgufFileReader, valueTypeToBytesToRead} from "../fileReaders/GgufFileReader.js";
+import {GgufFsFileReader} from "../fileReaders/GgufFsFileReader.js";
 import {GgufReadOffset} from "../utils/GgufReadOffset.js";
 import {UnsupportedGgufValueTypeError} from "../errors/UnsupportedGgufValueTypeError.js";
 import {
@@ -7,11 +8,25 @@ import {
 import {GgufMetadata} from "../types/GgufMetadataTypes.js";
 import {GgmlType, GgufTensorInfo} from "../types/GgufTensorInfoTypes.js";
 import {convertMetadataKeyValueRecordToNestedObject} from "../utils/convertMetadataKeyValueRecordToNestedObject.js";
+import {createLazyGgufMetadataArray} from "../utils/createLazyGgufMetadataArray.js";
 import {promisableLoop, Promisable, transformPromisable, transformPromisablesInOrder} from "../../utils/transformPromisable.js";
 import {noDirectSubNestingGGufMetadataKeys} from "../consts.js";
 import {Writable} from "../../utils/utilTypes.js";
 
 const ggufDefaultAlignment = 32;
+const ggufValueTypeItemSize: Partial<Record<GgufValueType, number>> = {
+    [GgufValueType.Uint8]: valueTypeToBytesToRead.uint8,
+    [GgufValueType.Int8]: valueTypeToBytesToRead.int8,
+    [GgufValueType.Uint16]: valueTypeToBytesToRead.uint16,
+    [GgufValueType.Int16]: valueTypeToBytesToRead.int16,
+    [GgufValueType.Uint32]: valueTypeToBytesToRead.uint32,
+    [GgufValueType.Int32]: valueTypeToBytesToRead.int32,
+    [GgufValueType.Float32]: valueTypeToBytesToRead.float32,
+    [GgufValueType.Bool]: valueTypeToBytesToRead.bool,
+    [GgufValueType.Uint64]: valueTypeToBytesToRead.uint64,
+    [GgufValueType.Int64]: valueTypeToBytesToRead.int64,
+    [GgufValueType.Float64]: valueTypeToBytesToRead.float64
+};
 
 export class GgufV2Parser {
     private readonly _fileReader: GgufFileReader;
@@ -19,13 +34,19 @@ export class GgufV2Parser {
     private readonly _ignoreKeys: string[];
     private readonly _readOffset: GgufReadOffset;
     private readonly _logWarnings: boolean;
+    private readonly _lazyArrayMinLength?: number;
 
-    public constructor({fileReader, readTensorInfo = true, ignoreKeys = [], readOffset, logWarnings}: GgufVersionParserOptions) {
+    public constructor({
+        fileReader, readTensorInfo = true, ignoreKeys = [], readOffset, logWarnings, lazyArrayMinLength
+    }: GgufVersionParserOptions) {
         this._fileReader = fileReader;
         this._shouldReadTensorInfo = readTensorInfo;
         this._ignoreKeys = ignoreKeys;
         this._readOffset = readOffset;
         this._logWarnings = logWarnings;
+        this._lazyArrayMinLength = fileReader instanceof GgufFsFileReader
+            ? lazyArrayMinLength
+            : undefined;
     }
 
     public async parse(): Promise<GgufVersionParserResult> {
@@ -84,28 +105,73 @@ export class GgufV2Parser {
             case GgufValueType.Float64: return this._fileReader.readFloat64(readOffset);
         }
 
-        if (type === GgufValueType.Array) {
-            return transformPromisablesInOrder([
-                () => this._fileReader.readUint32(readOffset),
-                () => this._fileReader.readUint64(readOffset)
-            ], ([arrayType, arrayLength]) => {
-                const arrayValues: MetadataValue[] = [];
-                let i = 0;
-
-                return promisableLoop({
-                    condition: () => i < arrayLength,
-                    callback: () => {
-                        return transformPromisable(this._readGgufValue(arrayType, readOffset), (value) => {
-                            arrayValues.push(value);
-                        });
-                    },
-                    afterthought: () => void i++,
-                    returnValue: () => arrayValues
-                });
+        if (type === GgufValueType.Array)
+            return this._readArrayValue(readOffset, false);
+
+        throw new UnsupportedGgufValueTypeError(type);
+    }
+
+    protected _readArrayValue(readOffset: GgufReadOffset, allowLazy: boolean): Promisable<MetadataValue> {
+        return transformPromisablesInOrder([
+            () => this._fileReader.readUint32(readOffset),
+            () => this._fileReader.readUint64(readOffset)
+        ], ([arrayType, arrayLength]) => {
+            if (allowLazy && this._lazyArrayMinLength != null && arrayLength >= this._lazyArrayMinLength &&
+                arrayType !== GgufValueType.Array && this._fileReader instanceof GgufFsFileReader
+            ) {
+                const filePath = this._fileReader.filePath;
+                const offset = readOffset.offset;
+
+                return transformPromisable(this._skipArrayItems(arrayType, arrayLength, readOffset), () => (
+                    createLazyGgufMetadataArray({
+                        filePath,
+                        type: arrayType,
+                        length: Number(arrayLength),
+                        offset,
+                        byteLength: readOffset.offset - offset
+                    })
+                ));
+            }
+
+            const arrayValues: MetadataValue[] = [];
+            let i = 0;
+
+            return promisableLoop({
+                condition: () => i < arrayLength,
+                callback: () => {
+                    return transformPromisable(this._readGgufValue(arrayType, readOffset), (value) => {
+                        arrayValues.push(value);
+                    });
+                },
+                afterthought: () => void i++,
+                returnValue: () => arrayValues
+            });
+        });
+    }
+
+    // move the read offset past the items of an array without decoding them
+    private _skipArrayItems(type: GgufValueType, length: bigint, readOffset: GgufReadOffset): Promisable<void> {
+        if (type === GgufValueType.String) {
+            let i = 0n;
+
+            return promisableLoop({
+                condition: () => i < length,
+                callback: () => {
+                    return transformPromisable(this._fileReader.readUint64(readOffset), (stringLength) => {
+                        readOffset.moveBy(Number(stringLength));
+                    });
+                },
+                afterthought: () => void i++,
+                returnValue: () => undefined
             });
         }
 
-        throw new UnsupportedGgufValueTypeError(type);
+        const itemSize = ggufValueTypeItemSize[type];
+        if (itemSize == null)
+            throw new UnsupportedGgufValueTypeError(type);
+
+        readOffset.moveBy(itemSize * Number(length));
+        return undefined;
     }
 
     protected _readStringValue(offset: number | GgufReadOffset) {
@@ -134,7 +200,11 @@ export class GgufV2Parser {
                     () => this._readStringValue(readOffset),
                     () => this._fileReader.readUint32(readOffset)
                 ], ([keyResult, valueType]) => {
-                    return transformPromisable(this._readGgufValue(valueType, readOffset), (value) => {
+                    const valuePromisable = valueType === GgufValueType.Array
+                        ? this._readArrayValue(readOffset, true)
+                        : this._readGgufValue(valueType, readOffset);
+
+                    return transformPromisable(valuePromisable, (value) => {
                         metadata[keyResult] = value;
                     });
                 });
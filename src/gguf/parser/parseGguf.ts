@@ -16,12 +16,14 @@ export async function parseGguf({
     fileReader,
     readTensorInfo = true,
     ignoreKeys = [],
-    logWarnings = true
+    logWarnings = true,
+    lazyArrayMinLength
 }: {
     fileReader: GgufFileReader,
     readTensorInfo?: boolean,
     ignoreKeys?: string[],
-    logWarnings?: boolean
+    logWarnings?: boolean,
+    lazyArrayMinLength?: number
 }): Promise<GgufFileInfo> {
     const readOffset = new GgufReadOffset(0);
     const magicAndVersion = await parseMagicAndVersion(fileReader, readOffset);
@@ -32,7 +34,8 @@ export async function parseGguf({
 
         version: magicAndVersion.version,
         readOffset,
-        logWarnings
+        logWarnings,
+        lazyArrayMinLength
     });
     const architectureMetadata = getGgufMetadataArchitectureData(ggufInfo.metadata);
     const sourceData: Promisable<GgufFileInfoSourceData> | undefined = ggufInfo.infoEndOffset == null
@@ -0,0 +1,169 @@
+import path from "path";
+import {AddonGgufArrayValue, AddonGgufFileHeader, AddonGgufValue, BindingModule} from "../../bindings/AddonTypes.js";
+import {GgufFileInfo, GgufValueType, MetadataKeyValueRecord, MetadataValue} from "../types/GgufFileInfoTypes.js";
+import {GgufMetadata} from "../types/GgufMetadataTypes.js";
+import {GgmlType, GgufTensorInfo} from "../types/GgufTensorInfoTypes.js";
+import {GgufFileReader} from "../fileReaders/GgufFileReader.js";
+import {convertMetadataKeyValueRecordToNestedObject} from "../utils/convertMetadataKeyValueRecordToNestedObject.js";
+import {createLazyGgufMetadataArray} from "../utils/createLazyGgufMetadataArray.js";
+import {getGgufMetadataArchitectureData} from "../utils/getGgufMetadataArchitectureData.js";
+import {noDirectSubNestingGGufMetadataKeys} from "../consts.js";
+
+const maxParallelism = 8;
+const supportedVersions = new Set([2, 3]);
+
+/**
+ * Read the GGUF file info of files on the filesystem using the native addon, which parses the files in parallel on a separate thread.
+ *
+ * Files the native parser cannot read (or that use GGUF versions it doesn't handle) resolve to `undefined`,
+ * so they can be read using `parseGguf` instead, which reports the detailed errors and warnings.
+ */
+export async function readGgufFileInfosNatively(bindings: BindingModule, filePaths: string[], {
+    readTensorInfo = true,
+    ignoreKeys = [],
+    logWarnings = true,
+    lazyArrayMinLength
+}: {
+    readTensorInfo?: boolean,
+    ignoreKeys?: string[],
+    logWarnings?: boolean,
+
+    /** Top-level metadata arrays with at least this many items are skipped and decoded only when accessed */
+    lazyArrayMinLength?: number
+} = {}): Promise<(GgufFileInfo | undefined)[]> {
+    if (filePaths.length === 0)
+        return [];
+
+    const headers = await bindings.readGgufFileHeaders(filePaths, {
+        readTensorInfo,
+        ignoreKeys,
+        lazyArrayMinLength,
+        maxParallelism: Math.min(maxParallelism, filePaths.length)
+    });
+
+    return headers.map((header, index) => {
+        if (header.error != null || !supportedVersions.has(header.version))
+            return undefined;
+
+        return createGgufFileInfoFromHeader(header, filePaths[index]!, {ignoreKeys, logWarnings});
+    });
+}
+
+function createGgufFileInfoFromHeader(
+    header: Exclude<AddonGgufFileHeader, {error: string}>,
+    filePath: string,
+    {ignoreKeys, logWarnings}: {ignoreKeys: string[], logWarnings: boolean}
+): GgufFileInfo {
+    const metadataRecord: MetadataKeyValueRecord = {};
+    const resolvedFilePath = path.resolve(process.cwd(), filePath);
+    for (let i = 0; i < header.keys.length; i++)
+        metadataRecord[header.keys[i]!] = convertValue(header.values[i]!, resolvedFilePath);
+
+    const metadata = convertMetadataKeyValueRecordToNestedObject(metadataRecord, {
+        logOverrideWarnings: logWarnings,
+        ignoreKeys,
+        noDirectSubNestingKeys: noDirectSubNestingGGufMetadataKeys
+    }) as any as GgufMetadata;
+    const tensorCount = GgufFileReader.castNumberIfSafe(header.tensorCount);
+    const tensorInfo = createTensorInfo(header);
+
+    return {
+        version: header.version,
+        tensorCount,
+        metadata,
+        infoEndOffset: header.infoEndOffset,
+        architectureMetadata: getGgufMetadataArchitectureData(metadata),
+        tensorInfo,
+        metadataSize: header.metadataSize,
+        splicedParts: 1,
+        totalTensorInfoSize: header.tensorInfoSize,
+        totalTensorCount: tensorCount,
+        totalMetadataSize: header.metadataSize,
+        sourceData: header.infoEndOffset == null
+            ? []
+            : [{
+                type: "path",
+                path: filePath,
+                length: header.infoEndOffset
+            }],
+        fullTensorInfo: tensorInfo,
+        tensorInfoSize: header.tensorInfoSize
+    };
+}
+
+function createTensorInfo(header: Exclude<AddonGgufFileHeader, {error: string}>) {
+    const {
+        infoEndOffset, tensorNames, tensorDimensionCounts, tensorDimensions, tensorTypes, tensorOffsets
+    } = header;
+
+    if (infoEndOffset == null || tensorNames == null || tensorDimensionCounts == null || tensorDimensions == null ||
+        tensorTypes == null || tensorOffsets == null
+    )
+        return undefined;
+
+    const tensorInfo: GgufTensorInfo[] = new Array(tensorNames.length);
+    let dimensionIndex = 0;
+
+    for (let i = 0; i < tensorNames.length; i++) {
+        const dimensionCount = tensorDimensionCounts[i]!;
+        const dimensions: (number | bigint)[] = new Array(dimensionCount);
+        for (let d = 0; d < dimensionCount; d++)
+            dimensions[d] = GgufFileReader.castNumberIfSafe(tensorDimensions[dimensionIndex + d]!);
+
+        dimensionIndex += dimensionCount;
+
+        const offset = GgufFileReader.castNumberIfSafe(tensorOffsets[i]!);
+        tensorInfo[i] = {
+            name: tensorNames[i]!,
+            dimensions,
+            ggmlType: tensorTypes[i]! as GgmlType,
+            offset,
+            fileOffset: typeof offset === "bigint"
+                ? BigInt(infoEndOffset) + offset
+                : infoEndOffset + offset,
+            filePart: 1
+        };
+    }
+
+    return tensorInfo;
+}
+
+function convertValue(value: AddonGgufValue, filePath: string): MetadataValue {
+    if (typeof value === "bigint")
+        return GgufFileReader.castNumberIfSafe(value);
+    else if (typeof value !== "object")
+        return value;
+    else if (value.values == null)
+        return createLazyGgufMetadataArray({
+            filePath,
+            type: value.type,
+            length: value.length,
+            offset: value.offset,
+            byteLength: value.byteLength
+        });
+
+    return convertArrayValue(value);
+}
+
+function convertArrayValue(value: AddonGgufArrayValue): MetadataValue[] {
+    if (value.values == null)
+        return [];
+
+    const {type, values, stringOffsets} = value;
+    if (values instanceof Array)
+        return values.map(convertArrayValue);
+    else if (type === GgufValueType.String && stringOffsets != null) {
+        const buffer = Buffer.from(values.buffer, values.byteOffset, values.byteLength);
+        const res: string[] = new Array(Math.max(0, stringOffsets.length - 1));
+
+        for (let i = 0; i < res.length; i++)
+            res[i] = buffer.toString("utf8", stringOffsets[i]!, stringOffsets[i + 1]!);
+
+        return res;
+    } else if (type === GgufValueType.Bool)
+        return Array.from(values as Uint8Array, (item) => item === 1);
+    else if (values instanceof BigUint64Array || values instanceof BigInt64Array)
+        return Array.from(values, GgufFileReader.castNumberIfSafe);
+
+    return Array.from(values);
+}
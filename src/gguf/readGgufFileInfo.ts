@@ -7,20 +7,27 @@ import {ModelDownloadEndpoints} from "../utils/modelDownloadEndpoints.js";
 import {parseGguf} from "./parser/parseGguf.js";
 import {GgufNetworkFetchFileReader} from "./fileReaders/GgufNetworkFetchFileReader.js";
 import {GgufFsFileReader} from "./fileReaders/GgufFsFileReader.js";
-import {ggufDefaultFetchRetryOptions} from "./consts.js";
+import {GgufBufferFileReader} from "./fileReaders/GgufBufferFileReader.js";
+import {ggufDefaultFetchRetryOptions, lazyGgufMetadataArrayMinLength} from "./consts.js";
 import {normalizeGgufDownloadUrl} from "./utils/normalizeGgufDownloadUrl.js";
 import {resolveSplitGgufParts} from "./utils/resolveSplitGgufParts.js";
-import {GgufFileInfo} from "./types/GgufFileInfoTypes.js";
+import {GgufFileInfo, GgufFileInfoSource} from "./types/GgufFileInfoTypes.js";
 import {GgufTensorInfo} from "./types/GgufTensorInfoTypes.js";
+import {readGgufFileInfosNatively} from "./parser/readGgufFileInfosNatively.js";
+import type {Llama} from "../bindings/Llama.js";
 
 
 /**
  * Read a GGUF file and return its metadata and tensor info (unless `readTensorInfo` is set to `false`).
  * Only the parts of the file required for the metadata and tensor info are read.
+ *
+ * Pass a `Buffer` with the content of a GGUF file (or an array of buffers with all the parts of a split GGUF file, in order)
+ * to read the info of a model that is already in memory.
+ * The returned file info doesn't reference the given buffers.
  * @param pathOrUri
  * @param options
  */
-export async function readGgufFileInfo(pathOrUri: string, {
+export async function readGgufFileInfo(pathOrUri: string | Buffer | readonly Buffer[], {
     readTensorInfo = true,
     sourceType,
     ignoreKeys = [],
@@ -30,7 +37,9 @@ export async function readGgufFileInfo(pathOrUri: string, {
     spliceSplitFiles = true,
     signal,
     tokens,
-    endpoints
+    endpoints,
+    llama,
+    lazyMetadataArrays = false
 }: {
     /**
      * Whether to read the tensor info from the file's header.
@@ -82,9 +91,42 @@ export async function readGgufFileInfo(pathOrUri: string, {
      * Configure the URLs used for resolving model URIs.
      * @see [Model URIs](https://node-llama-cpp.withcat.ai/guide/downloading-models#model-uris)
      */
-    endpoints?: ModelDownloadEndpoints
-} = {}) {
+    endpoints?: ModelDownloadEndpoints,
+
+    /**
+     * When provided, files on the filesystem are parsed using the native bindings of this `Llama` instance,
+     * on a separate thread, instead of being read and parsed in JavaScript.
+     *
+     * This makes reading many files (such as when scanning a models directory) much faster.
+     */
+    llama?: Llama,
+
+    /**
+     * Don't decode large metadata arrays (such as `tokenizer.ggml.tokens` and `tokenizer.ggml.merges`) when reading the file.
+     * Instead, only their type, length and location in the file are recorded,
+     * and their items are read from the file when anything other than their `length` is accessed.
+     *
+     * This greatly reduces the time and memory it takes to read the metadata of models with large vocabularies.
+     *
+     * The lazy arrays are `Proxy` objects, so they cannot be passed to `structuredClone` or `postMessage` as-is,
+     * and their items are read synchronously from the file when accessed, so the file has to stay available at the given path.
+     *
+     * Relevant only when reading from the filesystem.
+     *
+     * Defaults to `false`.
+     */
+    lazyMetadataArrays?: boolean
+} = {}): Promise<GgufFileInfo> {
+    if (typeof pathOrUri !== "string")
+        return await readGgufFileInfoFromBuffers(Buffer.isBuffer(pathOrUri) ? [pathOrUri] : pathOrUri, {
+            readTensorInfo, ignoreKeys, logWarnings, signal
+        });
+
     const useNetworkReader = sourceType === "network" || (sourceType == null && (isUrl(pathOrUri) || isModelUri(pathOrUri)));
+    const lazyArrayMinLength = lazyMetadataArrays
+        ? lazyGgufMetadataArrayMinLength
+        : undefined;
+
     function createSource(pathOrUri: string) {
         return useNetworkReader
             ? {type: "uri" as const, uri: pathOrUri}
@@ -116,13 +158,13 @@ export async function readGgufFileInfo(pathOrUri: string, {
         throw new Error(`Unsupported sourceType: ${sourceType}`);
     }
 
-    async function readSingleFile(pathOrUri: string, splitPartNumber: number = 1) {
-        const fileReader = await createFileReader(pathOrUri);
-        const res = await parseGguf({
-            fileReader,
+    async function readSingleFile(pathOrUri: string, splitPartNumber: number = 1, nativeFileInfo?: GgufFileInfo) {
+        const res = nativeFileInfo ?? await parseGguf({
+            fileReader: await createFileReader(pathOrUri),
             ignoreKeys,
             readTensorInfo,
-            logWarnings
+            logWarnings,
+            lazyArrayMinLength
         });
 
         if (splitPartNumber > 1) {
@@ -135,18 +177,76 @@ export async function readGgufFileInfo(pathOrUri: string, {
         return res;
     }
 
-    if (!spliceSplitFiles)
-        return await readSingleFile(pathOrUri);
+    async function readNativeFileInfos(paths: string[]): Promise<(GgufFileInfo | undefined)[]> {
+        if (llama == null || useNetworkReader)
+            return [];
+
+        const res = await readGgufFileInfosNatively(llama._bindings, paths, {
+            readTensorInfo,
+            ignoreKeys,
+            logWarnings,
+            lazyArrayMinLength
+        });
+        signal?.throwIfAborted();
+
+        return res;
+    }
+
+    if (!spliceSplitFiles) {
+        const [nativeFileInfo] = await readNativeFileInfos([pathOrUri]);
+        return await readSingleFile(pathOrUri, undefined, nativeFileInfo);
+    }
 
     const allSplitPartPaths = resolveSplitGgufParts(pathOrUri);
+    const nativeFileInfos = await readNativeFileInfos(allSplitPartPaths);
 
     if (allSplitPartPaths.length === 1)
-        return await readSingleFile(allSplitPartPaths[0]!);
+        return await readSingleFile(allSplitPartPaths[0]!, undefined, nativeFileInfos[0]);
 
-    const [first, ...rest] = await Promise.all(
-        allSplitPartPaths.map((partPath, index) => readSingleFile(partPath, index + 1))
+    const parts = await Promise.all(
+        allSplitPartPaths.map((partPath, index) => readSingleFile(partPath, index + 1, nativeFileInfos[index]))
     );
 
+    return spliceGgufFileInfoParts(parts, createSource(pathOrUri));
+}
+
+async function readGgufFileInfoFromBuffers(buffers: readonly Buffer[], {
+    readTensorInfo, ignoreKeys, logWarnings, signal
+}: {
+    readTensorInfo: boolean,
+    ignoreKeys: string[],
+    logWarnings: boolean,
+    signal?: AbortSignal
+}): Promise<GgufFileInfo> {
+    if (buffers.length === 0)
+        throw new Error("Expected at least one GGUF buffer");
+
+    const parts = await Promise.all(
+        buffers.map(async (buffer, index) => {
+            const res = await parseGguf({
+                fileReader: new GgufBufferFileReader({buffer}),
+                ignoreKeys,
+                readTensorInfo,
+                logWarnings
+            });
+
+            if (index > 0) {
+                for (const tensor of res.tensorInfo ?? [])
+                    (tensor as Writable<GgufTensorInfo>).filePart = index + 1;
+            }
+
+            return res;
+        })
+    );
+    signal?.throwIfAborted();
+
+    if (parts.length === 1)
+        return parts[0]!;
+
+    return spliceGgufFileInfoParts(parts, undefined);
+}
+
+function spliceGgufFileInfoParts([first, ...rest]: GgufFileInfo[], source: GgufFileInfoSource | undefined) {
     if (first == null)
         throw new Error("First part of the split GGUF file is missing");
 
@@ -158,7 +258,7 @@ export async function readGgufFileInfo(pathOrUri: string, {
         architectureMetadata: first.architectureMetadata,
         tensorInfo: first.tensorInfo,
         metadataSize: first.metadataSize,
-        splicedParts: allSplitPartPaths.length,
+        splicedParts: rest.length + 1,
         totalTensorInfoSize: first.totalTensorInfoSize == null
             ? undefined
             : (first.totalTensorInfoSize + rest.reduce((acc, part) => (acc + (part.totalTensorInfoSize ?? 0)), 0)),
@@ -168,7 +268,7 @@ export async function readGgufFileInfo(pathOrUri: string, {
             ? undefined
             : [first, ...rest].flatMap((part) => (part.fullTensorInfo ?? [])),
         tensorInfoSize: first.tensorInfoSize,
-        source: createSource(pathOrUri),
+        source,
         sourceData: [first, ...rest].flatMap((part) => part.sourceData)
     } satisfies GgufFileInfo;
 }
@@ -134,7 +134,11 @@ export type GgufVersionParserOptions = {
 
     version: number,
     readOffset: GgufReadOffset,
-    logWarnings: boolean
+    logWarnings: boolean,
+
+    // top-level metadata arrays with at least this many items are skipped and decoded only when accessed.
+    // only used when reading from the filesystem
+    lazyArrayMinLength?: number
 };
 
 export type GgufVersionParserResult = {
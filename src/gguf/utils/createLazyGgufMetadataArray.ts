@@ -0,0 +1,125 @@
+import fs from "node:fs";
+import {GgufValueType, MetadataValue} from "../types/GgufFileInfoTypes.js";
+import {valueTypeToBytesToRead} from "../fileReaders/GgufFileReader.js";
+
+export type LazyGgufMetadataArraySource = {
+    filePath: string,
+
+    /** The type of the items of the array */
+    type: GgufValueType,
+    length: number,
+
+    /** The offset in the file of the first item of the array */
+    offset: number,
+
+    /** The total size in bytes of the items of the array in the file */
+    byteLength: number
+};
+
+/**
+ * Create an array that has the `length` of a metadata array that was skipped when parsing a GGUF file,
+ * and only reads and decodes its items from the file when anything other than its `length` is accessed.
+ *
+ * The returned array is a `Proxy`, so it cannot be passed to `structuredClone` before it's spread into a new array.
+ */
+export function createLazyGgufMetadataArray(source: LazyGgufMetadataArraySource): MetadataValue[] {
+    const target: MetadataValue[] = [];
+    target.length = source.length;
+
+    let decoded = false;
+    function ensureDecoded() {
+        if (decoded)
+            return;
+
+        const items = decodeGgufArrayItems(readFileRange(source.filePath, source.offset, source.byteLength), source.type, source.length);
+        decoded = true;
+
+        target.length = 0;
+        for (const item of items)
+            target.push(item);
+    }
+
+    return new Proxy(target, {
+        get(target, property, receiver) {
+            if (property !== "length")
+                ensureDecoded();
+
+            return Reflect.get(target, property, receiver);
+        },
+        set(target, property, value, receiver) {
+            ensureDecoded();
+            return Reflect.set(target, property, value, receiver);
+        },
+        has(target, property) {
+            ensureDecoded();
+            return Reflect.has(target, property);
+        },
+        ownKeys(target) {
+            ensureDecoded();
+            return Reflect.ownKeys(target);
+        },
+        getOwnPropertyDescriptor(target, property) {
+            ensureDecoded();
+            return Reflect.getOwnPropertyDescriptor(target, property);
+        },
+        defineProperty(target, property, descriptor) {
+            ensureDecoded();
+            return Reflect.defineProperty(target, property, descriptor);
+        },
+        deleteProperty(target, property) {
+            ensureDecoded();
+            return Reflect.deleteProperty(target, property);
+        }
+    });
+}
+
+function readFileRange(filePath: string, offset: number, length: number) {
+    const buffer = Buffer.alloc(length);
+    const fd = fs.openSync(filePath, "r");
+    try {
+        let readLength = 0;
+        while (readLength < length) {
+            const bytesRead = fs.readSync(fd, buffer, readLength, length - readLength, offset + readLength);
+            if (bytesRead === 0)
+                throw new Error(`The GGUF file "${filePath}" changed after its metadata was read`);
+
+            readLength += bytesRead;
+        }
+    } finally {
+        fs.closeSync(fd);
+    }
+
+    return buffer;
+}
+
+function decodeGgufArrayItems(buffer: Buffer, type: GgufValueType, length: number): MetadataValue[] {
+    const res: MetadataValue[] = new Array(length);
+    let offset = 0;
+
+    for (let i = 0; i < length; i++) {
+        switch (type) {
+            case GgufValueType.Uint8: res[i] = buffer.readUInt8(offset); offset += valueTypeToBytesToRead.uint8; break;
+            case GgufValueType.Int8: res[i] = buffer.readInt8(offset); offset += valueTypeToBytesToRead.int8; break;
+            case GgufValueType.Uint16: res[i] = buffer.readUInt16LE(offset); offset += valueTypeToBytesToRead.uint16; break;
+            case GgufValueType.Int16: res[i] = buffer.readInt16LE(offset); offset += valueTypeToBytesToRead.int16; break;
+            case GgufValueType.Uint32: res[i] = buffer.readUInt32LE(offset); offset += valueTypeToBytesToRead.uint32; break;
+            case GgufValueType.Int32: res[i] = buffer.readInt32LE(offset); offset += valueTypeToBytesToRead.int32; break;
+            case GgufValueType.Float32: res[i] = buffer.readFloatLE(offset); offset += valueTypeToBytesToRead.float32; break;
+            case GgufValueType.Bool: res[i] = buffer.readUInt8(offset) === 1; offset += valueTypeToBytesToRead.bool; break;
+            case GgufValueType.Uint64: res[i] = buffer.readBigUInt64LE(offset); offset += valueTypeToBytesToRead.uint64; break;
+            case GgufValueType.Int64: res[i] = buffer.readBigInt64LE(offset); offset += valueTypeToBytesToRead.int64; break;
+            case GgufValueType.Float64: res[i] = buffer.readDoubleLE(offset); offset += valueTypeToBytesToRead.float64; break;
+            case GgufValueType.String: {
+                const stringLength = Number(buffer.readBigUInt64LE(offset));
+                offset += valueTypeToBytesToRead.uint64;
+                res[i] = buffer.toString("utf8", offset, offset + stringLength);
+                offset += stringLength;
+                break;
+            }
+            default:
+                throw new Error(`Unsupported lazy GGUF array item type: ${type}`);
+        }
+    }
+
+    return res;
+}
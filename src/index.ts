@@ -4,18 +4,25 @@ import {getLlama, type LlamaOptions, type LastBuildOptions, type LlamaExperiment
 import {getLlamaGpuTypes} from "./bindings/utils/getLlamaGpuTypes.js";
 import {NoBinaryFoundError} from "./bindings/utils/NoBinaryFoundError.js";
 import {
-    type LlamaGpuType, type LlamaNuma, type RamState, LlamaLogLevel, LlamaLogLevelGreaterThan, LlamaLogLevelGreaterThanOrEqual,
-    LlamaVocabularyType
+    type LlamaGpuType, type LlamaNuma, type RamState, type LlamaLoadReport, LlamaLogLevel, LlamaLogLevelGreaterThan,
+    LlamaLogLevelGreaterThanOrEqual, LlamaVocabularyType
 } from "./bindings/types.js";
 import {resolveModelFile, type ResolveModelFileOptions} from "./utils/resolveModelFile.js";
-import {LlamaModel, LlamaModelInfillTokens, type LlamaModelOptions, LlamaModelTokens} from "./evaluator/LlamaModel/LlamaModel.js";
+import {
+    LlamaModel, LlamaModelInfillTokens, type LlamaModelOptions, type LlamaModelShareHandle, LlamaModelTokens
+} from "./evaluator/LlamaModel/LlamaModel.js";
 import {TokenAttributes} from "./evaluator/LlamaModel/utils/TokenAttributes.js";
+import {type LlamaLoraAdapterCacheStats} from "./evaluator/LlamaModel/utils/LlamaLoraAdapterCache.js";
 import {LlamaGrammar, type LlamaGrammarOptions} from "./evaluator/LlamaGrammar.js";
+import {LlamaTokenizer, type LlamaTokenizerOptions, type LlamaTokenizerShareHandle} from "./evaluator/LlamaTokenizer.js";
 import {LlamaJsonSchemaGrammar} from "./evaluator/LlamaJsonSchemaGrammar.js";
 import {LlamaJsonSchemaValidationError} from "./utils/gbnfJson/utils/validateObjectAgainstGbnfSchema.js";
 import {LlamaGrammarEvaluationState, LlamaGrammarEvaluationStateOptions} from "./evaluator/LlamaGrammarEvaluationState.js";
 import {LlamaContext, LlamaContextSequence} from "./evaluator/LlamaContext/LlamaContext.js";
-import {LlamaEmbeddingContext, type LlamaEmbeddingContextOptions} from "./evaluator/LlamaEmbeddingContext.js";
+import {
+    LlamaEmbeddingContext, type LlamaEmbeddingContextOptions, type LlamaEmbeddingMatrix, type LlamaEmbeddingMatrixFormat,
+    type LlamaEmbeddingMatrixOptions, type LlamaTokenEmbeddingsOptions, type LlamaTokenEmbeddings
+} from "./evaluator/LlamaEmbeddingContext.js";
 import {LlamaEmbedding, type LlamaEmbeddingOptions, type LlamaEmbeddingJSON} from "./evaluator/LlamaEmbedding.js";
 import {LlamaRankingContext, type LlamaRankingContextOptions} from "./evaluator/LlamaRankingContext.js";
 import {
@@ -23,8 +30,10 @@ import {
     type CustomBatchingDispatchSchedule, type CustomBatchingPrioritizationStrategy, type BatchItem, type PrioritizedBatchItem,
     type ContextShiftOptions, type ContextTokensDeleteRange, type EvaluationPriority, type SequenceEvaluateMetadataOptions,
     type SequenceEvaluateOutput, type ControlledEvaluateInputItem, type ControlledEvaluateIndexOutput,
-    type LlamaContextSequenceDryRepeatPenalty
+    type LlamaContextSequenceDryRepeatPenalty, type LlamaContextSequenceState,
+    type LlamaContextKvCacheStats, type LlamaContextLoraAdapter, type LlamaContextWarmupResult
 } from "./evaluator/LlamaContext/types.js";
+import {type LlamaPromptCacheStats} from "./evaluator/LlamaContext/LlamaPromptCache.js";
 import {TokenBias} from "./evaluator/TokenBias.js";
 import {
     LlamaChatSession, type LlamaChatSessionOptions, type LlamaChatSessionContextShiftOptions, type LLamaChatPromptOptions,
@@ -137,6 +146,7 @@ export {
     type LlamaGpuType,
     type LlamaNuma,
     type RamState,
+    type LlamaLoadReport,
     type LlamaClasses,
     LlamaLogLevel,
     NoBinaryFoundError,
@@ -147,6 +157,11 @@ export {
     LlamaModelInfillTokens,
     TokenAttributes,
     type LlamaModelOptions,
+    type LlamaModelShareHandle,
+    type LlamaLoraAdapterCacheStats,
+    LlamaTokenizer,
+    type LlamaTokenizerOptions,
+    type LlamaTokenizerShareHandle,
     LlamaGrammar,
     type LlamaGrammarOptions,
     LlamaJsonSchemaGrammar,
@@ -166,6 +181,11 @@ export {
     type ContextTokensDeleteRange,
     type EvaluationPriority,
     type SequenceEvaluateMetadataOptions,
+    type LlamaContextSequenceState,
+    type LlamaContextKvCacheStats,
+    type LlamaContextLoraAdapter,
+    type LlamaContextWarmupResult,
+    type LlamaPromptCacheStats,
     type SequenceEvaluateOutput,
     type LlamaContextSequenceRepeatPenalty,
     type LlamaContextSequenceDryRepeatPenalty,
@@ -174,6 +194,11 @@ export {
     TokenBias,
     LlamaEmbeddingContext,
     type LlamaEmbeddingContextOptions,
+    type LlamaEmbeddingMatrix,
+    type LlamaEmbeddingMatrixFormat,
+    type LlamaEmbeddingMatrixOptions,
+    type LlamaTokenEmbeddingsOptions,
+    type LlamaTokenEmbeddings,
     LlamaEmbedding,
     type LlamaEmbeddingOptions,
     type LlamaEmbeddingJSON,
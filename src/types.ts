@@ -14,6 +14,9 @@ export type Tokenizer = {
     tokenize(text: BuiltinSpecialTokenValue, specialTokens: "builtin"): Token[]
 }["tokenize"] & {
     readonly detokenize: Detokenizer,
+
+    /** Get the number of tokens the given text would be tokenized to, without creating the tokens array */
+    readonly countTokens?: (text: string, specialTokens?: boolean, options?: "trimLeadingSpace") => number,
     isSpecialToken(token: Token): boolean,
     isEogToken(token: Token): boolean
 };
@@ -1,5 +1,6 @@
 import {ChatHistoryItem, Tokenizer} from "../types.js";
 import {ChatWrapper} from "../ChatWrapper.js";
+import {LlamaText, SpecialToken, SpecialTokensText} from "./LlamaText.js";
 
 const maxSequentialUnhelpfulIterations = 100;
 
@@ -30,10 +31,11 @@ export async function findCharacterRemovalCountToFitChatHistoryInContext({
     compressedChatHistory: ChatHistoryItem[]
 }> {
     let currentEstimatedCharactersPerToken = estimatedCharactersPerToken;
+    const textTokensCountCache = new Map<string, number>();
 
     function getTokensCountForChatHistory(chatHistory: readonly ChatHistoryItem[]) {
         const {contextText} = chatWrapper.generateContextState({chatHistory});
-        return contextText.tokenize(tokenizer, "trimLeadingSpace").length;
+        return countLlamaTextTokens(contextText, tokenizer, textTokensCountCache);
     }
 
     async function getResultForCharacterRemovalCount(characterRemovalCount: number) {
@@ -142,3 +144,48 @@ export async function findCharacterRemovalCountToFitChatHistoryInContext({
         compressedChatHistory: bestCompressionAttempt.compressedHistory
     };
 }
+
+/**
+ * Equivalent to `text.tokenize(tokenizer, "trimLeadingSpace").length`.
+ *
+ * Most of the chat history is unchanged between compression attempts,
+ * so the token count of every text segment is cached to only tokenize the segments that changed.
+ */
+function countLlamaTextTokens(text: LlamaText, tokenizer: Tokenizer, cache: Map<string, number>) {
+    let count = 0;
+    let textToCount = "";
+
+    function countTextTokens(text: string, specialTokens: boolean) {
+        if (text === "")
+            return 0;
+
+        const cacheKey = (specialTokens ? "1" : "0") + text;
+        const cachedCount = cache.get(cacheKey);
+        if (cachedCount != null)
+            return cachedCount;
+
+        const res = tokenizer.countTokens != null
+            ? tokenizer.countTokens(text, specialTokens, "trimLeadingSpace")
+            : tokenizer(text, specialTokens, "trimLeadingSpace").length;
+
+        cache.set(cacheKey, res);
+        return res;
+    }
+
+    for (const value of text.values) {
+        if (value instanceof SpecialToken) {
+            count += countTextTokens(textToCount, false);
+            count += value.tokenize(tokenizer).length;
+            textToCount = "";
+        } else if (value instanceof SpecialTokensText) {
+            count += countTextTokens(textToCount, false);
+            count += countTextTokens(value.value, true);
+            textToCount = "";
+        } else
+            textToCount += value;
+    }
+
+    count += countTextTokens(textToCount, false);
+
+    return count;
+}
@@ -184,5 +184,105 @@ describe("bge", () => {
 
             expect(topSimilarDocument).to.eql("I love eating pizza with extra cheese");
         });
+
+        test("batched embeddings match single embeddings", {timeout: 1000 * 60 * 60 * 2}, async () => {
+            const modelPath = await getModelFile("bge-small-en-v1.5-q8_0.gguf");
+            const llama = await getTestLlama();
+
+            const model = await llama.loadModel({
+                modelPath
+            });
+            const embeddingContext = await model.createEmbeddingContext({
+                contextSize: 512,
+                sequences: 3
+            });
+
+            const texts = ["Hello world", "Hello there", "", "The capital of France is Paris"];
+            const batchedEmbeddings = await embeddingContext.getEmbeddingsFor(texts);
+
+            expect(batchedEmbeddings.length).to.eql(texts.length);
+            expect(batchedEmbeddings[2]!.vector).to.eql([]);
+
+            for (let i = 0; i < texts.length; i++) {
+                const singleEmbedding = await embeddingContext.getEmbeddingFor(texts[i]!);
+
+                expect(batchedEmbeddings[i]!.vector.length).to.eql(singleEmbedding.vector.length);
+                for (let j = 0; j < singleEmbedding.vector.length; j++)
+                    expect(batchedEmbeddings[i]!.vector[j]).toBeCloseTo(singleEmbedding.vector[j]!, 4);
+            }
+
+            const {vectorSize, vectors} = await embeddingContext.getEmbeddingMatrixFor(texts);
+            expect(vectorSize).to.eql(model.embeddingVectorSize);
+            expect(vectors.length).to.eql(texts.length * vectorSize);
+        });
+
+        test("quantized embedding matrix formats", {timeout: 1000 * 60 * 60 * 2}, async () => {
+            const modelPath = await getModelFile("bge-small-en-v1.5-q8_0.gguf");
+            const llama = await getTestLlama();
+
+            const model = await llama.loadModel({
+                modelPath
+            });
+            const embeddingContext = await model.createEmbeddingContext({
+                contextSize: 512,
+                sequences: 2
+            });
+
+            const texts = ["Hello world", "The capital of France is Paris"];
+            const float32Matrix = await embeddingContext.getEmbeddingMatrixFor(texts);
+            const normalizedMatrix = await embeddingContext.getEmbeddingMatrixFor(texts, {format: "normalizedFloat32"});
+            const int8Matrix = await embeddingContext.getEmbeddingMatrixFor(texts, {format: "int8"});
+            const binaryMatrix = await embeddingContext.getEmbeddingMatrixFor(texts, {format: "binary"});
+            const {vectorSize} = float32Matrix;
+
+            expect(binaryMatrix.vectorStride).to.eql(Math.ceil(vectorSize / 8));
+            expect(binaryMatrix.vectors.length).to.eql(texts.length * binaryMatrix.vectorStride);
+            expect(int8Matrix.scales.length).to.eql(texts.length);
+
+            for (let i = 0; i < texts.length; i++) {
+                let squaredNorm = 0;
+                for (let j = 0; j < vectorSize; j++) {
+                    const index = i * vectorSize + j;
+                    const value = float32Matrix.vectors[index]!;
+
+                    squaredNorm += normalizedMatrix.vectors[index]! ** 2;
+                    expect(int8Matrix.vectors[index]! * int8Matrix.scales[i]!).toBeCloseTo(value, 1);
+                    expect(Boolean(binaryMatrix.vectors[i * binaryMatrix.vectorStride + (j >> 3)]! & (0x80 >> (j & 7))))
+                        .to.eql(value > 0);
+                }
+
+                expect(squaredNorm).toBeCloseTo(1, 4);
+            }
+        });
+
+        test("token embeddings", {timeout: 1000 * 60 * 60 * 2}, async () => {
+            const modelPath = await getModelFile("bge-small-en-v1.5-q8_0.gguf");
+            const llama = await getTestLlama();
+
+            const model = await llama.loadModel({
+                modelPath
+            });
+            const embeddingContext = await model.createEmbeddingContext({
+                contextSize: 512,
+                tokenEmbeddings: true
+            });
+
+            const {tokens, vectorSize, vectors} = await embeddingContext.getTokenEmbeddingsFor("Hello world", {
+                normalize: true,
+                maxVectorSize: 128
+            });
+
+            expect(tokens.length).to.be.greaterThan(2);
+            expect(vectorSize).to.eql(128);
+            expect(vectors.length).to.eql(tokens.length * vectorSize);
+
+            for (let i = 0; i < tokens.length; i++) {
+                let squaredNorm = 0;
+                for (let j = 0; j < vectorSize; j++)
+                    squaredNorm += vectors[i * vectorSize + j]! ** 2;
+
+                expect(squaredNorm).toBeCloseTo(1, 4);
+            }
+        });
     });
 });
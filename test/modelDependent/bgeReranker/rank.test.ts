@@ -235,6 +235,35 @@ describe("bgeReranker", () => {
               ]
             `);
         });
+
+        test("batched ranking matches single ranking", {timeout: 1000 * 60 * 60 * 2}, async () => {
+            const modelPath = await getModelFile("bge-reranker-v2-m3-Q8_0.gguf");
+            const llama = await getTestLlama();
+
+            const model = await llama.loadModel({
+                modelPath
+            });
+            const rankingContext = await model.createRankingContext({
+                contextSize: 512,
+                sequences: 3
+            });
+
+            const documents = [
+                "The sky is clear and blue today",
+                "The capital of France is Paris",
+                "",
+                "Mount Everest is the tallest mountain in the world",
+                "Painting is a form of creative expression"
+            ];
+            const query = "Tell me a geographical fact";
+
+            const batchedRanks = await rankingContext.rankBatch(query, documents);
+            expect(batchedRanks).toBeInstanceOf(Float32Array);
+            expect(batchedRanks.length).to.eql(documents.length);
+
+            for (let i = 0; i < documents.length; i++)
+                expect(batchedRanks[i]).toBeCloseTo(await rankingContext.rank(query, documents[i]!), 4);
+        });
     });
 });
 
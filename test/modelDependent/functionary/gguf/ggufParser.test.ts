@@ -4,6 +4,7 @@ import {parseGguf} from "../../../../src/gguf/parser/parseGguf.js";
 import {getModelFile} from "../../../utils/modelFiles.js";
 import {readGgufFileInfo} from "../../../../src/gguf/readGgufFileInfo.js";
 import {simplifyGgufInfoForTestSnapshot} from "../../../utils/helpers/simplifyGgufInfoForTestSnapshot.js";
+import {getTestLlama} from "../../../utils/getTestLlama.js";
 
 describe("gguf", async () => {
     describe("parser", async () => {
@@ -32,5 +33,48 @@ describe("gguf", async () => {
 
             expect(simplifyGgufInfoForTestSnapshot(ggufMetadataParseResult)).toMatchSnapshot();
         });
+
+        it("should parse local gguf model natively with the same result", async () => {
+            const llama = await getTestLlama();
+
+            const ggufFileInfo = await readGgufFileInfo(modelPath);
+            const nativeGgufFileInfo = await readGgufFileInfo(modelPath, {llama});
+
+            expect(nativeGgufFileInfo).toEqual(ggufFileInfo);
+        });
+
+        it("should parse local gguf model natively without tensor info", async () => {
+            const llama = await getTestLlama();
+
+            const ggufFileInfo = await readGgufFileInfo(modelPath, {
+                readTensorInfo: false,
+                ignoreKeys: ["tokenizer.ggml.tokens"]
+            });
+            const nativeGgufFileInfo = await readGgufFileInfo(modelPath, {
+                readTensorInfo: false,
+                ignoreKeys: ["tokenizer.ggml.tokens"],
+                llama
+            });
+
+            expect(nativeGgufFileInfo).toEqual(ggufFileInfo);
+        });
+
+        it("should decode lazy metadata arrays only when accessed", async () => {
+            const llama = await getTestLlama();
+
+            const ggufFileInfo = await readGgufFileInfo(modelPath);
+            const lazyGgufFileInfo = await readGgufFileInfo(modelPath, {lazyMetadataArrays: true});
+            const nativeLazyGgufFileInfo = await readGgufFileInfo(modelPath, {lazyMetadataArrays: true, llama});
+
+            const tokens = ggufFileInfo.metadata.tokenizer.ggml.tokens;
+            expect(lazyGgufFileInfo.metadata.tokenizer.ggml.tokens.length).to.eql(tokens.length);
+            expect(nativeLazyGgufFileInfo.metadata.tokenizer.ggml.tokens.length).to.eql(tokens.length);
+
+            expect(lazyGgufFileInfo.metadata.tokenizer.ggml.tokens[tokens.length - 1]).to.eql(tokens[tokens.length - 1]);
+            expect([...nativeLazyGgufFileInfo.metadata.tokenizer.ggml.tokens]).to.eql(tokens);
+
+            expect(lazyGgufFileInfo).toEqual(ggufFileInfo);
+            expect(nativeLazyGgufFileInfo).toEqual(ggufFileInfo);
+        });
     });
 });
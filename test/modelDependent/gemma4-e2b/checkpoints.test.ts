@@ -0,0 +1,99 @@
+import {describe, expect, test} from "vitest";
+import {LlamaContextSequence, Token} from "../../../src/index.js";
+import {getModelFile} from "../../utils/modelFiles.js";
+import {getTestLlama} from "../../utils/getTestLlama.js";
+
+describe("gemma4 e2b", () => {
+    describe("checkpoints", () => {
+        const firstText = "The quick brown fox jumps over the lazy dog. ".repeat(8);
+        const secondText = "Some more text about the fox and the dog that comes after the first checkpoint.";
+
+        async function generateTokens(sequence: LlamaContextSequence, tokens: Token[], count: number) {
+            const res: Token[] = [];
+            for await (const token of sequence.evaluate(tokens, {temperature: 0})) {
+                res.push(token);
+
+                if (res.length >= count)
+                    break;
+            }
+
+            return res;
+        }
+
+        describe("deltas", () => {
+            test("store and restore delta checkpoints", {timeout: 1000 * 60 * 60 * 2}, async () => {
+                const modelPath = await getModelFile("gemma-4-E2B-it-Q4_K_M.gguf");
+                const llama = await getTestLlama();
+
+                const model = await llama.loadModel({
+                    modelPath
+                });
+                const context = await model.createContext({
+                    contextSize: 1024,
+                    sequences: 2
+                });
+                const firstTokens = model.tokenize(firstText);
+                const secondTokens = model.tokenize(secondText);
+
+                async function evaluateAndRestore(sequence: LlamaContextSequence) {
+                    await sequence.evaluateWithoutGeneratingNewTokens(firstTokens);
+                    await sequence.takeCheckpoint();
+                    await sequence.evaluateWithoutGeneratingNewTokens(secondTokens);
+                    await sequence.takeCheckpoint();
+
+                    const checkpointsStates = sequence._checkpoints.checkpoints.map((checkpoint) => checkpoint.isDelta);
+                    const memoryUsage = sequence.checkpointsMemoryUsage;
+                    const rawMemoryUsage = sequence.checkpointsRawMemoryUsage;
+
+                    await sequence.evaluateWithoutGeneratingNewTokens(model.tokenize(" And then"));
+
+                    // go back to right after the second checkpoint
+                    const initialMeterState = sequence.tokenMeter.getState();
+                    await sequence.eraseContextTokenRanges([{
+                        start: firstTokens.length + secondTokens.length + 1,
+                        end: sequence.nextTokenIndex
+                    }]);
+                    const usedInputTokens = sequence.tokenMeter.diff(initialMeterState).usedInputTokens;
+
+                    const generatedTokens = await generateTokens(sequence, model.tokenize(" And"), 8);
+
+                    return {checkpointsStates, memoryUsage, rawMemoryUsage, usedInputTokens, generatedTokens};
+                }
+
+                const deltaSequence = context.getSequence({
+                    checkpoints: {
+                        interval: false,
+                        deltas: true
+                    }
+                });
+                expect(deltaSequence.needsCheckpoints).to.eql(true);
+                const deltaRes = await evaluateAndRestore(deltaSequence);
+                deltaSequence.dispose();
+
+                const fullSequence = context.getSequence({
+                    checkpoints: {
+                        interval: false,
+                        deltas: false
+                    }
+                });
+                const fullRes = await evaluateAndRestore(fullSequence);
+                fullSequence.dispose();
+
+                // the second checkpoint only stores the changes from the first one
+                expect(deltaRes.checkpointsStates).to.eql([false, true]);
+                expect(deltaRes.memoryUsage).to.be.lessThan(deltaRes.rawMemoryUsage * 0.75);
+                expect(deltaRes.rawMemoryUsage).to.eql(fullRes.rawMemoryUsage);
+                expect(fullRes.checkpointsStates).to.eql([false, false]);
+                expect(fullRes.memoryUsage).to.eql(fullRes.rawMemoryUsage);
+
+                // restoring the delta checkpoint reconstructs the same state as restoring the full checkpoint
+                expect(deltaRes.usedInputTokens).to.be.lessThanOrEqual(1);
+                expect(fullRes.usedInputTokens).to.be.lessThanOrEqual(1);
+                expect(deltaRes.generatedTokens).to.eql(fullRes.generatedTokens);
+
+                await context.dispose();
+                await model.dispose();
+            });
+        });
+    });
+});
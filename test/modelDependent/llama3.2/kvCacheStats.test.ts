@@ -0,0 +1,74 @@
+import {describe, expect, test} from "vitest";
+import {getModelFile} from "../../utils/modelFiles.js";
+import {getTestLlama} from "../../utils/getTestLlama.js";
+
+describe("llama 3.2", () => {
+    describe("KV cache stats", () => {
+        test("positions of the sequences are reported", {timeout: 1000 * 60 * 60 * 2}, async () => {
+            const modelPath = await getModelFile("Llama-3.2-3B-Instruct.Q4_K_M.gguf");
+            const llama = await getTestLlama();
+
+            const model = await llama.loadModel({
+                modelPath
+            });
+            const context = await model.createContext({
+                contextSize: 512,
+                sequences: 2
+            });
+
+            const emptyStats = context.getKvCacheStats();
+            expect(emptyStats.totalCells).to.eql(1024);
+            expect(emptyStats.unified).to.eql(false);
+            expect(emptyStats.keyBytesPerCell).to.be.greaterThan(0);
+            expect(emptyStats.valueBytesPerCell).to.be.greaterThan(0);
+            expect(emptyStats.sequences).to.eql([]);
+
+            const tokens = model.tokenize("The quick brown fox jumps over the lazy dog");
+            const sequence1 = context.getSequence();
+            const sequence2 = context.getSequence();
+            await sequence2.evaluateWithoutGeneratingNewTokens(tokens);
+
+            const stats = context.getKvCacheStats();
+            expect(stats.sequences).to.eql([{
+                sequenceId: 1,
+                minPosition: 0,
+                maxPosition: tokens.length - 1,
+                swapped: false
+            }]);
+
+            sequence1.dispose();
+            await model.dispose();
+        });
+
+        test("erased tokens are reflected in the positions", {timeout: 1000 * 60 * 60 * 2}, async () => {
+            const modelPath = await getModelFile("Llama-3.2-3B-Instruct.Q4_K_M.gguf");
+            const llama = await getTestLlama();
+
+            const model = await llama.loadModel({
+                modelPath
+            });
+            const context = await model.createContext({
+                contextSize: 512,
+                sequences: 2,
+                preemption: true
+            });
+
+            const tokens = model.tokenize("The quick brown fox jumps over the lazy dog. ".repeat(4));
+            const sequence1 = context.getSequence();
+            const sequence2 = context.getSequence();
+            await sequence1.evaluateWithoutGeneratingNewTokens(tokens);
+            await sequence2.evaluateWithoutGeneratingNewTokens(tokens);
+
+            const stats = context.getKvCacheStats();
+            expect(stats.unified).to.eql(true);
+            expect(stats.sequences.map((sequence) => sequence.maxPosition)).to.eql([tokens.length - 1, tokens.length - 1]);
+
+            await sequence1.eraseContextTokenRanges([{start: 10, end: 20}]);
+
+            const erasedStats = context.getKvCacheStats();
+            expect(erasedStats.sequences.map((sequence) => sequence.maxPosition)).to.eql([tokens.length - 11, tokens.length - 1]);
+
+            await model.dispose();
+        });
+    });
+});
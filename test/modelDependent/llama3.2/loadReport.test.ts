@@ -0,0 +1,48 @@
+import {describe, expect, test} from "vitest";
+import {getModelFile} from "../../utils/modelFiles.js";
+import {getTestLlama} from "../../utils/getTestLlama.js";
+
+describe("llama 3.2", () => {
+    describe("load report", () => {
+        test("model and context loads are profiled", {timeout: 1000 * 60 * 60 * 2}, async () => {
+            const modelPath = await getModelFile("Llama-3.2-3B-Instruct.Q4_K_M.gguf");
+            const llama = await getTestLlama();
+
+            const model = await llama.loadModel({
+                modelPath
+            });
+
+            const modelLoadReport = model.loadReport!;
+            expect(modelLoadReport).to.not.eql(undefined);
+            expect(modelLoadReport.phases.map((phase) => phase.name)).to.eql(["initialization", "tensorData", "finalization"]);
+            expect(modelLoadReport.totalTime).to.be.greaterThanOrEqual(
+                modelLoadReport.phases.reduce((total, phase) => total + phase.time, 0) - 1
+            );
+            expect(modelLoadReport.tensorDataSize).to.eql(model.size);
+            expect(modelLoadReport.tensorDataThroughput).to.be.greaterThan(0);
+
+            const tensorDataPhase = modelLoadReport.phases.find((phase) => phase.name === "tensorData")!;
+            const {transformTime, kernelTime, waitTime} = modelLoadReport.tensorDataBreakdown!;
+            expect(transformTime).to.be.greaterThanOrEqual(0);
+            expect(kernelTime).to.be.greaterThanOrEqual(0);
+            expect(waitTime).to.be.greaterThanOrEqual(0);
+            expect(transformTime + kernelTime + waitTime).to.be.closeTo(tensorDataPhase.time, 0.001);
+            expect(modelLoadReport.userCpuTime).to.be.greaterThanOrEqual(transformTime);
+            expect(modelLoadReport.ioCountersScope).to.eql(process.platform === "linux" ? "threads" : "process");
+            expect(modelLoadReport.buffers.length).to.be.greaterThan(0);
+            expect(modelLoadReport.buffers.reduce((total, buffer) => total + buffer.size, 0)).to.be.greaterThan(0);
+
+            const context = await model.createContext({
+                contextSize: 512
+            });
+
+            const contextLoadReport = context.loadReport!;
+            expect(contextLoadReport).to.not.eql(undefined);
+            expect(contextLoadReport.phases.map((phase) => phase.name)).to.eql(["initialization"]);
+            expect(contextLoadReport.buffers.reduce((total, buffer) => total + (buffer.kvCacheSize ?? 0), 0)).to.be.greaterThan(0);
+
+            await context.dispose();
+            await model.dispose();
+        });
+    });
+});
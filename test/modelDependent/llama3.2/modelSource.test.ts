@@ -0,0 +1,73 @@
+import fs from "node:fs/promises";
+import {describe, expect, test} from "vitest";
+import {getModelFile} from "../../utils/modelFiles.js";
+import {getTestLlama} from "../../utils/getTestLlama.js";
+
+describe("llama 3.2", () => {
+    describe("model source", () => {
+        test("load a model from a buffer", {timeout: 1000 * 60 * 60 * 2}, async () => {
+            const modelPath = await getModelFile("Llama-3.2-3B-Instruct.Q4_K_M.gguf");
+            const llama = await getTestLlama();
+
+            const model = await llama.loadModel({
+                modelPath,
+                modelSource: await fs.readFile(modelPath)
+            });
+            expect(model.useMmap).to.eql(false);
+            expect(model.loadReport!.phases.map((phase) => phase.name)).to.eql(["initialization", "tensorData", "finalization"]);
+            expect(model.loadReport!.tensorDataSize).to.eql(model.size);
+
+            const text = "The quick brown fox jumps over the lazy dog";
+            expect(model.detokenize(model.tokenize(text))).to.eql(text);
+
+            const context = await model.createContext({
+                contextSize: 512
+            });
+            const sequence = context.getSequence();
+            await sequence.evaluateWithoutGeneratingNewTokens(model.tokenize(text));
+            expect(sequence.nextTokenIndex).to.eql(model.tokenize(text).length);
+
+            await context.dispose();
+            await model.dispose();
+
+            await expect(llama.loadModel({
+                modelPath,
+                modelSource: (await fs.readFile(modelPath)).subarray(0, 1024 * 1024 * 32)
+            })).rejects.toThrow();
+        });
+
+        test("load a model from a file descriptor", {timeout: 1000 * 60 * 60 * 2}, async (test) => {
+            if (process.platform !== "linux" && process.platform !== "darwin")
+                test.skip(); // loading from a file descriptor is only supported on Linux and macOS
+
+            const modelPath = await getModelFile("Llama-3.2-3B-Instruct.Q4_K_M.gguf");
+            const llama = await getTestLlama();
+
+            const fileHandle = await fs.open(modelPath, "r");
+            try {
+                const model = await llama.loadModel({
+                    modelPath: "in-memory-model.gguf",
+                    modelSource: {fileDescriptor: fileHandle.fd}
+                });
+                expect(model.filename).to.eql("in-memory-model.gguf");
+
+                // the metadata arrays are read eagerly, so they don't depend on the file descriptor after the model is loaded
+                const tokens = model.fileInfo.metadata.tokenizer.ggml.tokens;
+                expect(structuredClone(tokens)).to.eql(Array.from(tokens));
+
+                const text = "The quick brown fox jumps over the lazy dog";
+                const context = await model.createContext({
+                    contextSize: 512
+                });
+                const sequence = context.getSequence();
+                await sequence.evaluateWithoutGeneratingNewTokens(model.tokenize(text));
+                expect(sequence.nextTokenIndex).to.eql(model.tokenize(text).length);
+
+                await context.dispose();
+                await model.dispose();
+            } finally {
+                await fileHandle.close();
+            }
+        });
+    });
+});
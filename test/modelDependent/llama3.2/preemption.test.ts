@@ -0,0 +1,113 @@
+import {describe, expect, test} from "vitest";
+import {LlamaContextSequence, Token} from "../../../src/index.js";
+import {getModelFile} from "../../utils/modelFiles.js";
+import {getTestLlama} from "../../utils/getTestLlama.js";
+
+describe("llama 3.2", () => {
+    describe("preemption", () => {
+        test("sequences are swapped out when the KV cache is full", {timeout: 1000 * 60 * 60 * 2}, async () => {
+            const modelPath = await getModelFile("Llama-3.2-3B-Instruct.Q4_K_M.gguf");
+            const llama = await getTestLlama();
+
+            const model = await llama.loadModel({
+                modelPath
+            });
+            const context = await model.createContext({
+                contextSize: 512,
+                sequences: 2,
+                preemption: {
+                    kvCacheSize: 512
+                }
+            });
+            expect(context.preemptionStats.enabled).to.eql(true);
+
+            const prompt1Tokens = model.tokenize("The quick brown fox jumps over the lazy dog. ".repeat(30));
+            const prompt2Tokens = model.tokenize("A journey of a thousand miles begins with a single step. ".repeat(25));
+            expect(prompt1Tokens.length + prompt2Tokens.length).to.be.greaterThan(512);
+
+            const sequence1 = context.getSequence();
+            await sequence1.evaluateWithoutGeneratingNewTokens(prompt1Tokens.slice(0, -1));
+
+            const sequence2 = context.getSequence();
+            await sequence2.evaluateWithoutGeneratingNewTokens(prompt2Tokens.slice(0, -1));
+
+            expect(context.preemptionStats.preemptions).to.eql(1);
+            expect(context.preemptionStats.swappedSequences).to.eql(1);
+            expect(context.preemptionStats.swappedSize).to.be.greaterThan(0);
+
+            const sequence1NextToken = await getNextToken(sequence1, [prompt1Tokens.at(-1)!]);
+            expect(context.preemptionStats.swapIns).to.eql(1);
+            expect(context.preemptionStats.preemptions).to.eql(2);
+            expect(sequence1.contextTokens.slice(0, prompt1Tokens.length)).to.eql(prompt1Tokens);
+
+            await context.dispose();
+
+            const referenceContext = await model.createContext({
+                contextSize: 512
+            });
+            const referenceSequence = referenceContext.getSequence();
+            const referenceNextToken = await getNextToken(referenceSequence, prompt1Tokens);
+            expect(sequence1NextToken).to.eql(referenceNextToken);
+
+            await model.dispose();
+        });
+
+        test("erasing tokens of a swapped out sequence doesn't swap it in", {timeout: 1000 * 60 * 60 * 2}, async () => {
+            const modelPath = await getModelFile("Llama-3.2-3B-Instruct.Q4_K_M.gguf");
+            const llama = await getTestLlama();
+
+            const model = await llama.loadModel({
+                modelPath
+            });
+            const context = await model.createContext({
+                contextSize: 512,
+                sequences: 2,
+                preemption: {
+                    kvCacheSize: 512
+                }
+            });
+
+            const prompt1Tokens = model.tokenize("The quick brown fox jumps over the lazy dog. ".repeat(30));
+            const prompt2Tokens = model.tokenize("A journey of a thousand miles begins with a single step. ".repeat(25));
+            const keptTokensCount = 100;
+
+            const sequence1 = context.getSequence();
+            await sequence1.evaluateWithoutGeneratingNewTokens(prompt1Tokens);
+
+            const sequence2 = context.getSequence();
+            await sequence2.evaluateWithoutGeneratingNewTokens(prompt2Tokens);
+            expect(context.preemptionStats.swappedSequences).to.eql(1);
+
+            expect(sequence1.stateCellsStartIndex).to.eql(0);
+            await sequence1.eraseContextTokenRanges([{start: keptTokensCount, end: sequence1.nextTokenIndex}]);
+            expect(context.preemptionStats.swapIns).to.eql(0);
+            expect(context.preemptionStats.swappedSequences).to.eql(1);
+            expect(sequence1.contextTokens).to.eql(prompt1Tokens.slice(0, keptTokensCount));
+
+            const sequence1NextToken = await getNextToken(sequence1, [prompt2Tokens[0]!]);
+            expect(context.preemptionStats.swapIns).to.eql(1);
+
+            await context.dispose();
+
+            const referenceContext = await model.createContext({
+                contextSize: 512
+            });
+            const referenceSequence = referenceContext.getSequence();
+            const referenceNextToken = await getNextToken(referenceSequence, [
+                ...prompt1Tokens.slice(0, keptTokensCount),
+                prompt2Tokens[0]!
+            ]);
+            expect(sequence1NextToken).to.eql(referenceNextToken);
+
+            await model.dispose();
+        });
+    });
+});
+
+async function getNextToken(sequence: LlamaContextSequence, tokens: Token[]) {
+    const iterator = sequence.evaluate(tokens, {temperature: 0})[Symbol.asyncIterator]();
+    const res = await iterator.next();
+    await iterator.return?.();
+
+    return res.value;
+}
@@ -0,0 +1,64 @@
+import {describe, expect, test} from "vitest";
+import {LlamaContextSequence, Token} from "../../../src/index.js";
+import {getModelFile} from "../../utils/modelFiles.js";
+import {getTestLlama} from "../../utils/getTestLlama.js";
+
+describe("llama 3.2", () => {
+    describe("prefix cache", () => {
+        test("shared prefixes are reused across sequences", {timeout: 1000 * 60 * 60 * 2}, async () => {
+            const modelPath = await getModelFile("Llama-3.2-3B-Instruct.Q4_K_M.gguf");
+            const llama = await getTestLlama();
+
+            const model = await llama.loadModel({
+                modelPath
+            });
+            const context = await model.createContext({
+                contextSize: 1024,
+                sequences: 3,
+                prefixCache: true
+            });
+            expect(context.prefixCacheStats.enabled).to.eql(true);
+
+            const prefixTokens = model.tokenize("The quick brown fox jumps over the lazy dog, but the lazy dog is too lazy to care.");
+            const suffixTokens = model.tokenize(" The reason for this is that the lazy dog", false, "trimLeadingSpace");
+
+            const sequence1 = context.getSequence();
+            await sequence1.evaluateWithoutGeneratingNewTokens(prefixTokens);
+            expect(sequence1.tokenMeter.usedInputTokens).to.eql(prefixTokens.length);
+
+            const sequence2 = context.getSequence();
+            await sequence2.evaluateWithoutGeneratingNewTokens([...prefixTokens, ...suffixTokens.slice(0, -1)]);
+
+            expect(sequence2.contextTokens).to.eql([...prefixTokens, ...suffixTokens.slice(0, -1)]);
+            expect(sequence2.tokenMeter.usedInputTokens).to.eql(suffixTokens.length - 1);
+            expect(context.prefixCacheStats.hits).to.eql(1);
+            expect(context.prefixCacheStats.reusedTokens).to.eql(prefixTokens.length);
+
+            const lastToken = suffixTokens.at(-1)!;
+            const sequence2NextToken = await getNextToken(sequence2, [lastToken]);
+
+            await sequence1.evaluateWithoutGeneratingNewTokens(suffixTokens.slice(0, -1));
+            const sequence1NextToken = await getNextToken(sequence1, [lastToken]);
+            expect(sequence2NextToken).to.eql(sequence1NextToken);
+
+            // the cache of disposed sequences is kept for reuse by a new sequence
+            sequence1.dispose();
+            sequence2.dispose();
+            const sequence3 = context.getSequence();
+            await sequence3.evaluateWithoutGeneratingNewTokens(prefixTokens);
+
+            expect(sequence3.contextTokens).to.eql(prefixTokens);
+            expect(sequence3.tokenMeter.usedInputTokens).to.eql(0);
+
+            await model.dispose();
+        });
+    });
+});
+
+async function getNextToken(sequence: LlamaContextSequence, tokens: Token[]) {
+    const iterator = sequence.evaluate(tokens, {temperature: 0})[Symbol.asyncIterator]();
+    const res = await iterator.next();
+    await iterator.return?.();
+
+    return res.value;
+}
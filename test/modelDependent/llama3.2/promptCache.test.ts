@@ -0,0 +1,72 @@
+import {describe, expect, test} from "vitest";
+import fs from "fs-extra";
+import {LlamaContextSequence, Token} from "../../../src/index.js";
+import {getModelFile} from "../../utils/modelFiles.js";
+import {getTestLlama} from "../../utils/getTestLlama.js";
+import {getTempTestFilePath} from "../../utils/helpers/getTempTestDir.js";
+
+describe("llama 3.2", () => {
+    describe("prompt cache", () => {
+        test("cached prompt prefixes are loaded by new contexts", {timeout: 1000 * 60 * 60 * 2}, async (test) => {
+            const modelPath = await getModelFile("Llama-3.2-3B-Instruct.Q4_K_M.gguf");
+            const llama = await getTestLlama();
+
+            const promptCacheDirectory = await getTempTestFilePath("promptCache");
+            test.onTestFinished(() => fs.remove(promptCacheDirectory));
+
+            const model = await llama.loadModel({
+                modelPath
+            });
+
+            const promptTokens = model.tokenize(
+                "The quick brown fox jumps over the lazy dog, but the lazy dog is too lazy to care. " +
+                "The reason for this is that the lazy dog"
+            );
+            const prefixTokens = promptTokens.slice(0, -1);
+            const lastToken = promptTokens.at(-1)!;
+
+            const context1 = await model.createContext({
+                contextSize: 1024,
+                promptCache: {
+                    directory: promptCacheDirectory,
+                    minTokens: 16
+                }
+            });
+            const sequence1 = context1.getSequence();
+            const sequence1NextToken = await getNextToken(sequence1, promptTokens);
+
+            expect(sequence1.tokenMeter.usedInputTokens).to.eql(promptTokens.length);
+            expect(context1.promptCacheStats.entries).to.eql(1);
+            expect(context1.promptCacheStats.misses).to.eql(1);
+            await context1.dispose();
+
+            const context2 = await model.createContext({
+                contextSize: 1024,
+                promptCache: {
+                    directory: promptCacheDirectory,
+                    minTokens: 16
+                }
+            });
+            expect(context2.promptCacheStats.entries).to.eql(1);
+
+            const sequence2 = context2.getSequence();
+            const sequence2NextToken = await getNextToken(sequence2, [...prefixTokens, lastToken]);
+
+            expect(sequence2.tokenMeter.usedInputTokens).to.eql(1);
+            expect(context2.promptCacheStats.hits).to.eql(1);
+            expect(context2.promptCacheStats.hitRatio).to.eql(1);
+            expect(context2.promptCacheStats.reusedTokens).to.eql(prefixTokens.length);
+            expect(sequence2NextToken).to.eql(sequence1NextToken);
+
+            await model.dispose();
+        });
+    });
+});
+
+async function getNextToken(sequence: LlamaContextSequence, tokens: Token[]) {
+    const iterator = sequence.evaluate(tokens, {temperature: 0})[Symbol.asyncIterator]();
+    const res = await iterator.next();
+    await iterator.return?.();
+
+    return res.value;
+}
@@ -1,6 +1,6 @@
 import {describe, expect, test} from "vitest";
 import fs from "fs-extra";
-import {LlamaChatSession, resolveChatWrapper, TokenMeter} from "../../../src/index.js";
+import {LlamaChatSession, LlamaContextSequence, resolveChatWrapper, Token, TokenMeter} from "../../../src/index.js";
 import {getModelFile} from "../../utils/modelFiles.js";
 import {getTestLlama} from "../../utils/getTestLlama.js";
 import {getTempTestFilePath} from "../../utils/helpers/getTempTestDir.js";
@@ -307,6 +307,143 @@ describe("llama 3.2", () => {
 
                 expect(contextSequence2.contextTokens).to.eql([]);
             });
+
+            test("state files are validated before loading", {timeout: 1000 * 60 * 60 * 2}, async (test) => {
+                const modelPath = await getModelFile("Llama-3.2-3B-Instruct.Q4_K_M.gguf");
+                const llama = await getTestLlama();
+
+                const model = await llama.loadModel({
+                    modelPath
+                });
+                const context = await model.createContext({
+                    contextSize: 1024,
+                    sequences: 2
+                });
+                const contextSequence1 = context.getSequence();
+                const contextSequence2 = context.getSequence();
+
+                const chatSession1 = new LlamaChatSession({
+                    contextSequence: contextSequence1,
+                    chatWrapper: resolveChatWrapper(model, {customWrapperSettings: {"llama3.2-lightweight": {todayDate}}})
+                });
+
+                const res1 = await chatSession1.prompt("Remember: locks are not doors", {maxTokens: 4});
+                expect(res1).to.toMatchInlineSnapshot("\"That's a common\"");
+
+                const stateFilePath = await getTempTestFilePath("state");
+                test.onTestFinished(() => fs.remove(stateFilePath));
+
+                const saveProgress: number[] = [];
+                const {fileSize} = await contextSequence1.saveStateToFile(stateFilePath, {
+                    onProgress(progress) {
+                        saveProgress.push(progress);
+                    }
+                });
+                expect((await fs.stat(stateFilePath)).size).to.eql(fileSize);
+                expect(saveProgress.at(-1)).to.eql(1);
+                expect(saveProgress).to.eql(saveProgress.slice().sort((a, b) => a - b));
+
+                const loadProgress: number[] = [];
+                await contextSequence2.loadStateFromFile(stateFilePath, {
+                    acceptRisk: true,
+                    onProgress(progress) {
+                        loadProgress.push(progress);
+                    }
+                });
+                expect(contextSequence2.contextTokens).to.eql(contextSequence1.contextTokens);
+                expect(loadProgress.at(-1)).to.eql(1);
+
+                const loadedTokens = contextSequence2.contextTokens.slice();
+                const stateFileContent = await fs.readFile(stateFilePath);
+                stateFileContent[stateFileContent.length - 1024] ^= 0xff;
+                await fs.writeFile(stateFilePath, stateFileContent);
+
+                try {
+                    await contextSequence2.loadStateFromFile(stateFilePath, {acceptRisk: true});
+                    expect.unreachable("Should have thrown an error");
+                } catch (err) {
+                    expect(err).toMatchInlineSnapshot("[Error: The state file is corrupted]");
+                }
+
+                // a file that fails validation leaves the current state as it is
+                expect(contextSequence2.contextTokens).to.eql(loadedTokens);
+                expect(contextSequence2.nextTokenIndex).to.eql(loadedTokens.length);
+
+                async function generateTokens(sequence: LlamaContextSequence, tokens: Token[]) {
+                    const res: Token[] = [];
+                    for await (const token of sequence.evaluate(tokens, {temperature: 0})) {
+                        res.push(token);
+
+                        if (res.length >= 8)
+                            break;
+                    }
+
+                    return res;
+                }
+
+                // the evaluation state of the sequence was kept too
+                const nextTokens = model.tokenize(" Locks are not doors");
+                expect(await generateTokens(contextSequence2, nextTokens)).to.eql(await generateTokens(contextSequence1, nextTokens));
+            });
+
+            test("export, import and transfer a state in memory", {timeout: 1000 * 60 * 60 * 2}, async () => {
+                const modelPath = await getModelFile("Llama-3.2-3B-Instruct.Q4_K_M.gguf");
+                const llama = await getTestLlama();
+
+                const model = await llama.loadModel({
+                    modelPath
+                });
+                const context1 = await model.createContext({
+                    contextSize: 1024
+                });
+                const context2 = await model.createContext({
+                    contextSize: 1024,
+                    sequences: 2
+                });
+                const contextSequence1 = context1.getSequence();
+                const contextSequence2 = context2.getSequence();
+                const contextSequence3 = context2.getSequence();
+
+                const chatSession1 = new LlamaChatSession({
+                    contextSequence: contextSequence1,
+                    chatWrapper: resolveChatWrapper(model, {customWrapperSettings: {"llama3.2-lightweight": {todayDate}}})
+                });
+
+                const res1 = await chatSession1.prompt("Remember: locks are not doors", {maxTokens: 4});
+                expect(res1).to.toMatchInlineSnapshot("\"That's a common\"");
+
+                const state1Tokens = contextSequence1.contextTokens.slice();
+                const state = await contextSequence1.exportState();
+                expect(state.tokens).to.eql(state1Tokens);
+                expect(toBytes(state.data.byteLength)).to.toMatchInlineSnapshot('"11.27MB"');
+
+                await contextSequence2.importState(state, {acceptRisk: true});
+                expect(contextSequence2.contextTokens).to.eql(state1Tokens);
+
+                await contextSequence1.transferStateTo(contextSequence3);
+                expect(contextSequence3.contextTokens).to.eql(state1Tokens);
+
+                const contextSequence2TokensState = contextSequence2.tokenMeter.getState();
+                const contextSequence3TokensState = contextSequence3.tokenMeter.getState();
+
+                for (const [contextSequence, tokensState] of [
+                    [contextSequence2, contextSequence2TokensState],
+                    [contextSequence3, contextSequence3TokensState]
+                ] as const) {
+                    const chatSession = new LlamaChatSession({
+                        contextSequence,
+                        chatWrapper: resolveChatWrapper(model, {customWrapperSettings: {"llama3.2-lightweight": {todayDate}}})
+                    });
+                    chatSession.setChatHistory(chatSession1.getChatHistory());
+
+                    const res = await chatSession.prompt("What's the exact thing I told you to remember?", {maxTokens: 12});
+                    expect(res).toMatch(/^(You told me to "Remember: locks are not doors".|You told me to "Remember: locks are not doors.")/);
+
+                    // only the new prompt should be evaluated
+                    const tokensStateDiff = TokenMeter.diff(contextSequence.tokenMeter.getState(), tokensState);
+                    expect(tokensStateDiff.usedInputTokens).to.be.lessThan(state1Tokens.length);
+                }
+            });
         });
     });
 });
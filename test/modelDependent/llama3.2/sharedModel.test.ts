@@ -0,0 +1,129 @@
+import path from "path";
+import {fileURLToPath} from "url";
+import {describe, expect, test} from "vitest";
+import {Llama} from "../../../src/index.js";
+import {getModelFile} from "../../utils/modelFiles.js";
+import {getTestLlama} from "../../utils/getTestLlama.js";
+import {runTestWorker} from "../../utils/helpers/runTestWorker.js";
+
+const __dirname = path.dirname(fileURLToPath(import.meta.url));
+
+describe("llama 3.2", () => {
+    describe("shared model", () => {
+        test("models attached with a share handle use the same weights", {timeout: 1000 * 60 * 60 * 2}, async () => {
+            const modelPath = await getModelFile("Llama-3.2-3B-Instruct.Q4_K_M.gguf");
+            const llama = await getTestLlama();
+
+            const model1 = await llama.loadModel({
+                modelPath
+            });
+            const shareHandle = model1.getShareHandle();
+            expect(shareHandle.gpuLayers).to.eql(model1.gpuLayers);
+
+            const model2 = await llama.loadModel({
+                modelPath,
+                shareHandle: structuredClone(shareHandle)
+            });
+            expect(model2.getShareHandle().handle).to.eql(shareHandle.handle);
+            expect(model2.gpuLayers).to.eql(model1.gpuLayers);
+
+            await model1.dispose();
+
+            const text = "The quick brown fox jumps over the lazy dog";
+            expect(model2.detokenize(model2.tokenize(text))).to.eql(text);
+
+            const context = await model2.createContext({
+                contextSize: 512
+            });
+            const sequence = context.getSequence();
+            await sequence.evaluateWithoutGeneratingNewTokens(model2.tokenize(text));
+            expect(sequence.nextTokenIndex).to.eql(model2.tokenize(text).length);
+
+            await context.dispose();
+            await model2.dispose();
+
+            await expect(llama.loadModel({modelPath, shareHandle})).rejects.toThrow();
+        });
+
+        test("shared models with the same options reuse the loaded weights", {timeout: 1000 * 60 * 60 * 2}, async () => {
+            const modelPath = await getModelFile("Llama-3.2-3B-Instruct.Q4_K_M.gguf");
+            const llama = await getTestLlama();
+
+            const initialMarkedMemory = await getMarkedMemory(llama);
+
+            const model1 = await llama.loadModel({
+                modelPath,
+                gpuLayers: 0,
+                useMmap: true,
+                shared: true
+            });
+            const model1MarkedMemory = await getMarkedMemory(llama) - initialMarkedMemory;
+            expect(model1MarkedMemory).to.be.greaterThan(0);
+
+            const model2 = await llama.loadModel({
+                modelPath,
+                gpuLayers: 0,
+                useMmap: true,
+                shared: true
+            });
+            const model3 = await llama.loadModel({
+                modelPath,
+                gpuLayers: 0,
+                useMmap: true
+            });
+
+            expect(model2.getShareHandle().handle).to.eql(model1.getShareHandle().handle);
+            expect(model3.getShareHandle().handle).to.not.eql(model1.getShareHandle().handle);
+
+            // the shared weights are only marked once, and stay marked while any of the models that use them isn't disposed
+            expect(await getMarkedMemory(llama) - initialMarkedMemory).to.eql(model1MarkedMemory * 2);
+
+            await model1.dispose();
+            expect(await getMarkedMemory(llama) - initialMarkedMemory).to.eql(model1MarkedMemory * 2);
+
+            await model2.dispose();
+            expect(await getMarkedMemory(llama) - initialMarkedMemory).to.eql(model1MarkedMemory);
+
+            await model3.dispose();
+            expect(await getMarkedMemory(llama)).to.eql(initialMarkedMemory);
+        });
+
+        test("a model is shared with a worker thread", {timeout: 1000 * 60 * 60 * 2}, async () => {
+            const modelPath = await getModelFile("Llama-3.2-3B-Instruct.Q4_K_M.gguf");
+            const llama = await getTestLlama();
+
+            const model = await llama.loadModel({
+                modelPath
+            });
+            const text = "The quick brown fox jumps over the lazy dog";
+
+            const workerResult = await runTestWorker<{
+                tokens: number[],
+                gpuLayers: number,
+                markedMemory: number,
+                markedMemoryAfterDispose: number
+            }>(path.join(__dirname, "workers", "sharedModelWorker.ts"), {
+                modelPath,
+                shareHandle: model.getShareHandle(),
+                text
+            });
+
+            expect(workerResult.tokens).to.eql(model.tokenize(text));
+            expect(workerResult.gpuLayers).to.eql(model.gpuLayers);
+
+            // the worker accounts for the shared weights in its own memory orchestrators
+            expect(workerResult.markedMemory).to.be.greaterThan(0);
+            expect(workerResult.markedMemoryAfterDispose).to.eql(0);
+
+            // disposing the model in the worker doesn't free the weights the main thread uses
+            expect(model.detokenize(model.tokenize(text))).to.eql(text);
+
+            await model.dispose();
+        });
+    });
+});
+
+async function getMarkedMemory(llama: Llama) {
+    const {cpuRam, gpuVram} = await llama.getLlamaMemoryUsage();
+    return cpuRam + gpuVram;
+}
@@ -0,0 +1,83 @@
+import {describe, expect, test} from "vitest";
+import {getModelFile} from "../../utils/modelFiles.js";
+import {getTestLlama} from "../../utils/getTestLlama.js";
+
+describe("llama 3.2", () => {
+    describe("standalone tokenizer", () => {
+        test("tokenizes the same as the model", {timeout: 1000 * 60 * 60 * 2}, async () => {
+            const modelPath = await getModelFile("Llama-3.2-3B-Instruct.Q4_K_M.gguf");
+            const llama = await getTestLlama();
+
+            const tokenizer = await llama.loadTokenizer({
+                modelPath
+            });
+            const model = await llama.loadModel({
+                modelPath,
+                vocabOnly: true
+            });
+
+            const texts = [
+                "The quick brown fox jumps over the lazy dog",
+                "  leading spaces, emojis 🦙 and non-Latin text: שלום",
+                "<|begin_of_text|>special tokens"
+            ];
+            for (const text of texts) {
+                expect(tokenizer.tokenize(text)).to.eql(model.tokenize(text));
+                expect(tokenizer.tokenize(text, true)).to.eql(model.tokenize(text, true));
+                expect(tokenizer.countTokens(text, true)).to.eql(model.tokenize(text, true).length);
+                expect(tokenizer.detokenize(tokenizer.tokenize(text))).to.eql(text);
+            }
+            expect(tokenizer.countTokens(texts)).to.eql(texts.map((text) => model.tokenize(text).length));
+            expect(tokenizer.vocabularySize).to.eql(model.fileInfo.metadata.tokenizer.ggml.tokens.length);
+            expect(tokenizer.isEogToken(model.tokens.eos!)).to.eql(true);
+
+            const attachedTokenizer = await llama.loadTokenizer({
+                modelPath,
+                shareHandle: structuredClone(tokenizer.getShareHandle())
+            });
+            expect(attachedTokenizer.tokenize(texts[0]!)).to.eql(tokenizer.tokenize(texts[0]!));
+
+            tokenizer.dispose();
+            expect(attachedTokenizer.tokenize(texts[0]!)).to.eql(model.tokenize(texts[0]!));
+            expect(() => tokenizer.tokenize(texts[0]!)).toThrow();
+
+            const shareHandle = attachedTokenizer.getShareHandle();
+            attachedTokenizer.dispose();
+            await expect(llama.loadTokenizer({modelPath, shareHandle})).rejects.toThrow();
+
+            await model.dispose();
+        });
+    });
+
+    describe("count tokens", () => {
+        test("count tokens with a trimmed leading space", {timeout: 1000 * 60 * 60 * 2}, async () => {
+            const modelPath = await getModelFile("Llama-3.2-3B-Instruct.Q4_K_M.gguf");
+            const llama = await getTestLlama();
+
+            const model = await llama.loadModel({
+                modelPath,
+                vocabOnly: true
+            });
+
+            const texts = [
+                "The quick brown fox jumps over the lazy dog",
+                " a single leading space",
+                "   multiple leading spaces",
+                "\nleading new line",
+                "\n\n  new lines and spaces",
+                "<|begin_of_text|>special tokens",
+                " <|eot_id|> a special token after a space"
+            ];
+            for (const specialTokens of [false, true]) {
+                for (const text of texts)
+                    expect(model.countTokens(text, specialTokens, "trimLeadingSpace"))
+                        .to.eql(model.tokenize(text, specialTokens, "trimLeadingSpace").length);
+
+                expect(model.countTokens(texts, specialTokens, "trimLeadingSpace"))
+                    .to.eql(texts.map((text) => model.tokenize(text, specialTokens, "trimLeadingSpace").length));
+            }
+
+            await model.dispose();
+        });
+    });
+});
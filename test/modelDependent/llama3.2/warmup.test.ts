@@ -0,0 +1,45 @@
+import {describe, expect, test} from "vitest";
+import {getModelFile} from "../../utils/modelFiles.js";
+import {getTestLlama} from "../../utils/getTestLlama.js";
+
+describe("llama 3.2", () => {
+    describe("context warmup", () => {
+        test("warmup decodes the batch shapes and clears the KV cache", {timeout: 1000 * 60 * 60 * 2}, async () => {
+            const modelPath = await getModelFile("Llama-3.2-3B-Instruct.Q4_K_M.gguf");
+            const llama = await getTestLlama();
+
+            const model = await llama.loadModel({
+                modelPath
+            });
+            const context = await model.createContext({
+                contextSize: 512,
+                batchSize: 128,
+                sequences: 2
+            });
+
+            const res = await context.warmup({
+                batchSizes: [128, 1],
+                sequences: 2
+            });
+            expect(res.weightsWarmupTime).to.be.greaterThan(0);
+            expect(res.memoryClearTime).to.be.greaterThanOrEqual(0);
+            expect(res.batches.map(({batchSize, sequences}) => ({batchSize, sequences}))).to.eql([
+                {batchSize: 128, sequences: 2},
+                {batchSize: 1, sequences: 1}
+            ]);
+            expect(context.getKvCacheStats().sequences).to.eql([]);
+
+            await expect(context.warmup({batchSizes: [256]})).rejects.toThrow();
+
+            const sequence = context.getSequence();
+            const text = "The quick brown fox jumps over the lazy dog";
+            await sequence.evaluateWithoutGeneratingNewTokens(model.tokenize(text));
+            expect(sequence.nextTokenIndex).to.eql(model.tokenize(text).length);
+
+            await expect(context.warmup()).rejects.toThrow();
+
+            await context.dispose();
+            await model.dispose();
+        });
+    });
+});
@@ -0,0 +1,27 @@
+import {parentPort, workerData} from "worker_threads";
+import {getLlama, type LlamaModelShareHandle} from "../../../../src/index.js";
+
+const {modelPath, shareHandle, text} = workerData.data as {modelPath: string, shareHandle: LlamaModelShareHandle, text: string};
+
+const llama = await getLlama();
+const memoryUsageBeforeLoad = await llama.getLlamaMemoryUsage();
+
+const model = await llama.loadModel({
+    modelPath,
+    shareHandle
+});
+const memoryUsage = await llama.getLlamaMemoryUsage();
+const tokens = model.tokenize(text);
+const gpuLayers = model.gpuLayers;
+
+await model.dispose();
+const memoryUsageAfterDispose = await llama.getLlamaMemoryUsage();
+await llama.dispose();
+
+parentPort!.postMessage({
+    tokens,
+    gpuLayers,
+    markedMemory: (memoryUsage.cpuRam + memoryUsage.gpuVram) - (memoryUsageBeforeLoad.cpuRam + memoryUsageBeforeLoad.gpuVram),
+    markedMemoryAfterDispose: (memoryUsageAfterDispose.cpuRam + memoryUsageAfterDispose.gpuVram) -
+        (memoryUsageBeforeLoad.cpuRam + memoryUsageBeforeLoad.gpuVram)
+});
@@ -147,5 +147,149 @@ describe("llama 3", () => {
                 }
             });
         });
+
+        test("lora adapter cache evicts unused adapters", {timeout: 1000 * 60 * 60 * 2}, async () => {
+            const modelPath = await getModelFile("Meta-Llama-3-8B-Instruct-Q4_K_M.gguf");
+            const loraPath = await getModelFile("lora-Llama-3-Instruct-abliteration-LoRA-8B-f16.gguf");
+            const llama = await getTestLlama();
+
+            const model = await llama.loadModel({
+                modelPath,
+                loraAdapterCache: {
+                    maxSize: 0
+                }
+            });
+
+            await model.preloadLoraAdapters(loraPath);
+            expect(model.loraAdapterCacheStats).toMatchObject({
+                misses: 1,
+                evictions: 1,
+                adapters: 0
+            });
+
+            const context = await model.createContext({
+                contextSize: 2048,
+                lora: {
+                    adapters: [{
+                        filePath: loraPath
+                    }]
+                }
+            });
+            const context2 = await model.createContext({
+                contextSize: 2048,
+                lora: {
+                    adapters: [{
+                        filePath: loraPath
+                    }]
+                }
+            });
+            expect(model.loraAdapterCacheStats).toMatchObject({
+                hits: 1,
+                misses: 2,
+                evictions: 1,
+                adapters: 1,
+                pinnedAdapters: 1
+            });
+
+            await context.dispose();
+            expect(model.loraAdapterCacheStats.adapters).to.eql(1);
+
+            await context2.dispose();
+            expect(model.loraAdapterCacheStats).toMatchObject({
+                evictions: 2,
+                adapters: 0,
+                pinnedAdapters: 0,
+                size: 0
+            });
+
+            await model.dispose();
+        });
+
+        test("sequences with different lora adapters are evaluated in separate batches", {timeout: 1000 * 60 * 60 * 2}, async () => {
+            const modelPath = await getModelFile("Meta-Llama-3-8B-Instruct-Q4_K_M.gguf");
+            const loraPath = await getModelFile("lora-Llama-3-Instruct-abliteration-LoRA-8B-f16.gguf");
+            const llama = await getTestLlama();
+
+            const model = await llama.loadModel({
+                modelPath
+            });
+
+            const context = await model.createContext({
+                contextSize: 512,
+                sequences: 3,
+                batching: {
+                    maxConsecutiveLoraAdapterBatches: 1
+                }
+            });
+            const sequence1 = context.getSequence();
+            const sequence2 = context.getSequence();
+            const sequence3 = context.getSequence();
+
+            await sequence2.setLoraAdapters([{filePath: loraPath}]);
+            await sequence3.setLoraAdapters([{filePath: loraPath}]);
+            expect(model.loraAdapterCacheStats.pinnedAdapters).to.eql(1);
+
+            const tokens = model.tokenize("The quick brown fox jumps over the lazy dog");
+            await Promise.all([
+                sequence1.evaluateWithoutGeneratingNewTokens(tokens),
+                sequence2.evaluateWithoutGeneratingNewTokens(tokens),
+                sequence3.evaluateWithoutGeneratingNewTokens(tokens)
+            ]);
+
+            expect(context.loraAdapterSwitches).to.eql(1);
+            expect(sequence1.nextTokenIndex).to.eql(tokens.length);
+            expect(sequence2.nextTokenIndex).to.eql(tokens.length);
+            expect(sequence3.nextTokenIndex).to.eql(tokens.length);
+
+            sequence2.dispose();
+            await sequence3.setLoraAdapters(undefined);
+
+            // the adapters stay applied to the context until it switches to other adapters
+            expect(model.loraAdapterCacheStats.pinnedAdapters).to.eql(1);
+
+            await sequence1.evaluateWithoutGeneratingNewTokens(model.tokenize(" again"));
+            expect(context.loraAdapterSwitches).to.eql(2);
+            expect(model.loraAdapterCacheStats.pinnedAdapters).to.eql(0);
+
+            await context.dispose();
+            await model.dispose();
+        });
+
+        test("prefixes are only reused across sequences with the same lora adapters", {timeout: 1000 * 60 * 60 * 2}, async () => {
+            const modelPath = await getModelFile("Meta-Llama-3-8B-Instruct-Q4_K_M.gguf");
+            const loraPath = await getModelFile("lora-Llama-3-Instruct-abliteration-LoRA-8B-f16.gguf");
+            const llama = await getTestLlama();
+
+            const model = await llama.loadModel({
+                modelPath
+            });
+
+            const context = await model.createContext({
+                contextSize: 512,
+                sequences: 3,
+                prefixCache: true
+            });
+            const tokens = model.tokenize("The quick brown fox jumps over the lazy dog");
+
+            const sequence1 = context.getSequence();
+            await sequence1.evaluateWithoutGeneratingNewTokens(tokens);
+
+            const sequence2 = context.getSequence();
+            await sequence2.setLoraAdapters([{filePath: loraPath}]);
+            await sequence2.evaluateWithoutGeneratingNewTokens(tokens);
+
+            expect(sequence2.tokenMeter.usedInputTokens).to.eql(tokens.length);
+            expect(context.prefixCacheStats.hits).to.eql(0);
+
+            const sequence3 = context.getSequence();
+            await sequence3.setLoraAdapters([{filePath: loraPath}]);
+            await sequence3.evaluateWithoutGeneratingNewTokens(tokens);
+
+            expect(sequence3.tokenMeter.usedInputTokens).to.eql(0);
+            expect(context.prefixCacheStats.hits).to.eql(1);
+
+            await context.dispose();
+            await model.dispose();
+        });
     });
 });
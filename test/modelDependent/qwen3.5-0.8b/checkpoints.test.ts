@@ -0,0 +1,204 @@
+import path from "path";
+import {describe, expect, test} from "vitest";
+import fs from "fs-extra";
+import {getModelFile} from "../../utils/modelFiles.js";
+import {getTestLlama} from "../../utils/getTestLlama.js";
+import {getTempTestFilePath} from "../../utils/helpers/getTempTestDir.js";
+
+describe("qwen3.5 0.8b", () => {
+    describe("checkpoints", () => {
+        const firstText = "The quick brown fox jumps over the lazy dog. ".repeat(8);
+        const secondText = "Some more text about the fox and the dog that comes after the first checkpoint.";
+
+        describe("compression", () => {
+            test("restore from compressed checkpoints", {timeout: 1000 * 60 * 60 * 2}, async () => {
+                const modelPath = await getModelFile("Qwen3.5-0.8B-Q8_0.gguf");
+                const llama = await getTestLlama();
+
+                const model = await llama.loadModel({
+                    modelPath
+                });
+                const context = await model.createContext({
+                    contextSize: 1024
+                });
+                const sequence = context.getSequence({
+                    checkpoints: {
+                        interval: false,
+                        compression: true
+                    }
+                });
+
+                const firstTokens = model.tokenize(firstText);
+                const secondTokens = model.tokenize(secondText);
+
+                await sequence.evaluateWithoutGeneratingNewTokens(firstTokens);
+                await sequence.takeCheckpoint();
+                await sequence.evaluateWithoutGeneratingNewTokens(secondTokens);
+                await sequence.takeCheckpoint();
+
+                expect(sequence.checkpointsMemoryUsage).to.be.greaterThan(0);
+                expect(sequence.checkpointsMemoryUsage).to.be.lessThanOrEqual(sequence.checkpointsRawMemoryUsage);
+
+                // restoring a compressed checkpoint should reuse the same prefix as restoring an uncompressed one
+                const initialMeterState = sequence.tokenMeter.getState();
+                await sequence.eraseContextTokenRanges([{start: firstTokens.length + 2, end: sequence.nextTokenIndex}]);
+
+                expect(sequence.contextTokens).to.eql([...firstTokens, ...secondTokens.slice(0, 2)]);
+                expect(sequence.tokenMeter.diff(initialMeterState).usedInputTokens).to.be.lessThanOrEqual(2);
+
+                await context.dispose();
+                await model.dispose();
+            });
+        });
+
+        describe("disk spill", () => {
+            test("restore from spilled checkpoints", {timeout: 1000 * 60 * 60 * 2}, async (test) => {
+                const modelPath = await getModelFile("Qwen3.5-0.8B-Q8_0.gguf");
+                const llama = await getTestLlama();
+
+                const checkpointsDirectory = await getTempTestFilePath("checkpoints");
+                test.onTestFinished(() => fs.remove(checkpointsDirectory));
+
+                const model = await llama.loadModel({
+                    modelPath
+                });
+                const context = await model.createContext({
+                    contextSize: 1024
+                });
+                const sequence = context.getSequence({
+                    checkpoints: {
+                        interval: false,
+                        diskSpill: {
+                            directory: checkpointsDirectory,
+                            keepInMemory: 0
+                        }
+                    }
+                });
+                expect(sequence.needsCheckpoints).to.eql(true);
+
+                const firstTokens = model.tokenize(firstText);
+                const secondTokens = model.tokenize(secondText);
+
+                await sequence.evaluateWithoutGeneratingNewTokens(firstTokens);
+                await sequence.takeCheckpoint();
+                await sequence.evaluateWithoutGeneratingNewTokens(secondTokens);
+                await sequence.takeCheckpoint();
+                await sequence._checkpointsSpillPromise;
+
+                expect(sequence.checkpointsMemoryUsage).to.eql(0);
+                expect(sequence.checkpointsDiskUsage).to.be.greaterThan(0);
+                expect(await fs.readdir(checkpointsDirectory)).to.have.length(2);
+
+                // only the tokens after the first checkpoint are evaluated again
+                const initialMeterState = sequence.tokenMeter.getState();
+                await sequence.eraseContextTokenRanges([{start: firstTokens.length + 2, end: sequence.nextTokenIndex}]);
+                await sequence._checkpointsSpillPromise;
+
+                expect(sequence.contextTokens).to.eql([...firstTokens, ...secondTokens.slice(0, 2)]);
+                expect(sequence.tokenMeter.diff(initialMeterState).usedInputTokens).to.be.lessThanOrEqual(2);
+
+                sequence.dispose();
+                expect(await fs.readdir(checkpointsDirectory)).to.eql([]);
+
+                await context.dispose();
+                await model.dispose();
+            });
+
+            test("a corrupted spill file is not restored", {timeout: 1000 * 60 * 60 * 2}, async (test) => {
+                const modelPath = await getModelFile("Qwen3.5-0.8B-Q8_0.gguf");
+                const llama = await getTestLlama();
+
+                const checkpointsDirectory = await getTempTestFilePath("checkpoints");
+                test.onTestFinished(() => fs.remove(checkpointsDirectory));
+
+                const model = await llama.loadModel({
+                    modelPath
+                });
+                const context = await model.createContext({
+                    contextSize: 1024
+                });
+                const sequence = context.getSequence({
+                    checkpoints: {
+                        interval: false,
+                        diskSpill: {
+                            directory: checkpointsDirectory,
+                            keepInMemory: 0
+                        }
+                    }
+                });
+
+                const firstTokens = model.tokenize(firstText);
+                const secondTokens = model.tokenize(secondText);
+
+                await sequence.evaluateWithoutGeneratingNewTokens(firstTokens);
+                await sequence.takeCheckpoint();
+                await sequence.evaluateWithoutGeneratingNewTokens(secondTokens);
+                await sequence._checkpointsSpillPromise;
+
+                for (const fileName of await fs.readdir(checkpointsDirectory)) {
+                    const filePath = path.join(checkpointsDirectory, fileName);
+                    const content = await fs.readFile(filePath);
+                    const corruptedIndex = Math.floor(content.length / 2);
+                    content[corruptedIndex] = content[corruptedIndex]! ^ 0xff;
+                    await fs.writeFile(filePath, content);
+                }
+
+                // the entire sequence is evaluated again instead of restoring corrupted data
+                const initialMeterState = sequence.tokenMeter.getState();
+                await sequence.eraseContextTokenRanges([{start: firstTokens.length + 2, end: sequence.nextTokenIndex}]);
+
+                expect(sequence.contextTokens).to.eql([...firstTokens, ...secondTokens.slice(0, 2)]);
+                expect(sequence.tokenMeter.diff(initialMeterState).usedInputTokens).to.eql(firstTokens.length + 2);
+
+                await context.dispose();
+                await model.dispose();
+            });
+
+            test("failing to spill keeps the memory limit", {timeout: 1000 * 60 * 60 * 2}, async (test) => {
+                const modelPath = await getModelFile("Qwen3.5-0.8B-Q8_0.gguf");
+                const llama = await getTestLlama();
+
+                // a directory cannot be created at the path of an existing file
+                const checkpointsDirectory = await getTempTestFilePath("checkpoints");
+                await fs.writeFile(checkpointsDirectory, "");
+                test.onTestFinished(() => fs.remove(checkpointsDirectory));
+
+                const model = await llama.loadModel({
+                    modelPath
+                });
+                const context = await model.createContext({
+                    contextSize: 1024
+                });
+                const sequence = context.getSequence({
+                    checkpoints: {
+                        interval: false,
+                        maxMemory: 1,
+                        diskSpill: {
+                            directory: checkpointsDirectory
+                        }
+                    }
+                });
+
+                const tokens = model.tokenize(firstText);
+
+                await sequence.evaluateWithoutGeneratingNewTokens(tokens.slice(0, 16));
+                await sequence.takeCheckpoint();
+                await sequence._checkpointsSpillPromise;
+                const singleCheckpointMemoryUsage = sequence.checkpointsMemoryUsage;
+                expect(singleCheckpointMemoryUsage).to.be.greaterThan(0);
+
+                for (let i = 1; i < 4; i++) {
+                    await sequence.evaluateWithoutGeneratingNewTokens(tokens.slice(i * 16, (i + 1) * 16));
+                    await sequence.takeCheckpoint();
+                }
+                await sequence._checkpointsSpillPromise;
+
+                expect(sequence.checkpointsDiskUsage).to.eql(0);
+                expect(sequence.checkpointsMemoryUsage).to.be.lessThan(singleCheckpointMemoryUsage * 2);
+
+                await context.dispose();
+                await model.dispose();
+            });
+        });
+    });
+});
@@ -88,6 +88,33 @@ describe("stableCode", () => {
             await model.dispose();
         });
 
+        test("load progress emitted with prefetch", {timeout: 1000 * 60 * 60 * 2}, async () => {
+            const modelPath = await getModelFile("stable-code-3b-Q5_K_M.gguf");
+            const llama = await getTestLlama();
+
+            const logProgresses: number[] = [];
+            const model = await llama.loadModel({
+                modelPath,
+                useMmap: true,
+                prefetch: {
+                    threads: 4
+                },
+                onLoadProgress(loadPercentage: number) {
+                    logProgresses.push(loadPercentage);
+                }
+            });
+
+            expect(logProgresses.length).toBeGreaterThan(2);
+            expect(logProgresses.some((progress) => progress > 0 && progress <= 0.5)).toBe(true);
+            expect(logProgresses).toEqual([...logProgresses].sort((a, b) => a - b));
+            expect(logProgresses[logProgresses.length - 1]).toBe(1);
+
+            const text = model.detokenize(model.tokenize("Hello world"));
+            expect(text).toBe("Hello world");
+
+            await model.dispose();
+        });
+
         test("abort model load works", {timeout: 1000 * 60 * 60 * 2}, async () => {
             const modelPath = await getModelFile("stable-code-3b-Q5_K_M.gguf");
             const llama = await getTestLlama();
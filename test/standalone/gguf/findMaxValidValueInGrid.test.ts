@@ -0,0 +1,56 @@
+import {describe, expect, test} from "vitest";
+import {findMaxValidValueInGrid} from "../../../src/gguf/insights/utils/findMaxValidValueInGrid.js";
+
+
+describe("gguf", () => {
+    describe("findMaxValidValueInGrid", () => {
+        test("finds the highest valid value", async () => {
+            for (const maxValidValue of [1, 2, 5, 100, 1000, 4096, 131071]) {
+                let testCalls = 0;
+                const res = await findMaxValidValueInGrid({
+                    minValue: 1,
+                    maxValue: 131072,
+                    async test(values) {
+                        testCalls++;
+                        return values.map((value) => (
+                            value <= maxValidValue
+                                ? {value}
+                                : null
+                        ));
+                    }
+                });
+
+                expect(res?.value).to.eql(maxValidValue);
+                expect(res?.result).to.eql({value: maxValidValue});
+                expect(testCalls).to.be.lessThanOrEqual(7);
+            }
+        });
+
+        test("tests the max value alone first", async () => {
+            const testedValues: number[][] = [];
+            const res = await findMaxValidValueInGrid({
+                minValue: 256,
+                maxValue: 8192,
+                async test(values) {
+                    testedValues.push(values);
+                    return values.map((value) => value);
+                }
+            });
+
+            expect(res?.value).to.eql(8192);
+            expect(testedValues).to.eql([[8192]]);
+        });
+
+        test("returns null when no value is valid", async () => {
+            const res = await findMaxValidValueInGrid({
+                minValue: 256,
+                maxValue: 8192,
+                async test(values) {
+                    return values.map(() => null);
+                }
+            });
+
+            expect(res).to.eql(null);
+        });
+    });
+});
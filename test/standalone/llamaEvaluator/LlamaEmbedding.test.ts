@@ -0,0 +1,35 @@
+import {describe, expect, test} from "vitest";
+import {LlamaEmbedding} from "../../../src/index.js";
+
+
+describe("LlamaEmbedding", () => {
+    test("keeps the precision of a vector of numbers", () => {
+        const vector = [0.1, 0.2, 1 / 3];
+        const embedding = new LlamaEmbedding({vector});
+
+        expect(embedding.vector).to.eql(vector);
+        expect(Object.isFrozen(embedding.vector)).to.eql(true);
+        expect(LlamaEmbedding.fromJSON(embedding.toJSON()).vector).to.eql(vector);
+        expect(Array.from(embedding.float32Vector)).to.eql(Array.from(Float32Array.from(vector)));
+
+        vector[0] = 5;
+        expect(embedding.vector[0]).to.eql(0.1);
+    });
+
+    test("uses a Float32Array vector without copying it", () => {
+        const vector = Float32Array.from([0.1, 0.2, 0.3]);
+        const embedding = new LlamaEmbedding({vector});
+
+        expect(embedding.float32Vector).toBe(vector);
+        expect(embedding.vector).to.eql(Array.from(vector));
+    });
+
+    test("cosine similarity", () => {
+        const embedding = new LlamaEmbedding({vector: [1, 0, 1]});
+
+        expect(embedding.calculateCosineSimilarity([1, 0, 1])).toBeCloseTo(1, 10);
+        expect(embedding.calculateCosineSimilarity(Float32Array.from([0, 1, 0]))).to.eql(0);
+        expect(embedding.calculateCosineSimilarity(new LlamaEmbedding({vector: Float32Array.from([1, 0, 0])})))
+            .toBeCloseTo(Math.SQRT1_2, 6);
+    });
+});
@@ -0,0 +1,68 @@
+import path from "path";
+import {fileURLToPath} from "url";
+import {Worker} from "worker_threads";
+
+const __dirname = path.dirname(fileURLToPath(import.meta.url));
+const projectRoot = path.join(__dirname, "..", "..", "..");
+
+// `worker_threads` cannot run TypeScript files directly, so the worker runs the script using `vite-node`, like vitest does
+const workerCode = `
+const {workerData} = require("worker_threads");
+
+(async () => {
+    const {createServer} = await import("vite");
+    const {ViteNodeServer} = await import("vite-node/server");
+    const {ViteNodeRunner} = await import("vite-node/client");
+
+    const server = await createServer({
+        root: workerData.root,
+        logLevel: "error",
+        server: {hmr: false, ws: false},
+        optimizeDeps: {noDiscovery: true, include: []}
+    });
+    await server.pluginContainer.buildStart({});
+
+    const node = new ViteNodeServer(server);
+    const runner = new ViteNodeRunner({
+        root: server.config.root,
+        base: server.config.base,
+        fetchModule: (id) => node.fetchModule(id),
+        resolveId: (id, importer) => node.resolveId(id, importer)
+    });
+
+    try {
+        await runner.executeFile(workerData.scriptPath);
+    } finally {
+        await server.close();
+    }
+})();
+`;
+
+/**
+ * Run a TypeScript script in a `worker_threads` worker, and resolve with the first message it posts to its parent port.
+ * The script can access the given data using `workerData.data`
+ */
+export function runTestWorker<T>(scriptPath: string, data: unknown): Promise<T> {
+    return new Promise<T>((resolve, reject) => {
+        const worker = new Worker(workerCode, {
+            eval: true,
+            workerData: {
+                root: projectRoot,
+                scriptPath,
+                data
+            }
+        });
+
+        let result: {value: T} | undefined;
+        worker.once("message", (message: T) => {
+            result = {value: message};
+        });
+        worker.once("error", reject);
+        worker.once("exit", (exitCode) => {
+            if (result != null)
+                resolve(result.value);
+            else
+                reject(new Error(`The worker exited with code ${exitCode} without posting a result`));
+        });
+    });
+}